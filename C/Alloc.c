@@ -7,6 +7,11 @@
 
 #ifdef _WIN32
 #include <Windows.h>
+#else
+#include <sched.h>
+#ifdef _7ZIP_LARGE_PAGES
+#include <sys/mman.h>
+#endif
 #endif
 #include <stdlib.h>
 
@@ -128,6 +133,36 @@ static void PrintAddr(void *p)
 
 
 
+static CLargePagesStat g_LargePagesStat;
+
+/* BigAlloc() can be called by different threads */
+#ifdef _WIN32
+  #define LARGE_PAGES_STAT_INC(name) InterlockedIncrement((LONG volatile *)(void *)&g_LargePagesStat.name)
+#elif defined(__GNUC__) || defined(__clang__)
+  #define LARGE_PAGES_STAT_INC(name) __sync_fetch_and_add(&g_LargePagesStat.name, 1)
+#else
+  #define LARGE_PAGES_STAT_INC(name) g_LargePagesStat.name++
+#endif
+
+void LargePages_GetStat(CLargePagesStat *stat)
+{
+  *stat = g_LargePagesStat;
+}
+
+
+static unsigned g_AllocLayer_Flags;
+static BoolInt g_AllocLayer_Used;
+
+/* the blocks of the layer have the header, so
+   the mode can't be changed after the first allocation without the layer */
+#define ALLOC_LAYER_CHECK(kind, size) \
+  if (g_AllocLayer_Flags != 0) return AllocLayer_Alloc(kind, size); \
+  g_AllocLayer_Used = True;
+
+#define FREE_LAYER_CHECK(address) \
+  if (g_AllocLayer_Flags != 0) { AllocLayer_Free(address); return; }
+
+
 void *MyAlloc(size_t size)
 {
   if (size == 0)
@@ -222,7 +257,11 @@ void *BigAlloc(size_t size)
       {
         void *res = VirtualAlloc(NULL, size2, MEM_COMMIT | MY__MEM_LARGE_PAGES, PAGE_READWRITE);
         if (res)
+        {
+          LARGE_PAGES_STAT_INC(NumLarge);
           return res;
+        }
+        LARGE_PAGES_STAT_INC(NumFallback);
       }
     }
   }
@@ -243,17 +282,14 @@ void BigFree(void *address)
 #endif
 
 
-static void *SzAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); return MyAlloc(size); }
-static void SzFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); MyFree(address); }
+static void *SzAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); ALLOC_LAYER_CHECK(k_AllocKind_Alloc, size) return MyAlloc(size); }
+static void SzFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); FREE_LAYER_CHECK(address) MyFree(address); }
 const ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
 #ifdef _WIN32
-static void *SzMidAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); return MidAlloc(size); }
-static void SzMidFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); MidFree(address); }
-static void *SzBigAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); return BigAlloc(size); }
-static void SzBigFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); BigFree(address); }
+static void *SzMidAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); ALLOC_LAYER_CHECK(k_AllocKind_Mid, size) return MidAlloc(size); }
+static void SzMidFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); FREE_LAYER_CHECK(address) MidFree(address); }
 const ISzAlloc g_MidAlloc = { SzMidAlloc, SzMidFree };
-const ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
 #endif
 
 /*
@@ -327,14 +363,13 @@ static int posix_memalign(void **ptr, size_t align, size_t size)
 
 #define ALLOC_ALIGN_SIZE ((size_t)1 << 7)
 
-static void *SzAlignedAlloc(ISzAllocPtr pp, size_t size)
+static void *AlignedAlloc(size_t size)
 {
   #ifndef USE_posix_memalign
   
   void *p;
   void *pAligned;
   size_t newSize;
-  UNUSED_VAR(pp);
 
   /* also we can allocate additional dummy ALLOC_ALIGN_SIZE bytes after aligned
      block to prevent cache line sharing with another allocated blocks */
@@ -362,7 +397,6 @@ static void *SzAlignedAlloc(ISzAllocPtr pp, size_t size)
   #else
 
   void *p;
-  UNUSED_VAR(pp);
   if (posix_memalign(&p, ALLOC_ALIGN_SIZE, size))
     return NULL;
 
@@ -375,9 +409,8 @@ static void *SzAlignedAlloc(ISzAllocPtr pp, size_t size)
 }
 
 
-static void SzAlignedFree(ISzAllocPtr pp, void *address)
+static void AlignedFree(void *address)
 {
-  UNUSED_VAR(pp);
   #ifndef USE_posix_memalign
   if (address)
     MyFree(((void **)address)[-1]);
@@ -387,9 +420,490 @@ static void SzAlignedFree(ISzAllocPtr pp, void *address)
 }
 
 
+static void *SzAlignedAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); ALLOC_LAYER_CHECK(k_AllocKind_Aligned, size) return AlignedAlloc(size); }
+static void SzAlignedFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); FREE_LAYER_CHECK(address) AlignedFree(address); }
 const ISzAlloc g_AlignedAlloc = { SzAlignedAlloc, SzAlignedFree };
 
 
+#ifndef _WIN32
+
+/*
+  BigAlloc() in Linux:
+  If SetLargePageSize() was called, BigAlloc() for big block tries
+    1) mmap(MAP_HUGETLB)  : the pages from the pool of hugetlbfs (vm.nr_hugepages)
+    2) mmap() + madvise(MADV_HUGEPAGE) : transparent huge pages,
+         if THP is enabled in "always" or "madvise" mode.
+  Otherwise BigAlloc() uses MyAlloc().
+  The returned block is aligned for ALLOC_ALIGN_SIZE.
+  The header before the block contains the address and the size of mapping
+  (the size is 0 for MyAlloc() block) for BigFree().
+*/
+
+#define BIG_BLOCK_BASE_VAR(p)     ((void **)(p))[-1]
+#define BIG_BLOCK_MAP_SIZE_VAR(p) ((size_t *)(p))[-2]
+
+#if defined(_7ZIP_LARGE_PAGES) && (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+  #define USE_BIG_ALLOC_MAP
+#endif
+
+#ifdef _7ZIP_LARGE_PAGES
+extern
+SIZE_T g_LargePageSize;
+SIZE_T g_LargePageSize = 0;
+#endif
+
+#ifdef USE_BIG_ALLOC_MAP
+
+static size_t ReadHugePageSize(const char *path, const char *format, unsigned shift)
+{
+  size_t size = 0;
+  char line[256];
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return 0;
+  while (fgets(line, sizeof(line), f))
+  {
+    unsigned long v;
+    if (sscanf(line, format, &v) == 1)
+    {
+      size = (size_t)v << shift;
+      break;
+    }
+  }
+  fclose(f);
+  return size;
+}
+
+#endif
+
+void SetLargePageSize()
+{
+  #ifdef USE_BIG_ALLOC_MAP
+  size_t size = ReadHugePageSize("/proc/meminfo", "Hugepagesize: %lu kB", 10);
+  if (size == 0)
+    size = ReadHugePageSize("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "%lu", 0);
+  if (size == 0 || (size & (size - 1)) != 0)
+    return;
+  g_LargePageSize = size;
+  #endif
+}
+
+
+#ifdef USE_BIG_ALLOC_MAP
+
+/* (size) is multiple of (ps) */
+
+static void *BigAlloc_Map(size_t size, size_t ps)
+{
+  void *p;
+  
+  #ifdef MAP_HUGETLB
+  /* it fails, if there are no free pages in the pool of hugetlbfs */
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED)
+  {
+    LARGE_PAGES_STAT_INC(NumLarge);
+    return p;
+  }
+  #endif
+
+  #ifdef MADV_HUGEPAGE
+  if (size + ps > size)
+  {
+    /* the kernel can use huge pages only for the aligned ranges,
+       so we allocate one page more and unmap the unaligned head and tail */
+    p = mmap(NULL, size + ps, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+    {
+      char *a = (char *)MY_ALIGN_PTR_DOWN((char *)p + ps - 1, ps);
+      const size_t head = (size_t)(a - (char *)p);
+      if (head != 0)
+        munmap(p, head);
+      if (head != ps)
+        munmap(a + size, ps - head);
+      if (madvise(a, size, MADV_HUGEPAGE) == 0)
+      {
+        LARGE_PAGES_STAT_INC(NumThp);
+        return a;
+      }
+      munmap(a, size);
+    }
+  }
+  #endif
+
+  LARGE_PAGES_STAT_INC(NumFallback);
+  return NULL;
+}
+
+#endif
+
+
+void *BigAlloc(size_t size)
+{
+  void *p;
+  void *pAligned;
+  size_t newSize;
+
+  if (size == 0)
+    return NULL;
+
+  PRINT_ALLOC("Alloc-Big", g_allocCountBig, size, NULL);
+
+  #ifdef USE_BIG_ALLOC_MAP
+  {
+    size_t ps = g_LargePageSize;
+    if (ps != 0 && ps <= (1 << 30) && size > (ps / 2))
+    {
+      size_t size2;
+      ps--;
+      size2 = (size + ALLOC_ALIGN_SIZE + ps) & ~ps;
+      if (size2 > size)
+      {
+        p = BigAlloc_Map(size2, ps + 1);
+        if (p)
+        {
+          pAligned = (char *)p + ALLOC_ALIGN_SIZE;
+          BIG_BLOCK_BASE_VAR(pAligned) = p;
+          BIG_BLOCK_MAP_SIZE_VAR(pAligned) = size2;
+          return pAligned;
+        }
+      }
+    }
+  }
+  #endif
+
+  /* MyAlloc() can return the address that is aligned only for sizeof(void *),
+     so we reserve 2 * ALLOC_ALIGN_SIZE bytes for alignment and header */
+  newSize = size + ALLOC_ALIGN_SIZE * 2;
+  if (newSize < size)
+    return NULL;
+  p = MyAlloc(newSize);
+  if (!p)
+    return NULL;
+  pAligned = MY_ALIGN_PTR_DOWN((char *)p + ALLOC_ALIGN_SIZE * 2 - 1, ALLOC_ALIGN_SIZE);
+  BIG_BLOCK_BASE_VAR(pAligned) = p;
+  BIG_BLOCK_MAP_SIZE_VAR(pAligned) = 0;
+  return pAligned;
+}
+
+void BigFree(void *address)
+{
+  PRINT_FREE("Free-Big", g_allocCountBig, address);
+
+  if (!address)
+    return;
+  #ifdef USE_BIG_ALLOC_MAP
+  if (BIG_BLOCK_MAP_SIZE_VAR(address) != 0)
+  {
+    munmap(BIG_BLOCK_BASE_VAR(address), BIG_BLOCK_MAP_SIZE_VAR(address));
+    return;
+  }
+  #endif
+  MyFree(BIG_BLOCK_BASE_VAR(address));
+}
+
+#endif
+
+
+static void *SzBigAlloc(ISzAllocPtr p, size_t size) { UNUSED_VAR(p); ALLOC_LAYER_CHECK(k_AllocKind_Big, size) return BigAlloc(size); }
+static void SzBigFree(ISzAllocPtr p, void *address) { UNUSED_VAR(p); FREE_LAYER_CHECK(address) BigFree(address); }
+const ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
+
+
+
+/* ---------- Alloc layer ---------- */
+
+#ifdef _WIN32
+  static LONG volatile g_AllocLayer_Lock;
+  #define LAYER_LOCK    while (InterlockedExchange(&g_AllocLayer_Lock, 1) != 0) Sleep(0);
+  #define LAYER_UNLOCK  InterlockedExchange(&g_AllocLayer_Lock, 0);
+#elif defined(__GNUC__) || defined(__clang__)
+  static volatile int g_AllocLayer_Lock;
+  #define LAYER_LOCK    while (__sync_lock_test_and_set(&g_AllocLayer_Lock, 1) != 0) sched_yield();
+  #define LAYER_UNLOCK  __sync_lock_release(&g_AllocLayer_Lock);
+#else
+  #define LAYER_LOCK
+  #define LAYER_UNLOCK
+#endif
+
+/* the base allocators of the layer blocks */
+#define LAYER_BASE_MY       0
+#define LAYER_BASE_MID      1
+#define LAYER_BASE_BIG      2
+#define LAYER_BASE_ALIGNED  3
+
+typedef struct CLayerBlock_
+{
+  struct CLayerBlock_ *next; /* the list of the blocks in the pool */
+  size_t size;               /* the requested size */
+  size_t capacity;           /* the size of block without header */
+  unsigned kind;
+  unsigned base;
+} CLayerBlock;
+
+/* the header keeps the alignment of all base allocators */
+#define LAYER_HEADER_SIZE ALLOC_ALIGN_SIZE
+
+#define LAYER_BLOCK_FROM_PTR(p) ((CLayerBlock *)(void *)((Byte *)(p) - LAYER_HEADER_SIZE))
+#define LAYER_PTR_FROM_BLOCK(b) ((void *)((Byte *)(b) + LAYER_HEADER_SIZE))
+
+static const char * const k_AllocKind_Names[k_AllocKind_Num + 1] =
+  { "Alloc", "Mid", "Big", "Aligned", "zstd", "brotli", "Total" };
+
+/* these variables are protected by LAYER_LOCK */
+static CAllocStat g_AllocLayer_Stat[k_AllocKind_Num + 1];
+static CLayerBlock *g_AllocLayer_Pool;
+static size_t g_AllocLayer_PoolSize;
+static size_t g_AllocLayer_PoolSizeMax;
+static UInt64 g_AllocLayer_UsedBytes;  /* the capacity of the blocks in use (without the pool) */
+static UInt64 g_AllocLayer_MarkBytes;
+static UInt64 g_AllocLayer_MarkPeak;
+static CAllocLayerHost g_AllocLayer_Host;
+
+
+BoolInt AllocLayer_Set(unsigned flags, size_t poolSizeMax)
+{
+  if (g_AllocLayer_Used || (g_AllocLayer_Flags != 0 && flags == 0))
+    return False;
+  g_AllocLayer_Flags = flags;
+  g_AllocLayer_PoolSizeMax = (flags & k_AllocLayer_Pool) ? poolSizeMax : 0;
+  return True;
+}
+
+void AllocLayer_GetHost(CAllocLayerHost *host)
+{
+  host->Flags = g_AllocLayer_Flags;
+  host->Alloc = AllocLayer_Alloc;
+  host->Free = AllocLayer_Free;
+}
+
+BoolInt AllocLayer_SetHost(const CAllocLayerHost *host)
+{
+  if (!AllocLayer_Set(host->Flags, 0))
+    return False;
+  g_AllocLayer_Host = *host;
+  return True;
+}
+
+unsigned AllocLayer_GetFlags(void)
+{
+  return g_AllocLayer_Flags;
+}
+
+const char *AllocLayer_GetKindName(unsigned kind)
+{
+  return k_AllocKind_Names[kind];
+}
+
+void AllocLayer_GetStat(unsigned kind, CAllocStat *stat)
+{
+  LAYER_LOCK
+  *stat = g_AllocLayer_Stat[kind];
+  LAYER_UNLOCK
+}
+
+void AllocLayer_ResetMarkPeak(void)
+{
+  LAYER_LOCK
+  g_AllocLayer_MarkBytes = g_AllocLayer_UsedBytes;
+  g_AllocLayer_MarkPeak = g_AllocLayer_MarkBytes;
+  LAYER_UNLOCK
+}
+
+UInt64 AllocLayer_GetMarkPeak(void)
+{
+  UInt64 v;
+  LAYER_LOCK
+  v = g_AllocLayer_MarkPeak - g_AllocLayer_MarkBytes;
+  LAYER_UNLOCK
+  return v;
+}
+
+
+static void AllocStat_Add(CAllocStat *p, size_t size)
+{
+  unsigned i;
+  p->NumAllocs++;
+  p->TotalBytes += size;
+  p->CurBytes += size;
+  if (p->PeakBytes < p->CurBytes)
+    p->PeakBytes = p->CurBytes;
+  for (i = 0; i < k_AllocStat_HistSize - 1; i++)
+    if (size < ((size_t)1 << (4 * i + 4)))
+      break;
+  p->Hist[i]++;
+}
+
+static void AllocStat_Sub(CAllocStat *p, size_t size)
+{
+  p->NumFrees++;
+  p->CurBytes -= size;
+}
+
+
+static unsigned Layer_GetBase(unsigned kind, size_t size)
+{
+  switch (kind)
+  {
+    case k_AllocKind_Alloc: return LAYER_BASE_MY;
+    case k_AllocKind_Mid: return LAYER_BASE_MID;
+    case k_AllocKind_Big: return LAYER_BASE_BIG;
+    case k_AllocKind_Aligned: return LAYER_BASE_ALIGNED;
+  }
+  /* the libraries allocate small structures and big windows and tables via same function */
+  return size >= k_AllocLayer_PoolBlockMin ? LAYER_BASE_BIG : LAYER_BASE_MY;
+}
+
+static void *Layer_BaseAlloc(unsigned base, size_t size)
+{
+  switch (base)
+  {
+    case LAYER_BASE_MID: return MidAlloc(size);
+    case LAYER_BASE_BIG: return BigAlloc(size);
+    case LAYER_BASE_ALIGNED: return AlignedAlloc(size);
+  }
+  return MyAlloc(size);
+}
+
+static void Layer_BaseFree(unsigned base, void *address)
+{
+  switch (base)
+  {
+    case LAYER_BASE_MID: MidFree(address); return;
+    case LAYER_BASE_BIG: BigFree(address); return;
+    case LAYER_BASE_ALIGNED: AlignedFree(address); return;
+  }
+  MyFree(address);
+}
+
+
+/* it returns the smallest block from the pool that is not larger than (size + size / 8) */
+
+static CLayerBlock *Pool_Take(unsigned base, size_t size)
+{
+  CLayerBlock **best = NULL;
+  CLayerBlock **pp;
+  CLayerBlock *b;
+  const size_t sizeMax = size + (size >> 3);
+  for (pp = &g_AllocLayer_Pool; *pp; pp = &(*pp)->next)
+  {
+    b = *pp;
+    if (b->base == base && b->capacity >= size && b->capacity <= sizeMax
+        && (!best || b->capacity < (*best)->capacity))
+      best = pp;
+  }
+  if (!best)
+    return NULL;
+  b = *best;
+  *best = b->next;
+  g_AllocLayer_PoolSize -= b->capacity;
+  return b;
+}
+
+
+void *AllocLayer_Alloc(unsigned kind, size_t size)
+{
+  CLayerBlock *b = NULL;
+  const unsigned flags = g_AllocLayer_Flags;
+  const unsigned base = Layer_GetBase(kind, size);
+  BoolInt isNew = False;
+
+  if (g_AllocLayer_Host.Alloc)
+    return g_AllocLayer_Host.Alloc(kind, size);
+  /* the blocks of this module can't be passed to the host later */
+  g_AllocLayer_Used = True;
+
+  if (size == 0)
+    return NULL;
+
+  if ((flags & k_AllocLayer_Pool) && size >= k_AllocLayer_PoolBlockMin)
+  {
+    LAYER_LOCK
+    b = Pool_Take(base, size);
+    LAYER_UNLOCK
+  }
+
+  if (!b)
+  {
+    const size_t newSize = size + LAYER_HEADER_SIZE;
+    if (newSize < size)
+      return NULL;
+    b = (CLayerBlock *)Layer_BaseAlloc(base, newSize);
+    if (!b)
+      return NULL;
+    b->capacity = size;
+    b->base = base;
+    isNew = True;
+  }
+  b->next = NULL;
+  b->size = size;
+  b->kind = kind;
+
+  if (flags & k_AllocLayer_Stat)
+  {
+    LAYER_LOCK
+    AllocStat_Add(&g_AllocLayer_Stat[kind], size);
+    /* the block from the pool is used memory of the stage too,
+       so the mark peak doesn't depend on the pool */
+    g_AllocLayer_UsedBytes += b->capacity;
+    if (g_AllocLayer_MarkPeak < g_AllocLayer_UsedBytes)
+      g_AllocLayer_MarkPeak = g_AllocLayer_UsedBytes;
+    if (isNew)
+      AllocStat_Add(&g_AllocLayer_Stat[k_AllocKind_Total], b->capacity);
+    else
+    {
+      g_AllocLayer_Stat[kind].NumPoolHits++;
+      g_AllocLayer_Stat[k_AllocKind_Total].NumPoolHits++;
+    }
+    LAYER_UNLOCK
+  }
+
+  return LAYER_PTR_FROM_BLOCK(b);
+}
+
+
+void AllocLayer_Free(void *address)
+{
+  CLayerBlock *b;
+  const unsigned flags = g_AllocLayer_Flags;
+
+  if (g_AllocLayer_Host.Free)
+  {
+    g_AllocLayer_Host.Free(address);
+    return;
+  }
+  if (!address)
+    return;
+  b = LAYER_BLOCK_FROM_PTR(address);
+
+  if (flags != 0)
+  {
+    LAYER_LOCK
+    if (flags & k_AllocLayer_Stat)
+    {
+      AllocStat_Sub(&g_AllocLayer_Stat[b->kind], b->size);
+      g_AllocLayer_UsedBytes -= b->capacity;
+    }
+    /* the blocks in the pool are still counted in (Total) statistics */
+    if ((flags & k_AllocLayer_Pool)
+        && b->capacity >= k_AllocLayer_PoolBlockMin
+        && b->capacity <= g_AllocLayer_PoolSizeMax - g_AllocLayer_PoolSize)
+    {
+      b->next = g_AllocLayer_Pool;
+      g_AllocLayer_Pool = b;
+      g_AllocLayer_PoolSize += b->capacity;
+      b = NULL;
+    }
+    else if (flags & k_AllocLayer_Stat)
+      AllocStat_Sub(&g_AllocLayer_Stat[k_AllocKind_Total], b->capacity);
+    LAYER_UNLOCK
+  }
+
+  if (b)
+    Layer_BaseFree(b->base, b);
+}
+
+
 
 #define MY_ALIGN_PTR_DOWN_1(p) MY_ALIGN_PTR_DOWN(p, sizeof(void *))
 
@@ -11,37 +11,116 @@ EXTERN_C_BEGIN
 void *MyAlloc(size_t size);
 void MyFree(void *address);
 
-#ifdef _WIN32
-
 void SetLargePageSize(void);
 
-void *MidAlloc(size_t size);
-void MidFree(void *address);
 void *BigAlloc(size_t size);
 void BigFree(void *address);
 
+#ifdef _WIN32
+
+void *MidAlloc(size_t size);
+void MidFree(void *address);
+
 #else
 
 #define MidAlloc(size) MyAlloc(size)
 #define MidFree(address) MyFree(address)
-#define BigAlloc(size) MyAlloc(size)
-#define BigFree(address) MyFree(address)
 
 #endif
 
+/* the numbers of BigAlloc() calls that tried to use large pages after SetLargePageSize() */
+typedef struct
+{
+  UInt32 NumLarge;    /* VirtualAlloc(MEM_LARGE_PAGES) or mmap(MAP_HUGETLB) */
+  UInt32 NumThp;      /* madvise(MADV_HUGEPAGE) : transparent huge pages in Linux */
+  UInt32 NumFallback; /* normal pages */
+} CLargePagesStat;
+
+void LargePages_GetStat(CLargePagesStat *stat);
+
 extern const ISzAlloc g_Alloc;
 
-#ifdef _WIN32
 extern const ISzAlloc g_BigAlloc;
+#ifdef _WIN32
 extern const ISzAlloc g_MidAlloc;
 #else
-#define g_BigAlloc g_AlignedAlloc
 #define g_MidAlloc g_AlignedAlloc
 #endif
 
 extern const ISzAlloc g_AlignedAlloc;
 
 
+/*
+  Alloc layer:
+    k_AllocLayer_Stat : the statistics of allocations for each allocator kind
+    k_AllocLayer_Pool : the pool that keeps the freed big blocks (>= k_AllocLayer_PoolBlockMin)
+                        for the next allocations of similar size in any thread
+  AllocLayer_Set() must be called before the first allocation via
+  g_Alloc, g_MidAlloc, g_BigAlloc and g_AlignedAlloc. It returns 0, if it's too late.
+
+  AllocLayer_Alloc() / AllocLayer_Free() are the allocator for other libraries (zstd, brotli).
+  These blocks always have the header, so they can be used in any mode.
+*/
+
+#define k_AllocLayer_Stat  (1 << 0)
+#define k_AllocLayer_Pool  (1 << 1)
+
+#define k_AllocLayer_PoolBlockMin ((size_t)1 << 20)
+
+#define k_AllocKind_Alloc    0  /* g_Alloc */
+#define k_AllocKind_Mid      1  /* g_MidAlloc */
+#define k_AllocKind_Big      2  /* g_BigAlloc */
+#define k_AllocKind_Aligned  3  /* g_AlignedAlloc */
+#define k_AllocKind_Zstd     4  /* ZSTD_customMem */
+#define k_AllocKind_Brotli   5  /* brotli_alloc_func */
+#define k_AllocKind_Num      6
+#define k_AllocKind_Total    k_AllocKind_Num /* all kinds, including the blocks in the pool */
+
+/* Hist[i] : the number of blocks with (size < ((size_t)1 << (4 * i + 4))),
+   the last item is for all bigger blocks */
+#define k_AllocStat_HistSize 8
+
+typedef struct
+{
+  UInt64 NumAllocs;
+  UInt64 NumFrees;
+  UInt64 NumPoolHits;   /* the allocations that were served from the pool */
+  UInt64 TotalBytes;    /* the sum of the sizes of all allocations */
+  UInt64 CurBytes;
+  UInt64 PeakBytes;
+  UInt64 Hist[k_AllocStat_HistSize];
+} CAllocStat;
+
+BoolInt AllocLayer_Set(unsigned flags, size_t poolSizeMax);
+unsigned AllocLayer_GetFlags(void);
+const char *AllocLayer_GetKindName(unsigned kind);
+void AllocLayer_GetStat(unsigned kind, CAllocStat *stat);
+
+/* the peak of the bytes in use (including the blocks taken from the pool)
+   over the level at the last AllocLayer_ResetMarkPeak() call.
+   It's used to measure the memory of one stage of work (for example, in benchmark). */
+void AllocLayer_ResetMarkPeak(void);
+UInt64 AllocLayer_GetMarkPeak(void);
+
+void *AllocLayer_Alloc(unsigned kind, size_t size);
+void AllocLayer_Free(void *address);
+
+/* 7z.dll / 7z.so has its own copy of the layer. The host program passes its layer
+   to the module (SetAllocLayer() export), and then the module forwards all blocks
+   of its layer to the host. So there is one pool and one table of statistics.
+   AllocLayer_SetHost() returns 0, if the module has allocated blocks already. */
+
+typedef struct
+{
+  unsigned Flags;
+  void *(*Alloc)(unsigned kind, size_t size);
+  void (*Free)(void *address);
+} CAllocLayerHost;
+
+void AllocLayer_GetHost(CAllocLayerHost *host);
+BoolInt AllocLayer_SetHost(const CAllocLayerHost *host);
+
+
 typedef struct
 {
   ISzAlloc vt;
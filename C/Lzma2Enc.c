@@ -85,6 +85,7 @@ typedef struct
   Byte propsByte;
   Byte needInitState;
   Byte needInitProp;
+  Byte needInitDic;
   UInt64 srcPos;
 } CLzma2EncInt;
 
@@ -108,6 +109,7 @@ static void Lzma2EncInt_InitBlock(CLzma2EncInt *p)
   p->srcPos = 0;
   p->needInitState = True;
   p->needInitProp = True;
+  p->needInitDic = True;
 }
 
 
@@ -115,6 +117,9 @@ SRes LzmaEnc_PrepareForLzma2(CLzmaEncHandle pp, ISeqInStream *inStream, UInt32 k
     ISzAllocPtr alloc, ISzAllocPtr allocBig);
 SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
     UInt32 keepWindowSize, ISzAllocPtr alloc, ISzAllocPtr allocBig);
+SRes LzmaEnc_MemPreparePrimed(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
+    UInt32 primeSize, UInt64 streamPos,
+    UInt32 keepWindowSize, ISzAllocPtr alloc, ISzAllocPtr allocBig);
 SRes LzmaEnc_CodeOneMemBlock(CLzmaEncHandle pp, BoolInt reInit,
     Byte *dest, size_t *destLen, UInt32 desiredPackSize, UInt32 *unpackSize);
 const Byte *LzmaEnc_GetCurBuf(CLzmaEncHandle pp);
@@ -170,7 +175,8 @@ static SRes Lzma2EncInt_EncodeSubblock(CLzma2EncInt *p, Byte *outBuf,
       UInt32 u = (unpackSize < LZMA2_COPY_CHUNK_SIZE) ? unpackSize : LZMA2_COPY_CHUNK_SIZE;
       if (packSizeLimit - destPos < u + 3)
         return SZ_ERROR_OUTPUT_EOF;
-      outBuf[destPos++] = (Byte)(p->srcPos == 0 ? LZMA2_CONTROL_COPY_RESET_DIC : LZMA2_CONTROL_COPY_NO_RESET);
+      outBuf[destPos++] = (Byte)(p->needInitDic ? LZMA2_CONTROL_COPY_RESET_DIC : LZMA2_CONTROL_COPY_NO_RESET);
+      p->needInitDic = False;
       outBuf[destPos++] = (Byte)((u - 1) >> 8);
       outBuf[destPos++] = (Byte)(u - 1);
       memcpy(outBuf + destPos, LzmaEnc_GetCurBuf(p->enc) - unpackSize, u);
@@ -198,7 +204,7 @@ static SRes Lzma2EncInt_EncodeSubblock(CLzma2EncInt *p, Byte *outBuf,
     size_t destPos = 0;
     UInt32 u = unpackSize - 1;
     UInt32 pm = (UInt32)(packSize - 1);
-    unsigned mode = (p->srcPos == 0) ? 3 : (p->needInitState ? (p->needInitProp ? 2 : 1) : 0);
+    unsigned mode = p->needInitDic ? 3 : (p->needInitState ? (p->needInitProp ? 2 : 1) : 0);
 
     PRF(printf("               "));
 
@@ -213,6 +219,7 @@ static SRes Lzma2EncInt_EncodeSubblock(CLzma2EncInt *p, Byte *outBuf,
     
     p->needInitProp = False;
     p->needInitState = False;
+    p->needInitDic = False;
     destPos += packSize;
     p->srcPos += unpackSize;
 
@@ -232,6 +239,7 @@ void Lzma2EncProps_Init(CLzma2EncProps *p)
 {
   LzmaEncProps_Init(&p->lzmaProps);
   p->blockSize = LZMA2_ENC_PROPS__BLOCK_SIZE__AUTO;
+  p->blockPrimeSize = 0;
   p->numBlockThreads_Reduced = -1;
   p->numBlockThreads_Max = -1;
   p->numTotalThreads = -1;
@@ -289,7 +297,14 @@ void Lzma2EncProps_Normalize(CLzma2EncProps *p)
   if (   p->blockSize != LZMA2_ENC_PROPS__BLOCK_SIZE__SOLID
       && p->blockSize != LZMA2_ENC_PROPS__BLOCK_SIZE__AUTO
       && (p->blockSize < fileSize || fileSize == (UInt64)(Int64)-1))
-    p->lzmaProps.reduceSize = p->blockSize;
+  {
+    /* the encoder of primed block also sees (blockPrimeSize) bytes of previous data */
+    UInt64 reduceSize = p->blockSize + p->blockPrimeSize;
+    if (reduceSize < p->blockSize)
+      reduceSize = (UInt64)(Int64)-1;
+    if (reduceSize < fileSize)
+      p->lzmaProps.reduceSize = reduceSize;
+  }
 
   LzmaEncProps_Normalize(&p->lzmaProps);
 
@@ -338,6 +353,11 @@ void Lzma2EncProps_Normalize(CLzma2EncProps *p)
     }
   }
   
+  if (p->blockSize == LZMA2_ENC_PROPS__BLOCK_SIZE__SOLID)
+    p->blockPrimeSize = 0;
+  else if (p->blockPrimeSize > p->lzmaProps.dictSize)
+    p->blockPrimeSize = p->lzmaProps.dictSize;
+
   p->numBlockThreads_Max = t2;
   p->numBlockThreads_Reduced = t2r;
   p->numTotalThreads = t3;
@@ -501,6 +521,7 @@ static SRes Lzma2Enc_EncodeMt1(
     Byte *outBuf, size_t *outBufSize,
     ISeqInStream *inStream,
     const Byte *inData, size_t inDataSize,
+    size_t primeSize, UInt64 streamPos,
     int finished,
     ICompressProgress *progress)
 {
@@ -580,11 +601,26 @@ static SRes Lzma2Enc_EncodeMt1(
     
       // LzmaEnc_SetDataSize(p->enc, inSizeCur);
       
-      RINOK(LzmaEnc_MemPrepare(p->enc,
-          inData + (size_t)unpackTotal, inSizeCur,
-          LZMA2_KEEP_WINDOW_SIZE,
-          me->alloc,
-          me->allocBig));
+      if (primeSize != 0 && unpackTotal == 0)
+      {
+        /* (primeSize) bytes before (inData) are the end of previous block,
+           and the decoder has them in dictionary */
+        p->needInitDic = False;
+        RINOK(LzmaEnc_MemPreparePrimed(p->enc,
+            inData - primeSize, primeSize + inSizeCur,
+            (UInt32)primeSize, streamPos,
+            LZMA2_KEEP_WINDOW_SIZE,
+            me->alloc,
+            me->allocBig));
+      }
+      else
+      {
+        RINOK(LzmaEnc_MemPrepare(p->enc,
+            inData + (size_t)unpackTotal, inSizeCur,
+            LZMA2_KEEP_WINDOW_SIZE,
+            me->alloc,
+            me->allocBig));
+      }
     }
 
     for (;;)
@@ -661,6 +697,7 @@ static SRes Lzma2Enc_MtCallback_Code(void *pp, unsigned coderIndex, unsigned out
   size_t destSize = me->outBufSize;
   SRes res;
   CMtProgressThunk progressThunk;
+  const CMtCoderThread *thread = &me->mtCoder.threads[coderIndex];
 
   Byte *dest = me->outBufs[outBufIndex];
 
@@ -683,6 +720,7 @@ static SRes Lzma2Enc_MtCallback_Code(void *pp, unsigned coderIndex, unsigned out
       &me->coders[coderIndex],
       NULL, dest, &destSize,
       NULL, src, srcSize,
+      thread->prefixSize, thread->blockPos,
       finished,
       &progressThunk.vt);
 
@@ -771,6 +809,8 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle pp,
     if (p->mtCoder.blockSize != p->props.blockSize)
       return SZ_ERROR_PARAM; /* SZ_ERROR_MEM */
 
+    p->mtCoder.prefixSizeMax = p->props.blockPrimeSize;
+
     {
       size_t destBlockSize = p->mtCoder.blockSize + (p->mtCoder.blockSize >> 10) + 16;
       if (destBlockSize < p->mtCoder.blockSize)
@@ -798,6 +838,7 @@ SRes Lzma2Enc_Encode2(CLzma2EncHandle pp,
       &p->coders[0],
       outStream, outBuf, outBufSize,
       inStream, inData, inDataSize,
+      0, 0, /* no preset dictionary */
       True, /* finished */
       progress);
 }
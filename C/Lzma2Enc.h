@@ -15,6 +15,10 @@ typedef struct
 {
   CLzmaEncProps lzmaProps;
   UInt64 blockSize;
+  /* if (blockPrimeSize != 0), each block in multi-block mode (except of first block)
+     is encoded with up to (blockPrimeSize) bytes of previous data as preset dictionary,
+     and the blocks don't reset the dictionary of decoder */
+  UInt32 blockPrimeSize;
   int numBlockThreads_Reduced;
   int numBlockThreads_Max;
   int numTotalThreads;
@@ -26,6 +26,9 @@ SRes LzmaEnc_PrepareForLzma2(CLzmaEncHandle pp, ISeqInStream *inStream, UInt32 k
     ISzAllocPtr alloc, ISzAllocPtr allocBig);
 SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
     UInt32 keepWindowSize, ISzAllocPtr alloc, ISzAllocPtr allocBig);
+SRes LzmaEnc_MemPreparePrimed(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
+    UInt32 primeSize, UInt64 streamPos,
+    UInt32 keepWindowSize, ISzAllocPtr alloc, ISzAllocPtr allocBig);
 SRes LzmaEnc_CodeOneMemBlock(CLzmaEncHandle pp, BoolInt reInit,
     Byte *dest, size_t *destLen, UInt32 desiredPackSize, UInt32 *unpackSize);
 const Byte *LzmaEnc_GetCurBuf(CLzmaEncHandle pp);
@@ -2392,20 +2395,26 @@ void LzmaEnc_Destroy(CLzmaEncHandle p, ISzAllocPtr alloc, ISzAllocPtr allocBig)
 }
 
 
+static SRes LzmaEnc_InitMatchFinder(CLzmaEnc *p)
+{
+  #ifndef _7ZIP_ST
+  if (p->mtMode)
+  {
+    RINOK(MatchFinderMt_InitMt(&p->matchFinderMt));
+  }
+  #endif
+  p->matchFinder.Init(p->matchFinderObj);
+  p->needInit = 0;
+  return SZ_OK;
+}
+
 MY_NO_INLINE
 static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, UInt32 maxPackSize, UInt32 maxUnpackSize)
 {
   UInt32 nowPos32, startPos32;
   if (p->needInit)
   {
-    #ifndef _7ZIP_ST
-    if (p->mtMode)
-    {
-      RINOK(MatchFinderMt_InitMt(&p->matchFinderMt));
-    }
-    #endif
-    p->matchFinder.Init(p->matchFinderObj);
-    p->needInit = 0;
+    RINOK(LzmaEnc_InitMatchFinder(p));
   }
 
   if (p->finished)
@@ -2917,6 +2926,31 @@ SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
   return LzmaEnc_AllocAndInit(p, keepWindowSize, alloc, allocBig);
 }
 
+/*
+  LzmaEnc_MemPreparePrimed() prepares the encoding of (src + primeSize), where first
+  (primeSize) bytes of (src) are the end of data that was encoded before (preset dictionary).
+  These bytes are inserted to match finder without encoding.
+  (streamPos) is the position of (src + primeSize) in the data after last dictionary reset.
+  The decoder uses that position for (posState) and literal contexts.
+*/
+
+SRes LzmaEnc_MemPreparePrimed(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
+    UInt32 primeSize, UInt64 streamPos,
+    UInt32 keepWindowSize, ISzAllocPtr alloc, ISzAllocPtr allocBig)
+{
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  if (primeSize > srcLen || primeSize > streamPos)
+    return SZ_ERROR_PARAM;
+  RINOK(LzmaEnc_MemPrepare(pp, src, srcLen, keepWindowSize, alloc, allocBig));
+  if (primeSize != 0)
+  {
+    RINOK(LzmaEnc_InitMatchFinder(p));
+    p->matchFinder.Skip(p->matchFinderObj, primeSize);
+    p->nowPos64 = streamPos;
+  }
+  return SZ_OK;
+}
+
 void LzmaEnc_Finish(CLzmaEncHandle pp)
 {
   #ifndef _7ZIP_ST
@@ -3127,6 +3161,27 @@ SRes LzmaEnc_MemEncode(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte
 }
 
 
+SRes LzmaEnc_MemEncodeToStream(CLzmaEncHandle pp, ISeqOutStream *outStream, const Byte *src, SizeT srcLen,
+    ICompressProgress *progress, ISzAllocPtr alloc, ISzAllocPtr allocBig)
+{
+  SRes res;
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+
+  p->rc.outStream = outStream;
+
+  res = LzmaEnc_MemPrepare(pp, src, srcLen, 0, alloc, allocBig);
+  
+  if (res == SZ_OK)
+  {
+    res = LzmaEnc_Encode2(p, progress);
+    if (res == SZ_OK && p->nowPos64 != srcLen)
+      res = SZ_ERROR_FAIL;
+  }
+
+  return res;
+}
+
+
 SRes LzmaEncode(Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
     const CLzmaEncProps *props, Byte *propsEncoded, SizeT *propsSize, int writeEndMark,
     ICompressProgress *progress, ISzAllocPtr alloc, ISzAllocPtr allocBig)
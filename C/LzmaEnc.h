@@ -66,6 +66,11 @@ SRes LzmaEnc_Encode(CLzmaEncHandle p, ISeqOutStream *outStream, ISeqInStream *in
 SRes LzmaEnc_MemEncode(CLzmaEncHandle p, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
     int writeEndMark, ICompressProgress *progress, ISzAllocPtr alloc, ISzAllocPtr allocBig);
 
+/* LzmaEnc_MemEncodeToStream() encodes (src) buffer to (outStream).
+   The match finder reads the data directly from (src) without copying. */
+SRes LzmaEnc_MemEncodeToStream(CLzmaEncHandle p, ISeqOutStream *outStream, const Byte *src, SizeT srcLen,
+    ICompressProgress *progress, ISzAllocPtr alloc, ISzAllocPtr allocBig);
+
 
 /* ---------- One Call Interface ---------- */
 
@@ -3,6 +3,8 @@
 
 #include "Precomp.h"
 
+#include <string.h>
+
 #include "MtCoder.h"
 
 #ifndef _7ZIP_ST
@@ -54,7 +56,7 @@ static SRes MtCoderThread_CreateAndStart(CMtCoderThread *t)
   {
     t->stop = False;
     if (!Thread_WasCreated(&t->thread))
-      wres = Thread_Create(&t->thread, ThreadFunc, t);
+      wres = Thread_Create_Numa(&t->thread, ThreadFunc, t, t->index);
     if (wres == 0)
       wres = Event_Set(&t->startEvent);
   }
@@ -138,6 +140,8 @@ static SRes ThreadFunc2(CMtCoderThread *t)
     size = 0;
     inData = NULL;
     finished = True;
+    t->prefixSize = 0;
+    t->blockPos = mtc->readProcessed;
 
     if (res == SZ_OK)
     {
@@ -146,15 +150,30 @@ static SRes ThreadFunc2(CMtCoderThread *t)
       {
         if (!t->inBuf)
         {
-          t->inBuf = (Byte *)ISzAlloc_Alloc(mtc->allocBig, mtc->blockSize);
+          t->inBuf = (Byte *)ISzAlloc_Alloc(mtc->allocBig, mtc->prefixSizeMax + mtc->blockSize);
           if (!t->inBuf)
             res = SZ_ERROR_MEM;
         }
         if (res == SZ_OK)
         {
-          res = FullRead(mtc->inStream, t->inBuf, &size);
+          Byte *data = t->inBuf + mtc->prefixSizeMax;
+          size_t prefixSize = mtc->prevBlockAvail;
+          if (prefixSize > mtc->prefixSizeMax)
+            prefixSize = mtc->prefixSizeMax;
+          /* the owner of previous block can't reuse its inBuf until we set readEvent.
+             The previous block can be in our own inBuf, so we use memmove() */
+          if (prefixSize != 0)
+            memmove(data - prefixSize, mtc->prevBlockEnd - prefixSize, prefixSize);
+          t->prefixSize = prefixSize;
+          inData = data;
+          res = FullRead(mtc->inStream, data, &size);
           readProcessed = mtc->readProcessed + size;
           mtc->readProcessed = readProcessed;
+          if (mtc->prefixSizeMax != 0)
+          {
+            mtc->prevBlockEnd = data + size;
+            mtc->prevBlockAvail = prefixSize + size;
+          }
         }
         if (res != SZ_OK)
         {
@@ -173,6 +192,7 @@ static SRes ThreadFunc2(CMtCoderThread *t)
         if (size > rem)
           size = rem;
         inData = mtc->inData + (size_t)readProcessed;
+        t->prefixSize = ((size_t)readProcessed < mtc->prefixSizeMax ? (size_t)readProcessed : mtc->prefixSizeMax);
         readProcessed += size;
         mtc->readProcessed = readProcessed;
         finished = (mtc->inDataSize == (size_t)readProcessed);
@@ -238,7 +258,7 @@ static SRes ThreadFunc2(CMtCoderThread *t)
       CriticalSection_Leave(&mtc->cs);
       
       res = mtc->mtCallback->Code(mtc->mtCallbackObject, t->index, bufIndex,
-          mtc->inStream ? t->inBuf : inData, size, finished);
+          inData, size, finished);
       
       // MtProgress_Reinit(&mtc->mtProgress, t->index);
 
@@ -371,6 +391,7 @@ void MtCoder_Construct(CMtCoder *p)
   unsigned i;
   
   p->blockSize = 0;
+  p->prefixSizeMax = 0;
   p->numThreadsMax = 0;
   p->expectedDataSize = (UInt64)(Int64)-1;
 
@@ -396,6 +417,8 @@ void MtCoder_Construct(CMtCoder *p)
     t->index = i;
     t->inBuf = NULL;
     t->stop = False;
+    t->prefixSize = 0;
+    t->blockPos = 0;
     Event_Construct(&t->startEvent);
     Thread_Construct(&t->thread);
   }
@@ -466,7 +489,10 @@ SRes MtCoder_Code(CMtCoder *p)
   if (numBlocksMax > MTCODER__BLOCKS_MAX)
     numBlocksMax = MTCODER__BLOCKS_MAX;
 
-  if (p->blockSize != p->allocatedBufsSize)
+  if (p->prefixSizeMax + p->blockSize < p->blockSize)
+    return SZ_ERROR_PARAM;
+
+  if (p->prefixSizeMax + p->blockSize != p->allocatedBufsSize)
   {
     for (i = 0; i < MTCODER__THREADS_MAX; i++)
     {
@@ -477,7 +503,7 @@ SRes MtCoder_Code(CMtCoder *p)
         t->inBuf = NULL;
       }
     }
-    p->allocatedBufsSize = p->blockSize;
+    p->allocatedBufsSize = p->prefixSizeMax + p->blockSize;
   }
 
   p->readRes = SZ_OK;
@@ -504,6 +530,8 @@ SRes MtCoder_Code(CMtCoder *p)
   p->freeBlockHead = 0;
 
   p->readProcessed = 0;
+  p->prevBlockEnd = NULL;
+  p->prevBlockAvail = 0;
   p->blockIndex = 0;
   p->numBlocksMax = numBlocksMax;
   p->stopReading = False;
@@ -50,6 +50,10 @@ typedef struct
   int stop;
   Byte *inBuf;
 
+  /* the values for the block that is passed to IMtCoderCallback2::Code() */
+  size_t prefixSize;       /* the number of bytes of previous data just before (src) */
+  UInt64 blockPos;         /* the position of the block in the input data */
+
   CAutoResetEvent startEvent;
   CThread thread;
 } CMtCoderThread;
@@ -76,6 +80,9 @@ typedef struct _CMtCoder
   /* input variables */
   
   size_t blockSize;        /* size of input block */
+  /* if (prefixSizeMax != 0), the coder keeps up to (prefixSizeMax) bytes of
+     previous input data just before (src) of each block (except of first block) */
+  size_t prefixSizeMax;
   unsigned numThreadsMax;
   UInt64 expectedDataSize;
 
@@ -116,6 +123,8 @@ typedef struct _CMtCoder
   unsigned numBlocksMax;
   unsigned blockIndex;
   UInt64 readProcessed;
+  const Byte *prevBlockEnd; /* the end of data of previous block in inBuf of some thread */
+  size_t prevBlockAvail;    /* the size of contiguous previous data before (prevBlockEnd) */
 
   CCriticalSection cs;
 
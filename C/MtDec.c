@@ -126,7 +126,7 @@ static SRes MtDecThread_CreateAndStart(CMtDecThread *t)
   {
     if (Thread_WasCreated(&t->thread))
       return SZ_OK;
-    wres = Thread_Create(&t->thread, ThreadFunc, t);
+    wres = Thread_Create_Numa(&t->thread, ThreadFunc, t, t->index);
     if (wres == 0)
       return SZ_OK;
   }
@@ -188,6 +188,20 @@ WRes CriticalSection_Init(CCriticalSection *p)
 
 
 
+unsigned Numa_Enable(void) { return 0; }
+unsigned Numa_GetNumNodes(void) { return 0; }
+
+WRes Thread_Create_Numa(CThread *p, THREAD_FUNC_TYPE func, LPVOID param, unsigned index)
+{
+  UNUSED_VAR(index)
+  return Thread_Create(p, func, param);
+}
+
+void Numa_BindCurrentThread(unsigned index)
+{
+  UNUSED_VAR(index)
+}
+
 #else // _WIN32
 
 // ---------- POSIX ----------
@@ -537,4 +551,114 @@ LONG InterlockedIncrement(LONG volatile *addend)
   #endif
 }
 
+
+#ifdef _7ZIP_AFFINITY_SUPPORTED
+
+#include <stdio.h>
+
+#define NUMA_NODES_MAX 64
+
+static unsigned g_Numa_NumNodes;
+static CCpuSet g_Numa_CpuSets[NUMA_NODES_MAX];
+
+/* reads the list in sysfs format: "0-7,16-23" */
+
+static BoolInt Numa_ReadList(const char *path, CCpuSet *cs)
+{
+  char buf[1024];
+  const char *s = buf;
+  size_t size;
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return False;
+  size = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[size] = 0;
+  CpuSet_Zero(cs);
+  for (;;)
+  {
+    char *end;
+    unsigned long a, b;
+    if (*s < '0' || *s > '9')
+      break;
+    a = strtoul(s, &end, 10);
+    b = a;
+    s = end;
+    if (*s == '-')
+    {
+      b = strtoul(s + 1, &end, 10);
+      s = end;
+    }
+    for (; a <= b && a < CPU_SETSIZE; a++)
+      CpuSet_Set(cs, a);
+    if (*s != ',')
+      break;
+    s++;
+  }
+  return True;
+}
+
+unsigned Numa_Enable(void)
+{
+  CCpuSet nodes, procSet;
+  unsigned node;
+  if (g_Numa_NumNodes != 0)
+    return g_Numa_NumNodes;
+  if (!Numa_ReadList("/sys/devices/system/node/online", &nodes))
+    return 0;
+  if (sched_getaffinity(0, sizeof(procSet), &procSet) != 0)
+    return 0;
+  for (node = 0; node < CPU_SETSIZE && g_Numa_NumNodes < NUMA_NODES_MAX; node++)
+  {
+    char path[64];
+    CCpuSet *cs = &g_Numa_CpuSets[g_Numa_NumNodes];
+    if (!CpuSet_IsSet(&nodes, node))
+      continue;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    if (!Numa_ReadList(path, cs))
+      continue;
+    CPU_AND(cs, cs, &procSet);
+    // the nodes without allowed CPUs (memory only nodes or -stm) are not used
+    if (CPU_COUNT(cs) != 0)
+      g_Numa_NumNodes++;
+  }
+  return g_Numa_NumNodes;
+}
+
+unsigned Numa_GetNumNodes(void)
+{
+  return g_Numa_NumNodes;
+}
+
+WRes Thread_Create_Numa(CThread *p, THREAD_FUNC_TYPE func, LPVOID param, unsigned index)
+{
+  if (g_Numa_NumNodes < 2)
+    return Thread_Create(p, func, param);
+  return Thread_Create_With_CpuSet(p, func, param, &g_Numa_CpuSets[index % g_Numa_NumNodes]);
+}
+
+void Numa_BindCurrentThread(unsigned index)
+{
+  if (g_Numa_NumNodes >= 2)
+    pthread_setaffinity_np(pthread_self(), sizeof(CCpuSet), &g_Numa_CpuSets[index % g_Numa_NumNodes]);
+}
+
+#else
+
+unsigned Numa_Enable(void) { return 0; }
+unsigned Numa_GetNumNodes(void) { return 0; }
+
+WRes Thread_Create_Numa(CThread *p, THREAD_FUNC_TYPE func, LPVOID param, unsigned index)
+{
+  UNUSED_VAR(index)
+  return Thread_Create(p, func, param);
+}
+
+void Numa_BindCurrentThread(unsigned index)
+{
+  UNUSED_VAR(index)
+}
+
+#endif
+
 #endif // _WIN32
@@ -227,6 +227,31 @@ LONG InterlockedIncrement(LONG volatile *addend);
 
 #endif  // _WIN32
 
+
+/* ---------- NUMA ---------- */
+
+/*
+  Numa_Enable() reads the NUMA topology for the CPUs that are allowed for the process
+  (Linux: /sys/devices/system/node). Then Thread_Create_Numa() places the coder threads
+  to the nodes in round-robin order: the thread (index) runs on the CPUs of
+  node (index % numNodes). Each coder thread allocates and initializes its own buffers,
+  so these buffers are allocated in the local node of the thread by first touch.
+  There is no node-local allocation (mbind / VirtualAllocExNuma): a buffer that is
+  allocated and first written by another thread (for example, the shared input
+  buffers of the caller thread or the pages of a preallocated large-page pool)
+  stays in the node of that thread.
+  Numa_Enable() must be called before the creation of coder threads.
+  The decoder thread pools (MtDec, 7z MT extraction, gz, zstd, block decoders)
+  use it too, so "x -mnuma" binds them in the same way.
+  It returns the number of nodes. If (numNodes < 2), the threads are not bound.
+*/
+
+unsigned Numa_Enable(void);
+unsigned Numa_GetNumNodes(void);
+WRes Thread_Create_Numa(CThread *p, THREAD_FUNC_TYPE func, LPVOID param, unsigned index);
+/* for threads that are created by another code */
+void Numa_BindCurrentThread(unsigned index);
+
 EXTERN_C_END
 
 #endif
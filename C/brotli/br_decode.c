@@ -78,7 +78,7 @@ BrotliDecoderState* BrotliDecoderCreateInstance(
     brotli_alloc_func alloc_func, brotli_free_func free_func, void* opaque) {
   BrotliDecoderState* state = 0;
   if (!alloc_func && !free_func) {
-    state = (BrotliDecoderState*)malloc(sizeof(BrotliDecoderState));
+    state = (BrotliDecoderState*)BrotliDefaultAllocFunc(0, sizeof(BrotliDecoderState));
   } else if (alloc_func && free_func) {
     state = (BrotliDecoderState*)alloc_func(opaque, sizeof(BrotliDecoderState));
   }
@@ -89,7 +89,7 @@ BrotliDecoderState* BrotliDecoderCreateInstance(
   if (!BrotliDecoderStateInit(state, alloc_func, free_func, opaque)) {
     BROTLI_DUMP();
     if (!alloc_func && !free_func) {
-      free(state);
+      BrotliDefaultFreeFunc(0, state);
     } else if (alloc_func && free_func) {
       free_func(opaque, state);
     }
@@ -9,14 +9,30 @@
 #include "./common/platform.h"
 #include "types.h"
 
+static brotli_alloc_func default_alloc_func = 0;
+static brotli_free_func default_free_func = 0;
+static void* default_opaque = 0;
+
+void BrotliSetDefaultAllocators(brotli_alloc_func alloc_func,
+                                brotli_free_func free_func, void* opaque) {
+  default_alloc_func = alloc_func;
+  default_free_func = free_func;
+  default_opaque = opaque;
+}
+
 /* Default brotli_alloc_func */
 void* BrotliDefaultAllocFunc(void* opaque, size_t size) {
   BROTLI_UNUSED(opaque);
+  if (default_alloc_func) return default_alloc_func(default_opaque, size);
   return malloc(size);
 }
 
 /* Default brotli_free_func */
 void BrotliDefaultFreeFunc(void* opaque, void* address) {
   BROTLI_UNUSED(opaque);
+  if (default_free_func) {
+    default_free_func(default_opaque, address);
+    return;
+  }
   free(address);
 }
@@ -80,4 +80,20 @@ typedef void* (*brotli_alloc_func)(void* opaque, size_t size);
  */
 typedef void (*brotli_free_func)(void* opaque, void* address);
 
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * 7-Zip: sets the allocator that is used instead of malloc() / free(), if
+ * no ::brotli_alloc_func was provided, like in BrotliEncoderCompress() and
+ * BrotliDecoderDecompress(). It must be called before the first allocation.
+ */
+void BrotliSetDefaultAllocators(brotli_alloc_func alloc_func,
+                                brotli_free_func free_func, void* opaque);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
+
 #endif  /* BROTLI_COMMON_TYPES_H_ */
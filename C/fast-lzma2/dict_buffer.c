@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include "dict_buffer.h"
 #include "fl2_internal.h"
+#include "../Alloc.h"       /* BigAlloc : large pages for the dictionary */
 
 #define ALIGNMENT_SIZE 16U
 #define ALIGNMENT_MASK (~(size_t)(ALIGNMENT_SIZE-1))
@@ -39,11 +40,11 @@ int DICT_init(DICT_buffer * const buf, size_t const dict_size, size_t const over
         /* Free any existing buffers */
         DICT_destruct(buf);
 
-        buf->data[0] = malloc(dict_size);
+        buf->data[0] = BigAlloc(dict_size);
 
         buf->data[1] = NULL;
         if (buf->async)
-            buf->data[1] = malloc(dict_size);
+            buf->data[1] = BigAlloc(dict_size);
 
         if (buf->data[0] == NULL || (buf->async && buf->data[1] == NULL)) {
             DICT_destruct(buf);
@@ -82,8 +83,8 @@ int DICT_init(DICT_buffer * const buf, size_t const dict_size, size_t const over
 
 void DICT_destruct(DICT_buffer * const buf)
 {
-    free(buf->data[0]);
-    free(buf->data[1]);
+    BigFree(buf->data[0]);
+    BigFree(buf->data[1]);
     buf->data[0] = NULL;
     buf->data[1] = NULL;
     buf->size = 0;
@@ -20,6 +20,7 @@
 #ifndef FL2_SINGLETHREAD
 
 #include "fl2_threading.h"   /* pthread adaptation */
+#include "../Threads.h"      /* Numa_BindCurrentThread */
 
 struct FL2POOL_ctx_s {
     /* Keep track of the threads */
@@ -29,6 +30,8 @@ struct FL2POOL_ctx_s {
     FL2POOL_function function;
     void *opaque;
 
+    /* The number of started threads, it's used as index for NUMA placement */
+    size_t numThreadsStarted;
     /* The number of threads working on jobs */
     size_t numThreadsBusy;
     /* Indicates the number of threads requested and the values to pass */
@@ -58,6 +61,7 @@ static void* FL2POOL_thread(void* opaque)
     FL2POOL_ctx* const ctx = (FL2POOL_ctx*)opaque;
     if (!ctx) { return NULL; }
     FL2_pthread_mutex_lock(&ctx->queueMutex);
+    Numa_BindCurrentThread((unsigned)ctx->numThreadsStarted++);
     for (;;) {
 
         /* While the mutex is locked, wait for a non-empty queue or until shutdown */
@@ -95,6 +99,7 @@ FL2POOL_ctx* FL2POOL_create(size_t numThreads)
     ctx = calloc(1, sizeof(FL2POOL_ctx) + (numThreads - 1) * sizeof(FL2_pthread_t));
     if (!ctx) { return NULL; }
     /* Initialize the busy count and jobs range */
+    ctx->numThreadsStarted = 0;
     ctx->numThreadsBusy = 0;
     ctx->queueIndex = 0;
     ctx->queueEnd = 0;
@@ -15,6 +15,7 @@
 #include "mem.h"          /* U32, U64, MEM_64bits */
 #include "fl2_internal.h"
 #include "radix_internal.h"
+#include "../Alloc.h"       /* BigAlloc : large pages for the match table */
 
 #if defined(__GNUC__) && (__GNUC__ * 100 + __GNUC_MINOR__ >= 407)
 #  pragma GCC diagnostic ignored "-Wmaybe-uninitialized" /* warning: 'rpt_head_next' may be used uninitialized in this function */
@@ -217,7 +218,7 @@ FL2_matchTable* RMF_createMatchTable(const RMF_parameters* const p, size_t const
 
     size_t const table_bytes = is_struct ? ((dictionary_size + 3U) / 4U) * sizeof(RMF_unit)
         : dictionary_size * sizeof(U32);
-    FL2_matchTable* const tbl = malloc(sizeof(FL2_matchTable) + table_bytes - sizeof(U32));
+    FL2_matchTable* const tbl = BigAlloc(sizeof(FL2_matchTable) + table_bytes - sizeof(U32));
     if (tbl == NULL)
         return NULL;
 
@@ -245,7 +246,7 @@ void RMF_freeMatchTable(FL2_matchTable* const tbl)
     DEBUGLOG(3, "RMF_freeMatchTable");
 
     RMF_freeBuilderTable(tbl->builders, tbl->thread_count);
-    free(tbl);
+    BigFree(tbl);
 }
 
 BYTE RMF_compatibleParameters(const FL2_matchTable* const tbl, const RMF_parameters * const p, size_t const dict_reduce)
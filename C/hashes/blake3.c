@@ -565,6 +565,41 @@ void blake3_hasher_update(blake3_hasher *self, const void *input,
   }
 }
 
+// The following two functions allow the caller to hash the subtrees of one
+// input in several threads. blake3_compress_subtree_pair() doesn't change the
+// hasher, so it can be called for different subtrees at the same time. Then
+// the caller pushes the resulting CV pairs in input order with
+// blake3_hasher_push_subtree_pair(). The subtree must be a power-of-2 number
+// of chunks (more than 1 chunk), and the number of chunks hashed so far must
+// be a multiple of the subtree size, as in the main loop of
+// blake3_hasher_update().
+void blake3_compress_subtree_pair(const blake3_hasher *self, const void *input,
+                                  size_t input_len, uint64_t chunk_counter,
+                                  uint8_t out[2 * BLAKE3_OUT_LEN]) {
+#if defined(BLAKE3_TESTING)
+  assert(input_len > BLAKE3_CHUNK_LEN);
+  assert((input_len & (input_len - 1)) == 0);
+#endif
+  compress_subtree_to_parent_node((const uint8_t *)input, input_len, self->key,
+                                  chunk_counter, self->chunk.flags, out);
+}
+
+void blake3_hasher_push_subtree_pair(blake3_hasher *self,
+                                     const uint8_t cv_pair[2 * BLAKE3_OUT_LEN],
+                                     size_t input_len) {
+  uint64_t subtree_chunks = input_len / BLAKE3_CHUNK_LEN;
+#if defined(BLAKE3_TESTING)
+  assert(chunk_state_len(&self->chunk) == 0);
+  assert((self->chunk.chunk_counter & (subtree_chunks - 1)) == 0);
+#endif
+  uint8_t cv[BLAKE3_OUT_LEN];
+  memcpy(cv, cv_pair, BLAKE3_OUT_LEN);
+  hasher_push_cv(self, cv, self->chunk.chunk_counter);
+  memcpy(cv, &cv_pair[BLAKE3_OUT_LEN], BLAKE3_OUT_LEN);
+  hasher_push_cv(self, cv, self->chunk.chunk_counter + (subtree_chunks / 2));
+  self->chunk.chunk_counter += subtree_chunks;
+}
+
 void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out,
                             size_t out_len) {
   blake3_hasher_finalize_seek(self, 0, out, out_len);
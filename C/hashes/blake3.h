@@ -64,6 +64,12 @@ void blake3_hasher_init_derive_key_raw(blake3_hasher *self, const void *context,
                                        size_t context_len);
 void blake3_hasher_update(blake3_hasher *self, const void *input,
                           size_t input_len);
+void blake3_compress_subtree_pair(const blake3_hasher *self, const void *input,
+                                  size_t input_len, uint64_t chunk_counter,
+                                  uint8_t out[2 * BLAKE3_OUT_LEN]);
+void blake3_hasher_push_subtree_pair(blake3_hasher *self,
+                                     const uint8_t cv_pair[2 * BLAKE3_OUT_LEN],
+                                     size_t input_len);
 void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out,
                             size_t out_len);
 void blake3_hasher_finalize_seek(const blake3_hasher *self, uint64_t seek,
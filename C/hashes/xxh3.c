@@ -0,0 +1,120 @@
+/* xxh3.c -- XXH3 64-bit and 128-bit hash (streaming API)
+
+XXH3 code from zstd/xxhash.h is compiled here as static functions (XXH_INLINE_ALL),
+so it doesn't conflict with XXH32 / XXH64 functions in zstd/xxhash.c.
+
+The code for short inputs and the final mixing are same for all CPUs.
+The stripe loop of update function uses the fastest vector code:
+  x86/x64 : AVX2, if CPU and OS support it, and SSE2 (x64) or scalar code otherwise.
+  arm     : NEON, selected at compile time by xxhash.h.
+*/
+
+#include <stdlib.h>
+
+#include "../CpuArch.h"
+
+#ifdef MY_CPU_X86_OR_AMD64
+  #if defined(__clang__)
+    #if (__clang_major__ >= 4)
+      #define USE_XXH3_AVX2
+      #define ATTRIB_AVX2 __attribute__((__target__("avx2")))
+    #endif
+  #elif defined(__GNUC__)
+    #if (__GNUC__ >= 5)
+      #define USE_XXH3_AVX2
+      #ifndef __AVX2__
+        #define ATTRIB_AVX2 __attribute__((__target__("avx2")))
+      #endif
+    #endif
+  #elif defined(_MSC_VER)
+    #if (_MSC_VER >= 1900)
+      #define USE_XXH3_AVX2
+    #endif
+  #endif
+#endif
+
+#ifndef ATTRIB_AVX2
+  #define ATTRIB_AVX2
+#endif
+
+#ifdef USE_XXH3_AVX2
+  #include <immintrin.h>
+  #define XXH_DISPATCH_AVX2 1
+  #define XXH_TARGET_AVX2 ATTRIB_AVX2
+#endif
+
+#define XXH_ENABLE_XXH3
+#define XXH_INLINE_ALL
+#include "../zstd/xxhash.h"
+
+#include "xxh3.h"
+
+typedef XXH_errorcode (*XXH3_FUNC_UPDATE)(XXH3_state_t *state, const void *input, size_t len);
+
+struct xxh3_ctx
+{
+  XXH3_state_t *state;
+  XXH3_FUNC_UPDATE func_update;
+};
+
+#ifdef USE_XXH3_AVX2
+
+/* XXH3_update() is inlined here, so its stripe loop is compiled as AVX2 code */
+XXH_NO_INLINE ATTRIB_AVX2
+XXH_errorcode xxh3_update_avx2(XXH3_state_t *state, const void *input, size_t len)
+{
+  return XXH3_update(state, (const xxh_u8 *)input, len,
+      XXH3_accumulate_512_avx2, XXH3_scrambleAcc_avx2);
+}
+
+#endif
+
+xxh3_ctx *xxh3_create(void)
+{
+  xxh3_ctx *ctx = (xxh3_ctx *)malloc(sizeof(xxh3_ctx));
+  if (!ctx)
+    return NULL;
+  ctx->state = XXH3_createState();
+  if (!ctx->state)
+  {
+    free(ctx);
+    return NULL;
+  }
+  ctx->func_update = XXH3_64bits_update;
+  #ifdef USE_XXH3_AVX2
+  if (CPU_IsSupported_AVX2())
+    ctx->func_update = xxh3_update_avx2;
+  #endif
+  XXH3_64bits_reset(ctx->state);
+  return ctx;
+}
+
+void xxh3_free(xxh3_ctx *ctx)
+{
+  if (!ctx)
+    return;
+  XXH3_freeState(ctx->state);
+  free(ctx);
+}
+
+void xxh3_reset(xxh3_ctx *ctx)
+{
+  XXH3_64bits_reset(ctx->state);
+}
+
+void xxh3_update(xxh3_ctx *ctx, const void *data, size_t size)
+{
+  ctx->func_update(ctx->state, data, size);
+}
+
+uint64_t xxh3_digest64(const xxh3_ctx *ctx)
+{
+  return XXH3_64bits_digest(ctx->state);
+}
+
+void xxh3_digest128(const xxh3_ctx *ctx, unsigned char digest[XXH3_128_DIGEST_LENGTH])
+{
+  XXH128_canonical_t canon;
+  XXH128_canonicalFromHash(&canon, XXH3_128bits_digest(ctx->state));
+  memcpy(digest, canon.digest, XXH3_128_DIGEST_LENGTH);
+}
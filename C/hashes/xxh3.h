@@ -0,0 +1,35 @@
+/* xxh3.h -- XXH3 64-bit and 128-bit hash (streaming API) */
+
+#ifndef XXH3_WRAPPER_H
+#define XXH3_WRAPPER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XXH3_64_DIGEST_LENGTH   8
+#define XXH3_128_DIGEST_LENGTH 16
+
+typedef struct xxh3_ctx xxh3_ctx;
+
+/* xxh3_create() selects the fastest code of the stripe loop for current CPU.
+   It returns NULL, if there is no memory. */
+xxh3_ctx *xxh3_create(void);
+void xxh3_free(xxh3_ctx *ctx);
+
+/* the state is same for 64-bit and 128-bit hash */
+void xxh3_reset(xxh3_ctx *ctx);
+void xxh3_update(xxh3_ctx *ctx, const void *data, size_t size);
+
+uint64_t xxh3_digest64(const xxh3_ctx *ctx);
+/* the 128-bit digest is written in canonical (big-endian) form, as xxhsum prints it */
+void xxh3_digest128(const xxh3_ctx *ctx, unsigned char digest[XXH3_128_DIGEST_LENGTH]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,7 +13,9 @@
 */
 
 
-#ifndef XXH_NO_XXH3
+/* XXH3 is compiled only in C/hashes/xxh3.c, that defines XXH_ENABLE_XXH3.
+   XXH3Reg.cpp and XXH128Reg.cpp use it via C/hashes/xxh3.h */
+#if !defined(XXH_NO_XXH3) && !defined(XXH_ENABLE_XXH3)
 # define XXH_NO_XXH3
 #endif
 
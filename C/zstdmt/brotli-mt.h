@@ -103,6 +103,15 @@ typedef struct BROTLIMT_CCtx_s BROTLIMT_CCtx;
  */
 BROTLIMT_CCtx *BROTLIMT_createCCtx(int threads, int level, int inputsize);
 
+/**
+ * 1b) select the output format, before compression
+ *
+ * @stream - 0: each chunk is one brotli stream within a skippable frame
+ *         - 1: the chunks are compressed in parallel and concatenated to
+ *              one standard brotli stream, readable by any brotli decoder
+ */
+void BROTLIMT_setStreamModeCCtx(BROTLIMT_CCtx * ctx, int stream);
+
 /**
  * 2) threaded compression
  * - errorcheck via 
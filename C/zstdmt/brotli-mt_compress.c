@@ -58,6 +58,10 @@ struct BROTLIMT_CCtx_s {
 	/* should be used for read from input */
 	int inputsize;
 
+	/* output: skippable frames (0) or one standard brotli stream (1) */
+	int stream;
+	int eof;
+
 	/* statistic */
 	size_t insize;
 	size_t outsize;
@@ -114,6 +118,8 @@ BROTLIMT_CCtx *BROTLIMT_createCCtx(int threads, int level, int inputsize)
 	/* setup ctx */
 	ctx->level = level;
 	ctx->threads = threads;
+	ctx->stream = 0;
+	ctx->eof = 0;
 	ctx->insize = 0;
 	ctx->outsize = 0;
 	ctx->frames = 0;
@@ -144,6 +150,12 @@ BROTLIMT_CCtx *BROTLIMT_createCCtx(int threads, int level, int inputsize)
 	return 0;
 }
 
+void BROTLIMT_setStreamModeCCtx(BROTLIMT_CCtx * ctx, int stream)
+{
+	if (ctx)
+		ctx->stream = stream ? 1 : 0;
+}
+
 /**
  * mt_error - return mt lib specific error code
  */
@@ -193,6 +205,66 @@ static size_t pt_write(BROTLIMT_CCtx * ctx, struct writelist *wl)
 	return 0;
 }
 
+/**
+ * pt_compress_stream - compress one chunk of a standard brotli stream
+ *
+ * - only the first chunk gets the stream header, the others are started at
+ *   their offset within the stream, so their distances and static
+ *   dictionary references stay valid after concatenation
+ * - all chunks with input are flushed, so each one ends byte aligned
+ * - the final chunk has no input and just finishes the stream
+ */
+static int pt_compress_stream(BROTLIMT_CCtx * ctx, BROTLIMT_Buffer * in,
+			      size_t offset, BROTLIMT_Buffer * out)
+{
+	BrotliEncoderState *state;
+	BrotliEncoderOperation op;
+	const uint8_t *next_in = (const uint8_t *)in->buf;
+	uint8_t *next_out = (uint8_t *)out->buf;
+	size_t avail_in = in->size;
+	size_t avail_out = out->size;
+	int rv = BROTLI_FALSE;
+
+	state = BrotliEncoderCreateInstance(0, 0, 0);
+	if (!state)
+		return BROTLI_FALSE;
+
+	/* bigger offsets have the same effect as the window size */
+	if (offset > ((size_t)1 << 30))
+		offset = (size_t)1 << 30;
+
+	/* all chunks must use the same parameters, except the offset */
+	BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY,
+				  (uint32_t)ctx->level);
+	BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN,
+				  BROTLI_MAX_WINDOW_BITS);
+	BrotliEncoderSetParameter(state, BROTLI_PARAM_STREAM_OFFSET,
+				  (uint32_t)offset);
+	if (in->size)
+		BrotliEncoderSetParameter(state, BROTLI_PARAM_SIZE_HINT,
+					  (uint32_t)in->size);
+
+	op = in->size ? BROTLI_OPERATION_FLUSH : BROTLI_OPERATION_FINISH;
+	for (;;) {
+		if (!BrotliEncoderCompressStream(state, op, &avail_in, &next_in,
+						 &avail_out, &next_out, 0))
+			break;
+		if (op == BROTLI_OPERATION_FINISH ?
+		    BrotliEncoderIsFinished(state) :
+		    (avail_in == 0 && !BrotliEncoderHasMoreOutput(state))) {
+			out->size = (size_t)(next_out - (uint8_t *)out->buf);
+			rv = BROTLI_TRUE;
+			break;
+		}
+		/* output buffer is too small */
+		if (avail_out == 0)
+			break;
+	}
+
+	BrotliEncoderDestroyInstance(state);
+	return rv;
+}
+
 static void *pt_compress(void *arg)
 {
 	cwork_t *w = (cwork_t *) arg;
@@ -209,6 +281,7 @@ static void *pt_compress(void *arg)
 	for (;;) {
 		struct list_head *entry;
 		struct writelist *wl;
+		size_t offset;
 		int rv;
 
 		/* allocate space for new output */
@@ -248,8 +321,9 @@ static void *pt_compress(void *arg)
 			return (void *)mt_error(rv);
 		}
 
-		/* eof */
-		if (in.size == 0 && ctx->frames > 0) {
+		/* eof, a standard stream still needs its last (empty) chunk */
+		if (in.size == 0 && ctx->frames > 0
+		    && (!ctx->stream || ctx->eof)) {
 			free(in.buf);
 			pthread_mutex_unlock(&ctx->read_mutex);
 
@@ -259,10 +333,24 @@ static void *pt_compress(void *arg)
 
 			goto okay;
 		}
+		if (in.size == 0)
+			ctx->eof = 1;
+		offset = ctx->insize;
 		ctx->insize += in.size;
 		wl->frame = ctx->frames++;
 		pthread_mutex_unlock(&ctx->read_mutex);
 
+		/* one chunk of the standard stream, no skippable frame */
+		if (ctx->stream) {
+			if (!pt_compress_stream(ctx, &in, offset, &wl->out)) {
+				pthread_mutex_lock(&ctx->write_mutex);
+				list_move(&wl->node, &ctx->writelist_free);
+				pthread_mutex_unlock(&ctx->write_mutex);
+				return (void *)MT_ERROR(frame_compress);
+			}
+			goto do_write;
+		}
+
 		/* compress whole frame */
 		{
 			const uint8_t *ibuf = in.buf;
@@ -307,6 +395,7 @@ static void *pt_compress(void *arg)
 
 		wl->out.size += 16;
 
+ do_write:
 		/* write result */
 		pthread_mutex_lock(&ctx->write_mutex);
 		result = pt_write(ctx, wl);
@@ -327,6 +416,13 @@ size_t BROTLIMT_compressCCtx(BROTLIMT_CCtx * ctx, BROTLIMT_RdWr_t * rdwr)
 	if (!ctx)
 		return MT_ERROR(compressionParameter_unsupported);
 
+	/* the context can be used for more than one stream */
+	ctx->insize = 0;
+	ctx->outsize = 0;
+	ctx->frames = 0;
+	ctx->curframe = 0;
+	ctx->eof = 0;
+
 	/* init reading and writing functions */
 	ctx->fn_read = rdwr->fn_read;
 	ctx->fn_write = rdwr->fn_write;
@@ -343,6 +343,12 @@ size_t LZ4MT_compressCCtx(LZ4MT_CCtx * ctx, LZ4MT_RdWr_t * rdwr)
 	if (!ctx)
 		return ERROR(compressionParameter_unsupported);
 
+	/* the context can be used for more than one stream */
+	ctx->insize = 0;
+	ctx->outsize = 0;
+	ctx->frames = 0;
+	ctx->curframe = 0;
+
 	/* init reading and writing functions */
 	ctx->fn_read = rdwr->fn_read;
 	ctx->fn_write = rdwr->fn_write;
@@ -359,6 +359,10 @@ $O/Window2.o: ../../../Windows/Control/Window2.cpp
 	$(CXX) $(CXXFLAGS) $<
 
 
+$O/AsyncFileStreams.o: ../../Common/AsyncFileStreams.cpp
+	$(CXX) $(CXXFLAGS) $<
+$O/BlockCoderMt.o: ../../Common/BlockCoderMt.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/CreateCoder.o: ../../Common/CreateCoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/CWrappers.o: ../../Common/CWrappers.cpp
@@ -579,6 +583,8 @@ $O/TarHandler.o: ../../Archive/Tar/TarHandler.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/TarHandlerOut.o: ../../Archive/Tar/TarHandlerOut.cpp
 	$(CXX) $(CXXFLAGS) $<
+$O/TarCodecOut.o: ../../Archive/Tar/TarCodecOut.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/TarHeader.o: ../../Archive/Tar/TarHeader.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/TarIn.o: ../../Archive/Tar/TarIn.cpp
@@ -694,6 +700,8 @@ $O/LzOutWindow.o: ../../Compress/LzOutWindow.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/LzxDecoder.o: ../../Compress/LzxDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
+$O/LzxEncoder.o: ../../Compress/LzxEncoder.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/PpmdDecoder.o: ../../Compress/PpmdDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/PpmdEncoder.o: ../../Compress/PpmdEncoder.cpp
@@ -720,6 +728,8 @@ $O/ShrinkDecoder.o: ../../Compress/ShrinkDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/XpressDecoder.o: ../../Compress/XpressDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
+$O/XpressEncoder.o: ../../Compress/XpressEncoder.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/XzDecoder.o: ../../Compress/XzDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/XzEncoder.o: ../../Compress/XzEncoder.cpp
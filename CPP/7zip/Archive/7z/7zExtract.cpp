@@ -3,10 +3,18 @@
 #include "StdAfx.h"
 
 #include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
 
 #include "../../../Common/ComTry.h"
 
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamObjects.h"
+#include "../../Common/StreamUtils.h"
+
+#ifndef _7ZIP_ST
+#include "../../../Windows/Synchronization.h"
+#include "../../../Windows/Thread.h"
+#endif
 
 #include "7zDecode.h"
 #include "7zHandler.h"
@@ -214,6 +222,442 @@ HRESULT CFolderOutStream::FlushCorrupted(Int32 callbackOperationResult)
   return S_OK;
 }
 
+/* the items of one folder (solid block) that are processed by one Decode() call,
+   or one item without data (folderIndex == kNumNoIndex) */
+
+struct CFolderExtractInfo
+{
+  UInt32 ItemIndex;     // the index of first item in (indices) array
+  UInt32 NumItems;      // the number of items in (indices) array
+  UInt32 StartFile;     // the first file that will be processed by CFolderOutStream
+  CNum FolderIndex;
+  UInt64 UnpackSize;    // the size that must be unpacked from folder
+  UInt64 PackSize;
+  #ifndef _7ZIP_ST
+  UInt64 MtMemUsage;    // (0) means that folder is decoded in main thread
+  #endif
+};
+
+
+static HRESULT SetFolderResult(CFolderOutStream *folderOutStream,
+    IArchiveExtractCallbackMessage *callbackMessage, CNum folderIndex,
+    HRESULT result, bool dataAfterEnd_Error)
+{
+  if (result == S_FALSE || result == E_NOTIMPL || dataAfterEnd_Error)
+  {
+    bool wasFinished = folderOutStream->WasWritingFinished();
+    
+    int resOp = NExtract::NOperationResult::kDataError;
+    
+    if (result != S_FALSE)
+    {
+      if (result == E_NOTIMPL)
+        resOp = NExtract::NOperationResult::kUnsupportedMethod;
+      else if (wasFinished && dataAfterEnd_Error)
+        resOp = NExtract::NOperationResult::kDataAfterEnd;
+    }
+    
+    RINOK(folderOutStream->FlushCorrupted(resOp));
+    
+    if (wasFinished)
+    {
+      // we don't show error, if it's after required files
+      if (/* !folderOutStream->ExtraWriteWasCut && */ callbackMessage)
+      {
+        RINOK(callbackMessage->ReportExtractResult(NEventIndexType::kBlockIndex, folderIndex, resOp));
+      }
+    }
+    return S_OK;
+  }
+  
+  if (result != S_OK)
+    return result;
+  
+  return folderOutStream->FlushCorrupted(NExtract::NOperationResult::kDataError);
+}
+
+
+#ifndef _7ZIP_ST
+
+/*
+The folders of 7z archive are independent, so they can be decoded in parallel.
+CMtExtract decodes the folders in worker threads to memory buffers,
+and the main thread writes these buffers to CFolderOutStream in original order.
+So IArchiveExtractCallback is called only from main thread and in same order
+as in single-thread extraction.
+
+The folders that require too much memory (unpack size + dictionary)
+and encrypted folders are decoded in main thread directly to CFolderOutStream,
+while the worker threads continue to decode next folders.
+*/
+
+class CMtInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  IInStream *_stream;
+  NWindows::NSynchronization::CCriticalSection *_cs;
+  UInt64 _virtPos;
+public:
+  void Init(IInStream *stream, NWindows::NSynchronization::CCriticalSection *cs)
+  {
+    _stream = stream;
+    _cs = cs;
+    _virtPos = 0;
+  }
+
+  MY_UNKNOWN_IMP2(ISequentialInStream, IInStream)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+};
+
+STDMETHODIMP CMtInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  RINOK(_stream->Seek((Int64)_virtPos, STREAM_SEEK_SET, NULL));
+  UInt32 realProcessedSize = 0;
+  const HRESULT res = _stream->Read(data, size, &realProcessedSize);
+  _virtPos += realProcessedSize;
+  if (processedSize)
+    *processedSize = realProcessedSize;
+  return res;
+}
+
+STDMETHODIMP CMtInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _virtPos; break;
+    case STREAM_SEEK_END:
+    {
+      UInt64 size;
+      {
+        NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+        RINOK(_stream->Seek(0, STREAM_SEEK_END, &size));
+      }
+      offset += size;
+      break;
+    }
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _virtPos = (UInt64)offset;
+  if (newPosition)
+    *newPosition = (UInt64)offset;
+  return S_OK;
+}
+
+
+// the default window of zstd levels for big input (zstd/clevels.h)
+
+static unsigned GetZstdWindowLog(unsigned level)
+{
+  if (level == 0)
+    level = 3;
+  if (level >= 32) // fast levels are stored as (32 + fast)
+    return 19;
+  if (level <= 2)
+    return 18 + level;
+  if (level <= 8)
+    return 21;
+  if (level <= 16)
+    return 22;
+  if (level <= 19)
+    return 23;
+  if (level <= 22)
+    return level + 5;
+  return 27;
+}
+
+
+// it's approximate size of memory that is required for decoder of folder
+
+static UInt64 GetFolderDecoderMemUsage(const CFolderEx &folder)
+{
+  UInt64 size = 0;
+  FOR_VECTOR (i, folder.Coders)
+  {
+    const CCoderInfo &coder = folder.Coders[i];
+    const CByteBuffer &props = coder.Props;
+    UInt64 cur = (UInt64)1 << 22; // for internal buffers and unknown methods
+    if (coder.MethodID == k_LZMA || coder.MethodID == k_PPMD)
+    {
+      if (props.Size() == 5)
+        cur += GetUi32((const Byte *)props + 1);
+    }
+    else if (coder.MethodID == k_LZMA2)
+    {
+      if (props.Size() == 1)
+      {
+        const unsigned d = props[0];
+        if (d >= 40)
+          cur += (UInt32)0xFFFFFFFF;
+        else
+          cur += (UInt64)(2 | (d & 1)) << (d / 2 + 11);
+      }
+    }
+    else if (coder.MethodID == k_ZSTD)
+    {
+      /* the props contain only the level. The window that was changed by
+         encoder properties (-mlong, window size) is not stored there */
+      if (props.Size() >= 3)
+        cur += (UInt64)1 << GetZstdWindowLog(props[2]);
+    }
+    else if (coder.MethodID == k_BROTLI)
+    {
+      // the encoder uses the maximal window (BROTLI_MAX_WINDOW_BITS)
+      cur += (UInt32)1 << 24;
+    }
+    size += cur;
+  }
+  return size;
+}
+
+
+static const unsigned kMtSlotsPerThread = 2;
+
+struct CMtSlot
+{
+  CByteBuffer Buf;
+  size_t OutSize;
+  unsigned InfoIndex;
+  HRESULT Res;
+  bool DataAfterEnd_Error;
+  NWindows::NSynchronization::CAutoResetEvent Done;
+};
+
+class CMtExtract;
+
+struct CMtWorker
+{
+  CMtExtract *Owner;
+  CDecoder *Decoder;
+  NWindows::CThread Thread;
+
+  CMtWorker(): Decoder(NULL) {}
+  ~CMtWorker() { delete Decoder; }
+};
+
+class CMtExtract
+{
+  CObjectVector<CMtWorker> _workers;
+  NWindows::NSynchronization::CSemaphore _workSem;
+  NWindows::NSynchronization::CCriticalSection _cs;
+  unsigned _numCreated;
+  unsigned _nextDecode;  // protected by (_cs)
+  bool _exit;            // protected by (_cs)
+
+  unsigned _numSubmitted;
+  unsigned _numWritten;
+  UInt64 _memInProgress;
+
+public:
+  CObjectVector<CMtSlot> Slots;
+  NWindows::NSynchronization::CCriticalSection InStreamCS;
+  CMyComPtr<IInStream> InStream;
+  UInt64 StartPos;
+  const CDbEx *Db;
+  const CRecordVector<CFolderExtractInfo> *Infos;
+  UInt64 MemLimit;
+  DECL_EXTERNAL_CODECS_LOC_VARS2;
+
+  CMtExtract(): _numCreated(0), _nextDecode(0), _exit(false),
+      _numSubmitted(0), _numWritten(0), _memInProgress(0) {}
+  ~CMtExtract();
+
+  HRESULT Create(unsigned numThreads, bool useMixerMT);
+  void ThreadFunc(CMtWorker &w);
+
+  bool WasExit()
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    return _exit;
+  }
+  
+  /* it submits the next folders with (MtMemUsage != 0), starting from (infoIndex),
+     while there are free slots and memory */
+  HRESULT Submit(unsigned &infoIndex);
+  // it waits and returns the slot of next submitted folder
+  CMtSlot &WaitNext();
+  void ReleaseNext();
+};
+
+/* the worker threads don't report progress: the main thread reports it,
+   when it writes the folder. But the decoder of big folder must be stopped,
+   if extraction was cancelled, and (CMtExtract) is destroyed. */
+
+class CMtProgress:
+  public ICompressProgressInfo,
+  public CMyUnknownImp
+{
+public:
+  CMtExtract *Owner;
+
+  MY_UNKNOWN_IMP1(ICompressProgressInfo)
+  STDMETHOD(SetRatioInfo)(const UInt64 *inSize, const UInt64 *outSize);
+};
+
+STDMETHODIMP CMtProgress::SetRatioInfo(const UInt64 * /* inSize */, const UInt64 * /* outSize */)
+{
+  return Owner->WasExit() ? E_ABORT : S_OK;
+}
+
+static THREAD_FUNC_DECL MtExtractThread(void *p)
+{
+  CMtWorker *w = (CMtWorker *)p;
+  w->Owner->ThreadFunc(*w);
+  return 0;
+}
+
+CMtExtract::~CMtExtract()
+{
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    _exit = true;
+  }
+  if (_numCreated != 0)
+    _workSem.Release(_numCreated);
+  for (unsigned i = 0; i < _numCreated; i++)
+    _workers[i].Thread.Wait_Close();
+}
+
+HRESULT CMtExtract::Create(unsigned numThreads, bool useMixerMT)
+{
+  const unsigned numSlots = numThreads * kMtSlotsPerThread;
+  for (unsigned i = 0; i < numSlots; i++)
+  {
+    CMtSlot &s = Slots.AddNew();
+    const WRes wres = s.Done.CreateIfNotCreated_Reset();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  {
+    const WRes wres = _workSem.OptCreateInit(0, numSlots + numThreads);
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    CMtWorker &w = _workers.AddNew();
+    w.Owner = this;
+    w.Decoder = new CDecoder(useMixerMT);
+  }
+  for (; _numCreated < numThreads; _numCreated++)
+  {
+    const WRes wres = _workers[_numCreated].Thread.Create_Numa(MtExtractThread, &_workers[_numCreated], _numCreated);
+    if (wres != 0)
+      return _numCreated == 0 ? HRESULT_FROM_WIN32(wres) : S_OK;
+  }
+  return S_OK;
+}
+
+void CMtExtract::ThreadFunc(CMtWorker &w)
+{
+  CMtInStream *inStreamSpec = new CMtInStream;
+  CMyComPtr<IInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(InStream, &InStreamCS);
+  
+  CBufPtrSeqOutStream *outStreamSpec = new CBufPtrSeqOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  
+  CMtProgress *progressSpec = new CMtProgress;
+  CMyComPtr<ICompressProgressInfo> progress = progressSpec;
+  progressSpec->Owner = this;
+  
+  for (;;)
+  {
+    _workSem.Lock();
+    unsigned slotIndex;
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+      if (_exit)
+        return;
+      slotIndex = _nextDecode++ % Slots.Size();
+    }
+    CMtSlot &s = Slots[slotIndex];
+    const CFolderExtractInfo &fi = (*Infos)[s.InfoIndex];
+    outStreamSpec->Init(s.Buf, (size_t)fi.UnpackSize);
+    s.DataAfterEnd_Error = false;
+    
+    try
+    {
+      #ifndef _NO_CRYPTO
+      // encrypted folders are not decoded in worker threads
+      ICryptoGetTextPassword *getTextPassword = NULL;
+      bool isEncrypted = false;
+      bool passwordIsDefined = false;
+      UString_Wipe password;
+      #endif
+      
+      s.Res = w.Decoder->Decode(
+          EXTERNAL_CODECS_LOC_VARS
+          inStream,
+          StartPos,
+          *Db, fi.FolderIndex,
+          &fi.UnpackSize,
+          outStream,
+          progress,
+          NULL, // *inStreamMainRes
+          s.DataAfterEnd_Error
+          _7Z_DECODER_CRYPRO_VARS
+          , true, 1, fi.MtMemUsage
+          );
+    }
+    catch(...) { s.Res = E_FAIL; }
+    
+    s.OutSize = outStreamSpec->GetPos();
+    s.Done.Set();
+  }
+}
+
+HRESULT CMtExtract::Submit(unsigned &infoIndex)
+{
+  const CRecordVector<CFolderExtractInfo> &infos = *Infos;
+  while (infoIndex < infos.Size() && _numSubmitted - _numWritten != Slots.Size())
+  {
+    const CFolderExtractInfo &fi = infos[infoIndex];
+    if (fi.MtMemUsage == 0)
+    {
+      infoIndex++;
+      continue;
+    }
+    if (_memInProgress != 0 && _memInProgress + fi.MtMemUsage > MemLimit)
+      break;
+    CMtSlot &s = Slots[_numSubmitted % Slots.Size()];
+    s.Buf.Alloc((size_t)fi.UnpackSize);
+    s.InfoIndex = infoIndex;
+    _memInProgress += fi.MtMemUsage;
+    _numSubmitted++;
+    infoIndex++;
+    const WRes wres = _workSem.Release();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  return S_OK;
+}
+
+CMtSlot &CMtExtract::WaitNext()
+{
+  CMtSlot &s = Slots[_numWritten % Slots.Size()];
+  s.Done.Lock();
+  return s;
+}
+
+void CMtExtract::ReleaseNext()
+{
+  CMtSlot &s = Slots[_numWritten++ % Slots.Size()];
+  _memInProgress -= (*Infos)[s.InfoIndex].MtMemUsage;
+  s.Buf.Free();
+}
+
+#endif
+
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testModeSpec, IArchiveExtractCallback *extractCallbackSpec)
 {
@@ -236,24 +680,52 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   if (numItems == 0)
     return S_OK;
 
+  CRecordVector<CFolderExtractInfo> infos;
+
   {
-    CNum prevFolder = kNumNoIndex;
-    UInt32 nextFile = 0;
-    
-    UInt32 i;
-    
-    for (i = 0; i < numItems; i++)
+    for (UInt32 i = 0; i < numItems;)
     {
+      CFolderExtractInfo fi;
+      fi.ItemIndex = i;
+      fi.UnpackSize = 0;
+      fi.PackSize = 0;
+      #ifndef _7ZIP_ST
+      fi.MtMemUsage = 0;
+      #endif
+      
       UInt32 fileIndex = allFilesMode ? i : indices[i];
       CNum folderIndex = _db.FileIndexToFolderIndexMap[fileIndex];
-      if (folderIndex == kNumNoIndex)
-        continue;
-      if (folderIndex != prevFolder || fileIndex < nextFile)
-        nextFile = _db.FolderStartFileIndex[folderIndex];
-      for (CNum index = nextFile; index <= fileIndex; index++)
-        importantTotalUnpacked += _db.Files[index].Size;
-      nextFile = fileIndex + 1;
-      prevFolder = folderIndex;
+      
+      UInt32 numSolidFiles = 1;
+      
+      if (folderIndex != kNumNoIndex)
+      {
+        fi.PackSize = _db.GetFolderFullPackSize(folderIndex);
+        UInt32 nextFile = fileIndex + 1;
+        fileIndex = _db.FolderStartFileIndex[folderIndex];
+        UInt32 k;
+        
+        for (k = i + 1; k < numItems; k++)
+        {
+          UInt32 fileIndex2 = allFilesMode ? k : indices[k];
+          if (_db.FileIndexToFolderIndexMap[fileIndex2] != folderIndex
+              || fileIndex2 < nextFile)
+            break;
+          nextFile = fileIndex2 + 1;
+        }
+        
+        numSolidFiles = k - i;
+        
+        for (k = fileIndex; k < nextFile; k++)
+          fi.UnpackSize += _db.Files[k].Size;
+      }
+      
+      fi.StartFile = fileIndex;
+      fi.FolderIndex = folderIndex;
+      fi.NumItems = numSolidFiles;
+      infos.Add(fi);
+      importantTotalUnpacked += fi.UnpackSize;
+      i += numSolidFiles;
     }
   }
 
@@ -263,7 +735,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
-  CDecoder decoder(
+  const bool useMixerMT =
     #if !defined(USE_MIXER_MT)
       false
     #elif !defined(USE_MIXER_ST)
@@ -277,9 +749,9 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     #else
       _useMultiThreadMixer
     #endif
-    );
+    ;
 
-  UInt64 curPacked, curUnpacked;
+  CDecoder decoder(useMixerMT);
 
   CMyComPtr<IArchiveExtractCallbackMessage> callbackMessage;
   extractCallback.QueryInterface(IID_IArchiveExtractCallbackMessage, &callbackMessage);
@@ -292,132 +764,211 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   folderOutStream->TestMode = (testModeSpec != 0);
   folderOutStream->CheckCrc = (_crcSize != 0);
 
-  for (UInt32 i = 0;; lps->OutSize += curUnpacked, lps->InSize += curPacked)
-  {
-    RINOK(lps->SetCur());
-
-    if (i >= numItems)
-      break;
-
-    curUnpacked = 0;
-    curPacked = 0;
-
-    UInt32 fileIndex = allFilesMode ? i : indices[i];
-    CNum folderIndex = _db.FileIndexToFolderIndexMap[fileIndex];
+  CMyComPtr<IInStream> inStream = _inStream;
 
-    UInt32 numSolidFiles = 1;
-
-    if (folderIndex != kNumNoIndex)
+  #ifndef _7ZIP_ST
+  
+  CMtExtract mtExtract;
+  CMtExtract *mt = NULL;
+  unsigned mtSubmitIndex = 0;
+  // the memory for decoder of main thread, if the worker threads are used
+  UInt64 mainMemUsage = 0;
+  
+  if (_numThreads > 1)
+  {
+    /* we use parallel mode, if there are at least 2 folders that can be decoded in memory.
+       The folders that can't be decoded in memory are decoded in main thread,
+       while the worker threads decode next folders. So the decoder of main thread
+       (with its own threads) gets the memory of biggest such decoder,
+       and the worker threads use the remaining memory.
+       One folder can use up to half of remaining memory, so we can decode 2 folders in parallel.
+       If some folder doesn't fit, it's moved to main thread, and we check the folders again. */
+    const UInt64 memLimit = _memUsage_Decompress;
+    CRecordVector<UInt64> decoderMemUsages;
+    decoderMemUsages.ClearAndSetSize(infos.Size());
+    FOR_VECTOR (i, infos)
     {
-      curPacked = _db.GetFolderFullPackSize(folderIndex);
-      UInt32 nextFile = fileIndex + 1;
-      fileIndex = _db.FolderStartFileIndex[folderIndex];
-      UInt32 k;
-
-      for (k = i + 1; k < numItems; k++)
+      const CFolderExtractInfo &fi = infos[i];
+      UInt64 mem = 0;
+      if (fi.FolderIndex != kNumNoIndex)
       {
-        UInt32 fileIndex2 = allFilesMode ? k : indices[k];
-        if (_db.FileIndexToFolderIndexMap[fileIndex2] != folderIndex
-            || fileIndex2 < nextFile)
-          break;
-        nextFile = fileIndex2 + 1;
+        CFolderEx folder;
+        try
+        {
+          _db.ParseFolderEx(fi.FolderIndex, folder);
+          mem = GetFolderDecoderMemUsage(folder);
+        }
+        catch(...) {}
       }
-      
-      numSolidFiles = k - i;
-      
-      for (k = fileIndex; k < nextFile; k++)
-        curUnpacked += _db.Files[k].Size;
+      decoderMemUsages[i] = mem;
     }
 
+    unsigned numMtFolders;
+    for (;;)
     {
-      HRESULT result = folderOutStream->Init(fileIndex,
-          allFilesMode ? NULL : indices + i,
-          numSolidFiles);
-
-      i += numSolidFiles;
+      const UInt64 mtMemLimit = (mainMemUsage < memLimit ? memLimit - mainMemUsage : 0);
+      UInt64 mainMemUsage2 = mainMemUsage;
+      numMtFolders = 0;
+      FOR_VECTOR (i, infos)
+      {
+        CFolderExtractInfo &fi = infos[i];
+        fi.MtMemUsage = 0;
+        if (fi.FolderIndex == kNumNoIndex)
+          continue;
+        const UInt64 decoderMem = decoderMemUsages[i];
+        const UInt64 mem = fi.UnpackSize + decoderMem;
+        if (decoderMem == 0
+            || fi.UnpackSize == 0
+            || fi.UnpackSize != (size_t)fi.UnpackSize
+            || IsFolderEncrypted(fi.FolderIndex)
+            || mem > mtMemLimit / 2)
+        {
+          if (mainMemUsage2 < decoderMem)
+            mainMemUsage2 = decoderMem;
+          continue;
+        }
+        fi.MtMemUsage = mem;
+        numMtFolders++;
+      }
+      if (mainMemUsage2 == mainMemUsage)
+        break;
+      mainMemUsage = mainMemUsage2;
+    }
+    
+    if (numMtFolders >= 2)
+    {
+      UInt32 numThreads = _numThreads;
+      if (numThreads > numMtFolders)
+        numThreads = numMtFolders;
+      mt = &mtExtract;
+      mt->InStream = _inStream;
+      mt->StartPos = _db.ArcInfo.DataStartPosition;
+      mt->Db = &_db;
+      mt->Infos = &infos;
+      mt->MemLimit = memLimit - mainMemUsage;
+      #ifdef EXTERNAL_CODECS
+      mt->__externalCodecs = EXTERNAL_CODECS_VARS2;
+      #endif
+      const HRESULT res = mt->Create(numThreads, useMixerMT);
+      if (res != S_OK)
+      {
+        // we can extract in single-thread mode
+        mt = NULL;
+      }
+      else
+      {
+        // the folders in main thread and in worker threads share same input stream
+        CMtInStream *mtInStreamSpec = new CMtInStream;
+        inStream = mtInStreamSpec;
+        mtInStreamSpec->Init(_inStream, &mt->InStreamCS);
+      }
+    }
+    
+    if (!mt)
+    {
+      // all folders are decoded in main thread
+      FOR_VECTOR (k, infos)
+        infos[k].MtMemUsage = 0;
+      mainMemUsage = 0;
+    }
+  }
+  
+  #endif
 
+  FOR_VECTOR (infoIndex, infos)
+  {
+    const CFolderExtractInfo &fi = infos[infoIndex];
+    
+    #ifndef _7ZIP_ST
+    if (mt)
+    {
+      RINOK(mt->Submit(mtSubmitIndex));
+    }
+    #endif
+    
+    {
+      HRESULT result = folderOutStream->Init(fi.StartFile,
+          allFilesMode ? NULL : indices + fi.ItemIndex,
+          fi.NumItems);
       RINOK(result);
     }
 
-    // to test solid block with zero unpacked size we disable that code
-    if (folderOutStream->WasWritingFinished())
-      continue;
+    UInt64 curUnpacked = fi.UnpackSize;
 
-    #ifndef _NO_CRYPTO
-    CMyComPtr<ICryptoGetTextPassword> getTextPassword;
-    if (extractCallback)
-      extractCallback.QueryInterface(IID_ICryptoGetTextPassword, &getTextPassword);
+    #ifndef _7ZIP_ST
+    if (fi.MtMemUsage != 0)
+    {
+      CMtSlot &s = mt->WaitNext();
+      HRESULT result = s.Res;
+      // to test solid block with zero unpacked size we disable that code
+      if (!folderOutStream->WasWritingFinished() && s.OutSize != 0)
+      {
+        const HRESULT res2 = WriteStream(outStream, s.Buf, s.OutSize);
+        if (res2 != S_OK)
+          result = res2;
+      }
+      const bool dataAfterEnd_Error = s.DataAfterEnd_Error;
+      mt->ReleaseNext();
+      RINOK(SetFolderResult(folderOutStream, callbackMessage, fi.FolderIndex, result, dataAfterEnd_Error));
+      lps->OutSize += fi.UnpackSize;
+      lps->InSize += fi.PackSize;
+      RINOK(lps->SetCur());
+      continue;
+    }
     #endif
 
-    try
+    // to test solid block with zero unpacked size we disable that code
+    if (!folderOutStream->WasWritingFinished())
     {
       #ifndef _NO_CRYPTO
-        bool isEncrypted = false;
-        bool passwordIsDefined = false;
-        UString_Wipe password;
+      CMyComPtr<ICryptoGetTextPassword> getTextPassword;
+      if (extractCallback)
+        extractCallback.QueryInterface(IID_ICryptoGetTextPassword, &getTextPassword);
       #endif
 
-
-      bool dataAfterEnd_Error = false;
-
-      HRESULT result = decoder.Decode(
-          EXTERNAL_CODECS_VARS
-          _inStream,
-          _db.ArcInfo.DataStartPosition,
-          _db, folderIndex,
-          &curUnpacked,
-
-          outStream,
-          progress,
-          NULL // *inStreamMainRes
-          , dataAfterEnd_Error
+      try
+      {
+        #ifndef _NO_CRYPTO
+          bool isEncrypted = false;
+          bool passwordIsDefined = false;
+          UString_Wipe password;
+        #endif
+
+
+        bool dataAfterEnd_Error = false;
+
+        HRESULT result = decoder.Decode(
+            EXTERNAL_CODECS_VARS
+            inStream,
+            _db.ArcInfo.DataStartPosition,
+            _db, fi.FolderIndex,
+            &curUnpacked,
+
+            outStream,
+            progress,
+            NULL // *inStreamMainRes
+            , dataAfterEnd_Error
           
-          _7Z_DECODER_CRYPRO_VARS
-          #if !defined(_7ZIP_ST)
-            , true, _numThreads, _memUsage_Decompress
-          #endif
-          );
+            _7Z_DECODER_CRYPRO_VARS
+            #if !defined(_7ZIP_ST)
+              , true, _numThreads, mainMemUsage != 0 ? mainMemUsage : _memUsage_Decompress
+            #endif
+            );
 
-      if (result == S_FALSE || result == E_NOTIMPL || dataAfterEnd_Error)
+        RINOK(SetFolderResult(folderOutStream, callbackMessage, fi.FolderIndex, result, dataAfterEnd_Error));
+      }
+      catch(...)
       {
-        bool wasFinished = folderOutStream->WasWritingFinished();
-
-        int resOp = NExtract::NOperationResult::kDataError;
-        
-        if (result != S_FALSE)
-        {
-          if (result == E_NOTIMPL)
-            resOp = NExtract::NOperationResult::kUnsupportedMethod;
-          else if (wasFinished && dataAfterEnd_Error)
-            resOp = NExtract::NOperationResult::kDataAfterEnd;
-        }
-
-        RINOK(folderOutStream->FlushCorrupted(resOp));
-
-        if (wasFinished)
-        {
-          // we don't show error, if it's after required files
-          if (/* !folderOutStream->ExtraWriteWasCut && */ callbackMessage)
-          {
-            RINOK(callbackMessage->ReportExtractResult(NEventIndexType::kBlockIndex, folderIndex, resOp));
-          }
-        }
-        continue;
+        RINOK(folderOutStream->FlushCorrupted(NExtract::NOperationResult::kDataError));
+        // continue;
+        // return E_FAIL;
+        throw;
       }
-      
-      if (result != S_OK)
-        return result;
-
-      RINOK(folderOutStream->FlushCorrupted(NExtract::NOperationResult::kDataError));
-      continue;
-    }
-    catch(...)
-    {
-      RINOK(folderOutStream->FlushCorrupted(NExtract::NOperationResult::kDataError));
-      // continue;
-      // return E_FAIL;
-      throw;
     }
+
+    lps->OutSize += fi.UnpackSize;
+    lps->InSize += fi.PackSize;
+    RINOK(lps->SetCur());
   }
 
   return S_OK;
@@ -2,6 +2,10 @@
 
 #include "StdAfx.h"
 
+#ifndef _7ZIP_ST
+#include "../../../../C/Threads.h"
+#endif
+
 #include "../../../Common/StringToInt.h"
 
 #include "../Common/ParseProperties.h"
@@ -108,6 +112,18 @@ bool CCommonMethodProps::SetCommonProperty(const UString &name, const PROPVARIAN
     return true;
   }
 
+  if (name.IsEqualTo("numa"))
+  {
+    // the coder threads that are created later are bound to NUMA nodes
+    bool numa = false;
+    hres = PROPVARIANT_to_bool(value, numa);
+    #ifndef _7ZIP_ST
+    if (hres == S_OK && numa)
+      Numa_Enable();
+    #endif
+    return true;
+  }
+
   return false;
 }
 
@@ -6,9 +6,7 @@
 
 #include "../../Common/MyInitGuid.h"
 
-#if defined(_7ZIP_LARGE_PAGES)
 #include "../../../C/Alloc.h"
-#endif
 
 #include "../../Common/ComTry.h"
 
@@ -20,6 +18,8 @@
 
 #include "../Common/CreateCoder.h"
 
+#include "../Compress/CoderCtxCache.h"
+
 #include "IArchive.h"
 
 
@@ -109,10 +109,22 @@ STDAPI SetLargePageMode();
 STDAPI SetLargePageMode()
 {
   #if defined(_7ZIP_LARGE_PAGES)
-  #ifdef _WIN32
   SetLargePageSize();
   #endif
-  #endif
+  return S_OK;
+}
+
+STDAPI SetAllocLayer(const CAllocLayerHost *host);
+STDAPI SetAllocLayer(const CAllocLayerHost *host)
+{
+  return AllocLayer_SetHost(host) ? S_OK : E_FAIL;
+}
+
+// the host calls it before it unloads the module
+STDAPI FreeCtxCaches();
+STDAPI FreeCtxCaches()
+{
+  NCompress::FreeAllCtxCaches();
   return S_OK;
 }
 
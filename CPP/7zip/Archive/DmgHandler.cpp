@@ -11,6 +11,7 @@
 
 #include "../../Windows/PropVariant.h"
 
+#include "../Common/BlockCoderMt.h"
 #include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
@@ -1247,6 +1248,232 @@ STDMETHODIMP CAdcDecoder::Code(ISequentialInStream *inStream,
 
 
 
+// the state of one thread that unpacks chunks in memory
+
+struct CChunkDecoder
+{
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+
+  NCompress::NBZip2::CDecoder *Bzip2CoderSpec;
+  CMyComPtr<ICompressCoder> Bzip2Coder;
+
+  NCompress::NZlib::CDecoder *ZlibCoderSpec;
+  CMyComPtr<ICompressCoder> ZlibCoder;
+
+  CAdcDecoder *AdcCoderSpec;
+  CMyComPtr<ICompressCoder> AdcCoder;
+
+  NCompress::NLzfse::CDecoder *LzfseCoderSpec;
+  CMyComPtr<ICompressCoder> LzfseCoder;
+
+  CChunkDecoder()
+  {
+    InStreamSpec = new CBufInStream;
+    InStream = InStreamSpec;
+    OutStreamSpec = new CBufPtrSeqOutStream;
+    OutStream = OutStreamSpec;
+  }
+
+  HRESULT Decode(const CBlock &block, const Byte *packed, size_t packSize, Byte *dest, bool &dataError);
+};
+
+HRESULT CChunkDecoder::Decode(const CBlock &block, const Byte *packed, size_t packSize, Byte *dest, bool &dataError)
+{
+  dataError = false;
+  InStreamSpec->Init(packed, packSize);
+  OutStreamSpec->Init(dest, (size_t)block.UnpSize);
+  HRESULT res;
+  
+  switch (block.Type)
+  {
+    case METHOD_ADC:
+      if (!AdcCoder)
+      {
+        AdcCoderSpec = new CAdcDecoder();
+        AdcCoder = AdcCoderSpec;
+      }
+      return AdcCoder->Code(InStream, OutStream, &block.PackSize, &block.UnpSize, NULL);
+    
+    case METHOD_ZLIB:
+      if (!ZlibCoder)
+      {
+        ZlibCoderSpec = new NCompress::NZlib::CDecoder();
+        ZlibCoder = ZlibCoderSpec;
+      }
+      res = ZlibCoder->Code(InStream, OutStream, NULL, NULL, NULL);
+      if (res == S_OK && ZlibCoderSpec->GetInputProcessedSize() != block.PackSize)
+        dataError = true;
+      return res;
+
+    case METHOD_BZIP2:
+      if (!Bzip2Coder)
+      {
+        Bzip2CoderSpec = new NCompress::NBZip2::CDecoder();
+        Bzip2Coder = Bzip2CoderSpec;
+      }
+      res = Bzip2Coder->Code(InStream, OutStream, NULL, NULL, NULL);
+      if (res == S_OK && Bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
+        dataError = true;
+      return res;
+
+    case METHOD_LZFSE:
+      if (!LzfseCoder)
+      {
+        LzfseCoderSpec = new NCompress::NLzfse::CDecoder();
+        LzfseCoder = LzfseCoderSpec;
+      }
+      return LzfseCoder->Code(InStream, OutStream, &block.PackSize, &block.UnpSize, NULL);
+  }
+  return E_NOTIMPL;
+}
+
+
+static const size_t kMtMemoryMax = (size_t)1 << 26;
+static const unsigned kMtNumJobsMax = 32;
+
+static bool IsMtMethod(UInt32 type)
+{
+  return type == METHOD_ADC
+      || type == METHOD_ZLIB
+      || type == METHOD_BZIP2
+      || type == METHOD_LZFSE;
+}
+
+// chunk that was read from archive and unpacked by one of threads
+struct CChunkJob
+{
+  unsigned BlockIndex;
+  size_t PackSize;
+  size_t UnpSize;
+  HRESULT Res;
+  bool DataError;
+  CByteBuffer Packed;
+  CByteBuffer Unpacked;
+};
+
+/* CChunksDecoderMt unpacks the chunks of file that follow the current chunk
+   in parallel. The chunks are read and unpacked in groups, and the total size
+   of buffers of group is limited by (kMtMemoryMax).
+   Extract() writes the unpacked chunks in original order.
+   The progress is reported under (ProgressCS) from any thread, so the
+   group can be stopped after any chunk. */
+
+struct CChunksDecoderMt: public IBlockCoderCallback
+{
+  CBlockCoderMt DecoderMt;
+  CObjectVector<CChunkDecoder> Decoders;
+  CObjectVector<CChunkJob> Jobs;
+  const CRecordVector<CBlock> *Blocks;
+  unsigned NumJobs;
+  unsigned NextJob;
+
+  ICompressProgressInfo *Progress;
+  HRESULT ProgressRes;
+  UInt64 PackDone;
+  UInt64 UnpDone;
+  #ifndef _7ZIP_ST
+  NWindows::NSynchronization::CCriticalSection ProgressCS;
+  #endif
+
+  CChunksDecoderMt(): NumJobs(0), NextJob(0), Progress(NULL), ProgressRes(S_OK) {}
+  void Init(const CRecordVector<CBlock> &blocks)
+  {
+    Blocks = &blocks;
+    NumJobs = 0;
+    NextJob = 0;
+  }
+  bool IsUsed(const CBlock &block) const
+  {
+    // the sizes are from archive, so each size is checked before the sum
+    return DecoderMt.GetNumThreads() > 1
+        && IsMtMethod(block.Type)
+        && block.PackSize <= kMtMemoryMax
+        && block.UnpSize <= kMtMemoryMax
+        && block.PackSize + block.UnpSize <= kMtMemoryMax;
+  }
+  HRESULT ReadAndDecode(IInStream *stream, UInt64 startPos, unsigned blockIndex, ICompressProgressInfo *progress);
+  virtual void CodeBlock(unsigned threadIndex, unsigned jobIndex);
+};
+
+HRESULT CChunksDecoderMt::ReadAndDecode(IInStream *stream, UInt64 startPos, unsigned blockIndex, ICompressProgressInfo *progress)
+{
+  NumJobs = 0;
+  NextJob = 0;
+  size_t memSize = 0;
+  Progress = progress;
+  ProgressRes = S_OK;
+  PackDone = 0;
+  UnpDone = 0;
+  
+  for (; blockIndex < Blocks->Size(); blockIndex++)
+  {
+    const CBlock &block = (*Blocks)[blockIndex];
+    if (!block.ThereAreDataInBlock())
+      continue;
+    if (!IsUsed(block)
+        || NumJobs == kMtNumJobsMax
+        || (NumJobs != 0 && memSize + (size_t)(block.PackSize + block.UnpSize) > kMtMemoryMax))
+      break;
+    memSize += (size_t)(block.PackSize + block.UnpSize);
+    
+    if (Jobs.Size() == NumJobs)
+      Jobs.AddNew();
+    CChunkJob &job = Jobs[NumJobs++];
+    job.BlockIndex = blockIndex;
+    job.Packed.AllocAtLeast((size_t)block.PackSize);
+    job.Unpacked.AllocAtLeast((size_t)block.UnpSize);
+    
+    RINOK(stream->Seek(startPos + block.PackPos, STREAM_SEEK_SET, NULL));
+    // the decoder will report the error, if the chunk is truncated
+    job.PackSize = (size_t)block.PackSize;
+    RINOK(ReadStream(stream, job.Packed, &job.PackSize));
+    PackDone += job.PackSize;
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&PackDone, &UnpDone));
+    }
+  }
+
+  while (Decoders.Size() < DecoderMt.GetNumThreads())
+    Decoders.AddNew();
+  RINOK(DecoderMt.Code(this, NumJobs));
+  return ProgressRes;
+}
+
+void CChunksDecoderMt::CodeBlock(unsigned threadIndex, unsigned jobIndex)
+{
+  CChunkJob &job = Jobs[jobIndex];
+  {
+    #ifndef _7ZIP_ST
+    NWindows::NSynchronization::CCriticalSectionLock lock(ProgressCS);
+    #endif
+    // the group was stopped by the progress (E_ABORT)
+    if (ProgressRes != S_OK)
+    {
+      job.Res = ProgressRes;
+      job.UnpSize = 0;
+      return;
+    }
+  }
+  CChunkDecoder &decoder = Decoders[threadIndex];
+  job.Res = decoder.Decode((*Blocks)[job.BlockIndex], job.Packed, job.PackSize, job.Unpacked, job.DataError);
+  job.UnpSize = decoder.OutStreamSpec->GetPos();
+  if (Progress)
+  {
+    #ifndef _7ZIP_ST
+    NWindows::NSynchronization::CCriticalSectionLock lock(ProgressCS);
+    #endif
+    UnpDone += job.UnpSize;
+    if (ProgressRes == S_OK)
+      ProgressRes = Progress->SetRatioInfo(&PackDone, &UnpDone);
+  }
+}
+
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -1303,6 +1530,9 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ISequentialInStream> inStream(streamSpec);
   streamSpec->SetStream(_inStream);
 
+  CChunksDecoderMt mt;
+  mt.DecoderMt.SetNumThreads_Default();
+
   for (i = 0; i < numItems; i++, currentPackTotal += currentPackSize, currentUnpTotal += currentUnpSize)
   {
     lps->InSize = currentPackTotal;
@@ -1354,6 +1584,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
       UInt64 unpPos = 0;
       UInt64 packPos = 0;
+      mt.Init(item.Blocks);
       {
         FOR_VECTOR (j, item.Blocks)
         {
@@ -1372,66 +1603,87 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
             break;
           }
 
-          RINOK(_inStream->Seek(_startPos + _dataStartOffset + item.StartPos + block.PackPos, STREAM_SEEK_SET, NULL));
-          streamSpec->Init(block.PackSize);
           bool realMethod = true;
           outStreamSpec->Init(block.UnpSize);
           HRESULT res = S_OK;
 
           outCrcStreamSpec->EnableCalc(needCrc);
 
-          switch (block.Type)
+          if (mt.IsUsed(block))
           {
-            case METHOD_ZERO_0:
-            case METHOD_ZERO_2:
-              realMethod = false;
-              if (block.PackSize != 0)
-                opRes = NExtract::NOperationResult::kUnsupportedMethod;
-              outCrcStreamSpec->EnableCalc(block.Type == METHOD_ZERO_0);
-              break;
-
-            case METHOD_COPY:
-              if (block.UnpSize != block.PackSize)
-              {
-                opRes = NExtract::NOperationResult::kUnsupportedMethod;
-                break;
-              }
-              res = copyCoder->Code(inStream, outStream, NULL, NULL, progress);
-              break;
-            
-            case METHOD_ADC:
+            if (mt.NextJob == mt.NumJobs)
             {
-              res = adcCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
-              break;
+              RINOK(mt.ReadAndDecode(_inStream, _startPos + _dataStartOffset + item.StartPos, j, progress));
             }
-            
-            case METHOD_ZLIB:
+            const CChunkJob &job = mt.Jobs[mt.NextJob++];
+            if (job.BlockIndex != j)
+              return E_FAIL;
+            res = job.Res;
+            if (res == S_OK && job.DataError)
+              opRes = NExtract::NOperationResult::kDataError;
+            if (res == S_OK || res == S_FALSE)
             {
-              res = zlibCoder->Code(inStream, outStream, NULL, NULL, progress);
-              if (res == S_OK)
-                if (zlibCoderSpec->GetInputProcessedSize() != block.PackSize)
-                  opRes = NExtract::NOperationResult::kDataError;
-              break;
+              RINOK(WriteStream(outStream, job.Unpacked, job.UnpSize));
             }
+          }
+          else
+          {
+            RINOK(_inStream->Seek(_startPos + _dataStartOffset + item.StartPos + block.PackPos, STREAM_SEEK_SET, NULL));
+            streamSpec->Init(block.PackSize);
 
-            case METHOD_BZIP2:
+            switch (block.Type)
             {
-              res = bzip2Coder->Code(inStream, outStream, NULL, NULL, progress);
-              if (res == S_OK)
-                if (bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
-                  opRes = NExtract::NOperationResult::kDataError;
-              break;
-            }
+              case METHOD_ZERO_0:
+              case METHOD_ZERO_2:
+                realMethod = false;
+                if (block.PackSize != 0)
+                  opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                outCrcStreamSpec->EnableCalc(block.Type == METHOD_ZERO_0);
+                break;
 
-            case METHOD_LZFSE:
-            {
-              res = lzfseCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
-              break;
+              case METHOD_COPY:
+                if (block.UnpSize != block.PackSize)
+                {
+                  opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                  break;
+                }
+                res = copyCoder->Code(inStream, outStream, NULL, NULL, progress);
+                break;
+              
+              case METHOD_ADC:
+              {
+                res = adcCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
+                break;
+              }
+              
+              case METHOD_ZLIB:
+              {
+                res = zlibCoder->Code(inStream, outStream, NULL, NULL, progress);
+                if (res == S_OK)
+                  if (zlibCoderSpec->GetInputProcessedSize() != block.PackSize)
+                    opRes = NExtract::NOperationResult::kDataError;
+                break;
+              }
+
+              case METHOD_BZIP2:
+              {
+                res = bzip2Coder->Code(inStream, outStream, NULL, NULL, progress);
+                if (res == S_OK)
+                  if (bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
+                    opRes = NExtract::NOperationResult::kDataError;
+                break;
+              }
+
+              case METHOD_LZFSE:
+              {
+                res = lzfseCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
+                break;
+              }
+              
+              default:
+                opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                break;
             }
-            
-            default:
-              opRes = NExtract::NOperationResult::kUnsupportedMethod;
-              break;
           }
 
           if (res != S_OK)
@@ -1473,22 +1725,19 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   COM_TRY_END
 }
 
-struct CChunk
-{
-  int BlockIndex;
-  UInt64 AccessMark;
-  CByteBuffer Buf;
-};
+static const size_t kChunkCacheSize = (size_t)1 << 26;
 
 class CInStream:
   public IInStream,
   public CMyUnknownImp
 {
   UInt64 _virtPos;
-  int _latestChunk;
   int _latestBlock;
-  UInt64 _accessMark;
-  CObjectVector<CChunk> _chunks;
+  const Byte *_latestChunk;
+  // unpacked chunks, the key is the index of block
+  CBlockCache _chunks;
+
+  HRESULT AllocChunks();
 
   NCompress::NBZip2::CDecoder *bzip2CoderSpec;
   CMyComPtr<ICompressCoder> bzip2Coder;
@@ -1518,9 +1767,9 @@ public:
   {
     _startPos = startPos;
     _virtPos = 0;
-    _latestChunk = -1;
+    _latestChunk = NULL;
     _latestBlock = -1;
-    _accessMark = 0;
+    _chunks.Free();
 
     limitedStreamSpec = new CLimitedSequentialInStream;
     inStream = limitedStreamSpec;
@@ -1553,6 +1802,33 @@ static unsigned FindBlock(const CRecordVector<CBlock> &blocks, UInt64 pos)
   }
 }
 
+HRESULT CInStream::AllocChunks()
+{
+  // all slots have the size of largest compressed chunk
+  UInt64 maxSize = 0;
+  unsigned numChunks = 0;
+  FOR_VECTOR (i, File->Blocks)
+  {
+    const CBlock &block = File->Blocks[i];
+    if (block.IsZeroMethod() || block.Type == METHOD_COPY || !block.ThereAreDataInBlock())
+      continue;
+    numChunks++;
+    if (maxSize < block.UnpSize)
+      maxSize = block.UnpSize;
+  }
+  if (maxSize > ((UInt32)1 << 31))
+    return E_FAIL;
+  if (maxSize == 0)
+    maxSize = 1;
+  size_t cacheSize = kChunkCacheSize;
+  if (cacheSize / (size_t)maxSize > numChunks)
+    cacheSize = (size_t)maxSize * numChunks;
+  if (!_chunks.Alloc((size_t)maxSize, cacheSize, 2))
+    return E_OUTOFMEMORY;
+  return S_OK;
+}
+
+
 STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   COM_TRY_BEGIN
@@ -1578,47 +1854,27 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
   
   if (_latestBlock < 0)
   {
-    _latestChunk = -1;
+    _latestChunk = NULL;
     unsigned blockIndex = FindBlock(File->Blocks, _virtPos);
     const CBlock &block = File->Blocks[blockIndex];
     
     if (!block.IsZeroMethod() && block.Type != METHOD_COPY)
     {
-      unsigned i;
-      for (i = 0; i < _chunks.Size(); i++)
-        if (_chunks[i].BlockIndex == (int)blockIndex)
-          break;
-      
-      if (i != _chunks.Size())
-        _latestChunk = i;
-      else
+      if (!_chunks.IsAllocated())
       {
-        const unsigned kNumChunksMax = 128;
-        unsigned chunkIndex;
+        RINOK(AllocChunks());
+      }
+      size_t chunkSize;
+      _latestChunk = _chunks.Find(blockIndex, chunkSize);
       
-        if (_chunks.Size() != kNumChunksMax)
-          chunkIndex = _chunks.Add(CChunk());
-        else
-        {
-          chunkIndex = 0;
-          for (i = 0; i < _chunks.Size(); i++)
-            if (_chunks[i].AccessMark < _chunks[chunkIndex].AccessMark)
-              chunkIndex = i;
-        }
-        
-        CChunk &chunk = _chunks[chunkIndex];
-        chunk.BlockIndex = -1;
-        chunk.AccessMark = 0;
-        
-        if (chunk.Buf.Size() < block.UnpSize)
-        {
-          chunk.Buf.Free();
-          if (block.UnpSize > ((UInt32)1 << 31))
-            return E_FAIL;
-          chunk.Buf.Alloc((size_t)block.UnpSize);
-        }
+      if (!_latestChunk)
+      {
+        if (block.UnpSize > _chunks.GetBlockSize())
+          return E_FAIL;
+        const UInt32 slot = _chunks.Reserve();
+        Byte *buf = _chunks.GetSlotData(slot);
         
-        outStreamSpec->Init(chunk.Buf, (size_t)block.UnpSize);
+        outStreamSpec->Init(buf, (size_t)block.UnpSize);
           
         RINOK(Stream->Seek(_startPos + File->StartPos + block.PackPos, STREAM_SEEK_SET, NULL));
 
@@ -1630,7 +1886,7 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
           case METHOD_COPY:
             if (block.PackSize != block.UnpSize)
               return E_FAIL;
-            res = ReadStream_FAIL(inStream, chunk.Buf, (size_t)block.UnpSize);
+            res = ReadStream_FAIL(inStream, buf, (size_t)block.UnpSize);
             break;
             
           case METHOD_ADC:
@@ -1681,11 +1937,9 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
           return res;
         if (block.Type != METHOD_COPY && outStreamSpec->GetPos() != block.UnpSize)
           return E_FAIL;
-        chunk.BlockIndex = blockIndex;
-        _latestChunk = chunkIndex;
+        _chunks.Commit(slot, blockIndex, (size_t)block.UnpSize);
+        _latestChunk = buf;
       }
-      
-      _chunks[_latestChunk].AccessMark = _accessMark++;
     }
   
     _latestBlock = blockIndex;
@@ -1707,7 +1961,7 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
   else if (block.IsZeroMethod())
     memset(data, 0, size);
   else if (size != 0)
-    memcpy(data, _chunks[_latestChunk].Buf + (size_t)offset, size);
+    memcpy(data, _latestChunk + (size_t)offset, size);
   
   _virtPos += size;
   if (processedSize)
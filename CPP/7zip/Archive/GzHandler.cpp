@@ -4,18 +4,27 @@
 
 // #include  <stdio.h>
 
+#include "../../../C/7zCrc.h"
 #include "../../../C/CpuArch.h"
 
 #include "../../Common/ComTry.h"
 #include "../../Common/Defs.h"
+#include "../../Common/MyBuffer.h"
 #include "../../Common/StringConvert.h"
 
+#include "../../Windows/FileIO.h"
 #include "../../Windows/PropVariant.h"
 #include "../../Windows/PropVariantUtils.h"
 #include "../../Windows/TimeUtils.h"
 
+#ifndef _7ZIP_ST
+#include "../../Windows/Synchronization.h"
+#include "../../Windows/Thread.h"
+#endif
+
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
+#include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
 
 #include "../Compress/CopyCoder.h"
@@ -27,6 +36,7 @@
 #include "Common/OutStreamWithCRC.h"
 
 #define Get32(p) GetUi32(p)
+#define Get64(p) GetUi64(p)
 
 using namespace NWindows;
 
@@ -447,9 +457,106 @@ HRESULT CItem::WriteFooter(ISequentialOutStream *stream)
   return WriteStream(stream, buf, 8);
 }
 
+/*
+The index of access points allows random access (GetStream()) and
+multithreaded extraction.
+Access point is the start of member (after its header) or the start of
+deflate block with the window (the last 32 KB of data) that precedes it.
+The last item of index is the end of archive.
+
+Extract() creates the index only, if (-mcidx=path) property is set.
+It's written to that file after a successful pass over the whole archive.
+Open() reads the index from (-midx=path) file, or from "name.gz.gzidx" file,
+if the property is not set. Open() doesn't read the index, if (-mcidx) is set.
+
+Index file:
+  Byte   Signature[8]
+  UInt64 PackSize    - the size of archive
+  UInt32 Crc         - the footer of last member
+  UInt32 Size32
+  UInt32 NumPoints
+  {
+    UInt64 InBitPos
+    UInt64 OutPos
+    UInt32 WindowSize  - (1 << 31) is flag of member start
+    Byte   Window[WindowSize]
+  } [NumPoints]
+  UInt32 Crc of all previous bytes
+*/
+
+static const Byte kIndexSignature[8] = { '7', 'z', 'G', 'z', 'I', 'd', 'x', 1 };
+static const unsigned kIndexHeaderSize = 8 + 8 + 4 + 4 + 4;
+static const unsigned kIndexPointSize = 8 + 8 + 4;
+static const UInt32 kIndexFlag_MemberStart = (UInt32)1 << 31;
+static const UInt32 kIndexFileSizeMax = (UInt32)1 << 30;
+static const UInt32 kIndexSpan = (UInt32)1 << 22;
+static const UInt32 kSegmentSizeMax = (UInt32)1 << 30;
+static const char * const kIndexExtension = ".gzidx";
+
+struct CAccessPoint
+{
+  UInt64 InBitPos;
+  UInt64 OutPos;
+  bool MemberStart;
+  CByteBuffer Window;
+};
+
+class CIndexBuilder: public NDecoder::IAccessPointCallback
+{
+  UInt64 _memberOutPos;
+public:
+  CObjectVector<CAccessPoint> Points;
+
+  CIndexBuilder(): _memberOutPos(0) {}
+
+  void AddPoint(UInt64 inBitPos, UInt64 outPos, bool memberStart)
+  {
+    CAccessPoint &p = Points.AddNew();
+    p.InBitPos = inBitPos;
+    p.OutPos = outPos;
+    p.MemberStart = memberStart;
+    if (memberStart)
+      _memberOutPos = outPos;
+  }
+
+  virtual HRESULT AddAccessPoint(UInt64 inBitPos, UInt64 outPos, const Byte *window, UInt32 windowSize)
+  {
+    AddPoint(inBitPos, _memberOutPos + outPos, false);
+    Points.Back().Window.CopyFrom(window, windowSize);
+    return S_OK;
+  }
+};
+
+#ifndef _7ZIP_ST
+
+/* the data between two access points, decoded by worker thread */
+struct CMtSegment
+{
+  CByteBuffer Pack;
+  size_t PackSize;
+  CByteBuffer Out;
+  unsigned Index;
+  CItem Footer;
+  HRESULT Res;
+  NSynchronization::CAutoResetEvent Done;
+};
+
+class CHandler;
+
+struct CMtWorker
+{
+  CHandler *Handler;
+  NDecoder::CCOMCoder *DecoderSpec;
+  CMyComPtr<ICompressCoder> Decoder;
+  NWindows::CThread Thread;
+};
+
+#endif
+
 class CHandler:
   public IInArchive,
   public IArchiveOpenSeq,
+  public IInArchiveGetStream,
   public IOutArchive,
   public ISetProperties,
   public CMyUnknownImp
@@ -477,15 +584,39 @@ class CHandler:
   CSingleMethodProps _props;
   CHandlerTimeOptions _timeOptions;
 
+  UString _indexPath;
+  UString _createIndexPath;
+  CIndexBuilder _indexBuilder;
+  // (number of access points + 1) items
+  CObjectVector<CAccessPoint> _points;
+  UInt32 _maxSegmentSize;
+
+  bool ParseIndex(const Byte *p, size_t size);
+  HRESULT ReadIndex(IArchiveOpenCallback *callback);
+  HRESULT WriteIndex() const;
+
+  #ifndef _7ZIP_ST
+  CObjectVector<CMtWorker> _mtWorkers;
+  CObjectVector<CMtSegment> _mtSegments;
+  NSynchronization::CSemaphore _mtWorkSem;
+  NSynchronization::CCriticalSection _mtCs;
+  unsigned _mtNextDecode;
+  bool _mtExit;
+
+  HRESULT ExtractMt(COutStreamWithCRC *outStreamSpec, CLocalProgress *lps, bool &crcError);
+  #endif
+
 public:
-  MY_UNKNOWN_IMP4(
+  MY_UNKNOWN_IMP5(
       IInArchive,
       IArchiveOpenSeq,
+      IInArchiveGetStream,
       IOutArchive,
       ISetProperties)
   INTERFACE_IInArchive(;)
   INTERFACE_IOutArchive(;)
   STDMETHOD(OpenSeq)(ISequentialInStream *stream);
+  STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
   CHandler():
@@ -500,6 +631,13 @@ public:
     _decoderSpec = new NDecoder::CCOMCoder;
     _decoder = _decoderSpec;
   }
+
+  const CObjectVector<CAccessPoint> &Points() const { return _points; }
+  HRESULT ReadSegmentPack(unsigned index, CByteBuffer &buf, size_t &size);
+  
+  #ifndef _7ZIP_ST
+  void WorkerThread(CMtWorker &w);
+  #endif
 };
 
 static const Byte kProps[] =
@@ -631,7 +769,7 @@ STDMETHODIMP CCompressProgressInfoImp::SetRatioInfo(const UInt64 *inSize, const
 /*
 */
 
-STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallback *)
+STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallback *callback)
 {
   COM_TRY_BEGIN
   RINOK(OpenSeq(stream));
@@ -643,6 +781,21 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
   _stream = stream;
   _isArc = true;
   _needSeekToStart = true;
+
+  if (_createIndexPath.IsEmpty() && ReadIndex(callback) == S_OK)
+  {
+    _packSize_Defined = true;
+    _unpackSize = _points.Back().OutPos;
+    _unpackSize_Defined = true;
+    _numStreams = 0;
+    FOR_VECTOR (i, _points)
+      if (_points[i].MemberStart)
+        _numStreams++;
+    _numStreams--;
+    _numStreams_Defined = true;
+  }
+  else
+    _points.Clear();
   return S_OK;
   COM_TRY_END
 }
@@ -681,12 +834,522 @@ STDMETHODIMP CHandler::Close()
   _packSize = 0;
   _headerSize = 0;
   
+  _points.Clear();
+  _maxSegmentSize = 0;
+
   _stream.Release();
   if (_decoder)
     _decoderSpec->ReleaseInStream();
   return S_OK;
 }
 
+
+bool CHandler::ParseIndex(const Byte *p, size_t size)
+{
+  _points.Clear();
+  _maxSegmentSize = 0;
+
+  if (size < kIndexHeaderSize + 4
+      || memcmp(p, kIndexSignature, sizeof(kIndexSignature)) != 0)
+    return false;
+  size -= 4;
+  if (CrcCalc(p, size) != Get32(p + size))
+    return false;
+  
+  // the index must be created for this archive
+  if (Get64(p + 8) != _packSize
+      || Get32(p + 16) != _item.Crc
+      || Get32(p + 20) != _item.Size32)
+    return false;
+  
+  const UInt32 numPoints = Get32(p + 24);
+  size_t pos = kIndexHeaderSize;
+  if (numPoints < 2 || numPoints > (size - pos) / kIndexPointSize)
+    return false;
+
+  UInt64 memberOutPos = 0;
+
+  for (UInt32 i = 0; i < numPoints; i++)
+  {
+    if (size - pos < kIndexPointSize)
+      return false;
+    CAccessPoint &ap = _points.AddNew();
+    ap.InBitPos = Get64(p + pos);
+    ap.OutPos = Get64(p + pos + 8);
+    const UInt32 v = Get32(p + pos + 16);
+    pos += kIndexPointSize;
+    ap.MemberStart = ((v & kIndexFlag_MemberStart) != 0);
+    const UInt32 windowSize = v & ~kIndexFlag_MemberStart;
+
+    if (i == 0)
+    {
+      if (!ap.MemberStart || ap.OutPos != 0)
+        return false;
+    }
+    else
+    {
+      const CAccessPoint &prev = _points[i - 1];
+      if (ap.InBitPos <= prev.InBitPos || ap.OutPos < prev.OutPos)
+        return false;
+      const UInt64 segSize = ap.OutPos - prev.OutPos;
+      const UInt64 packSize = ((ap.InBitPos + 7) >> 3) - (prev.InBitPos >> 3);
+      if (segSize > kSegmentSizeMax || packSize > kSegmentSizeMax)
+        return false;
+      if (_maxSegmentSize < segSize)
+        _maxSegmentSize = (UInt32)segSize;
+    }
+    
+    if (ap.MemberStart)
+      memberOutPos = ap.OutPos;
+    if (windowSize > kHistorySize32
+        || windowSize > ap.OutPos - memberOutPos
+        || windowSize > size - pos)
+      return false;
+    ap.Window.CopyFrom(p + pos, windowSize);
+    pos += windowSize;
+  }
+
+  const CAccessPoint &last = _points.Back();
+  return pos == size
+      && last.MemberStart
+      && last.InBitPos == _packSize * 8;
+}
+
+
+HRESULT CHandler::ReadIndex(IArchiveOpenCallback *callback)
+{
+  CByteBuffer buf;
+
+  if (!_indexPath.IsEmpty())
+  {
+    NFile::NIO::CInFile file;
+    if (!file.Open(us2fs(_indexPath)))
+      return S_FALSE;
+    UInt64 size;
+    if (!file.GetLength(size) || size > kIndexFileSizeMax)
+      return S_FALSE;
+    buf.Alloc((size_t)size);
+    size_t processed;
+    if (!file.ReadFull(buf, (size_t)size, processed) || processed != size)
+      return S_FALSE;
+  }
+  else
+  {
+    if (!callback)
+      return S_FALSE;
+    CMyComPtr<IArchiveOpenVolumeCallback> volumeCallback;
+    callback->QueryInterface(IID_IArchiveOpenVolumeCallback, (void **)&volumeCallback);
+    if (!volumeCallback)
+      return S_FALSE;
+    UString name;
+    {
+      NCOM::CPropVariant prop;
+      RINOK(volumeCallback->GetProperty(kpidName, &prop));
+      if (prop.vt != VT_BSTR)
+        return S_FALSE;
+      name = prop.bstrVal;
+    }
+    name += kIndexExtension;
+    CMyComPtr<IInStream> stream;
+    RINOK(volumeCallback->GetStream(name, &stream));
+    if (!stream)
+      return S_FALSE;
+    UInt64 size;
+    RINOK(stream->Seek(0, STREAM_SEEK_END, &size));
+    if (size > kIndexFileSizeMax)
+      return S_FALSE;
+    RINOK(stream->Seek(0, STREAM_SEEK_SET, NULL));
+    buf.Alloc((size_t)size);
+    RINOK(ReadStream_FALSE(stream, buf, (size_t)size));
+  }
+
+  return ParseIndex(buf, buf.Size()) ? S_OK : S_FALSE;
+}
+
+
+HRESULT CHandler::WriteIndex() const
+{
+  size_t size = kIndexHeaderSize + 4;
+  FOR_VECTOR (i, _points)
+    size += kIndexPointSize + _points[i].Window.Size();
+  
+  CByteBuffer buf(size);
+  Byte *p = buf;
+  memcpy(p, kIndexSignature, sizeof(kIndexSignature));
+  SetUi64(p + 8, _packSize);
+  SetUi32(p + 16, _item.Crc);
+  SetUi32(p + 20, _item.Size32);
+  SetUi32(p + 24, _points.Size());
+  size_t pos = kIndexHeaderSize;
+  FOR_VECTOR (i, _points)
+  {
+    const CAccessPoint &ap = _points[i];
+    const UInt32 windowSize = (UInt32)ap.Window.Size();
+    SetUi64(p + pos, ap.InBitPos);
+    SetUi64(p + pos + 8, ap.OutPos);
+    SetUi32(p + pos + 16, windowSize | (ap.MemberStart ? kIndexFlag_MemberStart : 0));
+    pos += kIndexPointSize;
+    memcpy(p + pos, ap.Window, windowSize);
+    pos += windowSize;
+  }
+  SetUi32(p + pos, CrcCalc(p, pos));
+
+  NFile::NIO::COutFile file;
+  if (!file.Create(us2fs(_createIndexPath), true)
+      || !file.WriteFull(p, size))
+    return GetLastError_noZero_HRESULT();
+  return S_OK;
+}
+
+
+HRESULT CHandler::ReadSegmentPack(unsigned index, CByteBuffer &buf, size_t &size)
+{
+  const UInt64 start = _points[index].InBitPos >> 3;
+  size = (size_t)(((_points[index + 1].InBitPos + 7) >> 3) - start);
+  buf.AllocAtLeast(size);
+  RINOK(_stream->Seek((Int64)start, STREAM_SEEK_SET, NULL));
+  return ReadStream_FALSE(_stream, buf, size);
+}
+
+
+/* It decodes the data between access points (index) and (index + 1).
+   If next access point is the start of member, it also reads the footer of current member. */
+
+static HRESULT DecodeSegment(NDecoder::CCOMCoder *decoder, const CObjectVector<CAccessPoint> &points, unsigned index,
+    const Byte *pack, size_t packSize, Byte *dest, CItem &footer)
+{
+  const CAccessPoint &ap = points[index];
+  const CAccessPoint &next = points[index + 1];
+  const UInt64 outSize = next.OutPos - ap.OutPos;
+
+  CBufInStream *inStreamSpec = new CBufInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(pack, packSize);
+
+  CBufPtrSeqOutStream *outStreamSpec = new CBufPtrSeqOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  outStreamSpec->Init(dest, (size_t)outSize);
+
+  decoder->Set_NeedFinishInput(next.MemberStart);
+  decoder->SetAccessPoint((unsigned)ap.InBitPos & 7, ap.Window, (UInt32)ap.Window.Size());
+  RINOK(decoder->Code(inStream, outStream, NULL, &outSize, NULL));
+  if (outStreamSpec->GetPos() != outSize)
+    return S_FALSE;
+  if (!next.MemberStart)
+    return S_OK;
+  if (!decoder->IsFinished())
+    return S_FALSE;
+  decoder->AlignToByte();
+  return footer.ReadFooter1(decoder);
+}
+
+
+static unsigned FindSegment(const CObjectVector<CAccessPoint> &points, UInt64 pos)
+{
+  unsigned left = 0, right = points.Size() - 1;
+  for (;;)
+  {
+    const unsigned mid = (left + right) / 2;
+    if (mid == left)
+      return left;
+    if (pos < points[mid].OutPos)
+      right = mid;
+    else
+      left = mid;
+  }
+}
+
+
+class CInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  UInt64 _virtPos;
+  UInt64 _cacheStartPos;
+  size_t _cacheSize;
+  CByteBuffer _packBuf;
+  NDecoder::CCOMCoder *_decoderSpec;
+  CMyComPtr<ICompressCoder> _decoder;
+public:
+  UInt64 Size;
+  CByteBuffer _cache;
+
+  CHandler *_handlerSpec;
+  CMyComPtr<IUnknown> _handler;
+
+  CInStream(): _virtPos(0), _cacheStartPos(0), _cacheSize(0)
+  {
+    _decoderSpec = new NDecoder::CCOMCoder;
+    _decoder = _decoderSpec;
+  }
+
+  MY_UNKNOWN_IMP1(IInStream)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+};
+
+
+STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  COM_TRY_BEGIN
+
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+
+  {
+    if (_virtPos >= Size)
+      return S_OK;
+    {
+      UInt64 rem = Size - _virtPos;
+      if (size > rem)
+        size = (UInt32)rem;
+    }
+  }
+
+  if (_virtPos < _cacheStartPos || _virtPos >= _cacheStartPos + _cacheSize)
+  {
+    const CObjectVector<CAccessPoint> &points = _handlerSpec->Points();
+    const unsigned index = FindSegment(points, _virtPos);
+    _cacheSize = 0;
+    size_t packSize;
+    RINOK(_handlerSpec->ReadSegmentPack(index, _packBuf, packSize));
+    CItem footer;
+    RINOK(DecodeSegment(_decoderSpec, points, index, _packBuf, packSize, _cache, footer));
+    _cacheStartPos = points[index].OutPos;
+    _cacheSize = (size_t)(points[index + 1].OutPos - _cacheStartPos);
+  }
+
+  {
+    size_t offset = (size_t)(_virtPos - _cacheStartPos);
+    size_t rem = _cacheSize - offset;
+    if (size > rem)
+      size = (UInt32)rem;
+    memcpy(data, _cache + offset, size);
+    _virtPos += size;
+    if (processedSize)
+      *processedSize = size;
+    return S_OK;
+  }
+
+  COM_TRY_END
+}
+
+
+STDMETHODIMP CInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _virtPos; break;
+    case STREAM_SEEK_END: offset += Size; break;
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _virtPos = (UInt64)offset;
+  if (newPosition)
+    *newPosition = (UInt64)offset;
+  return S_OK;
+}
+
+
+STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
+{
+  COM_TRY_BEGIN
+
+  *stream = NULL;
+
+  if (index != 0)
+    return E_INVALIDARG;
+
+  // random access requires the index
+  if (_points.Size() < 2 || !_stream)
+    return S_FALSE;
+  if (_maxSegmentSize > _props._memUsage_Decompress / 4)
+    return S_FALSE;
+
+  CInStream *spec = new CInStream;
+  CMyComPtr<ISequentialInStream> specStream = spec;
+  spec->_cache.Alloc(_maxSegmentSize);
+  spec->_handlerSpec = this;
+  spec->_handler = (IInArchive *)this;
+  spec->Size = _points.Back().OutPos;
+
+  *stream = specStream.Detach();
+  return S_OK;
+
+  COM_TRY_END
+}
+
+
+#ifndef _7ZIP_ST
+
+static const unsigned kMtSegmentsPerThread = 2;
+
+void CHandler::WorkerThread(CMtWorker &w)
+{
+  const unsigned numSlots = _mtSegments.Size();
+  for (;;)
+  {
+    _mtWorkSem.Lock();
+    if (_mtExit)
+      return;
+    unsigned slot;
+    {
+      NSynchronization::CCriticalSectionLock lock(_mtCs);
+      slot = _mtNextDecode++ % numSlots;
+    }
+    CMtSegment &s = _mtSegments[slot];
+    try
+    {
+      s.Res = DecodeSegment(w.DecoderSpec, _points, s.Index, s.Pack, s.PackSize, s.Out, s.Footer);
+    }
+    catch(...) { s.Res = E_FAIL; }
+    s.Done.Set();
+  }
+}
+
+static THREAD_FUNC_DECL MtWorkerThread(void *p)
+{
+  CMtWorker *w = (CMtWorker *)p;
+  w->Handler->WorkerThread(*w);
+  return 0;
+}
+
+/* it extracts all data with the index: the workers decode the segments
+   between access points, and the main thread writes them in order and checks
+   the footers of members. */
+
+HRESULT CHandler::ExtractMt(COutStreamWithCRC *outStreamSpec, CLocalProgress *lps, bool &crcError)
+{
+  const unsigned numSegments = _points.Size() - 1;
+  UInt32 numThreads = _props._numThreads;
+  if (numThreads > numSegments)
+    numThreads = numSegments;
+  {
+    // each slot keeps the unpacked and packed data of segment
+    const UInt64 slotSize = (UInt64)_maxSegmentSize * 2 + (1 << 20);
+    const UInt64 numSlotsMax = _props._memUsage_Decompress / slotSize / kMtSegmentsPerThread;
+    if (numThreads > numSlotsMax)
+      numThreads = (UInt32)numSlotsMax;
+    if (numThreads == 0)
+      numThreads = 1;
+  }
+  const unsigned numSlots = numThreads * kMtSegmentsPerThread;
+
+  while (_mtWorkers.Size() < numThreads)
+  {
+    CMtWorker &w = _mtWorkers.AddNew();
+    w.Handler = this;
+    w.DecoderSpec = new NDecoder::CCOMCoder;
+    w.Decoder = w.DecoderSpec;
+  }
+  if (_mtSegments.Size() != numSlots)
+  {
+    _mtSegments.Clear();
+    for (unsigned i = 0; i < numSlots; i++)
+      _mtSegments.AddNew();
+  }
+  for (unsigned i = 0; i < numSlots; i++)
+  {
+    CMtSegment &s = _mtSegments[i];
+    s.Out.AllocAtLeast(_maxSegmentSize);
+    WRes wres = s.Done.CreateIfNotCreated_Reset();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  {
+    WRes wres = _mtWorkSem.OptCreateInit(0, numSlots + numThreads);
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+
+  _mtNextDecode = 0;
+  _mtExit = false;
+
+  HRESULT res = S_OK;
+  unsigned numCreated;
+  for (numCreated = 0; numCreated < numThreads; numCreated++)
+  {
+    WRes wres = _mtWorkers[numCreated].Thread.Create_Numa(MtWorkerThread, &_mtWorkers[numCreated], numCreated);
+    if (wres != 0)
+    {
+      res = HRESULT_FROM_WIN32(wres);
+      break;
+    }
+  }
+
+  unsigned numRead = 0;
+  unsigned numWritten = 0;
+  UInt64 memberStart = 0;
+
+  for (;;)
+  {
+    if (res != S_OK || numCreated == 0)
+      break;
+    
+    if (numRead - numWritten == numSlots || numRead == numSegments)
+    {
+      if (numWritten == numRead)
+        break;
+      
+      // we write the oldest segment, before its slot is reused
+      CMtSegment &s = _mtSegments[numWritten++ % numSlots];
+      s.Done.Lock();
+      res = s.Res;
+      if (res != S_OK)
+        break;
+      const CAccessPoint &ap = _points[s.Index];
+      const CAccessPoint &next = _points[s.Index + 1];
+      if (ap.MemberStart)
+      {
+        memberStart = outStreamSpec->GetSize();
+        outStreamSpec->InitCRC();
+      }
+      res = WriteStream(outStreamSpec, s.Out, (size_t)(next.OutPos - ap.OutPos));
+      if (res != S_OK)
+        break;
+      if (next.MemberStart)
+        if (s.Footer.Crc != outStreamSpec->GetCRC()
+            || s.Footer.Size32 != (UInt32)(outStreamSpec->GetSize() - memberStart))
+        {
+          crcError = true;
+          res = S_FALSE;
+          break;
+        }
+      lps->InSize = next.InBitPos >> 3;
+      lps->OutSize = next.OutPos;
+      res = lps->SetCur();
+      continue;
+    }
+
+    CMtSegment &s = _mtSegments[numRead % numSlots];
+    s.Index = numRead;
+    res = ReadSegmentPack(numRead, s.Pack, s.PackSize);
+    if (res != S_OK)
+      break;
+    numRead++;
+    _mtWorkSem.Release();
+  }
+
+  // drain
+  while (numWritten < numRead)
+    _mtSegments[numWritten++ % numSlots].Done.Lock();
+
+  _mtExit = true;
+  if (numCreated != 0)
+    _mtWorkSem.Release(numCreated);
+  for (unsigned i = 0; i < numCreated; i++)
+    _mtWorkers[i].Thread.Wait_Close();
+
+  return res;
+}
+
+#endif
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -722,7 +1385,28 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, true);
 
+  #ifndef _7ZIP_ST
+  if (_needSeekToStart && _points.Size() > 1 && _props._numThreads > 1)
+  {
+    bool crcError = false;
+    HRESULT result = ExtractMt(outStreamSpec, lps, crcError);
+    outStream.Release();
+    Int32 opRes = NExtract::NOperationResult::kOK;
+    if (crcError)
+      opRes = NExtract::NOperationResult::kCRCError;
+    else if (result == S_FALSE)
+      opRes = NExtract::NOperationResult::kDataError;
+    else if (result != S_OK)
+      return result;
+    return extractCallback->SetOperationResult(opRes);
+  }
+  #endif
+
   bool needReadFirstItem = _needSeekToStart;
+  const bool needIndex = _needSeekToStart && _points.IsEmpty() && !_createIndexPath.IsEmpty();
+  const UInt64 arcSize = _packSize;
+  _indexBuilder.Points.Clear();
+  _decoderSpec->SetAccessPointCallback(needIndex ? &_indexBuilder : NULL, kIndexSpan);
   
   if (_needSeekToStart)
   {
@@ -792,6 +1476,9 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
     UInt64 startOffset = outStreamSpec->GetSize();
     outStreamSpec->InitCRC();
+    
+    if (needIndex)
+      _indexBuilder.AddPoint(_decoderSpec->GetInputProcessedBits(), startOffset, true);
 
     result = _decoderSpec->CodeResume(outStream, NULL, progress);
 
@@ -856,6 +1543,29 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
   outStream.Release();
 
+  if (needIndex && result == S_OK && !crcError && !_dataAfterEnd && packSize == arcSize)
+  {
+    _indexBuilder.AddPoint(packSize * 8, unpackedSize, true);
+    _points = _indexBuilder.Points;
+    _maxSegmentSize = 0;
+    for (unsigned i = 1; i < _points.Size(); i++)
+    {
+      const UInt64 segSize = _points[i].OutPos - _points[i - 1].OutPos;
+      if (segSize > kSegmentSizeMax)
+      {
+        _points.Clear();
+        break;
+      }
+      if (_maxSegmentSize < segSize)
+        _maxSegmentSize = (UInt32)segSize;
+    }
+    if (!_points.IsEmpty())
+    {
+      RINOK(WriteIndex());
+    }
+  }
+  _indexBuilder.Points.Clear();
+
   Int32 retResult = NExtract::NOperationResult::kDataError;
 
   if (!_isArc)
@@ -1123,7 +1833,11 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
         return E_INVALIDARG;
       size = prop.uhVal.QuadPart;
     }
-    return UpdateArchive(outStream, size, newItem, _props, _timeOptions, updateCallback);
+    CSingleMethodProps props2 = _props;
+    #ifndef _7ZIP_ST
+    props2.AddProp_NumThreads(_props._numThreads);
+    #endif
+    return UpdateArchive(outStream, size, newItem, props2, _timeOptions, updateCallback);
   }
 
   if (indexInArchive != 0)
@@ -1172,6 +1886,8 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
 {
   _timeOptions.Init();
   _props.Init();
+  _indexPath.Empty();
+  _createIndexPath.Empty();
 
   for (UInt32 i = 0; i < numProps; i++)
   {
@@ -1180,6 +1896,20 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
     if (name.IsEmpty())
       return E_INVALIDARG;
     const PROPVARIANT &value = values[i];
+    if (name.IsEqualTo("idx"))
+    {
+      if (value.vt != VT_BSTR)
+        return E_INVALIDARG;
+      _indexPath = value.bstrVal;
+      continue;
+    }
+    if (name.IsEqualTo("cidx"))
+    {
+      if (value.vt != VT_BSTR)
+        return E_INVALIDARG;
+      _createIndexPath = value.bstrVal;
+      continue;
+    }
     {
       bool processed = false;
       RINOK(_timeOptions.Parse(name, value, processed));
@@ -12,6 +12,7 @@
 
 #include "../../Windows/PropVariant.h"
 
+#include "../Common/BlockCoderMt.h"
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
@@ -32,6 +33,9 @@ namespace NQcow {
   
 static const Byte k_Signature[] = SIGNATURE;
 
+static const size_t kCacheSize = (size_t)1 << 25;
+static const unsigned kReadAheadMax = 16;
+
 /*
 VA to PA maps:
   high bits (L1) :              : in L1 Table : the reference to L1 Table
@@ -39,7 +43,34 @@ VA to PA maps:
   low bits       : _clusterBits
 */
 
-class CHandler: public CHandlerImg
+struct CClusterDecoder
+{
+  NCompress::NDeflate::NDecoder::CCOMCoder *DeflateDecoderSpec;
+  CMyComPtr<ICompressCoder> DeflateDecoder;
+
+  CClusterDecoder()
+  {
+    DeflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder();
+    DeflateDecoder = DeflateDecoderSpec;
+    DeflateDecoderSpec->Set_NeedFinishInput(true);
+  }
+};
+
+
+// compressed cluster that was read from archive, and that must be unpacked to cache slot
+struct CClusterJob
+{
+  UInt64 Cluster;
+  UInt32 Slot;
+  size_t PackSize;
+  HRESULT Res;
+  CByteBuffer Packed;
+};
+
+
+class CHandler:
+  public CHandlerImg,
+  public IBlockCoderCallback
 {
   unsigned _clusterBits;
   unsigned _numMidBits;
@@ -47,24 +78,18 @@ class CHandler: public CHandlerImg
 
   CObjArray2<UInt32> _dir;
   CAlignedBuffer _table;
-  UInt64 _cacheCluster;
-  CByteBuffer _cache;
+  // unpacked clusters, the key is the index of cluster
+  CBlockCache _cache;
   CByteBuffer _cacheCompressed;
+  CBlockCoderMt _decoderMt;
+  CObjectVector<CClusterDecoder> _decoders;
+  CObjectVector<CClusterJob> _jobs;
 
   UInt64 _comprPos;
   size_t _comprSize;
 
   UInt64 _phySize;
 
-  CBufInStream *_bufInStreamSpec;
-  CMyComPtr<ISequentialInStream> _bufInStream;
-
-  CBufPtrSeqOutStream *_bufOutStreamSpec;
-  CMyComPtr<ISequentialOutStream> _bufOutStream;
-
-  NCompress::NDeflate::NDecoder::CCOMCoder *_deflateDecoderSpec;
-  CMyComPtr<ICompressCoder> _deflateDecoder;
-
   bool _needDeflate;
   bool _isArc;
   bool _unsupported;
@@ -84,9 +109,13 @@ class CHandler: public CHandlerImg
     return Seek2(0);
   }
 
+  UInt64 GetTableItem(UInt64 cluster) const;
+  HRESULT ReadCompressedCluster(UInt64 v, CClusterJob &job);
   HRESULT Open2(IInStream *stream, IArchiveOpenCallback *openCallback);
 
 public:
+  virtual void CodeBlock(unsigned threadIndex, unsigned blockIndex);
+
   INTERFACE_IInArchive_Img(;)
 
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
@@ -96,6 +125,109 @@ public:
 
 static const UInt32 kEmptyDirItem = (UInt32)0 - 1;
 
+UInt64 CHandler::GetTableItem(UInt64 cluster) const
+{
+  const UInt64 high = cluster >> _numMidBits;
+  if (high >= _dir.Size())
+    return 0;
+  const UInt32 tabl = _dir[(unsigned)high];
+  if (tabl == kEmptyDirItem)
+    return 0;
+  const Byte *buffer = _table + ((size_t)tabl << (_numMidBits + 3));
+  const size_t midBits = (size_t)cluster & (((size_t)1 << _numMidBits) - 1);
+  return Get64((const Byte *)buffer + (midBits << 3));
+}
+
+
+HRESULT CHandler::ReadCompressedCluster(UInt64 v, CClusterJob &job)
+{
+  /*
+  the example of table record for 12-bit clusters (4KB uncompressed).
+   2 bits : isCompressed status
+   4 bits : num_sectors_minus1; packSize = (num_sectors_minus1 + 1) * 512;
+            it uses one additional bit over unpacked cluster_bits
+  49 bits : offset of 512-sector
+   9 bits : offset in 512-sector
+  */
+
+  const unsigned numOffsetBits = (62 - (_clusterBits - 9 + 1));
+  const UInt64 offset = v & (((UInt64)1 << 62) - 1);
+  const size_t dataSize = ((size_t)(offset >> numOffsetBits) + 1) << 9;
+  UInt64 sectorOffset = offset & (((UInt64)1 << numOffsetBits) - (1 << 9));
+  const UInt64 offset2inCache = sectorOffset - _comprPos;
+  
+  // _comprPos is aligned for 512-bytes
+  // we try to use previous _cacheCompressed that contains compressed data
+  // that was read for previous unpacking
+
+  if (sectorOffset >= _comprPos && offset2inCache < _comprSize)
+  {
+    if (offset2inCache != 0)
+    {
+      _comprSize -= (size_t)offset2inCache;
+      memmove(_cacheCompressed, _cacheCompressed + (size_t)offset2inCache, _comprSize);
+      _comprPos = sectorOffset;
+    }
+    sectorOffset += _comprSize;
+  }
+  else
+  {
+    _comprPos = sectorOffset;
+    _comprSize = 0;
+  }
+  
+  if (dataSize > _comprSize)
+  {
+    if (sectorOffset != _posInArc)
+    {
+      // printf("\nDeflate-Seek %12I64x %12I64x\n", sectorOffset, sectorOffset - _posInArc);
+      RINOK(Seek2(sectorOffset));
+    }
+    if (_cacheCompressed.Size() < dataSize)
+      return E_FAIL;
+    const size_t dataSize3 = dataSize - _comprSize;
+    size_t dataSize2 = dataSize3;
+    // printf("\n\n=======\nReadStream = %6d _comprPos = %6d \n", (UInt32)dataSize2, (UInt32)_comprPos);
+    RINOK(ReadStream(Stream, _cacheCompressed + _comprSize, &dataSize2));
+    _posInArc += dataSize2;
+    if (dataSize2 != dataSize3)
+      return E_FAIL;
+    _comprSize += dataSize2;
+  }
+  
+  const size_t kSectorMask = (1 << 9) - 1;
+  const size_t offsetInSector = ((size_t)offset & kSectorMask);
+  
+  if (job.Packed.Size() < dataSize)
+    return E_FAIL;
+  job.PackSize = dataSize - offsetInSector;
+  memcpy(job.Packed, _cacheCompressed + offsetInSector, job.PackSize);
+  return S_OK;
+}
+
+
+void CHandler::CodeBlock(unsigned threadIndex, unsigned blockIndex)
+{
+  CClusterJob &job = _jobs[blockIndex];
+  const size_t clusterSize = (size_t)1 << _clusterBits;
+  
+  // Do we need to use smaller block than clusterSize for last cluster?
+  size_t outSize = clusterSize;
+  HRESULT res = _decoders[threadIndex].DeflateDecoderSpec->CodeBuf(
+      job.Packed, job.PackSize,
+      _cache.GetSlotData(job.Slot), &outSize);
+
+  /*
+  if (outSize != clusterSize)
+    memset(_cache + outSize, 0, clusterSize - outSize);
+  */
+
+  if (res == S_OK && outSize != clusterSize)
+    res = S_FALSE;
+  job.Res = res;
+}
+
+
 STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   if (processedSize)
@@ -124,137 +256,87 @@ STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
         size = (UInt32)rem;
     }
 
-    if (cluster == _cacheCluster)
+    const unsigned numAhead = _cache.GetReadAhead(cluster, cluster + 1);
     {
-      memcpy(data, _cache + lowBits, size);
-      break;
+      size_t cachedSize;
+      const Byte *p = _cache.Find(cluster, cachedSize);
+      if (p)
+      {
+        memcpy(data, p + lowBits, size);
+        break;
+      }
     }
     
-    const UInt64 high = cluster >> _numMidBits;
- 
-    if (high < _dir.Size())
+    UInt64 v = GetTableItem(cluster);
+        
+    if (v != 0)
     {
-      const UInt32 tabl = _dir[(unsigned)high];
-    
-      if (tabl != kEmptyDirItem)
+      if ((v & _compressedFlag) != 0)
       {
-        const Byte *buffer = _table + ((size_t)tabl << (_numMidBits + 3));
-        const size_t midBits = (size_t)cluster & (((size_t)1 << _numMidBits) - 1);
-        const Byte *p = (const Byte *)buffer + (midBits << 3);
-        UInt64 v = Get64(p);
-        
-        if (v != 0)
+        if (_version <= 1)
+          return E_FAIL;
+
+        /* for sequential reading we read the compressed clusters that follow
+           the current cluster, and we unpack all these clusters in parallel.
+           An error in next cluster stops the read-ahead only. */
+        unsigned numJobs = 0;
+        for (;;)
         {
-          if ((v & _compressedFlag) != 0)
+          const UInt64 cluster2 = cluster + numJobs;
+          if (numJobs != 0)
           {
-            if (_version <= 1)
-              return E_FAIL;
-
-            /*
-            the example of table record for 12-bit clusters (4KB uncompressed).
-             2 bits : isCompressed status
-             4 bits : num_sectors_minus1; packSize = (num_sectors_minus1 + 1) * 512;
-                      it uses one additional bit over unpacked cluster_bits
-            49 bits : offset of 512-sector
-             9 bits : offset in 512-sector
-            */
-
-            const unsigned numOffsetBits = (62 - (_clusterBits - 9 + 1));
-            const UInt64 offset = v & (((UInt64)1 << 62) - 1);
-            const size_t dataSize = ((size_t)(offset >> numOffsetBits) + 1) << 9;
-            UInt64 sectorOffset = offset & (((UInt64)1 << numOffsetBits) - (1 << 9));
-            const UInt64 offset2inCache = sectorOffset - _comprPos;
-            
-            // _comprPos is aligned for 512-bytes
-            // we try to use previous _cacheCompressed that contains compressed data
-            // that was read for previous unpacking
-
-            if (sectorOffset >= _comprPos && offset2inCache < _comprSize)
-            {
-              if (offset2inCache != 0)
-              {
-                _comprSize -= (size_t)offset2inCache;
-                memmove(_cacheCompressed, _cacheCompressed + (size_t)offset2inCache, _comprSize);
-                _comprPos = sectorOffset;
-              }
-              sectorOffset += _comprSize;
-            }
-            else
-            {
-              _comprPos = sectorOffset;
-              _comprSize = 0;
-            }
-            
-            if (dataSize > _comprSize)
-            {
-              if (sectorOffset != _posInArc)
-              {
-                // printf("\nDeflate-Seek %12I64x %12I64x\n", sectorOffset, sectorOffset - _posInArc);
-                RINOK(Seek2(sectorOffset));
-              }
-              if (_cacheCompressed.Size() < dataSize)
-                return E_FAIL;
-              const size_t dataSize3 = dataSize - _comprSize;
-              size_t dataSize2 = dataSize3;
-              // printf("\n\n=======\nReadStream = %6d _comprPos = %6d \n", (UInt32)dataSize2, (UInt32)_comprPos);
-              RINOK(ReadStream(Stream, _cacheCompressed + _comprSize, &dataSize2));
-              _posInArc += dataSize2;
-              if (dataSize2 != dataSize3)
-                return E_FAIL;
-              _comprSize += dataSize2;
-            }
-            
-            const size_t kSectorMask = (1 << 9) - 1;
-            const size_t offsetInSector = ((size_t)offset & kSectorMask);
-            _bufInStreamSpec->Init(_cacheCompressed + offsetInSector, dataSize - offsetInSector);
-            
-            _cacheCluster = (UInt64)(Int64)-1;
-            if (_cache.Size() < clusterSize)
-              return E_FAIL;
-            _bufOutStreamSpec->Init(_cache, clusterSize);
-            
-            // Do we need to use smaller block than clusterSize for last cluster?
-            const UInt64 blockSize64 = clusterSize;
-            HRESULT res = _deflateDecoderSpec->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
-
-            /*
-            if (_bufOutStreamSpec->GetPos() != clusterSize)
-              memset(_cache + _bufOutStreamSpec->GetPos(), 0, clusterSize - _bufOutStreamSpec->GetPos());
-            */
-
-            if (res == S_OK)
-              if (!_deflateDecoderSpec->IsFinished()
-                  || _bufOutStreamSpec->GetPos() != clusterSize)
-                res = S_FALSE;
-
-            RINOK(res);
-            _cacheCluster = cluster;
-            
-            continue;
-            /*
-            memcpy(data, _cache + lowBits, size);
-            break;
-            */
+            if (numJobs > numAhead
+                || (cluster2 << _clusterBits) >= _size
+                || _cache.Contains(cluster2))
+              break;
+            v = GetTableItem(cluster2);
+            if ((v & _compressedFlag) == 0)
+              break;
           }
-
-          // version 3 support zero clusters
-          if (((UInt32)v & 511) != 1)
+          CClusterJob &job = _jobs[numJobs];
+          const HRESULT res = ReadCompressedCluster(v, job);
+          if (res != S_OK)
           {
-            v &= (_compressedFlag - 1);
-            v += lowBits;
-            if (v != _posInArc)
-            {
-              // printf("\n%12I64x\n", v - _posInArc);
-              RINOK(Seek2(v));
-            }
-            HRESULT res = Stream->Read(data, size, &size);
-            _posInArc += size;
-            _virtPos += size;
-            if (processedSize)
-              *processedSize = size;
-            return res;
+            if (numJobs == 0)
+              return res;
+            break;
           }
+          job.Cluster = cluster2;
+          numJobs++;
+        }
+
+        unsigned i;
+        for (i = 0; i < numJobs; i++)
+          _jobs[i].Slot = _cache.Reserve();
+        RINOK(_decoderMt.Code(this, numJobs));
+        
+        for (i = numJobs; i != 0;)
+        {
+          const CClusterJob &job = _jobs[--i];
+          if (job.Res == S_OK)
+            _cache.Commit(job.Slot, job.Cluster, clusterSize);
+        }
+        RINOK(_jobs[0].Res);
+        
+        continue;
+      }
+
+      // version 3 support zero clusters
+      if (((UInt32)v & 511) != 1)
+      {
+        v &= (_compressedFlag - 1);
+        v += lowBits;
+        if (v != _posInArc)
+        {
+          // printf("\n%12I64x\n", v - _posInArc);
+          RINOK(Seek2(v));
         }
+        HRESULT res = Stream->Read(data, size, &size);
+        _posInArc += size;
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return res;
       }
     }
     
@@ -602,7 +684,8 @@ STDMETHODIMP CHandler::Close()
   _dir.Free();
   _phySize = 0;
 
-  _cacheCluster = (UInt64)(Int64)-1;
+  _cache.Free();
+  _jobs.Clear();
   _comprPos = 0;
   _comprSize = 0;
   _needDeflate = false;
@@ -630,28 +713,21 @@ STDMETHODIMP CHandler::GetStream(UInt32 /* index */, ISequentialInStream **strea
     if (_version <= 1)
       return S_FALSE;
 
-    if (!_bufInStream)
-    {
-      _bufInStreamSpec = new CBufInStream;
-      _bufInStream = _bufInStreamSpec;
-    }
-    
-    if (!_bufOutStream)
-    {
-      _bufOutStreamSpec = new CBufPtrSeqOutStream();
-      _bufOutStream = _bufOutStreamSpec;
-    }
-
-    if (!_deflateDecoder)
-    {
-      _deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder();
-      _deflateDecoder = _deflateDecoderSpec;
-      _deflateDecoderSpec->Set_NeedFinishInput(true);
-    }
+    _decoderMt.SetNumThreads_Default();
+    while (_decoders.Size() < _decoderMt.GetNumThreads())
+      _decoders.AddNew();
     
     const size_t clusterSize = (size_t)1 << _clusterBits;
-    _cache.AllocAtLeast(clusterSize);
+    if (_cache.GetBlockSize() != clusterSize)
+      if (!_cache.Alloc(clusterSize, kCacheSize, 2))
+        return E_OUTOFMEMORY;
+    _cache.Clear();
+    _cache.SetReadAheadMax(kReadAheadMax);
     _cacheCompressed.AllocAtLeast(clusterSize * 2);
+    while (_jobs.Size() <= kReadAheadMax)
+      _jobs.AddNew();
+    FOR_VECTOR (i, _jobs)
+      _jobs[i].Packed.AllocAtLeast(clusterSize * 2);
   }
     
   CMyComPtr<ISequentialInStream> streamTemp = this;
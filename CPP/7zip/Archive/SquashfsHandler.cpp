@@ -17,6 +17,7 @@
 #include "../../Windows/PropVariantUtils.h"
 #include "../../Windows/TimeUtils.h"
 
+#include "../Common/BlockCoderMt.h"
 #include "../Common/CWrappers.h"
 #include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
@@ -34,6 +35,8 @@ namespace NSquashfs {
 
 static const UInt32 kNumFilesMax = (1 << 28);
 static const unsigned kNumDirLevelsMax = (1 << 10);
+static const size_t kBlockCacheSize = (size_t)1 << 24;
+static const unsigned kReadAheadMax = 16;
 
 // Layout: Header, Data, inodes, Directories, Fragments, UIDs, GIDs
 
@@ -837,10 +840,58 @@ struct CFrag
   UInt32 Size;
 };
 
+// the state of one thread that unpacks data blocks
+
+struct CBlockUnpacker
+{
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+
+  NCompress::NZlib::CDecoder *ZlibDecoderSpec;
+  CMyComPtr<ICompressCoder> ZlibDecoder;
+  
+  NCompress::NZSTD::CDecoder *ZstdDecoderSpec;
+  CMyComPtr<ICompressCoder> ZstdDecoder;
+
+  CXzUnpacker Xz;
+
+  CBlockUnpacker()
+  {
+    InStreamSpec = new CBufInStream;
+    InStream = InStreamSpec;
+    OutStreamSpec = new CBufPtrSeqOutStream;
+    OutStream = OutStreamSpec;
+    XzUnpacker_Construct(&Xz, &g_Alloc);
+  }
+  ~CBlockUnpacker()
+  {
+    XzUnpacker_Free(&Xz);
+  }
+};
+
+
+// data block that was read from archive, and that must be unpacked to cache slot
+struct CBlockJob
+{
+  UInt64 Offset;
+  UInt32 PackSize;
+  UInt32 UnpackSize;
+  UInt32 Method;
+  UInt32 Slot;
+  bool Compressed;
+  HRESULT Res;
+  CByteBuffer Packed;
+};
+
+
 class CHandler:
   public IInArchive,
   public IInArchiveGetStream,
-  public CMyUnknownImp
+  public CMyUnknownImp,
+  public IBlockCoderCallback
 {
   CRecordVector<CItem> _items;
   CRecordVector<CNode> _nodes;
@@ -866,17 +917,15 @@ class CHandler:
   CRecordVector<bool> _blockCompressed;
   CRecordVector<UInt64> _blockOffsets;
   
-  CByteBuffer _cachedBlock;
-  UInt64 _cachedBlockStartPos;
-  UInt32 _cachedPackBlockSize;
-  UInt32 _cachedUnpackBlockSize;
+  // unpacked data blocks and fragment blocks, the key is the offset of block
+  CBlockCache _blockCache;
+  CBlockCoderMt _decoderMt;
+  CObjectVector<CBlockUnpacker> _unpackers;
+  CObjectVector<CBlockJob> _jobs;
 
   CLimitedSequentialInStream *_limitedInStreamSpec;
   CMyComPtr<ISequentialInStream> _limitedInStream;
 
-  CBufPtrSeqOutStream *_outStreamSpec;
-  CMyComPtr<ISequentialOutStream> _outStream;
-
   // NCompress::NLzma::CDecoder *_lzmaDecoderSpec;
   // CMyComPtr<ICompressCoder> _lzmaDecoder;
 
@@ -893,20 +942,19 @@ class CHandler:
   CDynBufSeqOutStream *_dynOutStreamSpec;
   CMyComPtr<ISequentialOutStream> _dynOutStream;
 
-  void ClearCache()
-  {
-    _cachedBlockStartPos = 0;
-    _cachedPackBlockSize = 0;
-    _cachedUnpackBlockSize = 0;
-  }
-
   HRESULT Seek2(UInt64 offset)
   {
     return _stream->Seek(offset, STREAM_SEEK_SET, NULL);
   }
 
+  UInt32 GetMethod(Byte firstByte);
+  HRESULT UnpackBuf(CXzUnpacker *xz, UInt32 method, const Byte *src, UInt32 inSize,
+      Byte *dest, UInt32 outSizeMax, UInt32 &outSize) const;
+  HRESULT UnpackBlock(CBlockUnpacker &unpacker, UInt32 method, const Byte *src, UInt32 inSize,
+      Byte *dest, UInt32 outSizeMax, UInt32 &outSize) const;
   HRESULT Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool *outBufWasWritten, UInt32 *outBufWasWrittenSize,
       UInt32 inSize, UInt32 outSizeMax);
+  HRESULT ReadDataBlock(CBlockJob &job);
   HRESULT ReadMetadataBlock(UInt32 &packSize);
   HRESULT ReadMetadataBlock2();
   HRESULT ReadData(CData &data, UInt64 start, UInt64 end);
@@ -930,6 +978,7 @@ public:
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
 
   HRESULT ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize);
+  virtual void CodeBlock(unsigned threadIndex, unsigned blockIndex);
 };
 
 CHandler::CHandler()
@@ -939,9 +988,6 @@ CHandler::CHandler()
   _limitedInStreamSpec = new CLimitedSequentialInStream;
   _limitedInStream = _limitedInStreamSpec;
 
-  _outStreamSpec = new CBufPtrSeqOutStream();
-  _outStream = _outStreamSpec;
-
   _dynOutStreamSpec = new CDynBufSeqOutStream;
   _dynOutStream = _dynOutStreamSpec;
 }
@@ -1150,6 +1196,131 @@ static HRESULT Lz4Decode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *src
   return S_OK;
 }
 
+UInt32 CHandler::GetMethod(Byte firstByte)
+{
+  UInt32 method = _h.Method;
+  if (_h.SeveralMethods)
+    method = (firstByte == 0x5D ? kMethod_LZMA : kMethod_ZLIB);
+
+  if (method == kMethod_ZLIB && _needCheckLzma)
+  {
+    if (firstByte == 0)
+    {
+      _noPropsLZMA = true;
+      method = _h.Method = kMethod_LZMA;
+    }
+    _needCheckLzma = false;
+  }
+  return method;
+}
+
+HRESULT CHandler::UnpackBuf(CXzUnpacker *xz, UInt32 method, const Byte *src, UInt32 inSize,
+    Byte *dest, UInt32 outSizeMax, UInt32 &outSize) const
+{
+  outSize = 0;
+  SizeT destLen = outSizeMax, srcLen = inSize;
+
+  if (method == kMethod_LZO)
+  {
+    RINOK(LzoDecode(dest, &destLen, src, &srcLen));
+  }
+  else if (method == kMethod_LZ4)
+  {
+    RINOK(Lz4Decode(dest, &destLen, src, &srcLen));
+  }
+  else if (method == kMethod_LZMA)
+  {
+    Byte props[5];
+
+    if (_noPropsLZMA)
+    {
+      props[0] = 0x5D;
+      SetUi32(&props[1], _h.BlockSize);
+    }
+    else
+    {
+      const UInt32 kPropsSize = LZMA_PROPS_SIZE + 8;
+      if (inSize < kPropsSize)
+        return S_FALSE;
+      memcpy(props, src, LZMA_PROPS_SIZE);
+      UInt64 outSize64 = GetUi64(src + LZMA_PROPS_SIZE);
+      if (outSize64 > outSizeMax)
+        return S_FALSE;
+      destLen = (SizeT)outSize64;
+      src += kPropsSize;
+      inSize -= kPropsSize;
+      srcLen = inSize;
+    }
+
+    ELzmaStatus status;
+    SRes res = LzmaDecode(dest, &destLen,
+        src, &srcLen,
+        props, LZMA_PROPS_SIZE,
+        LZMA_FINISH_END,
+        &status, &g_Alloc);
+    if (res != 0)
+      return SResToHRESULT(res);
+    if (status != LZMA_STATUS_FINISHED_WITH_MARK
+        && status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+      return S_FALSE;
+  }
+  else
+  {
+    ECoderStatus status;
+    SRes res = XzUnpacker_CodeFull(xz,
+        dest, &destLen,
+        src, &srcLen,
+        CODER_FINISH_END, &status);
+    if (res != 0)
+      return SResToHRESULT(res);
+    if (status != CODER_STATUS_NEEDS_MORE_INPUT || !XzUnpacker_IsStreamWasFinished(xz))
+      return S_FALSE;
+  }
+  
+  if (inSize != srcLen)
+    return S_FALSE;
+  outSize = (UInt32)destLen;
+  return S_OK;
+}
+
+HRESULT CHandler::UnpackBlock(CBlockUnpacker &unpacker, UInt32 method, const Byte *src, UInt32 inSize,
+    Byte *dest, UInt32 outSizeMax, UInt32 &outSize) const
+{
+  if (method != kMethod_ZLIB && method != kMethod_ZSTD)
+    return UnpackBuf(&unpacker.Xz, method, src, inSize, dest, outSizeMax, outSize);
+
+  outSize = 0;
+  unpacker.InStreamSpec->Init(src, inSize);
+  unpacker.OutStreamSpec->Init(dest, outSizeMax);
+  UInt64 inProcessed;
+  
+  if (method == kMethod_ZLIB)
+  {
+    if (!unpacker.ZlibDecoder)
+    {
+      unpacker.ZlibDecoderSpec = new NCompress::NZlib::CDecoder();
+      unpacker.ZlibDecoder = unpacker.ZlibDecoderSpec;
+    }
+    RINOK(unpacker.ZlibDecoder->Code(unpacker.InStream, unpacker.OutStream, NULL, NULL, NULL));
+    inProcessed = unpacker.ZlibDecoderSpec->GetInputProcessedSize();
+  }
+  else
+  {
+    if (!unpacker.ZstdDecoder)
+    {
+      unpacker.ZstdDecoderSpec = new NCompress::NZSTD::CDecoder();
+      unpacker.ZstdDecoder = unpacker.ZstdDecoderSpec;
+    }
+    RINOK(unpacker.ZstdDecoder->Code(unpacker.InStream, unpacker.OutStream, NULL, NULL, NULL));
+    inProcessed = unpacker.ZstdDecoderSpec->GetInputProcessedSize();
+  }
+  
+  if (inSize != inProcessed)
+    return S_FALSE;
+  outSize = (UInt32)unpacker.OutStreamSpec->GetPos();
+  return S_OK;
+}
+
 HRESULT CHandler::Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool *outBufWasWritten, UInt32 *outBufWasWrittenSize, UInt32 inSize, UInt32 outSizeMax)
 {
   if (outBuf)
@@ -1158,25 +1329,12 @@ HRESULT CHandler::Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool
     *outBufWasWrittenSize = 0;
   }
   UInt32 method = _h.Method;
-  if (_h.SeveralMethods)
+  if (_h.SeveralMethods || (method == kMethod_ZLIB && _needCheckLzma))
   {
     Byte b;
     RINOK(ReadStream_FALSE(_stream, &b, 1));
     RINOK(_stream->Seek(-1, STREAM_SEEK_CUR, NULL));
-    method = (b == 0x5D ? kMethod_LZMA : kMethod_ZLIB);
-  }
-
-  if (method == kMethod_ZLIB && _needCheckLzma)
-  {
-    Byte b;
-    RINOK(ReadStream_FALSE(_stream, &b, 1));
-    RINOK(_stream->Seek(-1, STREAM_SEEK_CUR, NULL));
-    if (b == 0)
-    {
-      _noPropsLZMA = true;
-      method = _h.Method = kMethod_LZMA;
-    }
-    _needCheckLzma = false;
+    method = GetMethod(b);
   }
   
   if (method == kMethod_ZLIB)
@@ -1249,72 +1407,13 @@ HRESULT CHandler::Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool
         return E_OUTOFMEMORY;
     }
     
-    SizeT destLen = outSizeMax, srcLen = inSize;
-
-    if (method == kMethod_LZO)
-    {
-      RINOK(LzoDecode(dest, &destLen, _inputBuffer, &srcLen));
-    }
-    else if (method == kMethod_LZ4)
-    {
-      RINOK(Lz4Decode(dest, &destLen, _inputBuffer, &srcLen));
-    }
-    else if (method == kMethod_LZMA)
-    {
-      Byte props[5];
-      const Byte *src = _inputBuffer;
-
-      if (_noPropsLZMA)
-      {
-        props[0] = 0x5D;
-        SetUi32(&props[1], _h.BlockSize);
-      }
-      else
-      {
-        const UInt32 kPropsSize = LZMA_PROPS_SIZE + 8;
-        if (inSize < kPropsSize)
-          return S_FALSE;
-        memcpy(props, src, LZMA_PROPS_SIZE);
-        UInt64 outSize = GetUi64(src + LZMA_PROPS_SIZE);
-        if (outSize > outSizeMax)
-          return S_FALSE;
-        destLen = (SizeT)outSize;
-        src += kPropsSize;
-        inSize -= kPropsSize;
-        srcLen = inSize;
-      }
-
-      ELzmaStatus status;
-      SRes res = LzmaDecode(dest, &destLen,
-          src, &srcLen,
-          props, LZMA_PROPS_SIZE,
-          LZMA_FINISH_END,
-          &status, &g_Alloc);
-      if (res != 0)
-        return SResToHRESULT(res);
-      if (status != LZMA_STATUS_FINISHED_WITH_MARK
-          && status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
-        return S_FALSE;
-    }
-    else
-    {
-      ECoderStatus status;
-      SRes res = XzUnpacker_CodeFull(&_xz,
-          dest, &destLen,
-          _inputBuffer, &srcLen,
-          CODER_FINISH_END, &status);
-      if (res != 0)
-        return SResToHRESULT(res);
-      if (status != CODER_STATUS_NEEDS_MORE_INPUT || !XzUnpacker_IsStreamWasFinished(&_xz))
-        return S_FALSE;
-    }
+    UInt32 destLen;
+    RINOK(UnpackBuf(&_xz, method, _inputBuffer, inSize, dest, outSizeMax, destLen));
     
-    if (inSize != srcLen)
-      return S_FALSE;
     if (outBuf)
     {
       *outBufWasWritten = true;
-      *outBufWasWrittenSize = (UInt32)destLen;
+      *outBufWasWrittenSize = destLen;
     }
     else
       _dynOutStreamSpec->UpdateSize(destLen);
@@ -1844,8 +1943,8 @@ STDMETHODIMP CHandler::Close()
   // _uids.Free();
   // _gids.Free();;
 
-  _cachedBlock.Free();
-  ClearCache();
+  _blockCache.Free();
+  _jobs.Clear();
 
   return S_OK;
 }
@@ -2144,6 +2243,38 @@ HRESULT CSquashfsInStream::ReadBlock(UInt64 blockIndex, Byte *dest, size_t block
   return Handler->ReadBlock(blockIndex, dest, blockSize);
 }
 
+HRESULT CHandler::ReadDataBlock(CBlockJob &job)
+{
+  if (!job.Compressed && job.PackSize > _h.BlockSize)
+    return S_FALSE;
+  RINOK(Seek2(job.Offset));
+  job.Slot = _blockCache.Reserve();
+  Byte *buf = _blockCache.GetSlotData(job.Slot);
+  job.Res = S_OK;
+  if (!job.Compressed)
+  {
+    job.UnpackSize = job.PackSize;
+    return ReadStream_FALSE(_stream, buf, job.PackSize);
+  }
+  if (job.Packed.Size() < job.PackSize)
+  {
+    job.Packed.Free();
+    job.Packed.Alloc(job.PackSize);
+  }
+  RINOK(ReadStream_FALSE(_stream, job.Packed, job.PackSize));
+  job.Method = GetMethod(job.Packed[0]);
+  return S_OK;
+}
+
+void CHandler::CodeBlock(unsigned threadIndex, unsigned blockIndex)
+{
+  CBlockJob &job = _jobs[blockIndex];
+  if (!job.Compressed)
+    return;
+  job.Res = UnpackBlock(_unpackers[threadIndex], job.Method, job.Packed, job.PackSize,
+      _blockCache.GetSlotData(job.Slot), _h.BlockSize, job.UnpackSize);
+}
+
 HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
 {
   const CNode &node = _nodes[_nodeIndex];
@@ -2176,39 +2307,64 @@ HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
     return S_OK;
   }
 
-  if (blockOffset != _cachedBlockStartPos ||
-      packBlockSize != _cachedPackBlockSize)
+  /* for sequential reading of data blocks we read the blocks that follow
+     the current block, and we unpack all these blocks in parallel.
+     An error in next block stops the read-ahead only. */
+  unsigned numAhead = 0;
+  if (blockIndex < _blockCompressed.Size())
+    numAhead = _blockCache.GetReadAhead(blockOffset, blockOffset + packBlockSize);
+
+  size_t unpackBlockSize;
+  const Byte *block = _blockCache.Find(blockOffset, unpackBlockSize);
+  if (!block)
   {
-    ClearCache();
-    RINOK(Seek2(blockOffset));
-    _limitedInStreamSpec->Init(packBlockSize);
-    
-    if (compressed)
-    {
-      _outStreamSpec->Init((Byte *)_cachedBlock, _h.BlockSize);
-      bool outBufWasWritten;
-      UInt32 outBufWasWrittenSize;
-      HRESULT res = Decompress(_outStream, _cachedBlock, &outBufWasWritten, &outBufWasWrittenSize, packBlockSize, _h.BlockSize);
-      RINOK(res);
-      if (outBufWasWritten)
-        _cachedUnpackBlockSize = outBufWasWrittenSize;
+    unsigned numJobs = 0;
+    for (;;)
+    {
+      CBlockJob &job = _jobs[numJobs];
+      if (numJobs == 0)
+      {
+        job.Offset = blockOffset;
+        job.PackSize = packBlockSize;
+        job.Compressed = compressed;
+      }
       else
-        _cachedUnpackBlockSize = (UInt32)_outStreamSpec->GetPos();
+      {
+        const unsigned index = (unsigned)blockIndex + numJobs;
+        if (numJobs > numAhead || index >= _blockCompressed.Size())
+          break;
+        job.Offset = _blockOffsets[index] + node.StartBlock;
+        job.PackSize = (UInt32)(_blockOffsets[index + 1] - _blockOffsets[index]);
+        job.Compressed = _blockCompressed[index];
+        if (job.PackSize == 0 || _blockCache.Contains(job.Offset))
+          break;
+      }
+      const HRESULT res = ReadDataBlock(job);
+      if (res != S_OK)
+      {
+        if (numJobs == 0)
+          return res;
+        break;
+      }
+      numJobs++;
     }
-    else
+
+    RINOK(_decoderMt.Code(this, numJobs));
+
+    for (unsigned i = numJobs; i != 0;)
     {
-      if (packBlockSize > _h.BlockSize)
-        return S_FALSE;
-      RINOK(ReadStream_FALSE(_limitedInStream, _cachedBlock, packBlockSize));
-      _cachedUnpackBlockSize = packBlockSize;
+      const CBlockJob &job = _jobs[--i];
+      if (job.Res == S_OK)
+        _blockCache.Commit(job.Slot, job.Offset, job.UnpackSize);
     }
-    _cachedBlockStartPos = blockOffset;
-    _cachedPackBlockSize = packBlockSize;
+    RINOK(_jobs[0].Res);
+    block = _blockCache.GetSlotData(_jobs[0].Slot);
+    unpackBlockSize = _jobs[0].UnpackSize;
   }
-  if (offsetInBlock + blockSize > _cachedUnpackBlockSize)
+  if (offsetInBlock + blockSize > unpackBlockSize)
     return S_FALSE;
   if (blockSize != 0)
-    memcpy(dest, _cachedBlock + offsetInBlock, blockSize);
+    memcpy(dest, block + offsetInBlock, blockSize);
   return S_OK;
 }
 
@@ -2342,12 +2498,17 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
 
   _nodeIndex = item.Node;
 
-  size_t cacheSize = _h.BlockSize;
-  if (_cachedBlock.Size() != cacheSize)
+  if (_blockCache.GetBlockSize() != _h.BlockSize)
   {
-    ClearCache();
-    _cachedBlock.Alloc(cacheSize);
+    if (!_blockCache.Alloc(_h.BlockSize, kBlockCacheSize, 2))
+      return E_OUTOFMEMORY;
+    _blockCache.SetReadAheadMax(kReadAheadMax);
   }
+  _decoderMt.SetNumThreads_Default();
+  while (_unpackers.Size() < _decoderMt.GetNumThreads())
+    _unpackers.AddNew();
+  while (_jobs.Size() <= kReadAheadMax)
+    _jobs.AddNew();
 
   CSquashfsInStream *streamSpec = new CSquashfsInStream;
   CMyComPtr<IInStream> streamTemp = streamSpec;
@@ -0,0 +1,351 @@
+// TarCodecOut.cpp
+
+#include "StdAfx.h"
+
+#include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
+
+#include "../../Common/StreamUtils.h"
+
+#include "../../Compress/XzEncoder.h"
+
+#include "TarCodecOut.h"
+#include "TarHeader.h"
+
+namespace NArchive {
+namespace NTar {
+
+static const UInt64 k_ZSTD = 0x4F71101;
+
+// zstd/contrib/seekable_format
+static const UInt32 kZstdSkippableMagic = 0x184D2A5E;
+static const UInt32 kZstdSeekableMagic = 0x8F92EAB1;
+static const unsigned kZstdSeekTableFooterSize = 9;
+static const UInt32 kZstdSeekTableFramesMax = 0x8000000;
+
+
+static bool IsCoderProp_Allowed(PROPID id)
+{
+  // the blocks and threads are controlled by CCodecOutStream
+  return id != NCoderPropID::kNumThreads
+      && id != NCoderPropID::kBlockSize
+      && id != NCoderPropID::kBlockSize2;
+}
+
+
+HRESULT CCodecOutStream::Create(DECL_EXTERNAL_CODECS_LOC_VARS
+    unsigned method, const CMethodProps &props, UInt64 blockSize, UInt32 numThreads,
+    ISequentialOutStream *stream)
+{
+  _stream = stream;
+  _method = method;
+  _numBlocks = 0;
+  _packSizes.Clear();
+  _unpackSizes.Clear();
+
+  if (blockSize == 0)
+    blockSize = kCodecBlockSize_Default;
+  if (blockSize > kCodecBlockSize_Max)
+    blockSize = kCodecBlockSize_Max;
+  if (blockSize < NFileHeader::kRecordSize)
+    blockSize = NFileHeader::kRecordSize;
+  _blockSize = (size_t)blockSize;
+
+  _mt.SetNumThreads(numThreads);
+  numThreads = _mt.GetNumThreads();
+
+  CMethodProps props2;
+  FOR_VECTOR (i, props.Props)
+    if (IsCoderProp_Allowed(props.Props[i].Id))
+      props2.Props.Add(props.Props[i]);
+  props2.AddProp_NumThreads(1);
+
+  if (method == NCodecMethod::kXz)
+  {
+    CProp &prop = props2.Props.AddNew();
+    prop.Id = NCoderPropID::kBlockSize2;
+    prop.Value = (UInt64)XZ_PROPS__BLOCK_SIZE__SOLID;
+  }
+
+  _coders.Clear();
+  for (unsigned t = 0; t < numThreads; t++)
+  {
+    CMyComPtr<ICompressCoder> &coder = _coders.AddNew();
+    if (method == NCodecMethod::kXz)
+      coder = new NCompress::NXz::CEncoder;
+    else
+    {
+      RINOK(CreateCoder_Id(EXTERNAL_CODECS_LOC_VARS k_ZSTD, true, coder));
+      if (!coder)
+        return E_NOTIMPL;
+    }
+    CMyComPtr<ICompressSetCoderProperties> setCoderProps;
+    coder.QueryInterface(IID_ICompressSetCoderProperties, &setCoderProps);
+    if (setCoderProps)
+    {
+      const UInt64 reduceSize = _blockSize;
+      RINOK(props2.SetCoderProps(setCoderProps, method == NCodecMethod::kXz ? &reduceSize : NULL));
+    }
+  }
+
+  _blocks.Clear();
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    CCodecBlock &block = _blocks.AddNew();
+    block.Buf.Alloc(_blockSize);
+    block.Size = 0;
+    block.Res = S_OK;
+    block.InStreamSpec = new CBufInStream;
+    block.InStream = block.InStreamSpec;
+    block.OutStreamSpec = new CDynBufSeqOutStream;
+    block.OutStream = block.OutStreamSpec;
+  }
+
+  return S_OK;
+}
+
+
+void CCodecOutStream::CodeBlock(unsigned threadIndex, unsigned blockIndex)
+{
+  CCodecBlock &block = _blocks[blockIndex];
+  block.InStreamSpec->Init(block.Buf, block.Size);
+  block.OutStreamSpec->Init();
+  const UInt64 size = block.Size;
+  block.Res = _coders[threadIndex]->Code(block.InStream, block.OutStream, &size, NULL, NULL);
+}
+
+
+STDMETHODIMP CCodecOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+  while (size != 0)
+  {
+    CCodecBlock &block = _blocks[_numBlocks];
+    size_t cur = _blockSize - block.Size;
+    if (cur > size)
+      cur = size;
+    memcpy(block.Buf + block.Size, data, cur);
+    block.Size += cur;
+    data = (const void *)((const Byte *)data + cur);
+    size -= (UInt32)cur;
+    if (processedSize)
+      *processedSize += (UInt32)cur;
+    if (block.Size == _blockSize)
+    {
+      RINOK(EndBlock());
+    }
+  }
+  return S_OK;
+}
+
+
+HRESULT CCodecOutStream::StartMember(UInt64 size)
+{
+  const size_t cur = _blocks[_numBlocks].Size;
+  if (cur != 0 && size > _blockSize - cur)
+    return EndBlock();
+  return S_OK;
+}
+
+
+HRESULT CCodecOutStream::EndBlock()
+{
+  if (_blocks[_numBlocks].Size == 0)
+    return S_OK;
+  _numBlocks++;
+  if (_numBlocks == _blocks.Size())
+    return FlushBlocks();
+  return S_OK;
+}
+
+
+HRESULT CCodecOutStream::FlushBlocks()
+{
+  if (_numBlocks == 0)
+    return S_OK;
+  RINOK(_mt.Code(this, _numBlocks));
+  for (unsigned i = 0; i < _numBlocks; i++)
+  {
+    CCodecBlock &block = _blocks[i];
+    RINOK(block.Res);
+    RINOK(WriteBlock(block));
+    block.Size = 0;
+  }
+  _numBlocks = 0;
+  return S_OK;
+}
+
+
+/* it writes the block header with the pack and unpack sizes.
+   It returns the size of header. */
+
+static unsigned XzBlock_WriteHeader_WithSizes(CXzBlock *p, Byte *header)
+{
+  unsigned pos = 1;
+  unsigned numFilters, i;
+  p->flags |= XZ_BF_PACK_SIZE | XZ_BF_UNPACK_SIZE;
+  header[pos++] = p->flags;
+  pos += Xz_WriteVarInt(header + pos, p->packSize);
+  pos += Xz_WriteVarInt(header + pos, p->unpackSize);
+  numFilters = XzBlock_GetNumFilters(p);
+  for (i = 0; i < numFilters; i++)
+  {
+    const CXzFilter *f = &p->filters[i];
+    pos += Xz_WriteVarInt(header + pos, f->id);
+    pos += Xz_WriteVarInt(header + pos, f->propsSize);
+    memcpy(header + pos, f->props, f->propsSize);
+    pos += f->propsSize;
+  }
+  while ((pos & 3) != 0)
+    header[pos++] = 0;
+  header[0] = (Byte)(pos >> 2);
+  SetUi32(header + pos, CrcCalc(header, pos));
+  return pos + 4;
+}
+
+
+HRESULT CCodecOutStream::WriteBlock(const CCodecBlock &block)
+{
+  const Byte *p = block.OutStreamSpec->GetBuffer();
+  const size_t size = block.OutStreamSpec->GetSize();
+
+  if (_method != NCodecMethod::kXz)
+  {
+    _packSizes.Add(size);
+    _unpackSizes.Add(block.Size);
+    return WriteStream(_stream, p, size);
+  }
+
+  /* xz encoder writes the stream with one block.
+     We copy the block to our stream, and we get the sizes of block from
+     the index of that stream to write our index later. */
+
+  if (size < XZ_STREAM_HEADER_SIZE + XZ_STREAM_FOOTER_SIZE)
+    return E_FAIL;
+  const Byte *footer = p + size - XZ_STREAM_FOOTER_SIZE;
+  const UInt64 indexSize = ((UInt64)GetUi32(footer + 4) + 1) << 2;
+  if (indexSize > size - XZ_STREAM_HEADER_SIZE - XZ_STREAM_FOOTER_SIZE)
+    return E_FAIL;
+  const Byte *index = footer - (size_t)indexSize;
+  const size_t blockPackSize = (size_t)(index - p) - XZ_STREAM_HEADER_SIZE;
+
+  UInt64 numRecords = 0, unpaddedSize = 0, unpackSize = 0;
+  {
+    size_t pos = 1;
+    unsigned n;
+    n = Xz_ReadVarInt(index + pos, (size_t)indexSize - pos, &numRecords);  pos += n;
+    if (n == 0 || index[0] != 0 || numRecords != 1)
+      return E_FAIL;
+    n = Xz_ReadVarInt(index + pos, (size_t)indexSize - pos, &unpaddedSize);  pos += n;
+    if (n == 0)
+      return E_FAIL;
+    n = Xz_ReadVarInt(index + pos, (size_t)indexSize - pos, &unpackSize);
+    if (n == 0 || unpackSize != block.Size || unpaddedSize > blockPackSize)
+      return E_FAIL;
+  }
+
+  /* the encoder doesn't know the sizes of block in streaming mode, so the block header
+     doesn't contain the sizes. But the multithreaded xz decoder requires the sizes
+     in block headers. So we replace the block header by new header with the sizes.
+     The size of padding depends only from the size of compressed data,
+     so the data, padding and check are copied without changes. */
+
+  const Byte *blockData = p + XZ_STREAM_HEADER_SIZE;
+  const unsigned headerSize = ((unsigned)blockData[0] + 1) << 2;
+  const unsigned checkSize = XzFlags_GetCheckSize((CXzStreamFlags)GetBe16(p + XZ_SIG_SIZE));
+  if (blockData[0] == 0 || headerSize + checkSize >= unpaddedSize)
+    return E_FAIL;
+  CXzBlock xzBlock;
+  if (XzBlock_Parse(&xzBlock, blockData) != SZ_OK)
+    return E_FAIL;
+  xzBlock.packSize = unpaddedSize - headerSize - checkSize;
+  xzBlock.unpackSize = unpackSize;
+  Byte newHeader[XZ_BLOCK_HEADER_SIZE_MAX];
+  const unsigned newHeaderSize = XzBlock_WriteHeader_WithSizes(&xzBlock, newHeader);
+
+  if (_packSizes.IsEmpty())
+  {
+    memcpy(_xzHeader, p, XZ_STREAM_HEADER_SIZE);
+    RINOK(WriteStream(_stream, p, XZ_STREAM_HEADER_SIZE));
+  }
+  else if (memcmp(_xzHeader, p, XZ_STREAM_HEADER_SIZE) != 0)
+    return E_FAIL;
+
+  _packSizes.Add(unpaddedSize - headerSize + newHeaderSize);
+  _unpackSizes.Add(unpackSize);
+  RINOK(WriteStream(_stream, newHeader, newHeaderSize));
+  return WriteStream(_stream, blockData + headerSize, blockPackSize - headerSize);
+}
+
+
+HRESULT CCodecOutStream::WriteXzIndex()
+{
+  const unsigned numBlocks = _packSizes.Size();
+  CByteBuffer buf;
+  buf.Alloc((size_t)numBlocks * 20 + 16 + XZ_STREAM_FOOTER_SIZE);
+  Byte *p = buf;
+
+  size_t pos = 0;
+  p[pos++] = 0;
+  pos += Xz_WriteVarInt(p + pos, numBlocks);
+  for (unsigned i = 0; i < numBlocks; i++)
+  {
+    pos += Xz_WriteVarInt(p + pos, _packSizes[i]);
+    pos += Xz_WriteVarInt(p + pos, _unpackSizes[i]);
+  }
+  while ((pos & 3) != 0)
+    p[pos++] = 0;
+  SetUi32(p + pos, CrcCalc(p, pos));
+  pos += 4;
+
+  Byte *footer = p + pos;
+  SetUi32(footer + 4, (UInt32)(pos >> 2) - 1);
+  footer[8] = _xzHeader[XZ_SIG_SIZE];
+  footer[9] = _xzHeader[XZ_SIG_SIZE + 1];
+  footer[10] = XZ_FOOTER_SIG_0;
+  footer[11] = XZ_FOOTER_SIG_1;
+  SetUi32(footer, CrcCalc(footer + 4, 6));
+  pos += XZ_STREAM_FOOTER_SIZE;
+
+  return WriteStream(_stream, p, pos);
+}
+
+
+HRESULT CCodecOutStream::WriteZstdSeekTable()
+{
+  const unsigned numFrames = _packSizes.Size();
+  // the frames without the seek table still can be unpacked sequentially
+  if (numFrames > kZstdSeekTableFramesMax)
+    return S_OK;
+  const size_t tableSize = (size_t)numFrames * 8 + kZstdSeekTableFooterSize;
+  CByteBuffer buf;
+  buf.Alloc(8 + tableSize);
+  Byte *p = buf;
+  SetUi32(p, kZstdSkippableMagic);
+  SetUi32(p + 4, (UInt32)tableSize);
+  p += 8;
+  for (unsigned i = 0; i < numFrames; i++, p += 8)
+  {
+    SetUi32(p, (UInt32)_packSizes[i]);
+    SetUi32(p + 4, (UInt32)_unpackSizes[i]);
+  }
+  SetUi32(p, (UInt32)numFrames);
+  p[4] = 0; // no checksums
+  SetUi32(p + 5, kZstdSeekableMagic);
+  return WriteStream(_stream, buf, buf.Size());
+}
+
+
+HRESULT CCodecOutStream::Finish()
+{
+  RINOK(EndBlock());
+  RINOK(FlushBlocks());
+  if (_packSizes.IsEmpty())
+    return S_OK;
+  if (_method == NCodecMethod::kXz)
+    return WriteXzIndex();
+  return WriteZstdSeekTable();
+}
+
+}}
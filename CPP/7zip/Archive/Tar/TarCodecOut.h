@@ -0,0 +1,91 @@
+// TarCodecOut.h
+
+#ifndef __TAR_CODEC_OUT_H
+#define __TAR_CODEC_OUT_H
+
+#include "../../../../C/Xz.h"
+
+#include "../../../Common/MyBuffer.h"
+#include "../../../Common/MyCom.h"
+
+#include "../../Common/BlockCoderMt.h"
+#include "../../Common/CreateCoder.h"
+#include "../../Common/MethodProps.h"
+#include "../../Common/StreamObjects.h"
+
+namespace NArchive {
+namespace NTar {
+
+/*
+  CCodecOutStream compresses tar archive to .tar.xz or .tar.zst by independent blocks.
+  UpdateArchive() calls StartMember() before each member.
+  If the member doesn't fit to current block, the new block is started.
+  So the member that is not larger than block is stored in one block,
+  and big member starts at the start of block.
+  The blocks of group are compressed in parallel and written in original order.
+  The index of blocks is written at the end, so the reader can unpack only
+  the blocks that contain the requested member:
+    xz   : one xz stream with the blocks and the index of blocks,
+    zstd : one frame per block and the seek table (zstd seekable format).
+*/
+
+namespace NCodecMethod
+{
+  const unsigned kNone = 0;
+  const unsigned kXz = 1;
+  const unsigned kZstd = 2;
+}
+
+const UInt32 kCodecBlockSize_Default = (UInt32)1 << 23;
+const UInt32 kCodecBlockSize_Max = (UInt32)1 << 30;
+
+struct CCodecBlock
+{
+  CByteBuffer Buf;
+  size_t Size;
+  HRESULT Res;
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CDynBufSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+};
+
+class CCodecOutStream:
+  public ISequentialOutStream,
+  public IBlockCoderCallback,
+  public CMyUnknownImp
+{
+  CMyComPtr<ISequentialOutStream> _stream;
+  unsigned _method;
+  size_t _blockSize;
+  CBlockCoderMt _mt;
+  CObjectVector< CMyComPtr<ICompressCoder> > _coders;
+  CObjectVector<CCodecBlock> _blocks;
+  unsigned _numBlocks; // the number of finished blocks in group
+
+  // xz: (unpadded size) of blocks; zstd: the sizes of frames
+  CRecordVector<UInt64> _packSizes;
+  CRecordVector<UInt64> _unpackSizes;
+  Byte _xzHeader[XZ_STREAM_HEADER_SIZE];
+
+  HRESULT EndBlock();
+  HRESULT FlushBlocks();
+  HRESULT WriteBlock(const CCodecBlock &block);
+  HRESULT WriteXzIndex();
+  HRESULT WriteZstdSeekTable();
+public:
+  MY_UNKNOWN_IMP1(ISequentialOutStream)
+
+  HRESULT Create(DECL_EXTERNAL_CODECS_LOC_VARS
+      unsigned method, const CMethodProps &props, UInt64 blockSize, UInt32 numThreads,
+      ISequentialOutStream *stream);
+  HRESULT StartMember(UInt64 size);
+  HRESULT Finish();
+
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+  virtual void CodeBlock(unsigned threadIndex, unsigned blockIndex);
+};
+
+}}
+
+#endif
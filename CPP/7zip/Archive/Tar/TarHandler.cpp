@@ -7,6 +7,7 @@
 #include "../../../Common/StringConvert.h"
 #include "../../../Common/UTFConvert.h"
 
+#include "../../../Windows/System.h"
 #include "../../../Windows/TimeUtils.h"
 
 #include "../../Common/LimitedStreams.h"
@@ -15,8 +16,10 @@
 #include "../../Common/StreamObjects.h"
 #include "../../Common/StreamUtils.h"
 
+#include "../Common/HandlerOut.h"
 #include "../Common/ItemNameUtils.h"
 
+#include "TarCodecOut.h"
 #include "TarHandler.h"
 
 using namespace NWindows;
@@ -958,6 +961,15 @@ void CHandler::Init()
   // TimeOptions.Clear();
   _handlerTimeOptions.Init();
   // _handlerTimeOptions.Write_MTime.Val = true; // it's default already
+  _codecMethod = NCodecMethod::kNone;
+  _codecProps.Clear();
+  _codecBlockSize = 0;
+  _level = (UInt32)(Int32)-1;
+  #ifndef _7ZIP_ST
+  _numThreads = NSystem::GetNumberOfProcessors();
+  #else
+  _numThreads = 1;
+  #endif
 }
 
 
@@ -979,6 +991,26 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       // some clients write 'x' property. So we support it
       UInt32 level = 0;
       RINOK(ParsePropToUInt32(name.Ptr(1), prop, level));
+      _level = level;
+    }
+    else if (name.IsEqualTo("0"))
+    {
+      // -m0=xz or -m0=zstd : .tar.xz or .tar.zst with independent blocks
+      RINOK(_codecProps.ParseMethodFromPROPVARIANT(UString(), prop));
+      const AString &m = _codecProps.MethodName;
+      if (StringsAreEqualNoCase_Ascii(m, "xz"))
+        _codecMethod = NCodecMethod::kXz;
+      else if (StringsAreEqualNoCase_Ascii(m, "zstd"))
+        _codecMethod = NCodecMethod::kZstd;
+      else if (StringsAreEqualNoCase_Ascii(m, "copy"))
+        _codecMethod = NCodecMethod::kNone;
+      else
+        return E_INVALIDARG;
+    }
+    else if (name.IsEqualTo("c"))
+    {
+      if (!ParseSizeString(L"", prop, 0, _codecBlockSize))
+        return E_INVALIDARG;
     }
     else if (name.IsEqualTo("cp"))
     {
@@ -989,6 +1021,9 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
     }
     else if (name.IsPrefixedBy_Ascii_NoCase("mt"))
     {
+      #ifndef _7ZIP_ST
+      RINOK(ParseMtProp(name.Ptr(2), prop, NSystem::GetNumberOfProcessors(), _numThreads));
+      #endif
     }
     else if (name.IsPrefixedBy_Ascii_NoCase("memuse"))
     {
@@ -1045,4 +1080,6 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
   return S_OK;
 }
 
+IMPL_ISetCompressCodecsInfo
+
 }}
@@ -7,6 +7,8 @@
 
 #include "../../../Windows/PropVariant.h"
 
+#include "../../Common/CreateCoder.h"
+
 #include "../../Compress/CopyCoder.h"
 
 #include "../Common/HandlerOut.h"
@@ -22,6 +24,7 @@ class CHandler:
   public IInArchiveGetStream,
   public ISetProperties,
   public IOutArchive,
+  PUBLIC_ISetCompressCodecsInfo
   public CMyUnknownImp
 {
 public:
@@ -40,6 +43,15 @@ private:
   CHandlerTimeOptions _handlerTimeOptions;
   CEncodingCharacts _encodingCharacts;
 
+  // the archive is compressed with (_codecMethod) by independent blocks
+  unsigned _codecMethod;
+  COneMethodInfo _codecProps;
+  UInt64 _codecBlockSize;
+  UInt32 _level;
+  UInt32 _numThreads;
+
+  DECL_EXTERNAL_CODECS_VARS
+
   UInt32 _curIndex;
   bool _latestIsRead;
   CItemEx _latestItem;
@@ -53,13 +65,14 @@ private:
   HRESULT SkipTo(UInt32 index);
   void TarStringToUnicode(const AString &s, NWindows::NCOM::CPropVariant &prop, bool toOs = false) const;
 public:
-  MY_UNKNOWN_IMP5(
-    IInArchive,
-    IArchiveOpenSeq,
-    IInArchiveGetStream,
-    ISetProperties,
-    IOutArchive
-  )
+  MY_QUERYINTERFACE_BEGIN2(IInArchive)
+  MY_QUERYINTERFACE_ENTRY(IArchiveOpenSeq)
+  MY_QUERYINTERFACE_ENTRY(IInArchiveGetStream)
+  MY_QUERYINTERFACE_ENTRY(ISetProperties)
+  MY_QUERYINTERFACE_ENTRY(IOutArchive)
+  QUERY_ENTRY_ISetCompressCodecsInfo
+  MY_QUERYINTERFACE_END
+  MY_ADDREF_RELEASE
 
   INTERFACE_IInArchive(;)
   INTERFACE_IOutArchive(;)
@@ -67,6 +80,8 @@ public:
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
+  DECL_ISetCompressCodecsInfo
+
   void Init();
   CHandler();
 };
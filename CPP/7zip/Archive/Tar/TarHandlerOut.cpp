@@ -12,6 +12,7 @@
 
 #include "../Common/ItemNameUtils.h"
 
+#include "TarCodecOut.h"
 #include "TarHandler.h"
 #include "TarUpdate.h"
 
@@ -323,8 +324,21 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
         // k_PaxTimeMode_RemoveZero_Always; // original pax code
   }
 
-  return UpdateArchive(_stream, outStream, _items, updateItems,
-      options, callback);
+  if (_codecMethod == NCodecMethod::kNone)
+    return UpdateArchive(_stream, outStream, _items, updateItems,
+        options, callback, NULL);
+
+  COneMethodInfo props = _codecProps;
+  if (_level != (UInt32)(Int32)-1 && props.FindProp(NCoderPropID::kLevel) < 0)
+    props.AddProp_Level(_level);
+
+  CCodecOutStream *codecStreamSpec = new CCodecOutStream;
+  CMyComPtr<ISequentialOutStream> codecStream = codecStreamSpec;
+  RINOK(codecStreamSpec->Create(EXTERNAL_CODECS_VARS
+      _codecMethod, props, _codecBlockSize, _numThreads, outStream));
+  RINOK(UpdateArchive(_stream, codecStream, _items, updateItems,
+      options, callback, codecStreamSpec));
+  return codecStreamSpec->Finish();
   
   COM_TRY_END
 }
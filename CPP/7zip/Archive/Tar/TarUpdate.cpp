@@ -11,6 +11,7 @@
 
 #include "../../Compress/CopyCoder.h"
 
+#include "TarCodecOut.h"
 #include "TarOut.h"
 #include "TarUpdate.h"
 
@@ -150,7 +151,8 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
     const CObjectVector<NArchive::NTar::CItemEx> &inputItems,
     const CObjectVector<CUpdateItem> &updateItems,
     const CUpdateOptions &options,
-    IArchiveUpdateCallback *updateCallback)
+    IArchiveUpdateCallback *updateCallback,
+    CCodecOutStream *codecStream)
 {
   COutArchive outArchive;
   outArchive.Create(outStream);
@@ -406,6 +408,10 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
 
       if (needWrite)
       {
+        if (codecStream)
+        {
+          RINOK(codecStream->StartMember(NFileHeader::kRecordSize + item.Get_PackSize_Aligned()));
+        }
         const UInt64 headerPos = outArchive.Pos;
         // item.PackSize = ((UInt64)1 << 33); // for debug
         RINOK(outArchive.WriteHeader(item));
@@ -491,6 +497,11 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
 
       const CItemEx &existItem = inputItems[(unsigned)ui.IndexInArc];
       UInt64 size, pos;
+
+      if (codecStream)
+      {
+        RINOK(codecStream->StartMember(existItem.Get_FullSize_Aligned()));
+      }
       
       if (ui.NewProps)
       {
@@ -55,11 +55,15 @@ struct CUpdateOptions
 };
 
 
+class CCodecOutStream;
+
+// (codecStream != NULL) : (outStream) is (codecStream) that compresses the archive
 HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
     const CObjectVector<CItemEx> &inputItems,
     const CObjectVector<CUpdateItem> &updateItems,
     const CUpdateOptions &options,
-    IArchiveUpdateCallback *updateCallback);
+    IArchiveUpdateCallback *updateCallback,
+    CCodecOutStream *codecStream);
 
 HRESULT GetPropString(IArchiveUpdateCallback *callback, UInt32 index, PROPID propId, AString &res,
     UINT codePage, unsigned utfFlags, bool convertSlash);
@@ -12,6 +12,7 @@
 #include "../../Windows/PropVariant.h"
 
 #include "../Common/RegisterArc.h"
+#include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
 
 #include "HandlerCont.h"
@@ -693,7 +694,11 @@ class CHandler: public CHandlerImg
     return ReadStream_FALSE(Stream, buf, size);
   }
   
+  // raw data of payload blocks, the key is (offset >> kCacheUnitLog)
+  CBlockCache _cache;
+
   void InitSeekPositions();
+  HRESULT ReadPhyDirect(UInt64 offset, void *data, UInt32 size, UInt32 &processed);
   HRESULT ReadPhy(UInt64 offset, void *data, UInt32 size, UInt32 &processed);
 
   bool IsDiff() const
@@ -792,15 +797,9 @@ void CHandler::InitSeekPositions()
 }
 
 
-HRESULT CHandler::ReadPhy(UInt64 offset, void *data, UInt32 size, UInt32 &processed)
+HRESULT CHandler::ReadPhyDirect(UInt64 offset, void *data, UInt32 size, UInt32 &processed)
 {
   processed = 0;
-  if (offset > _phySize
-      || offset + size > _phySize)
-  {
-    // we don't expect these cases, if (_phySize) was set correctly.
-    return S_FALSE;
-  }
   if (offset != _posInArc)
   {
     const HRESULT res = Seek2(offset);
@@ -823,6 +822,78 @@ HRESULT CHandler::ReadPhy(UInt64 offset, void *data, UInt32 size, UInt32 &proces
 }
 
 
+
+/* VHDX has no compression, but the file systems inside the image (NTFS, ext4)
+   read small clusters in random order. So small reads are served from
+   the cache of 64 KiB units, and sequential units are read in advance. */
+
+static const unsigned kCacheUnitLog = 16;
+static const UInt32 kCacheUnitSize = (UInt32)1 << kCacheUnitLog;
+static const size_t kCacheSize = (size_t)1 << 24;
+static const unsigned kReadAheadMax = 16;
+
+HRESULT CHandler::ReadPhy(UInt64 offset, void *data, UInt32 size, UInt32 &processed)
+{
+  processed = 0;
+  if (offset > _phySize
+      || offset + size > _phySize)
+  {
+    // we don't expect these cases, if (_phySize) was set correctly.
+    return S_FALSE;
+  }
+
+  const UInt32 offsetInUnit = (UInt32)offset & (kCacheUnitSize - 1);
+  if (offsetInUnit + size > kCacheUnitSize)
+    return ReadPhyDirect(offset, data, size, processed);
+  
+  if (!_cache.IsAllocated())
+  {
+    if (!_cache.Alloc(kCacheUnitSize, kCacheSize, 2))
+      return ReadPhyDirect(offset, data, size, processed);
+    _cache.SetReadAheadMax(kReadAheadMax);
+  }
+
+  const UInt64 key = offset >> kCacheUnitLog;
+  const unsigned numAhead = _cache.GetReadAhead(key, key + 1);
+  size_t unitSize;
+  const Byte *p = _cache.Find(key, unitSize);
+  
+  if (!p)
+  {
+    for (unsigned i = 0; i <= numAhead; i++)
+    {
+      const UInt64 key2 = key + i;
+      const UInt64 pos = key2 << kCacheUnitLog;
+      if (pos >= _phySize || (i != 0 && _cache.Contains(key2)))
+        break;
+      UInt32 size2 = kCacheUnitSize;
+      if (size2 > _phySize - pos)
+        size2 = (UInt32)(_phySize - pos);
+      const UInt32 slot = _cache.Reserve();
+      Byte *buf = _cache.GetSlotData(slot);
+      UInt32 processed2;
+      // if there is some reading error, we return the result of direct reading
+      if (ReadPhyDirect(pos, buf, size2, processed2) != S_OK || processed2 != size2)
+        break;
+      _cache.Commit(slot, key2, size2);
+      if (i == 0)
+      {
+        p = buf;
+        unitSize = size2;
+      }
+    }
+    if (!p)
+      return ReadPhyDirect(offset, data, size, processed);
+  }
+  
+  if (offsetInUnit + size > unitSize)
+    return S_FALSE;
+  memcpy(data, p + offsetInUnit, size);
+  processed = size;
+  return S_OK;
+}
+
+
 #define PAYLOAD_BLOCK_NOT_PRESENT   0
 #define PAYLOAD_BLOCK_UNDEFINED     1
 #define PAYLOAD_BLOCK_ZERO          2
@@ -2005,6 +2076,7 @@ void CHandler::CloseAtError()
   Stream.Release();
 
   _phySize = 0;
+  _cache.Free();
   Bat.Clear();
   BitMaps.Clear();
   NumUsedBlocks = 0;
@@ -14,6 +14,7 @@
 
 #include "../../Windows/PropVariant.h"
 
+#include "../Common/BlockCoderMt.h"
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
@@ -48,6 +49,9 @@ static const UInt32 k_Flags_Marker     = (UInt32)1 << 17;
 
 static const unsigned k_NumMidBits = 9; // num bits for index in Grain Table
 
+static const size_t kCacheSize = (size_t)1 << 25;
+static const unsigned kReadAheadMax = 16;
+
 struct CHeader
 {
   UInt32 flags;
@@ -370,6 +374,22 @@ struct CExtent
   UInt64 GetEndOffset() const { return StartOffset + NumBytes; }
   
   bool IsVmdk() const { return !IsZero && !IsFlat; };
+  
+  // returns the sector of grain, or 0, if the grain is not allocated or it's zero grain
+  UInt32 GetGrainSector(UInt64 cluster) const
+  {
+    const UInt64 high = cluster >> k_NumMidBits;
+    if (high >= Tables.Size())
+      return 0;
+    const CByteBuffer &table = Tables[(unsigned)high];
+    if (table.Size() == 0)
+      return 0;
+    const size_t midBits = (size_t)cluster & ((1 << k_NumMidBits) - 1);
+    const UInt32 v = Get32((const Byte *)table + (midBits << 2));
+    if (v == ZeroSector)
+      return 0;
+    return v;
+  }
   // if (IsOK && IsVmdk()), then VMDK header of this extent was read
   
   CExtent():
@@ -422,7 +442,42 @@ struct CExtent
 };
   
 
-class CHandler: public CHandlerImg
+struct CGrainDecoder
+{
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  NCompress::NZlib::CDecoder *ZlibDecoderSpec;
+  CMyComPtr<ICompressCoder> ZlibDecoder;
+
+  CGrainDecoder()
+  {
+    InStreamSpec = new CBufInStream;
+    InStream = InStreamSpec;
+    OutStreamSpec = new CBufPtrSeqOutStream;
+    OutStream = OutStreamSpec;
+    ZlibDecoderSpec = new NCompress::NZlib::CDecoder;
+    ZlibDecoder = ZlibDecoderSpec;
+  }
+};
+
+
+// compressed grain that was read from archive, and that must be unpacked to cache slot
+struct CGrainJob
+{
+  UInt64 Key;
+  UInt32 Slot;
+  UInt32 PackSize;
+  HRESULT Res;
+  bool DataError;
+  CByteBuffer Packed;
+};
+
+
+class CHandler:
+  public CHandlerImg,
+  public IBlockCoderCallback
 {
   bool _isArc;
   bool _unsupported;
@@ -432,25 +487,18 @@ class CHandler: public CHandlerImg
   bool _isMultiVol;
   bool _needDeflate;
 
-  UInt64 _cacheCluster;
-  unsigned _cacheExtent;
-  CByteBuffer _cache;
-  CByteBuffer _cacheCompressed;
+  // unpacked grains, the key is virtual offset of grain
+  CBlockCache _cache;
+  CBlockCoderMt _decoderMt;
+  CObjectVector<CGrainDecoder> _decoders;
+  CObjectVector<CGrainJob> _jobs;
+  size_t _jobClusterSize;
   
   unsigned _clusterBitsMax;
   UInt64 _phySize;
 
   CObjectVector<CExtent> _extents;
 
-  CBufInStream *_bufInStreamSpec;
-  CMyComPtr<ISequentialInStream> _bufInStream;
-
-  CBufPtrSeqOutStream *_bufOutStreamSpec;
-  CMyComPtr<ISequentialOutStream> _bufOutStream;
-
-  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
-  CMyComPtr<ICompressCoder> _zlibDecoder;
-
   CByteBuffer _descriptorBuf;
   CDescriptor _descriptor;
 
@@ -461,9 +509,13 @@ class CHandler: public CHandlerImg
     _virtPos = 0;
   }
 
+  HRESULT ReadGrain(CExtent &extent, UInt64 cluster, UInt64 offset, CGrainJob &job);
+
   virtual HRESULT Open2(IInStream *stream, IArchiveOpenCallback *openCallback);
   virtual void CloseAtError();
 public:
+  virtual void CodeBlock(unsigned threadIndex, unsigned blockIndex);
+
   INTERFACE_IInArchive_Img(;)
 
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
@@ -471,6 +523,76 @@ public:
 };
 
 
+HRESULT CHandler::ReadGrain(CExtent &extent, UInt64 cluster, UInt64 offset, CGrainJob &job)
+{
+  if (offset != extent.PosInArc)
+  {
+    // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
+    RINOK(extent.Seek(offset));
+  }
+  
+  Byte *buf = job.Packed;
+  const size_t kStartSize = 1 << 9;
+  {
+    size_t curSize = kStartSize;
+    RINOK(extent.Read(buf, &curSize));
+    // _stream_PackSize += curSize;
+    if (curSize != kStartSize)
+      return S_FALSE;
+  }
+
+  if (Get64(buf) != (cluster << (extent.ClusterBits - 9)))
+    return S_FALSE;
+
+  const UInt32 dataSize = Get32(buf + 8);
+  if (dataSize > ((UInt32)1 << 31))
+    return S_FALSE;
+
+  size_t dataSize2 = (size_t)dataSize + 12;
+  
+  if (dataSize2 > kStartSize)
+  {
+    dataSize2 = (dataSize2 + 511) & ~(size_t)511;
+    if (dataSize2 > job.Packed.Size())
+      return S_FALSE;
+    size_t curSize = dataSize2 - kStartSize;
+    const size_t curSize2 = curSize;
+    RINOK(extent.Read(buf + kStartSize, &curSize));
+    // _stream_PackSize += curSize;
+    if (curSize != curSize2)
+      return S_FALSE;
+  }
+  
+  job.PackSize = dataSize;
+  return S_OK;
+}
+
+
+void CHandler::CodeBlock(unsigned threadIndex, unsigned blockIndex)
+{
+  CGrainDecoder &d = _decoders[threadIndex];
+  CGrainJob &job = _jobs[blockIndex];
+  const size_t clusterSize = _jobClusterSize;
+  
+  d.InStreamSpec->Init(job.Packed + 12, job.PackSize);
+  d.OutStreamSpec->Init(_cache.GetSlotData(job.Slot), clusterSize);
+  
+  // Do we need to use smaller block than clusterSize for last cluster?
+  UInt64 blockSize64 = clusterSize;
+  HRESULT res = d.ZlibDecoderSpec->Code(d.InStream, d.OutStream, NULL, &blockSize64, NULL);
+
+  job.DataError = false;
+  if (d.OutStreamSpec->GetPos() != clusterSize
+      || d.ZlibDecoderSpec->GetInputProcessedSize() != job.PackSize)
+  {
+    job.DataError = true;
+    if (res == S_OK)
+      res = S_FALSE;
+  }
+  job.Res = res;
+}
+
+
 STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   if (processedSize)
@@ -607,140 +729,106 @@ STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
         size = (UInt32)rem;
     }
 
-    if (extentIndex == _cacheExtent && cluster == _cacheCluster)
+    const UInt64 key = _virtPos - lowBits;
+    const unsigned numAhead = _cache.GetReadAhead(key, key + clusterSize);
     {
-      memcpy(data, _cache + lowBits, size);
-      _virtPos += size;
-      if (processedSize)
-        *processedSize = size;
-      return S_OK;
+      size_t cachedSize;
+      const Byte *p = _cache.Find(key, cachedSize);
+      if (p)
+      {
+        memcpy(data, p + lowBits, size);
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return S_OK;
+      }
     }
     
-    const UInt64 high = cluster >> k_NumMidBits;
- 
-    if (high < extent.Tables.Size())
-    {
-      const CByteBuffer &table = extent.Tables[(unsigned)high];
+    const UInt32 v = extent.GetGrainSector(cluster);
     
-      if (table.Size() != 0)
+    if (v != 0)
+    {
+      UInt64 offset = (UInt64)v << 9;
+      if (extent.NeedDeflate)
       {
-        const size_t midBits = (size_t)cluster & ((1 << k_NumMidBits) - 1);
-        const Byte *p = (const Byte *)table + (midBits << 2);
-        const UInt32 v = Get32(p);
-        
-        if (v != 0 && v != extent.ZeroSector)
+        /* for sequential reading we read the compressed grains that follow
+           the current grain, and we unpack all these grains in parallel.
+           An error in next grain stops the read-ahead only. */
+        unsigned numJobs = 0;
+        for (;;)
         {
-          UInt64 offset = (UInt64)v << 9;
-          if (extent.NeedDeflate)
+          const UInt64 cluster2 = cluster + numJobs;
+          const UInt64 key2 = key + ((UInt64)numJobs << clusterBits);
+          if (numJobs != 0)
           {
-            if (offset != extent.PosInArc)
-            {
-              // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
-              RINOK(extent.Seek(offset));
-            }
-            
-            const size_t kStartSize = 1 << 9;
-            {
-              size_t curSize = kStartSize;
-              RINOK(extent.Read(_cacheCompressed, &curSize));
-              // _stream_PackSize += curSize;
-              if (curSize != kStartSize)
-                return S_FALSE;
-            }
-
-            if (Get64(_cacheCompressed) != (cluster << (clusterBits - 9)))
-              return S_FALSE;
-
-            UInt32 dataSize = Get32(_cacheCompressed + 8);
-            if (dataSize > ((UInt32)1 << 31))
-              return S_FALSE;
-
-            size_t dataSize2 = (size_t)dataSize + 12;
-            
-            if (dataSize2 > kStartSize)
-            {
-              dataSize2 = (dataSize2 + 511) & ~(size_t)511;
-              if (dataSize2 > _cacheCompressed.Size())
-                return S_FALSE;
-              size_t curSize = dataSize2 - kStartSize;
-              const size_t curSize2 = curSize;
-              RINOK(extent.Read(_cacheCompressed + kStartSize, &curSize));
-              // _stream_PackSize += curSize;
-              if (curSize != curSize2)
-                return S_FALSE;
-            }
-
-            _bufInStreamSpec->Init(_cacheCompressed + 12, dataSize);
-            
-            _cacheCluster = (UInt64)(Int64)-1;
-            _cacheExtent = (unsigned)(int)-1;
-
-            if (_cache.Size() < clusterSize)
-              return E_FAIL;
-            _bufOutStreamSpec->Init(_cache, clusterSize);
-            
-            // Do we need to use smaller block than clusterSize for last cluster?
-            UInt64 blockSize64 = clusterSize;
-            HRESULT res = _zlibDecoderSpec->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
-
-            /*
-            if (_bufOutStreamSpec->GetPos() != clusterSize)
-            {
-              _stream_dataError = true;
-              memset(_cache + _bufOutStreamSpec->GetPos(), 0, clusterSize - _bufOutStreamSpec->GetPos());
-            }
-            */
-
-              if (_bufOutStreamSpec->GetPos() != clusterSize
-                  || _zlibDecoderSpec->GetInputProcessedSize() != dataSize)
-              {
-                _stream_dataError = true;
-                if (res == S_OK)
-                  res = S_FALSE;
-              }
-
-            RINOK(res);
-            
-            _cacheCluster = cluster;
-            _cacheExtent = extentIndex;
-            
-            continue;
-            /*
-            memcpy(data, _cache + lowBits, size);
-            _virtPos += size;
-            if (processedSize)
-              *processedSize = size;
-            return S_OK;
-            */
+            if (numJobs > numAhead
+                || key2 >= extent.StartOffset + extent.VirtSize
+                || _cache.Contains(key2))
+              break;
+            const UInt32 v2 = extent.GetGrainSector(cluster2);
+            if (v2 == 0)
+              break;
+            offset = (UInt64)v2 << 9;
           }
+          CGrainJob &job = _jobs[numJobs];
+          const HRESULT res = ReadGrain(extent, cluster2, offset, job);
+          if (res != S_OK)
           {
-            offset += lowBits;
-            if (offset != extent.PosInArc)
-            {
-              // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
-              RINOK(extent.Seek(offset));
-            }
-            UInt32 size2 = 0;
-            HRESULT res = extent.Stream->Read(data, size, &size2);
-            if (res == S_OK && size2 == 0)
-            {
-              _stream_unavailData = true;
-              /*
-              memset(data, 0, size);
-              _virtPos += size;
-              if (processedSize)
-                *processedSize = size;
-              return S_OK;
-              */
-            }
-            extent.PosInArc += size2;
-            // _stream_PackSize += size2;
-            _virtPos += size2;
-            if (processedSize)
-              *processedSize = size2;
-            return res;
+            if (numJobs == 0)
+              return res;
+            break;
           }
+          job.Key = key2;
+          numJobs++;
+        }
+
+        unsigned i;
+        for (i = 0; i < numJobs; i++)
+          _jobs[i].Slot = _cache.Reserve();
+        _jobClusterSize = clusterSize;
+        RINOK(_decoderMt.Code(this, numJobs));
+        
+        for (i = numJobs; i != 0;)
+        {
+          const CGrainJob &job = _jobs[--i];
+          if (job.Res == S_OK)
+            _cache.Commit(job.Slot, job.Key, clusterSize);
+        }
+        {
+          const CGrainJob &job = _jobs[0];
+          if (job.DataError)
+            _stream_dataError = true;
+          RINOK(job.Res);
+        }
+        
+        continue;
+      }
+      {
+        offset += lowBits;
+        if (offset != extent.PosInArc)
+        {
+          // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
+          RINOK(extent.Seek(offset));
+        }
+        UInt32 size2 = 0;
+        HRESULT res = extent.Stream->Read(data, size, &size2);
+        if (res == S_OK && size2 == 0)
+        {
+          _stream_unavailData = true;
+          /*
+          memset(data, 0, size);
+          _virtPos += size;
+          if (processedSize)
+            *processedSize = size;
+          return S_OK;
+          */
         }
+        extent.PosInArc += size2;
+        // _stream_PackSize += size2;
+        _virtPos += size2;
+        if (processedSize)
+          *processedSize = size2;
+        return res;
       }
     }
     
@@ -1431,8 +1519,8 @@ STDMETHODIMP CHandler::Close()
 {
   _phySize = 0;
   
-  _cacheCluster = (UInt64)(Int64)-1;
-  _cacheExtent = (unsigned)(int)-1;
+  _cache.Free();
+  _jobs.Clear();
 
   _clusterBitsMax = 0;
 
@@ -1471,27 +1559,20 @@ STDMETHODIMP CHandler::GetStream(UInt32 /* index */, ISequentialInStream **strea
 
   if (_needDeflate)
   {
-    if (!_bufInStream)
-    {
-      _bufInStreamSpec = new CBufInStream;
-      _bufInStream = _bufInStreamSpec;
-    }
-    
-    if (!_bufOutStream)
-    {
-      _bufOutStreamSpec = new CBufPtrSeqOutStream();
-      _bufOutStream = _bufOutStreamSpec;
-    }
-
-    if (!_zlibDecoder)
-    {
-      _zlibDecoderSpec = new NCompress::NZlib::CDecoder;
-      _zlibDecoder = _zlibDecoderSpec;
-    }
+    _decoderMt.SetNumThreads_Default();
+    while (_decoders.Size() < _decoderMt.GetNumThreads())
+      _decoders.AddNew();
     
     const size_t clusterSize = (size_t)1 << _clusterBitsMax;
-    _cache.AllocAtLeast(clusterSize);
-    _cacheCompressed.AllocAtLeast(clusterSize * 2);
+    if (_cache.GetBlockSize() != clusterSize)
+      if (!_cache.Alloc(clusterSize, kCacheSize, 2))
+        return E_OUTOFMEMORY;
+    _cache.Clear();
+    _cache.SetReadAheadMax(kReadAheadMax);
+    while (_jobs.Size() <= kReadAheadMax)
+      _jobs.AddNew();
+    FOR_VECTOR (i, _jobs)
+      _jobs[i].Packed.AllocAtLeast(clusterSize * 2);
   }
 
   FOR_VECTOR (i, _extents)
@@ -1198,6 +1198,22 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       // some clients write 'x' property. So we support it
       UInt32 level = 0;
       RINOK(ParsePropToUInt32(name.Ptr(1), prop, level));
+      if (level == 0)
+        _method = 0;
+    }
+    else if (name.IsEqualTo("m") || name.IsEqualTo("0"))
+    {
+      if (prop.vt != VT_BSTR)
+        return E_INVALIDARG;
+      const wchar_t *m = prop.bstrVal;
+      if (StringsAreEqualNoCase_Ascii(m, "XPRESS"))
+        _method = NMethod::kXPRESS;
+      else if (StringsAreEqualNoCase_Ascii(m, "LZX"))
+        _method = NMethod::kLZX;
+      else if (StringsAreEqualNoCase_Ascii(m, "Copy"))
+        _method = 0;
+      else
+        return E_INVALIDARG;
     }
     else if (name.IsEqualTo("is"))
     {
@@ -1212,6 +1228,9 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
     }
     else if (name.IsPrefixedBy_Ascii_NoCase("mt"))
     {
+      #ifndef _7ZIP_ST
+      RINOK(ParseMtProp(name.Ptr(2), prop, NWindows::NSystem::GetNumberOfProcessors(), _numThreads));
+      #endif
     }
     else if (name.IsPrefixedBy_Ascii_NoCase("memuse"))
     {
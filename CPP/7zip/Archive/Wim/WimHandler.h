@@ -5,6 +5,8 @@
 
 #include "../../../Common/MyCom.h"
 
+#include "../../../Windows/System.h"
+
 #include "WimIn.h"
 
 namespace NArchive {
@@ -42,6 +44,9 @@ class CHandler:
   bool _set_showImageNumber;
   int _defaultImageNumber;
 
+  unsigned _method; // compression method for new archive
+  UInt32 _numThreads;
+
   bool _showImageNumber;
 
   bool _keepMode_ShowImageNumber;
@@ -54,6 +59,12 @@ class CHandler:
     _set_use_ShowImageNumber = false;
     _set_showImageNumber = false;
     _defaultImageNumber = -1;
+    _method = 0;
+    #ifndef _7ZIP_ST
+    _numThreads = NWindows::NSystem::GetNumberOfProcessors();
+    #else
+    _numThreads = 1;
+    #endif
   }
 
   bool IsUpdateSupported() const
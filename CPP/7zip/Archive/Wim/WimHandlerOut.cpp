@@ -12,11 +12,16 @@
 #include "../../../Windows/PropVariant.h"
 #include "../../../Windows/TimeUtils.h"
 
+#include "../../Common/BlockCoderMt.h"
 #include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamObjects.h"
 #include "../../Common/StreamUtils.h"
 #include "../../Common/UniqBlocks.h"
 
+#include "../../Compress/LzxEncoder.h"
+#include "../../Compress/XpressEncoder.h"
+
 #include "../../Crypto/RandGen.h"
 #include "../../Crypto/Sha1Cls.h"
 
@@ -358,6 +363,229 @@ STDMETHODIMP CInStreamWithSha1::Read(void *data, UInt32 size, UInt32 *processedS
 }
 
 
+/*
+  CChunksEncoder writes compressed resource:
+    - the table of chunk offsets,
+    - the chunks of (kChunkSize) bytes that are packed independently.
+  The chunks are read in groups, and the chunks of group are packed by
+  several threads. Then the packed chunks are written in original order.
+  The table is written after all chunks, so the place for the table is
+  reserved for the size of stream that was reported by update callback.
+*/
+
+struct CChunkInfo
+{
+  size_t UnpackSize;
+  size_t PackSize;
+  HRESULT Res;
+  bool Packed;
+};
+
+class CChunksEncoder: public IBlockCoderCallback
+{
+  CBlockCoderMt _mt;
+  unsigned _method;
+  unsigned _numChunksInGroup;
+  size_t _groupSize;
+  CObjectVector<NCompress::NXpress::CEncoder> _xpressEncoders;
+  CObjectVector<NCompress::NLzx::CEncoder> _lzxEncoders;
+  CByteBuffer _inBuf;
+  CByteBuffer _outBuf;
+  CRecordVector<CChunkInfo> _chunks;
+  CRecordVector<UInt64> _offsets;
+
+  HRESULT WriteTable(IOutStream *outStream, UInt64 pos, unsigned entrySizeShifts);
+public:
+  CChunksEncoder(): _method(0) {}
+  
+  unsigned GetMethod() const { return _method; }
+  HRESULT Create(unsigned method, UInt32 numThreads);
+  
+  HRESULT WriteResource(ISequentialInStream *inStream, IOutStream *outStream, UInt64 size,
+      ICompressProgressInfo *progress, UInt64 &curPos, CResource &resource);
+
+  virtual void CodeBlock(unsigned threadIndex, unsigned chunkIndex);
+};
+
+
+HRESULT CChunksEncoder::Create(unsigned method, UInt32 numThreads)
+{
+  _method = method;
+  if (method == 0)
+    return S_OK;
+  _mt.SetNumThreads(numThreads);
+  numThreads = _mt.GetNumThreads();
+  _numChunksInGroup = (unsigned)numThreads * 16;
+  _groupSize = (size_t)_numChunksInGroup << kChunkSizeBits;
+  _inBuf.AllocAtLeast(_groupSize);
+  _outBuf.AllocAtLeast(_groupSize);
+  if (method == NMethod::kXPRESS)
+    while (_xpressEncoders.Size() < numThreads)
+      _xpressEncoders.AddNew();
+  else
+    while (_lzxEncoders.Size() < numThreads)
+      _lzxEncoders.AddNew();
+  return S_OK;
+}
+
+
+void CChunksEncoder::CodeBlock(unsigned threadIndex, unsigned chunkIndex)
+{
+  CChunkInfo &chunk = _chunks[chunkIndex];
+  const size_t offset = (size_t)chunkIndex << kChunkSizeBits;
+  const Byte *in = _inBuf + offset;
+  const size_t size = chunk.UnpackSize;
+
+  // the packed chunk must be smaller than unpacked chunk
+  size_t packSize = size - 1;
+  HRESULT res;
+  if (_method == NMethod::kXPRESS)
+    res = _xpressEncoders[threadIndex].Encode(in, size, _outBuf + offset, packSize);
+  else
+    res = _lzxEncoders[threadIndex].Encode(in, size, _outBuf + offset, packSize);
+  
+  chunk.Packed = (res == S_OK);
+  if (res == S_FALSE)
+  {
+    res = S_OK;
+    packSize = size;
+  }
+  chunk.PackSize = packSize;
+  chunk.Res = res;
+}
+
+
+HRESULT CChunksEncoder::WriteTable(IOutStream *outStream, UInt64 pos, unsigned entrySizeShifts)
+{
+  RINOK(outStream->Seek(pos, STREAM_SEEK_SET, NULL));
+  // (_offsets[0] == 0) is not stored
+  Byte *buf = _outBuf;
+  const size_t numEntriesMax = _groupSize >> 3;
+  for (unsigned i = 1; i < _offsets.Size();)
+  {
+    size_t num = _offsets.Size() - i;
+    if (num > numEntriesMax)
+      num = numEntriesMax;
+    for (size_t k = 0; k < num; k++, i++)
+    {
+      if (entrySizeShifts == 2)
+      {
+        Set32(buf + k * 4, (UInt32)_offsets[i]);
+      }
+      else
+      {
+        Set64(buf + k * 8, _offsets[i]);
+      }
+    }
+    RINOK(WriteStream(outStream, buf, num << entrySizeShifts));
+  }
+  return S_OK;
+}
+
+
+HRESULT CChunksEncoder::WriteResource(ISequentialInStream *inStream, IOutStream *outStream, UInt64 size,
+    ICompressProgressInfo *progress, UInt64 &curPos, CResource &resource)
+{
+  resource.Offset = curPos;
+  resource.PackSize = 0;
+  resource.UnpackSize = 0;
+  resource.Flags = NResourceFlags::kCompressed;
+  
+  if (size == 0)
+    return S_OK;
+
+  const UInt64 startPos = curPos;
+  const UInt64 numChunks = (size + (kChunkSize - 1)) >> kChunkSizeBits;
+  const UInt64 tableSize = (numChunks - 1) << (size < ((UInt64)1 << 32) ? 2 : 3);
+  
+  {
+    memset(_outBuf, 0, _groupSize);
+    UInt64 rem = tableSize;
+    while (rem != 0)
+    {
+      size_t cur = _groupSize;
+      if (cur > rem)
+        cur = (size_t)rem;
+      RINOK(WriteStream(outStream, _outBuf, cur));
+      rem -= cur;
+    }
+  }
+
+  _offsets.Clear();
+  UInt64 packSize = 0;
+  UInt64 unpackSize = 0;
+
+  for (;;)
+  {
+    const UInt64 rem = size - unpackSize;
+    if (rem == 0)
+      break;
+    size_t cur = _groupSize;
+    if (cur > rem)
+      cur = (size_t)rem;
+    const size_t curRequested = cur;
+    RINOK(ReadStream(inStream, _inBuf, &cur));
+    if (cur == 0)
+      break;
+
+    const unsigned numChunksCur = (unsigned)((cur + (kChunkSize - 1)) >> kChunkSizeBits);
+    _chunks.ClearAndSetSize(numChunksCur);
+    {
+      for (unsigned i = 0; i < numChunksCur; i++)
+      {
+        size_t chunkSize = cur - ((size_t)i << kChunkSizeBits);
+        if (chunkSize > kChunkSize)
+          chunkSize = kChunkSize;
+        _chunks[i].UnpackSize = chunkSize;
+      }
+    }
+    
+    RINOK(_mt.Code(this, numChunksCur));
+
+    for (unsigned i = 0; i < numChunksCur; i++)
+    {
+      const CChunkInfo &chunk = _chunks[i];
+      RINOK(chunk.Res);
+      _offsets.Add(packSize);
+      const size_t offset = (size_t)i << kChunkSizeBits;
+      RINOK(WriteStream(outStream, (chunk.Packed ? _outBuf : _inBuf) + offset, chunk.PackSize));
+      packSize += chunk.PackSize;
+    }
+    
+    unpackSize += cur;
+    
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&unpackSize, &unpackSize));
+    }
+
+    if (cur != curRequested)
+      break;
+  }
+
+  curPos = startPos + tableSize + packSize;
+
+  if (unpackSize == 0)
+  {
+    curPos = startPos;
+    RINOK(outStream->Seek(curPos, STREAM_SEEK_SET, NULL));
+    return outStream->SetSize(curPos);
+  }
+
+  /* if the stream is shorter than expected, the table is also shorter,
+     and we don't use the start of reserved space */
+  const unsigned entrySizeShifts = (unpackSize < ((UInt64)1 << 32) ? 2 : 3);
+  const UInt64 tableSizeReal = (UInt64)(_offsets.Size() - 1) << entrySizeShifts;
+  
+  resource.Offset = startPos + (tableSize - tableSizeReal);
+  resource.PackSize = tableSizeReal + packSize;
+  resource.UnpackSize = unpackSize;
+  
+  RINOK(WriteTable(outStream, resource.Offset, entrySizeShifts));
+  return outStream->Seek(curPos, STREAM_SEEK_SET, NULL);
+}
+
+
 static void SetFileTimeToMem(Byte *p, const FILETIME &ft)
 {
   Set32(p, ft.dwLowDateTime);
@@ -670,14 +898,15 @@ static void AddTag_String_IfEmpty(CXmlItem &parentItem, const char *name, const
 }
 
 
-void CHeader::SetDefaultFields(bool useLZX)
+void CHeader::SetDefaultFields(unsigned method)
 {
   Version = k_Version_NonSolid;
   Flags = NHeaderFlags::kReparsePointFixup;
   ChunkSize = 0;
-  if (useLZX)
+  if (method != 0)
   {
-    Flags |= NHeaderFlags::kCompression | NHeaderFlags::kLZX;
+    Flags |= NHeaderFlags::kCompression;
+    Flags |= (method == NMethod::kXPRESS ? NHeaderFlags::kXPRESS : NHeaderFlags::kLZX);
     ChunkSize = kChunkSize;
     ChunkSizeBits = kChunkSizeBits;
   }
@@ -1366,11 +1595,8 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
 
   complexity = 0;
 
-  // bool useResourceCompression = false;
-  // use useResourceCompression only if CHeader::Flags compression is also set
-
   CHeader header;
-  header.SetDefaultFields(false);
+  header.SetDefaultFields(_method);
 
   if (isUpdate)
   {
@@ -1381,6 +1607,17 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
     header.ChunkSizeBits = srcHeader.ChunkSizeBits;
   }
 
+  // new streams use the method of archive. Another methods are stored without compression.
+  CChunksEncoder chunksEncoder;
+  if (header.IsCompressed() && header.ChunkSizeBits == kChunkSizeBits)
+  {
+    const unsigned method = header.GetMethod();
+    if (method == NMethod::kXPRESS || method == NMethod::kLZX)
+    {
+      RINOK(chunksEncoder.Create(method, _numThreads));
+    }
+  }
+
   {
     Byte buf[kHeaderSizeMax];
     header.WriteTo(buf);
@@ -1637,11 +1874,7 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
           s.Resource.PackSize = packSize;
           s.Resource.Offset = curPos;
           s.Resource.UnpackSize = packSize;
-          s.Resource.Flags = 0; // check it
-          /*
-            if (useResourceCompression)
-              s.Resource.Flags = NResourceFlags::Compressed;
-          */
+          s.Resource.Flags = 0; // small reparse data is stored without compression
           s.PartNumber = 1;
           s.RefCount = 1;
           memcpy(s.Hash, hash, kHashSize);
@@ -1657,27 +1890,30 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
         inShaStreamSpec->SetStream(fileInStream);
         fileInStream.Release();
         inShaStreamSpec->Init();
-        UInt64 offsetBlockSize = 0;
-        /*
-        if (useResourceCompression)
+        
+        const UInt64 startPos = curPos;
+        CResource resource;
+        
+        // the stream of unknown size is stored without compression
+        if (chunksEncoder.GetMethod() != 0 && size != 0)
         {
-          for (UInt64 t = kChunkSize; t < size; t += kChunkSize)
-          {
-            Byte buf[8];
-            SetUi32(buf, (UInt32)t);
-            RINOK(WriteStream(outStream, buf, 4));
-            offsetBlockSize += 4;
-          }
+          RINOK(chunksEncoder.WriteResource(inShaStream, outStream, size, progress, curPos, resource));
+          size = resource.UnpackSize;
+        }
+        else
+        {
+          RINOK(copyCoder->Code(inShaStream, outStream, NULL, NULL, progress));
+          size = copyCoderSpec->TotalSize;
+          resource.PackSize = size;
+          resource.Offset = curPos;
+          resource.UnpackSize = size;
+          resource.Flags = 0;
+          curPos += size;
         }
-        */
-        
-        RINOK(copyCoder->Code(inShaStream, outStream, NULL, NULL, progress));
-        size = copyCoderSpec->TotalSize;
        
         if (size != 0)
         {
           Byte hash[kHashSize];
-          UInt64 packSize = offsetBlockSize + size;
           inShaStreamSpec->Final(hash);
 
           int index = AddUniqHash(&streams.Front(), sortedHashes, hash, streams.Size());
@@ -1685,25 +1921,17 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
           if (index >= 0)
           {
             streams[index].RefCount++;
-            outStream->Seek(-(Int64)packSize, STREAM_SEEK_CUR, &curPos);
+            outStream->Seek(startPos, STREAM_SEEK_SET, &curPos);
             outStream->SetSize(curPos);
           }
           else
           {
             index = streams.Size();
             CStreamInfo s;
-            s.Resource.PackSize = packSize;
-            s.Resource.Offset = curPos;
-            s.Resource.UnpackSize = size;
-            s.Resource.Flags = 0;
-            /*
-            if (useResourceCompression)
-            s.Resource.Flags = NResourceFlags::Compressed;
-            */
+            s.Resource = resource;
             s.PartNumber = 1;
             s.RefCount = 1;
             memcpy(s.Hash, hash, kHashSize);
-            curPos += packSize;
 
             streams.Add(s);
           }
@@ -1818,10 +2046,26 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
       sha.Final(digest);
       
       CStreamInfo s;
-      s.Resource.PackSize = pos;
-      s.Resource.Offset = curPos;
-      s.Resource.UnpackSize = pos;
-      s.Resource.Flags = NResourceFlags::kMetadata;
+      
+      if (chunksEncoder.GetMethod() != 0)
+      {
+        CBufInStream *metaStreamSpec = new CBufInStream;
+        CMyComPtr<ISequentialInStream> metaStream = metaStreamSpec;
+        metaStreamSpec->Init(meta, pos);
+        RINOK(chunksEncoder.WriteResource(metaStream, outStream, pos, NULL, curPos, s.Resource));
+      }
+      else
+      {
+        RINOK(WriteStream(outStream, (const Byte *)meta, pos));
+        s.Resource.PackSize = pos;
+        s.Resource.Offset = curPos;
+        s.Resource.UnpackSize = pos;
+        s.Resource.Flags = 0;
+        curPos += pos;
+      }
+      meta.Free();
+      
+      s.Resource.Flags |= NResourceFlags::kMetadata;
       s.PartNumber = 1;
       s.RefCount = 1;
       memcpy(s.Hash, digest, kHashSize);
@@ -1832,10 +2076,6 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
         header.MetadataResource = s.Resource;
         header.BootIndex = _bootIndex;
       }
-
-      RINOK(WriteStream(outStream, (const Byte *)meta, pos));
-      meta.Free();
-      curPos += pos;
     }
   }
 
@@ -266,7 +266,7 @@ struct CHeader
   CResource MetadataResource;
   CResource IntegrityResource;
 
-  void SetDefaultFields(bool useLZX);
+  void SetDefaultFields(unsigned method);
 
   void WriteTo(Byte *p) const;
   HRESULT Parse(const Byte *p, UInt64 &phySize);
@@ -13,9 +13,11 @@
 #include "../../Windows/PropVariant.h"
 #include "../../Windows/System.h"
 
+#include "../Common/BlockCoderMt.h"
 #include "../Common/CWrappers.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
+#include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
 
 #include "../Compress/CopyCoder.h"
@@ -738,45 +740,67 @@ CXzUnpackerCPP2::~CXzUnpackerCPP2()
 }
 
 
+static const size_t kCacheSize = (size_t)1 << 26;
+static const unsigned kReadAheadMax = 32;
+
+struct CBlockDecoder
+{
+  CXzUnpackerCPP2 xz;
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+
+  CBlockDecoder()
+  {
+    InStreamSpec = new CBufInStream;
+    InStream = InStreamSpec;
+  }
+};
+
+struct CBlockJob
+{
+  CByteBuffer Packed;
+  size_t BlockIndex;
+  UInt32 Slot;
+  HRESULT Res;
+};
+
+
 class CInStream:
   public IInStream,
+  public IBlockCoderCallback,
   public CMyUnknownImp
 {
 public:
   UInt64 _virtPos;
   UInt64 Size;
-  UInt64 _cacheStartPos;
-  size_t _cacheSize;
-  CByteBuffer _cache;
   // UInt64 _startPos;
-  CXzUnpackerCPP2 xz;
+
+  // unpacked blocks, the key is (UnpackPos) of block
+  CBlockCache _cache;
+  CBlockCoderMt _decoderMt;
+  CObjectVector<CBlockDecoder> _decoders;
+  CObjectVector<CBlockJob> _jobs;
 
   void InitAndSeek()
   {
     _virtPos = 0;
-    _cacheStartPos = 0;
-    _cacheSize = 0;
     // _startPos = startPos;
   }
 
   CHandler *_handlerSpec;
   CMyComPtr<IUnknown> _handler;
 
+  HRESULT Alloc(UInt32 numThreads, UInt64 memLimit);
+  HRESULT ReadPackedBlock(size_t blockIndex, CBlockJob &job);
+  virtual void CodeBlock(unsigned threadIndex, unsigned blockIndex);
+
   MY_UNKNOWN_IMP1(IInStream)
 
   STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
   STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
-
-  ~CInStream();
 };
 
 
-CInStream::~CInStream()
-{
-  // _cache.Free();
-}
-
-
 static size_t FindBlock(const CBlockInfo *blocks, size_t numBlocks, UInt64 pos)
 {
   size_t left = 0, right = numBlocks;
@@ -794,7 +818,7 @@ static size_t FindBlock(const CBlockInfo *blocks, size_t numBlocks, UInt64 pos)
 
 
 
-static HRESULT DecodeBlock(CXzUnpackerCPP2 &xzu,
+static HRESULT DecodeXzBlock(CXzUnpackerCPP2 &xzu,
     ISequentialInStream *seqInStream,
     unsigned streamFlags,
     UInt64 packSize, // pure size from Index record, it doesn't include pad zeros
@@ -882,6 +906,82 @@ static HRESULT DecodeBlock(CXzUnpackerCPP2 &xzu,
 }
 
 
+/* the packed size of block can be larger than unpack size for
+   incompressible data, but LZMA2 overhead is small */
+
+static UInt64 GetPackSizeMax(UInt64 unpackSize)
+{
+  return unpackSize + (unpackSize >> 6) + ((UInt32)1 << 12);
+}
+
+
+HRESULT CInStream::Alloc(UInt32 numThreads, UInt64 memLimit)
+{
+  const size_t blockSize = (size_t)_handlerSpec->_maxBlocksSize;
+  
+  _decoderMt.SetNumThreads(numThreads);
+  numThreads = _decoderMt.GetNumThreads();
+  while (_decoders.Size() < numThreads)
+    _decoders.AddNew();
+
+  /* for sequential reading we unpack the blocks that follow the
+     current block in parallel. The cache must keep these blocks, and
+     read-ahead is limited by half of the slots of the cache. */
+  unsigned readAheadMax = 0;
+  if (numThreads > 1)
+  {
+    readAheadMax = numThreads * 2 - 1;
+    if (readAheadMax > kReadAheadMax)
+      readAheadMax = kReadAheadMax;
+  }
+  
+  UInt64 cacheSize = (UInt64)blockSize * (readAheadMax + 1) * 2;
+  if (cacheSize < kCacheSize)
+    cacheSize = kCacheSize;
+  if (cacheSize > memLimit)
+    cacheSize = memLimit;
+  if (cacheSize != (size_t)cacheSize)
+    cacheSize = (size_t)0 - 1;
+  
+  if (!_cache.Alloc(blockSize, (size_t)cacheSize))
+    return E_OUTOFMEMORY;
+  _cache.SetReadAheadMax(readAheadMax);
+  
+  while (_jobs.Size() <= readAheadMax)
+    _jobs.AddNew();
+  return S_OK;
+}
+
+
+HRESULT CInStream::ReadPackedBlock(size_t blockIndex, CBlockJob &job)
+{
+  const CBlockInfo &block = _handlerSpec->_blocks[blockIndex];
+  const UInt64 unpackSize = _handlerSpec->_blocks[blockIndex + 1].UnpackPos - block.UnpackPos;
+  const UInt64 packSizeAligned = block.PackSize + ((0 - (unsigned)block.PackSize) & 3);
+  if (packSizeAligned > GetPackSizeMax(unpackSize))
+    return S_FALSE;
+  job.Packed.AllocAtLeast((size_t)packSizeAligned);
+  RINOK(_handlerSpec->SeekToPackPos(block.PackPos));
+  RINOK(ReadStream_FALSE(_handlerSpec->_stream, job.Packed, (size_t)packSizeAligned));
+  job.BlockIndex = blockIndex;
+  return S_OK;
+}
+
+
+void CInStream::CodeBlock(unsigned threadIndex, unsigned blockIndex)
+{
+  CBlockDecoder &d = _decoders[threadIndex];
+  CBlockJob &job = _jobs[blockIndex];
+  const CBlockInfo &block = _handlerSpec->_blocks[job.BlockIndex];
+  const UInt64 unpackSize = _handlerSpec->_blocks[job.BlockIndex + 1].UnpackPos - block.UnpackPos;
+  const UInt64 packSizeAligned = block.PackSize + ((0 - (unsigned)block.PackSize) & 3);
+  
+  d.InStreamSpec->Init(job.Packed, (size_t)packSizeAligned);
+  job.Res = DecodeXzBlock(d.xz, d.InStream, block.StreamFlags, block.PackSize,
+      (size_t)unpackSize, _cache.GetSlotData(job.Slot));
+}
+
+
 STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   COM_TRY_BEGIN
@@ -904,33 +1004,70 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
   if (size == 0)
     return S_OK;
 
-  if (_virtPos < _cacheStartPos || _virtPos >= _cacheStartPos + _cacheSize)
+  const CBlockInfo *blocks = _handlerSpec->_blocks;
+  const size_t bi = FindBlock(blocks, _handlerSpec->_blocksArraySize, _virtPos);
+  const UInt64 key = blocks[bi].UnpackPos;
+  const unsigned numAhead = _cache.GetReadAhead(key, blocks[bi + 1].UnpackPos);
+
+  for (;;)
   {
-    size_t bi = FindBlock(_handlerSpec->_blocks, _handlerSpec->_blocksArraySize, _virtPos);
-    const CBlockInfo &block = _handlerSpec->_blocks[bi];
-    const UInt64 unpackSize = _handlerSpec->_blocks[bi + 1].UnpackPos - block.UnpackPos;
-    if (_cache.Size() < unpackSize)
+    {
+      size_t cachedSize;
+      const Byte *p = _cache.Find(key, cachedSize);
+      if (p)
+      {
+        const size_t offset = (size_t)(_virtPos - key);
+        const size_t rem = cachedSize - offset;
+        if (size > rem)
+          size = (UInt32)rem;
+        memcpy(data, p + offset, size);
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return S_OK;
+      }
+    }
+
+    if (blocks[bi + 1].UnpackPos - key > _cache.GetBlockSize())
       return E_FAIL;
 
-    _cacheSize = 0;
+    /* we read the packed data of blocks that follow the current block,
+       and we unpack all these blocks in parallel.
+       An error in next block stops the read-ahead only. */
+    unsigned numJobs = 0;
+    for (;;)
+    {
+      const size_t bi2 = bi + numJobs;
+      if (numJobs != 0)
+      {
+        if (numJobs > numAhead
+            || bi2 + 1 >= _handlerSpec->_blocksArraySize
+            || _cache.Contains(blocks[bi2].UnpackPos))
+          break;
+      }
+      const HRESULT res = ReadPackedBlock(bi2, _jobs[numJobs]);
+      if (res != S_OK)
+      {
+        if (numJobs == 0)
+          return res;
+        break;
+      }
+      numJobs++;
+    }
 
-    RINOK(_handlerSpec->SeekToPackPos(block.PackPos));
-    RINOK(DecodeBlock(xz, _handlerSpec->_seqStream, block.StreamFlags, block.PackSize,
-        (size_t)unpackSize, _cache));
-    _cacheStartPos = block.UnpackPos;
-    _cacheSize = (size_t)unpackSize;
-  }
+    unsigned i;
+    for (i = 0; i < numJobs; i++)
+      _jobs[i].Slot = _cache.Reserve();
+    RINOK(_decoderMt.Code(this, numJobs));
 
-  {
-    size_t offset = (size_t)(_virtPos - _cacheStartPos);
-    size_t rem = _cacheSize - offset;
-    if (size > rem)
-      size = (UInt32)rem;
-    memcpy(data, _cache + offset, size);
-    _virtPos += size;
-    if (processedSize)
-      *processedSize = size;
-    return S_OK;
+    for (i = numJobs; i != 0;)
+    {
+      const CBlockJob &job = _jobs[--i];
+      if (job.Res == S_OK)
+        _cache.Commit(job.Slot, blocks[job.BlockIndex].UnpackPos,
+            (size_t)(blocks[job.BlockIndex + 1].UnpackPos - blocks[job.BlockIndex].UnpackPos));
+    }
+    RINOK(_jobs[0].Res);
   }
 
   COM_TRY_END
@@ -981,11 +1118,19 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
       return S_FALSE;
   }
 
+  UInt32 numThreads = 1;
+  #ifndef _7ZIP_ST
+  numThreads = _numThreads;
+  #endif
+  UInt64 memLimit = memSize / 4;
+  if (memLimit > _memUsage_Decompress)
+    memLimit = _memUsage_Decompress;
+
   CInStream *spec = new CInStream;
   CMyComPtr<ISequentialInStream> specStream = spec;
-  spec->_cache.Alloc((size_t)_maxBlocksSize);
   spec->_handlerSpec = this;
   spec->_handler = (IInArchive *)this;
+  RINOK(spec->Alloc(numThreads, memLimit));
   spec->Size = _stat.OutSize;
   spec->InitAndSeek();
 
@@ -3,8 +3,10 @@
 #include "StdAfx.h"
 
 #include "../../../C/CpuArch.h"
+#include "../../../C/zstd/xxhash.h"
 #include "../../Common/ComTry.h"
 #include "../../Common/Defs.h"
+#include "../../Common/MyBuffer.h"
 
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
@@ -22,9 +24,17 @@ using namespace NWindows;
 namespace NArchive {
 namespace NZSTD {
 
+struct CFrameInfo
+{
+  UInt64 PackPos;
+  UInt64 UnpackPos;
+  UInt32 Checksum; // the low 32 bits of XXH64 of unpacked frame, if (ChecksumsDefined())
+};
+
 class CHandler:
   public IInArchive,
   public IArchiveOpenSeq,
+  public IInArchiveGetStream,
   public IOutArchive,
   public ISetProperties,
   public CMyUnknownImp
@@ -46,15 +56,34 @@ class CHandler:
 
   CSingleMethodProps _props;
 
+  /* seekable format: (_numBlocks + 1) entries, the last one is the end */
+  CRecordVector<CFrameInfo> _frames;
+  UInt32 _maxFrameSize;
+  UInt32 _maxFramePackSize;
+  bool _checksums;
+
+  HRESULT ReadSeekTable(IInStream *stream);
+
 public:
-  MY_UNKNOWN_IMP4(
+  MY_UNKNOWN_IMP5(
       IInArchive,
       IArchiveOpenSeq,
+      IInArchiveGetStream,
       IOutArchive,
       ISetProperties)
   INTERFACE_IInArchive(;)
   INTERFACE_IOutArchive(;)
   STDMETHOD(OpenSeq)(ISequentialInStream *stream);
+  STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
+
+  HRESULT ReadPack(UInt64 pos, void *data, size_t size)
+  {
+    RINOK(_stream->Seek((Int64)pos, STREAM_SEEK_SET, NULL));
+    return ReadStream_FALSE(_stream, data, size);
+  }
+  const CRecordVector<CFrameInfo> &Frames() const { return _frames; }
+  UInt32 MaxFrameSize() const { return _maxFrameSize; }
+  bool ChecksumsDefined() const { return _checksums; }
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
   CHandler() { }
@@ -68,6 +97,7 @@ static const Byte kProps[] =
 
 static const Byte kArcProps[] =
 {
+  kpidPhySize,
   kpidNumStreams,
   kpidNumBlocks
 };
@@ -75,8 +105,15 @@ static const Byte kArcProps[] =
 IMP_IInArchive_Props
 IMP_IInArchive_ArcProps
 
-STDMETHODIMP CHandler::GetArchiveProperty(PROPID /*propID*/, PROPVARIANT * /*value*/)
+STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
 {
+  NCOM::CPropVariant prop;
+  switch (propID)
+  {
+    case kpidPhySize: if (_packSize_Defined) prop = _packSize; break;
+    case kpidNumBlocks: if (_frames.Size() != 0) prop = _numBlocks; break;
+  }
+  prop.Detach(value);
   return S_OK;
 }
 
@@ -144,12 +181,91 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
     _isArc = true;
     _stream = stream;
     _seqStream = stream;
+    RINOK(ReadSeekTable(stream));
     RINOK(_stream->Seek(0, STREAM_SEEK_SET, NULL));
   }
   return S_OK;
   COM_TRY_END
 }
 
+/**
+ * seekable format: the seek table is the last skippable frame,
+ * the frames must cover everything before it
+ */
+HRESULT CHandler::ReadSeekTable(IInStream *stream)
+{
+  UInt64 fileSize;
+  RINOK(stream->Seek(0, STREAM_SEEK_END, &fileSize));
+  if (fileSize < 8 + ZSTD_SEEKABLE_FOOTERSIZE)
+    return S_OK;
+
+  Byte footer[ZSTD_SEEKABLE_FOOTERSIZE];
+  RINOK(stream->Seek(-(Int64)ZSTD_SEEKABLE_FOOTERSIZE, STREAM_SEEK_END, NULL));
+  RINOK(ReadStream_FALSE(stream, footer, ZSTD_SEEKABLE_FOOTERSIZE));
+  if (GetUi32(footer + 5) != ZSTD_SEEKABLE_MAGICNUMBER)
+    return S_OK;
+
+  const UInt32 numFrames = GetUi32(footer);
+  const Byte descriptor = footer[4];
+  if (numFrames > ZSTD_SEEKABLE_MAXFRAMES || (descriptor & 0x7C) != 0)
+    return S_OK;
+
+  const bool checksums = ((descriptor & ZSTD_SEEKABLE_CHECKSUMFLAG) != 0);
+  const unsigned entrySize = checksums ? 12 : 8;
+  const UInt64 tableSize = (UInt64)numFrames * entrySize + ZSTD_SEEKABLE_FOOTERSIZE;
+  if (tableSize + 8 > fileSize)
+    return S_OK;
+
+  const UInt64 tablePos = fileSize - tableSize - 8;
+  CByteBuffer table;
+  table.Alloc((size_t)tableSize + 8);
+  RINOK(stream->Seek((Int64)tablePos, STREAM_SEEK_SET, NULL));
+  RINOK(ReadStream_FALSE(stream, table, (size_t)tableSize + 8));
+  if (GetUi32(table) != ZSTD_SEEKABLE_SKIPPABLE || GetUi32(table + 4) != tableSize)
+    return S_OK;
+
+  CRecordVector<CFrameInfo> frames;
+  frames.ClearAndReserve(numFrames + 1);
+  UInt32 maxFrameSize = 0;
+  UInt32 maxFramePackSize = 0;
+  CFrameInfo fi;
+  fi.PackPos = 0;
+  fi.UnpackPos = 0;
+  fi.Checksum = 0;
+  const Byte *p = table + 8;
+  for (UInt32 i = 0; i < numFrames; i++, p += entrySize)
+  {
+    const UInt32 packSize = GetUi32(p);
+    const UInt32 unpackSize = GetUi32(p + 4);
+    if (packSize == 0 || unpackSize > ZSTD_SEEKABLE_MAXFRAMESIZE)
+      return S_OK;
+    if (checksums)
+      fi.Checksum = GetUi32(p + 8);
+    frames.AddInReserved(fi);
+    if (maxFrameSize < unpackSize)
+      maxFrameSize = unpackSize;
+    if (maxFramePackSize < packSize)
+      maxFramePackSize = packSize;
+    fi.PackPos += packSize;
+    fi.UnpackPos += unpackSize;
+  }
+  if (fi.PackPos != tablePos)
+    return S_OK;
+  fi.Checksum = 0;
+  frames.AddInReserved(fi);
+
+  _frames = frames;
+  _maxFrameSize = maxFrameSize;
+  _maxFramePackSize = maxFramePackSize;
+  _checksums = checksums;
+  _numBlocks = numFrames;
+  _packSize = fileSize;
+  _packSize_Defined = true;
+  _unpackSize = fi.UnpackPos;
+  _unpackSize_Defined = true;
+  return S_OK;
+}
+
 
 STDMETHODIMP CHandler::OpenSeq(ISequentialInStream *stream)
 {
@@ -169,12 +285,175 @@ STDMETHODIMP CHandler::Close()
   _unpackSize_Defined = false;
 
   _packSize = 0;
+  _numBlocks = 0;
+  _frames.Clear();
+  _maxFrameSize = 0;
+  _maxFramePackSize = 0;
+  _checksums = false;
 
   _seqStream.Release();
   _stream.Release();
   return S_OK;
 }
 
+class CInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  ZSTD_DCtx *_ctx;
+  UInt64 _virtPos;
+  UInt64 _cacheStartPos;
+  size_t _cacheSize;
+public:
+  UInt64 Size;
+  CByteBuffer _cache;
+  CByteBuffer _packBuf;
+
+  CHandler *_handlerSpec;
+  CMyComPtr<IUnknown> _handler;
+
+  CInStream(): _ctx(NULL), _virtPos(0), _cacheStartPos(0), _cacheSize(0) {}
+  ~CInStream() { if (_ctx) NCompress::NZSTD::ReleaseDCtx(_ctx); }
+
+  MY_UNKNOWN_IMP1(IInStream)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+};
+
+
+static unsigned FindFrame(const CRecordVector<CFrameInfo> &frames, UInt64 pos)
+{
+  unsigned left = 0, right = frames.Size() - 1;
+  for (;;)
+  {
+    unsigned mid = (left + right) / 2;
+    if (mid == left)
+      return left;
+    if (pos < frames[mid].UnpackPos)
+      right = mid;
+    else
+      left = mid;
+  }
+}
+
+
+STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  COM_TRY_BEGIN
+
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+
+  {
+    if (_virtPos >= Size)
+      return S_OK;
+    {
+      UInt64 rem = Size - _virtPos;
+      if (size > rem)
+        size = (UInt32)rem;
+    }
+  }
+
+  while (_virtPos < _cacheStartPos || _virtPos >= _cacheStartPos + _cacheSize)
+  {
+    const CRecordVector<CFrameInfo> &frames = _handlerSpec->Frames();
+    const unsigned fi = FindFrame(frames, _virtPos);
+    const CFrameInfo &frame = frames[fi];
+    const size_t packSize = (size_t)(frames[fi + 1].PackPos - frame.PackPos);
+    const size_t unpackSize = (size_t)(frames[fi + 1].UnpackPos - frame.UnpackPos);
+
+    // (_virtPos < Size), so the found frame is not empty
+    _cacheSize = 0;
+
+    if (!_ctx)
+    {
+      _ctx = NCompress::NZSTD::AllocDCtx();
+      if (!_ctx)
+        return E_OUTOFMEMORY;
+    }
+
+    RINOK(_handlerSpec->ReadPack(frame.PackPos, _packBuf, packSize));
+
+    const size_t res = ZSTD_decompressDCtx(_ctx, _cache, unpackSize, _packBuf, packSize);
+    if (ZSTD_isError(res) || res != unpackSize)
+      return S_FALSE;
+    if (_handlerSpec->ChecksumsDefined()
+        && (UInt32)XXH64(_cache, unpackSize, 0) != frame.Checksum)
+      return S_FALSE;
+
+    _cacheStartPos = frame.UnpackPos;
+    _cacheSize = unpackSize;
+  }
+
+  {
+    size_t offset = (size_t)(_virtPos - _cacheStartPos);
+    size_t rem = _cacheSize - offset;
+    if (size > rem)
+      size = (UInt32)rem;
+    memcpy(data, _cache + offset, size);
+    _virtPos += size;
+    if (processedSize)
+      *processedSize = size;
+    return S_OK;
+  }
+
+  COM_TRY_END
+}
+
+
+STDMETHODIMP CInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _virtPos; break;
+    case STREAM_SEEK_END: offset += Size; break;
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _virtPos = (UInt64)offset;
+  if (newPosition)
+    *newPosition = (UInt64)offset;
+  return S_OK;
+}
+
+
+STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
+{
+  COM_TRY_BEGIN
+
+  *stream = NULL;
+
+  if (index != 0)
+    return E_INVALIDARG;
+
+  /* only the seekable format allows random access */
+  if (_frames.Size() == 0 || !_stream)
+    return S_FALSE;
+
+  /* the stream keeps one unpacked frame and one packed frame.
+     The frames are limited by the seek table, not by the file size. */
+  if ((UInt64)_maxFrameSize + _maxFramePackSize > _props._memUsage_Decompress)
+    return S_FALSE;
+
+  CInStream *spec = new CInStream;
+  CMyComPtr<ISequentialInStream> specStream = spec;
+  spec->_cache.Alloc(_maxFrameSize);
+  spec->_packBuf.Alloc(_maxFramePackSize);
+  spec->_handlerSpec = this;
+  spec->_handler = (IInArchive *)this;
+  spec->Size = _unpackSize;
+
+  *stream = specStream.Detach();
+  return S_OK;
+
+  COM_TRY_END
+}
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -204,6 +483,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   NCompress::NZSTD::CDecoder *decoderSpec = new NCompress::NZSTD::CDecoder;
   CMyComPtr<ICompressCoder> decoder = decoderSpec;
   decoderSpec->SetInStream(_seqStream);
+  decoderSpec->SetNumberOfThreads(_props._numThreads);
 
   CDummyOutStream *outStreamSpec = new CDummyOutStream;
   CMyComPtr<ISequentialOutStream> outStream(outStreamSpec);
@@ -626,6 +626,22 @@ SOURCE=..\..\..\Windows\TimeUtils.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Common\AsyncFileStreams.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\AsyncFileStreams.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\BlockCoderMt.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\BlockCoderMt.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\CreateCoder.cpp
 # End Source File
 # Begin Source File
@@ -1409,6 +1425,14 @@ SOURCE=..\..\Archive\7z\7zUpdate.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Archive\Tar\TarCodecOut.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Archive\Tar\TarCodecOut.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Archive\Tar\TarHandler.cpp
 # End Source File
 # Begin Source File
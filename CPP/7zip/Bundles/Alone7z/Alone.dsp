@@ -590,6 +590,22 @@ SOURCE=..\..\..\Windows\TimeUtils.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Common\AsyncFileStreams.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\AsyncFileStreams.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\BlockCoderMt.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\BlockCoderMt.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\CreateCoder.cpp
 # End Source File
 # Begin Source File
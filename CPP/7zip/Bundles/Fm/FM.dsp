@@ -801,6 +801,14 @@ SOURCE=..\..\UI\FileManager\UpdateCallback100.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Common\AsyncFileStreams.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\AsyncFileStreams.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\CreateCoder.cpp
 # End Source File
 # Begin Source File
@@ -21,7 +21,9 @@ COMMON_OBJS = \
   $O\StringToInt.obj \
   $O\UTFConvert.obj \
   $O\Wildcard.obj \
+  $O\XXH128Reg.obj \
   $O\XXH32Reg.obj \
+  $O\XXH3Reg.obj \
   $O\XXH64Reg.obj \
   $O\XzCrc64Init.obj \
   $O\XzCrc64Reg.obj \
@@ -39,6 +41,7 @@ WIN_OBJS = \
   $O\TimeUtils.obj \
 
 7ZIP_COMMON_OBJS = \
+  $O\BlockCoderMt.obj \
   $O\CreateCoder.obj \
   $O\CWrappers.obj \
   $O\InBuffer.obj \
@@ -168,6 +171,7 @@ RAR_OBJS = \
   $O\Rar5Handler.obj \
 
 TAR_OBJS = \
+  $O\TarCodecOut.obj \
   $O\TarHandler.obj \
   $O\TarHandlerOut.obj \
   $O\TarHeader.obj \
@@ -228,6 +232,7 @@ COMPRESS_OBJS = \
   $O\LzmsDecoder.obj \
   $O\LzOutWindow.obj \
   $O\LzxDecoder.obj \
+  $O\LzxEncoder.obj \
   $O\PpmdDecoder.obj \
   $O\PpmdEncoder.obj \
   $O\PpmdRegister.obj \
@@ -241,6 +246,7 @@ COMPRESS_OBJS = \
   $O\RarCodecsRegister.obj \
   $O\ShrinkDecoder.obj \
   $O\XpressDecoder.obj \
+  $O\XpressEncoder.obj \
   $O\XzDecoder.obj \
   $O\XzEncoder.obj \
   $O\ZlibDecoder.obj \
@@ -270,6 +276,7 @@ HASHES_OBJS = \
   $O\md4.obj \
   $O\md5.obj \
   $O\sha512.obj \
+  $O\xxh3.obj \
 
 C_OBJS = \
   $O\7zBuf2.obj \
@@ -73,6 +73,7 @@ WIN_OBJS = \
   $O/TimeUtils.o \
 
 7ZIP_COMMON_OBJS = \
+  $O/BlockCoderMt.o \
   $O/CreateCoder.o \
   $O/CWrappers.o \
   $O/InBuffer.o \
@@ -197,6 +198,7 @@ endif
 
 
 TAR_OBJS = \
+  $O/TarCodecOut.o \
   $O/TarHandler.o \
   $O/TarHandlerOut.o \
   $O/TarHeader.o \
@@ -257,6 +259,7 @@ COMPRESS_OBJS = \
   $O/LzmsDecoder.o \
   $O/LzOutWindow.o \
   $O/LzxDecoder.o \
+  $O/LzxEncoder.o \
   $O/PpmdDecoder.o \
   $O/PpmdEncoder.o \
   $O/PpmdRegister.o \
@@ -264,6 +267,7 @@ COMPRESS_OBJS = \
   $O/QuantumDecoder.o \
   $O/ShrinkDecoder.o \
   $O/XpressDecoder.o \
+  $O/XpressEncoder.o \
   $O/XzDecoder.o \
   $O/XzEncoder.o \
   $O/ZlibDecoder.o \
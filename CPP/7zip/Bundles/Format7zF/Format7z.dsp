@@ -960,6 +960,24 @@ SOURCE=..\..\Compress\LzxDecoder.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Compress\LzxEncoder.cpp
+
+!IF  "$(CFG)" == "7z - Win32 Release"
+
+# ADD CPP /O2
+# SUBTRACT CPP /YX /Yc /Yu
+
+!ELSEIF  "$(CFG)" == "7z - Win32 Debug"
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Compress\LzxEncoder.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Compress\QuantumDecoder.cpp
 # End Source File
 # Begin Source File
@@ -1043,6 +1061,24 @@ SOURCE=..\..\Compress\XpressDecoder.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Compress\XpressEncoder.cpp
+
+!IF  "$(CFG)" == "7z - Win32 Release"
+
+# ADD CPP /O2
+# SUBTRACT CPP /YX /Yc /Yu
+
+!ELSEIF  "$(CFG)" == "7z - Win32 Debug"
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Compress\XpressEncoder.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Compress\XzDecoder.cpp
 # End Source File
 # Begin Source File
@@ -1323,6 +1359,14 @@ SOURCE=..\..\Crypto\ZipStrong.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Common\BlockCoderMt.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\BlockCoderMt.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\CreateCoder.cpp
 # End Source File
 # Begin Source File
@@ -2594,6 +2638,14 @@ SOURCE=..\..\Archive\Nsis\NsisRegister.cpp
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Archive\Tar\TarCodecOut.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Archive\Tar\TarCodecOut.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Archive\Tar\TarHandler.cpp
 # End Source File
 # Begin Source File
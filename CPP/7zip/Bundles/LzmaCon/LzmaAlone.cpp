@@ -68,6 +68,7 @@ static const char * const kHelpString =
     "  -mt{N} : set number of CPU threads\n"
     "  -eos   : write end of stream marker\n"
     "  -si    : read data from stdin\n"
+    "  -map   : map input file to memory (it must not be changed while it's read)\n"
     "  -so    : write data to stdout\n";
 
 
@@ -95,7 +96,8 @@ enum Enum
   kEOS,
   kStdIn,
   kStdOut,
-  kFilter86
+  kFilter86,
+  kFileMap
 };
 }
 
@@ -125,7 +127,8 @@ static const CSwitchForm kSwitchForms[] =
   { "EOS", SWFRM_SIMPLE },
   { "SI",  SWFRM_SIMPLE },
   { "SO",  SWFRM_SIMPLE },
-  { "F86",  NSwitchType::kChar, false, 0, "+" }
+  { "F86",  NSwitchType::kChar, false, 0, "+" },
+  { "MAP",  SWFRM_SIMPLE }
 };
 
 
@@ -488,6 +491,8 @@ static int main2(int numArgs, const char *args[])
       PrintError2("Cannot open input file", inputName);
       return 1;
     }
+    g_FileMapMode = parser[NKey::kFileMap].ThereIs;
+    inStreamSpec->MapFile();
   }
 
   CMyComPtr<ISequentialOutStream> outStream;
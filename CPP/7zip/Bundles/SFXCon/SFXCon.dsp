@@ -529,6 +529,14 @@ SOURCE=..\..\..\Common\Wildcard.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Common\AsyncFileStreams.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\AsyncFileStreams.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\CreateCoder.cpp
 # End Source File
 # Begin Source File
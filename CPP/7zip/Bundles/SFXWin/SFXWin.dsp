@@ -353,6 +353,14 @@ SOURCE=..\..\UI\FileManager\ProgressDialog2.h
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\..\Common\AsyncFileStreams.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\AsyncFileStreams.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\CreateCoder.cpp
 # End Source File
 # Begin Source File
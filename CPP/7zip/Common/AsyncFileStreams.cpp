@@ -0,0 +1,403 @@
+// AsyncFileStreams.cpp
+
+#include "StdAfx.h"
+
+#include "AsyncFileStreams.h"
+
+#ifndef _7ZIP_ST
+
+static const unsigned kNumBufs = k_AsyncFileStream_NumBufs;
+
+static THREAD_FUNC_DECL AsyncInFileStream_Thread(void *p)
+{
+  ((CAsyncInFileStream *)p)->ThreadFunc();
+  return 0;
+}
+
+static THREAD_FUNC_DECL AsyncOutFileStream_Thread(void *p)
+{
+  ((CAsyncOutFileStream *)p)->ThreadFunc();
+  return 0;
+}
+
+
+CAsyncInFileStream::CAsyncInFileStream():
+    _readIndex(0),
+    _numFilled(0),
+    _finished(false),
+    _stop(false),
+    _exit(false),
+    _readPos(0),
+    _virtPos(0),
+    _running(false),
+    _syncMode(false)
+{
+}
+
+CAsyncInFileStream::~CAsyncInFileStream()
+{
+  Stop();
+  if (_thread.IsCreated())
+  {
+    _cs.Enter();
+    _exit = true;
+    _cs.Leave();
+    _startEvent.Set();
+    _thread.Wait_Close();
+  }
+}
+
+void CAsyncInFileStream::ThreadFunc()
+{
+  for (;;)
+  {
+    _startEvent.Lock();
+    _cs.Enter();
+    const bool exit = _exit;
+    _cs.Leave();
+    if (exit)
+      return;
+
+    for (;;)
+    {
+      _cs.Enter();
+      while (_numFilled == kNumBufs && !_stop)
+      {
+        _cs.Leave();
+        _freeEvent.Lock();
+        _cs.Enter();
+      }
+      const bool stop = _stop;
+      const unsigned index = (_readIndex + _numFilled) % kNumBufs;
+      _cs.Leave();
+      if (stop)
+        break;
+
+      CAsyncFileBuf &b = _bufs[index];
+      size_t size = 0;
+      HRESULT res = S_OK;
+      while (size != k_AsyncFileStream_BlockSize)
+      {
+        UInt32 processed = 0;
+        res = CInFileStream::Read(b.Buf + size, (UInt32)(k_AsyncFileStream_BlockSize - size), &processed);
+        size += processed;
+        if (res != S_OK || processed == 0)
+          break;
+      }
+      b.Size = size;
+      b.Res = res;
+
+      _cs.Enter();
+      _numFilled++;
+      _cs.Leave();
+      _filledEvent.Set();
+
+      if (res != S_OK || size != k_AsyncFileStream_BlockSize)
+        break;
+    }
+
+    _cs.Enter();
+    _finished = true;
+    _cs.Leave();
+    _filledEvent.Set();
+    _stoppedEvent.Set();
+  }
+}
+
+HRESULT CAsyncInFileStream::Start()
+{
+  if (!_thread.IsCreated())
+  {
+    for (unsigned i = 0; i < kNumBufs; i++)
+    {
+      _bufs[i].Buf.Alloc(k_AsyncFileStream_BlockSize);
+      if (!_bufs[i].Buf.IsAllocated())
+        return E_OUTOFMEMORY;
+    }
+    WRes wres = _startEvent.CreateIfNotCreated_Reset();
+    if (wres == 0) wres = _filledEvent.CreateIfNotCreated_Reset();
+    if (wres == 0) wres = _freeEvent.CreateIfNotCreated_Reset();
+    if (wres == 0) wres = _stoppedEvent.CreateIfNotCreated_Reset();
+    if (wres == 0) wres = _thread.Create(AsyncInFileStream_Thread, this);
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  RINOK(CInFileStream::Seek(0, STREAM_SEEK_CUR, &_virtPos));
+  _readPos = 0;
+  _readIndex = 0;
+  _numFilled = 0;
+  _finished = false;
+  _stop = false;
+  _running = true;
+  _startEvent.Set();
+  return S_OK;
+}
+
+void CAsyncInFileStream::Stop()
+{
+  if (!_running)
+    return;
+  _cs.Enter();
+  _stop = true;
+  _cs.Leave();
+  _freeEvent.Set();
+  _stoppedEvent.Lock();
+  _running = false;
+}
+
+STDMETHODIMP CAsyncInFileStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (_syncMode)
+    return CInFileStream::Read(data, size, processedSize);
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+  if (!_running)
+  {
+    const HRESULT res = Start();
+    if (res != S_OK)
+    {
+      if (_thread.IsCreated())
+        return res;
+      _syncMode = true;
+      return CInFileStream::Read(data, size, processedSize);
+    }
+  }
+
+  _cs.Enter();
+  while (_numFilled == 0 && !_finished)
+  {
+    _cs.Leave();
+    _filledEvent.Lock();
+    _cs.Enter();
+  }
+  const unsigned numFilled = _numFilled;
+  _cs.Leave();
+  if (numFilled == 0)
+    return S_OK;
+
+  const CAsyncFileBuf &b = _bufs[_readIndex];
+  size_t rem = b.Size - _readPos;
+  if (rem == 0 && b.Res != S_OK)
+    return b.Res;
+  if (rem > size)
+    rem = size;
+  memcpy(data, b.Buf + _readPos, rem);
+  _readPos += rem;
+  _virtPos += rem;
+  if (processedSize)
+    *processedSize = (UInt32)rem;
+
+  if (_readPos == b.Size && b.Res == S_OK)
+  {
+    _readPos = 0;
+    _cs.Enter();
+    _readIndex = (_readIndex + 1) % kNumBufs;
+    _numFilled--;
+    _cs.Leave();
+    _freeEvent.Set();
+  }
+  return S_OK;
+}
+
+STDMETHODIMP CAsyncInFileStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  if (_running)
+  {
+    if (seekOrigin == STREAM_SEEK_CUR)
+    {
+      if (offset == 0)
+      {
+        if (newPosition)
+          *newPosition = _virtPos;
+        return S_OK;
+      }
+      offset += (Int64)_virtPos;
+      seekOrigin = STREAM_SEEK_SET;
+    }
+    Stop();
+  }
+  return CInFileStream::Seek(offset, seekOrigin, newPosition);
+}
+
+STDMETHODIMP CAsyncInFileStream::GetView(const Byte **data, UInt64 *size)
+{
+  if (_running)
+  {
+    *data = NULL;
+    *size = 0;
+    return S_FALSE;
+  }
+  return CInFileStream::GetView(data, size);
+}
+
+
+CAsyncOutFileStream::CAsyncOutFileStream():
+    _writeIndex(0),
+    _numPending(0),
+    _res(S_OK),
+    _exit(false),
+    _pos(0),
+    _created(false),
+    _syncMode(false)
+{
+}
+
+CAsyncOutFileStream::~CAsyncOutFileStream()
+{
+  if (_created)
+  {
+    FlushBufs();
+    _cs.Enter();
+    _exit = true;
+    _cs.Leave();
+    _submitEvent.Set();
+    _thread.Wait_Close();
+  }
+}
+
+void CAsyncOutFileStream::ThreadFunc()
+{
+  for (;;)
+  {
+    _cs.Enter();
+    while (_numPending == 0 && !_exit)
+    {
+      _cs.Leave();
+      _submitEvent.Lock();
+      _cs.Enter();
+    }
+    if (_numPending == 0)
+    {
+      _cs.Leave();
+      return;
+    }
+    const unsigned index = (_writeIndex + kNumBufs - _numPending) % kNumBufs;
+    HRESULT res = _res;
+    _cs.Leave();
+
+    const CAsyncFileBuf &b = _bufs[index];
+    size_t pos = 0;
+    // after error we skip the data of pending buffers
+    while (res == S_OK && pos != b.Size)
+    {
+      UInt32 processed = 0;
+      res = COutFileStream::Write(b.Buf + pos, (UInt32)(b.Size - pos), &processed);
+      pos += processed;
+      if (res == S_OK && processed == 0)
+        res = E_FAIL;
+    }
+
+    _cs.Enter();
+    if (_res == S_OK)
+      _res = res;
+    _numPending--;
+    _cs.Leave();
+    _doneEvent.Set();
+  }
+}
+
+HRESULT CAsyncOutFileStream::CreateThread()
+{
+  for (unsigned i = 0; i < kNumBufs; i++)
+  {
+    _bufs[i].Buf.Alloc(k_AsyncFileStream_BlockSize);
+    if (!_bufs[i].Buf.IsAllocated())
+      return E_OUTOFMEMORY;
+  }
+  WRes wres = _submitEvent.CreateIfNotCreated_Reset();
+  if (wres == 0) wres = _doneEvent.CreateIfNotCreated_Reset();
+  if (wres == 0) wres = _thread.Create(AsyncOutFileStream_Thread, this);
+  if (wres != 0)
+    return HRESULT_FROM_WIN32(wres);
+  _created = true;
+  return S_OK;
+}
+
+HRESULT CAsyncOutFileStream::Submit()
+{
+  _bufs[_writeIndex].Size = _pos;
+  _pos = 0;
+  _cs.Enter();
+  _numPending++;
+  _writeIndex = (_writeIndex + 1) % kNumBufs;
+  _cs.Leave();
+  _submitEvent.Set();
+
+  // we wait for free buffer for next Write() calls
+  _cs.Enter();
+  while (_numPending == kNumBufs)
+  {
+    _cs.Leave();
+    _doneEvent.Lock();
+    _cs.Enter();
+  }
+  const HRESULT res = _res;
+  _cs.Leave();
+  return res;
+}
+
+HRESULT CAsyncOutFileStream::FlushBufs()
+{
+  if (!_created)
+    return S_OK;
+  if (_pos != 0)
+    Submit();
+  _cs.Enter();
+  while (_numPending != 0)
+  {
+    _cs.Leave();
+    _doneEvent.Lock();
+    _cs.Enter();
+  }
+  const HRESULT res = _res;
+  _cs.Leave();
+  return res;
+}
+
+STDMETHODIMP CAsyncOutFileStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (_syncMode)
+    return COutFileStream::Write(data, size, processedSize);
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+  if (!_created)
+  {
+    const HRESULT res = CreateThread();
+    if (res != S_OK)
+    {
+      if (_thread.IsCreated())
+        return res;
+      _syncMode = true;
+      return COutFileStream::Write(data, size, processedSize);
+    }
+  }
+
+  size_t rem = k_AsyncFileStream_BlockSize - _pos;
+  if (rem > size)
+    rem = size;
+  memcpy(_bufs[_writeIndex].Buf + _pos, data, rem);
+  _pos += rem;
+  if (processedSize)
+    *processedSize = (UInt32)rem;
+  if (_pos == k_AsyncFileStream_BlockSize)
+    return Submit();
+  return S_OK;
+}
+
+STDMETHODIMP CAsyncOutFileStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  RINOK(FlushBufs());
+  return COutFileStream::Seek(offset, seekOrigin, newPosition);
+}
+
+STDMETHODIMP CAsyncOutFileStream::SetSize(UInt64 newSize)
+{
+  RINOK(FlushBufs());
+  return COutFileStream::SetSize(newSize);
+}
+
+#endif
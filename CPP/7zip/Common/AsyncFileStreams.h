@@ -0,0 +1,112 @@
+// AsyncFileStreams.h
+
+#ifndef __ASYNC_FILE_STREAMS_H
+#define __ASYNC_FILE_STREAMS_H
+
+#include "../../Common/MyBuffer2.h"
+
+#include "../../Windows/Synchronization.h"
+#include "../../Windows/Thread.h"
+
+#include "FileStreams.h"
+
+/*
+CAsyncInFileStream reads the file in another thread ahead of the consumer (read-ahead).
+CAsyncOutFileStream writes the file in another thread after the producer (write-behind).
+So the coder threads don't wait for the disk, while there are free buffers.
+
+The file itself is accessed via the methods of CInFileStream / COutFileStream,
+and all other interfaces of these classes work as before.
+The thread and the buffers are created at first Read() / Write() call.
+If they can't be created, the stream works as synchronous stream.
+*/
+
+const unsigned k_AsyncFileStream_NumBufs = 3;
+const size_t k_AsyncFileStream_BlockSize = (size_t)1 << 20;
+
+// smaller files are read and written synchronously
+const UInt64 k_AsyncFileStream_MinFileSize = (UInt64)1 << 22;
+
+struct CAsyncFileBuf
+{
+  CMidBuffer Buf;
+  size_t Size;
+  HRESULT Res;
+};
+
+class CAsyncInFileStream: public CInFileStream
+{
+  NWindows::CThread _thread;
+  NWindows::NSynchronization::CCriticalSection _cs;
+  NWindows::NSynchronization::CAutoResetEvent _startEvent;
+  NWindows::NSynchronization::CAutoResetEvent _filledEvent;
+  NWindows::NSynchronization::CAutoResetEvent _freeEvent;
+  NWindows::NSynchronization::CAutoResetEvent _stoppedEvent;
+
+  CAsyncFileBuf _bufs[k_AsyncFileStream_NumBufs];
+
+  // these variables are protected by (_cs)
+  unsigned _readIndex;  // the buffer that is read by consumer
+  unsigned _numFilled;
+  bool _finished;       // the thread will not fill more buffers
+  bool _stop;
+  bool _exit;
+
+  // these variables are used only by consumer
+  size_t _readPos;      // position in _bufs[_readIndex]
+  UInt64 _virtPos;
+  bool _running;
+  bool _syncMode;
+
+  HRESULT Start();
+  void Stop();
+public:
+  void ThreadFunc();
+
+  CAsyncInFileStream();
+  ~CAsyncInFileStream();
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+  STDMETHOD(GetView)(const Byte **data, UInt64 *size);
+};
+
+class CAsyncOutFileStream: public COutFileStream
+{
+  NWindows::CThread _thread;
+  NWindows::NSynchronization::CCriticalSection _cs;
+  NWindows::NSynchronization::CAutoResetEvent _submitEvent;
+  NWindows::NSynchronization::CAutoResetEvent _doneEvent;
+
+  CAsyncFileBuf _bufs[k_AsyncFileStream_NumBufs];
+
+  // these variables are protected by (_cs)
+  unsigned _writeIndex; // the buffer that is filled by producer
+  unsigned _numPending; // the number of buffers submitted to the thread
+  HRESULT _res;         // the first error of writing
+  bool _exit;
+
+  // these variables are used only by producer
+  size_t _pos;          // position in _bufs[_writeIndex]
+  bool _created;
+  bool _syncMode;
+
+  HRESULT CreateThread();
+  HRESULT Submit();
+public:
+  void ThreadFunc();
+
+  CAsyncOutFileStream();
+  ~CAsyncOutFileStream();
+
+  /* FlushBufs() waits until all written data is in the file.
+     It returns the error of writing, if there was error.
+     The caller must call it before the access to (File) or (ProcessedSize). */
+  HRESULT FlushBufs();
+
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+  STDMETHOD(SetSize)(UInt64 newSize);
+};
+
+#endif
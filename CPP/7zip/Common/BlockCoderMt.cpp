@@ -0,0 +1,100 @@
+// BlockCoderMt.cpp
+
+#include "StdAfx.h"
+
+#ifndef _7ZIP_ST
+#include "../../Windows/System.h"
+#endif
+
+#include "BlockCoderMt.h"
+
+#ifndef _7ZIP_ST
+
+void CBlockCoderThread::Execute()
+{
+  // CVirtThread has no index at creation, so the thread binds itself
+  Numa_BindCurrentThread(ThreadIndex);
+  Mt->Run(ThreadIndex);
+}
+
+#endif
+
+void CBlockCoderMt::SetNumThreads(unsigned numThreads)
+{
+  #ifdef _7ZIP_ST
+  numThreads = 1;
+  #endif
+  const unsigned kNumThreadsMax = 64;
+  if (numThreads < 1)
+    numThreads = 1;
+  if (numThreads > kNumThreadsMax)
+    numThreads = kNumThreadsMax;
+  _numThreads = numThreads;
+}
+
+void CBlockCoderMt::SetNumThreads_Default(unsigned numThreadsMax)
+{
+  unsigned numThreads = 1;
+  #ifndef _7ZIP_ST
+  numThreads = (unsigned)NWindows::NSystem::GetNumberOfProcessors();
+  #endif
+  if (numThreads > numThreadsMax)
+    numThreads = numThreadsMax;
+  SetNumThreads(numThreads);
+}
+
+void CBlockCoderMt::Run(unsigned threadIndex)
+{
+  #ifndef _7ZIP_ST
+  for (unsigned i = threadIndex; i < _numBlocks; i += _numThreadsUsed)
+    _callback->CodeBlock(threadIndex, i);
+  #else
+  UNUSED_VAR(threadIndex)
+  #endif
+}
+
+HRESULT CBlockCoderMt::Code(IBlockCoderCallback *callback, unsigned numBlocks)
+{
+  unsigned numThreads = _numThreads;
+  if (numThreads > numBlocks)
+    numThreads = numBlocks;
+
+  #ifndef _7ZIP_ST
+  if (numThreads > 1)
+  {
+    _callback = callback;
+    _numBlocks = numBlocks;
+    _numThreadsUsed = numThreads;
+    while (_threads.Size() < numThreads - 1)
+    {
+      CBlockCoderThread &t = _threads.AddNew();
+      t.Mt = this;
+      t.ThreadIndex = _threads.Size();
+    }
+    // if a thread can't be created, fewer threads are used
+    unsigned numCreated;
+    for (numCreated = 0; numCreated < numThreads - 1; numCreated++)
+      if (_threads[numCreated].Create() != 0)
+        break;
+    _numThreadsUsed = numCreated + 1;
+    unsigned i;
+    for (i = 0; i < numCreated; i++)
+      _threads[i].Started = (_threads[i].Start() == 0);
+    Run(0);
+    // the blocks of a thread that was not started are processed here
+    for (i = 0; i < numCreated; i++)
+    {
+      CBlockCoderThread &t = _threads[i];
+      if (t.Started)
+        t.WaitExecuteFinish();
+      else
+        Run(t.ThreadIndex);
+    }
+    return S_OK;
+  }
+  #endif
+
+  for (unsigned i = 0; i < numBlocks; i++)
+    callback->CodeBlock(0, i);
+  return S_OK;
+}
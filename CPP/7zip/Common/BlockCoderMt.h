@@ -0,0 +1,67 @@
+// BlockCoderMt.h
+
+#ifndef __BLOCK_CODER_MT_H
+#define __BLOCK_CODER_MT_H
+
+#include "../../Common/MyTypes.h"
+#include "../../Common/MyVector.h"
+#include "../../Common/MyWindows.h"
+
+#ifndef _7ZIP_ST
+#include "VirtThread.h"
+#endif
+
+/*
+  CBlockCoderMt : unpacks or packs several independent blocks in parallel.
+  The caller reads the input data of all blocks in advance (the input
+  stream is sequential). Then Code() calls CodeBlock() for each block,
+  the first thread is the calling thread.
+  CodeBlock() must keep its per-thread state in slot (threadIndex),
+  and it stores the result of each block.
+*/
+
+struct IBlockCoderCallback
+{
+  virtual void CodeBlock(unsigned threadIndex, unsigned blockIndex) = 0;
+};
+
+#ifndef _7ZIP_ST
+
+class CBlockCoderMt;
+
+struct CBlockCoderThread: public CVirtThread
+{
+  CBlockCoderMt *Mt;
+  unsigned ThreadIndex;
+  bool Started;
+
+  virtual void Execute();
+  virtual ~CBlockCoderThread() { CVirtThread::WaitThreadFinish(); }
+};
+
+#endif
+
+class CBlockCoderMt
+{
+  unsigned _numThreads;
+  #ifndef _7ZIP_ST
+  unsigned _numThreadsUsed;
+  unsigned _numBlocks;
+  IBlockCoderCallback *_callback;
+  CObjectVector<CBlockCoderThread> _threads;
+  #endif
+
+  CLASS_NO_COPY(CBlockCoderMt)
+public:
+  CBlockCoderMt(): _numThreads(1) {}
+
+  void SetNumThreads(unsigned numThreads);
+  // the number of processors, but not more than (numThreadsMax)
+  void SetNumThreads_Default(unsigned numThreadsMax = 8);
+  unsigned GetNumThreads() const { return _numThreads; }
+
+  HRESULT Code(IBlockCoderCallback *callback, unsigned numBlocks);
+  void Run(unsigned threadIndex);
+};
+
+#endif
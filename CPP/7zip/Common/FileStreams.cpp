@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <grp.h>
 #include <pwd.h>
+#include <sys/mman.h>
 
 // for major()/minor():
 #if defined(__FreeBSD__) || defined(BSD)
@@ -51,7 +52,24 @@ static inline HRESULT ConvertBoolToHRESULT(bool result)
 static const UInt32 kClusterSize = 1 << 18;
 #endif
 
+bool g_FileMapMode = false;
+
+#ifdef USE_FILE_MAP
+// Read() asks the kernel to read the next block of mapped file in advance
+static const size_t kMapAdviseStep = (size_t)1 << 22;
+// small files are read faster than mapped
+static const UInt64 kMapSizeMin = (UInt64)1 << 20;
+// 32-bit process can't find the big free range of address space
+static const UInt64 kMapSizeMax = (UInt64)1 << (sizeof(size_t) > 4 ? 40 : 28);
+#endif
+
 CInFileStream::CInFileStream():
+ #ifdef USE_FILE_MAP
+  _map(NULL),
+  _mapSize(0),
+  _mapPos(0),
+  _mapAdvisePos(0),
+ #endif
  #ifdef SUPPORT_DEVICE_FILE
   VirtPos(0),
   PhyPos(0),
@@ -77,10 +95,81 @@ CInFileStream::~CInFileStream()
   MidFree(Buf);
   #endif
 
+  #ifdef USE_FILE_MAP
+  UnmapFile();
+  #endif
+
   if (Callback)
     Callback->InFileStream_On_Destroy(this, CallbackRef);
 }
 
+
+#ifdef USE_FILE_MAP
+
+bool CInFileStream::MapFile()
+{
+  UnmapFile();
+  if (!g_FileMapMode)
+    return false;
+  struct stat st;
+  if (File.my_fstat(&st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return false;
+  const UInt64 size = (UInt64)st.st_size;
+  if (size < kMapSizeMin || size > kMapSizeMax || size != (size_t)size)
+    return false;
+  const off_t pos = File.seekToCur();
+  if (pos == -1)
+    return false;
+  void *p = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, File.GetHandle(), 0);
+  if (p == MAP_FAILED)
+    return false;
+  #ifdef MADV_SEQUENTIAL
+  madvise(p, (size_t)size, MADV_SEQUENTIAL);
+  #endif
+  _map = (const Byte *)p;
+  _mapSize = (size_t)size;
+  _mapPos = (UInt64)pos;
+  _mapAdvisePos = 0;
+  return true;
+}
+
+void CInFileStream::UnmapFile() throw()
+{
+  if (_map)
+  {
+    munmap((void *)_map, _mapSize);
+    _map = NULL;
+    _mapSize = 0;
+  }
+}
+
+#else
+
+bool CInFileStream::MapFile()
+{
+  return false;
+}
+
+#endif
+
+
+STDMETHODIMP CInFileStream::GetView(const Byte **data, UInt64 *size)
+{
+  #ifdef USE_FILE_MAP
+  if (_map)
+  {
+    const size_t pos = (_mapPos < _mapSize) ? (size_t)_mapPos : _mapSize;
+    *data = _map + pos;
+    *size = _mapSize - pos;
+    return S_OK;
+  }
+  #endif
+  *data = NULL;
+  *size = 0;
+  return S_FALSE;
+}
+
+
 STDMETHODIMP CInFileStream::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   #ifdef USE_WIN_FILE
@@ -192,6 +281,35 @@ STDMETHODIMP CInFileStream::Read(void *data, UInt32 size, UInt32 *processedSize)
   
   if (processedSize)
     *processedSize = 0;
+
+  #ifdef USE_FILE_MAP
+  if (_map)
+  {
+    if (_mapPos >= _mapSize)
+      return S_OK;
+    size_t rem = _mapSize - (size_t)_mapPos;
+    if (rem > size)
+      rem = size;
+    const size_t end = (size_t)_mapPos + rem;
+    #ifdef MADV_WILLNEED
+    if (end > _mapAdvisePos)
+    {
+      const size_t pos = end & ~(kMapAdviseStep - 1);
+      size_t adviseSize = _mapSize - pos;
+      if (adviseSize > kMapAdviseStep * 2)
+        adviseSize = kMapAdviseStep * 2;
+      madvise((void *)(_map + pos), adviseSize, MADV_WILLNEED);
+      _mapAdvisePos = pos + kMapAdviseStep;
+    }
+    #endif
+    memcpy(data, _map + (size_t)_mapPos, rem);
+    _mapPos = end;
+    if (processedSize)
+      *processedSize = (UInt32)rem;
+    return S_OK;
+  }
+  #endif
+
   const ssize_t res = File.read_part(data, (size_t)size);
   if (res != -1)
   {
@@ -303,6 +421,28 @@ STDMETHODIMP CInFileStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPos
   return hres;
   
   #else
+
+  #ifdef USE_FILE_MAP
+  if (_map)
+  {
+    switch (seekOrigin)
+    {
+      case STREAM_SEEK_SET: break;
+      case STREAM_SEEK_CUR: offset += _mapPos; break;
+      case STREAM_SEEK_END: offset += _mapSize; break;
+      default: return STG_E_INVALIDFUNCTION;
+    }
+    if (offset < 0)
+      return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+    _mapPos = (UInt64)offset;
+    // the next Read() after random seek starts new read-ahead block
+    if (_mapPos > _mapAdvisePos || _mapPos + kMapAdviseStep < _mapAdvisePos)
+      _mapAdvisePos = 0;
+    if (newPosition)
+      *newPosition = (UInt64)offset;
+    return S_OK;
+  }
+  #endif
   
   const off_t res = File.seek((off_t)offset, (int)seekOrigin);
   if (res == -1)
@@ -321,6 +461,13 @@ STDMETHODIMP CInFileStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPos
 
 STDMETHODIMP CInFileStream::GetSize(UInt64 *size)
 {
+  #ifdef USE_FILE_MAP
+  if (_map)
+  {
+    *size = _mapSize;
+    return S_OK;
+  }
+  #endif
   return ConvertBoolToHRESULT(File.GetLength(*size));
 }
 
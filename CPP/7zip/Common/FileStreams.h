@@ -5,6 +5,8 @@
 
 #ifdef _WIN32
 #define USE_WIN_FILE
+#else
+#define USE_FILE_MAP
 #endif
 
 #include "../../Common/MyCom.h"
@@ -17,6 +19,10 @@
 #include "UniqBlocks.h"
 
 
+/* CInFileStream::MapFile() maps the files only, if g_FileMapMode is set.
+   The UI sets it with -smm switch for the commands that only read archives. */
+extern bool g_FileMapMode;
+
 class CInFileStream;
 struct IInFileStream_Callback
 {
@@ -30,9 +36,19 @@ class CInFileStream:
   public IStreamGetProps,
   public IStreamGetProps2,
   public IStreamGetProp,
+  public IStreamGetView,
   public CMyUnknownImp
 {
   NWindows::NFile::NIO::CInFile File;
+
+  #ifdef USE_FILE_MAP
+  const Byte *_map;
+  size_t _mapSize;
+  UInt64 _mapPos;
+  size_t _mapAdvisePos;
+  void UnmapFile() throw();
+  #endif
+
 public:
 
   #ifdef USE_WIN_FILE
@@ -80,21 +96,37 @@ public:
   
   bool Open(CFSTR fileName)
   {
+    #ifdef USE_FILE_MAP
+    UnmapFile();
+    #endif
     _info_WasLoaded = false;
     return File.Open(fileName);
   }
   
   bool OpenShared(CFSTR fileName, bool shareForWrite)
   {
+    #ifdef USE_FILE_MAP
+    UnmapFile();
+    #endif
     _info_WasLoaded = false;
     return File.OpenShared(fileName, shareForWrite);
   }
 
+  /* MapFile() maps the opened regular file to memory, if (g_FileMapMode) is set,
+     and the size of file is in range [kMapSizeMin, kMapSizeMax].
+     Then Read() copies the data from the mapping without system calls,
+     and GetView() gives the direct access to the data of file.
+     The file must not be truncated or changed while it's mapped:
+     the access to the lost pages raises SIGBUS.
+     It returns false, if the file was not mapped. Then the stream still works via read(). */
+  bool MapFile();
+
   MY_QUERYINTERFACE_BEGIN2(IInStream)
   MY_QUERYINTERFACE_ENTRY(IStreamGetSize)
   MY_QUERYINTERFACE_ENTRY(IStreamGetProps)
   MY_QUERYINTERFACE_ENTRY(IStreamGetProps2)
   MY_QUERYINTERFACE_ENTRY(IStreamGetProp)
+  MY_QUERYINTERFACE_ENTRY(IStreamGetView)
   MY_QUERYINTERFACE_END
   MY_ADDREF_RELEASE
 
@@ -106,6 +138,7 @@ public:
   STDMETHOD(GetProps2)(CStreamFileProps *props);
   STDMETHOD(GetProperty)(PROPID propID, PROPVARIANT *value);
   STDMETHOD(ReloadProps)();
+  STDMETHOD(GetView)(const Byte **data, UInt64 *size);
 };
 
 class CStdInFileStream:
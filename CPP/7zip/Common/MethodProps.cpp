@@ -419,7 +419,10 @@ static const CNameToPropID g_NameToPropID[] =
   { VT_UI4, "ldmhlog" },
   { VT_UI4, "ldmslen" },
   { VT_UI4, "ldmblog" },
-  { VT_UI4, "ldmhevery" }
+  { VT_UI4, "ldmhevery" },
+  { VT_BSTR, "dict" },
+  { VT_UI4, "prime" },
+  { VT_BOOL, "std" }
 };
 
 #if defined(static_assert) || (__STDC_VERSION >= 201112L) || (_MSC_VER >= 1900)
@@ -514,6 +517,7 @@ static bool IsLogSizeProp(PROPID propid)
     case NCoderPropID::kUsedMemorySize:
     case NCoderPropID::kBlockSize:
     case NCoderPropID::kBlockSize2:
+    case NCoderPropID::kBlockPrimeSize:
     // case NCoderPropID::kReduceSize:
       return true;
   }
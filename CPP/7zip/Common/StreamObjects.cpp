@@ -78,6 +78,14 @@ STDMETHODIMP CBufInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosi
   return S_OK;
 }
 
+STDMETHODIMP CBufInStream::GetView(const Byte **data, UInt64 *size)
+{
+  const size_t pos = (_pos < _size) ? (size_t)_pos : _size;
+  *data = _data + pos;
+  *size = _size - pos;
+  return S_OK;
+}
+
 void Create_BufInStream_WithReference(const void *data, size_t size, IUnknown *ref, ISequentialInStream **stream)
 {
   *stream = NULL;
@@ -176,38 +184,236 @@ STDMETHODIMP CSequentialOutStreamSizeCount::Write(const void *data, UInt32 size,
   return result;
 }
 
-static const UInt64 kEmptyTag = (UInt64)(Int64)-1;
+static const UInt32 kNone = (UInt32)0 - 1;
+static const UInt32 kNumSlotsMax = (UInt32)1 << 20;
 
-void CCachedInStream::Free() throw()
+void CBlockCache::Free() throw()
 {
-  MyFree(_tags);
-  _tags = NULL;
   MidFree(_data);
   _data = NULL;
+  MyFree(_slots);
+  _slots = NULL;
+  MyFree(_hash);
+  _hash = NULL;
+  _blockSize = 0;
+  _numSlots = 0;
 }
 
-bool CCachedInStream::Alloc(unsigned blockSizeLog, unsigned numBlocksLog) throw()
+bool CBlockCache::Alloc(size_t blockSize, size_t cacheSize, unsigned numSlotsMin) throw()
 {
-  unsigned sizeLog = blockSizeLog + numBlocksLog;
-  if (sizeLog >= sizeof(size_t) * 8)
+  if (blockSize == 0)
     return false;
-  size_t dataSize = (size_t)1 << sizeLog;
-  if (!_data || dataSize != _dataSize)
+  size_t numSlots = cacheSize / blockSize;
+  if (numSlots < numSlotsMin)
+    numSlots = numSlotsMin;
+  if (numSlots == 0)
+    numSlots = 1;
+  if (numSlots > kNumSlotsMax)
+    numSlots = kNumSlotsMax;
+  if (blockSize > ((size_t)0 - 1) / numSlots)
+    return false;
+
+  if (!_data || blockSize != _blockSize || numSlots != _numSlots)
   {
-    MidFree(_data);
-    _data = (Byte *)MidAlloc(dataSize);
-    if (!_data)
+    Free();
+    unsigned hashBits = 1;
+    while (((size_t)1 << hashBits) < numSlots * 2)
+      hashBits++;
+    _data = (Byte *)MidAlloc(blockSize * numSlots);
+    _slots = (CSlot *)MyAlloc(sizeof(CSlot) * numSlots);
+    _hash = (UInt32 *)MyAlloc(sizeof(UInt32) << hashBits);
+    if (!_data || !_slots || !_hash)
+    {
+      Free();
       return false;
-    _dataSize = dataSize;
+    }
+    _blockSize = blockSize;
+    _numSlots = (UInt32)numSlots;
+    _hashBits = hashBits;
   }
-  if (!_tags || numBlocksLog != _numBlocksLog)
+  Clear();
+  return true;
+}
+
+void CBlockCache::Clear() throw()
+{
+  _curKey = kEmptyKey;
+  _nextKey = kEmptyKey;
+  _readAhead = 0;
+  if (!_data)
+    return;
+  for (UInt32 i = 0; i < _numSlots; i++)
   {
-    MyFree(_tags);
-    _tags = (UInt64 *)MyAlloc(sizeof(UInt64) << numBlocksLog);
-    if (!_tags)
-      return false;
-    _numBlocksLog = numBlocksLog;
+    CSlot &s = _slots[i];
+    s.Key = kEmptyKey;
+    s.Size = 0;
+    s.Prev = i - 1;
+    s.Next = i + 1;
+    s.HashNext = kNone;
+  }
+  _slots[0].Prev = kNone;
+  _slots[_numSlots - 1].Next = kNone;
+  _head = 0;
+  _tail = _numSlots - 1;
+  const size_t numHash = (size_t)1 << _hashBits;
+  for (size_t i = 0; i < numHash; i++)
+    _hash[i] = kNone;
+}
+
+void CBlockCache::Unlink(UInt32 slot) throw()
+{
+  const CSlot &s = _slots[slot];
+  if (s.Prev != kNone)
+    _slots[s.Prev].Next = s.Next;
+  else
+    _head = s.Next;
+  if (s.Next != kNone)
+    _slots[s.Next].Prev = s.Prev;
+  else
+    _tail = s.Prev;
+}
+
+void CBlockCache::LinkToFront(UInt32 slot) throw()
+{
+  CSlot &s = _slots[slot];
+  s.Prev = kNone;
+  s.Next = _head;
+  if (_head != kNone)
+    _slots[_head].Prev = slot;
+  else
+    _tail = slot;
+  _head = slot;
+}
+
+void CBlockCache::RemoveFromHash(UInt32 slot) throw()
+{
+  CSlot &s = _slots[slot];
+  UInt32 *ref = &_hash[GetHash(s.Key)];
+  while (*ref != kNone)
+  {
+    if (*ref == slot)
+    {
+      *ref = s.HashNext;
+      break;
+    }
+    ref = &_slots[*ref].HashNext;
+  }
+  s.HashNext = kNone;
+  s.Key = kEmptyKey;
+  s.Size = 0;
+}
+
+const Byte *CBlockCache::Find(UInt64 key, size_t &size) throw()
+{
+  size = 0;
+  if (!_data || key == kEmptyKey)
+    return NULL;
+  for (UInt32 i = _hash[GetHash(key)]; i != kNone; i = _slots[i].HashNext)
+  {
+    if (_slots[i].Key == key)
+    {
+      if (i != _head)
+      {
+        Unlink(i);
+        LinkToFront(i);
+      }
+      size = _slots[i].Size;
+      return GetSlotData(i);
+    }
+  }
+  return NULL;
+}
+
+bool CBlockCache::Contains(UInt64 key) const throw()
+{
+  if (!_data || key == kEmptyKey)
+    return false;
+  for (UInt32 i = _hash[GetHash(key)]; i != kNone; i = _slots[i].HashNext)
+    if (_slots[i].Key == key)
+      return true;
+  return false;
+}
+
+UInt32 CBlockCache::Reserve() throw()
+{
+  const UInt32 slot = _tail;
+  if (_slots[slot].Key != kEmptyKey)
+    RemoveFromHash(slot);
+  if (slot != _head)
+  {
+    Unlink(slot);
+    LinkToFront(slot);
   }
+  return slot;
+}
+
+void CBlockCache::Commit(UInt32 slot, UInt64 key, size_t size) throw()
+{
+  CSlot &s = _slots[slot];
+  if (s.Key != kEmptyKey)
+    RemoveFromHash(slot);
+  if (key == kEmptyKey)
+    return;
+  Remove(key);
+  const UInt32 h = GetHash(key);
+  s.Key = key;
+  s.Size = size;
+  s.HashNext = _hash[h];
+  _hash[h] = slot;
+}
+
+void CBlockCache::Remove(UInt64 key) throw()
+{
+  if (!_data || key == kEmptyKey)
+    return;
+  for (UInt32 i = _hash[GetHash(key)]; i != kNone; i = _slots[i].HashNext)
+  {
+    if (_slots[i].Key == key)
+    {
+      RemoveFromHash(i);
+      // the empty slot will be reused first
+      if (i != _tail)
+      {
+        Unlink(i);
+        CSlot &s = _slots[i];
+        s.Next = kNone;
+        s.Prev = _tail;
+        _slots[_tail].Next = i;
+        _tail = i;
+      }
+      return;
+    }
+  }
+}
+
+unsigned CBlockCache::GetReadAhead(UInt64 key, UInt64 nextKey) throw()
+{
+  if (key == _curKey)
+    return _readAhead;
+  if (key == _nextKey && key != kEmptyKey)
+  {
+    unsigned lim = _readAheadMax;
+    if (lim > _numSlots / 2)
+      lim = _numSlots / 2;
+    _readAhead = (_readAhead == 0 ? 1 : _readAhead * 2);
+    if (_readAhead > lim)
+      _readAhead = lim;
+  }
+  else
+    _readAhead = 0;
+  _curKey = key;
+  _nextKey = nextKey;
+  return _readAhead;
+}
+
+
+bool CCachedInStream::Alloc(unsigned blockSizeLog, unsigned numBlocksLog) throw()
+{
+  unsigned sizeLog = blockSizeLog + numBlocksLog;
+  if (sizeLog >= sizeof(size_t) * 8)
+    return false;
+  if (!_cache.Alloc((size_t)1 << blockSizeLog, (size_t)1 << sizeLog))
+    return false;
   _blockSizeLog = blockSizeLog;
   return true;
 }
@@ -216,9 +422,7 @@ void CCachedInStream::Init(UInt64 size) throw()
 {
   _size = size;
   _pos = 0;
-  size_t numBlocks = (size_t)1 << _numBlocksLog;
-  for (size_t i = 0; i < numBlocks; i++)
-    _tags[i] = kEmptyTag;
+  _cache.Clear();
 }
 
 STDMETHODIMP CCachedInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
@@ -239,20 +443,22 @@ STDMETHODIMP CCachedInStream::Read(void *data, UInt32 size, UInt32 *processedSiz
   while (size != 0)
   {
     const UInt64 cacheTag = _pos >> _blockSizeLog;
-    const size_t cacheIndex = (size_t)cacheTag & (((size_t)1 << _numBlocksLog) - 1);
-    Byte *p = _data + (cacheIndex << _blockSizeLog);
+    size_t cachedSize;
+    const Byte *p = _cache.Find(cacheTag, cachedSize);
 
-    if (_tags[cacheIndex] != cacheTag)
+    if (!p)
     {
-      _tags[cacheIndex] = kEmptyTag;
       UInt64 remInBlock = _size - (cacheTag << _blockSizeLog);
       size_t blockSize = (size_t)1 << _blockSizeLog;
       if (blockSize > remInBlock)
         blockSize = (size_t)remInBlock;
       
-      RINOK(ReadBlock(cacheTag, p, blockSize));
+      const UInt32 slot = _cache.Reserve();
+      Byte *dest = _cache.GetSlotData(slot);
+      RINOK(ReadBlock(cacheTag, dest, blockSize));
       
-      _tags[cacheIndex] = cacheTag;
+      _cache.Commit(slot, cacheTag, blockSize);
+      p = dest;
     }
     
     const size_t kBlockSize = (size_t)1 << _blockSizeLog;
@@ -52,9 +52,10 @@ public:
   }
   void Init(CReferenceBuf *ref) { Init(ref->Buf, ref->Buf.Size(), ref); }
 
-  MY_UNKNOWN_IMP2(ISequentialInStream, IInStream)
+  MY_UNKNOWN_IMP3(ISequentialInStream, IInStream, IStreamGetView)
   STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
   STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+  STDMETHOD(GetView)(const Byte **data, UInt64 *size);
 };
 
 
@@ -138,23 +139,101 @@ public:
 };
 
 
+/*
+  CBlockCache : LRU cache of unpacked blocks (clusters, grains, chunks)
+  for the handlers of disk images and file systems.
+  All slots have the same size, so the total size of the cache is limited.
+  The key of block is any UInt64 value except (kEmptyKey).
+
+  A new block is added in two steps:
+    slot = Reserve();  unpack to GetSlotData(slot);  Commit(slot, key, size);
+  If unpacking fails, the reserved slot just stays empty.
+*/
+
+class CBlockCache
+{
+  struct CSlot
+  {
+    UInt64 Key;
+    size_t Size;
+    UInt32 Prev;     // more recently used slot
+    UInt32 Next;     // less recently used slot
+    UInt32 HashNext;
+  };
+
+  Byte *_data;
+  CSlot *_slots;
+  UInt32 *_hash;
+  size_t _blockSize;
+  UInt32 _numSlots;
+  unsigned _hashBits;
+  UInt32 _head;      // most recently used slot
+  UInt32 _tail;      // least recently used slot
+
+  UInt64 _curKey;
+  UInt64 _nextKey;
+  unsigned _readAhead;
+  unsigned _readAheadMax;
+
+  UInt32 GetHash(UInt64 key) const
+  {
+    const UInt32 h = (UInt32)key ^ (UInt32)(key >> 32);
+    return (h * 0x9E3779B1) >> (32 - _hashBits);
+  }
+  void Unlink(UInt32 slot) throw();
+  void LinkToFront(UInt32 slot) throw();
+  void RemoveFromHash(UInt32 slot) throw();
+
+  CLASS_NO_COPY(CBlockCache)
+public:
+  static const UInt64 kEmptyKey = (UInt64)(Int64)-1;
+
+  CBlockCache(): _data(NULL), _slots(NULL), _hash(NULL), _blockSize(0), _numSlots(0), _readAheadMax(0) {}
+  ~CBlockCache() { Free(); }
+
+  /* (cacheSize / blockSize) slots, but (numSlotsMin) slots at least.
+     Read-ahead is limited by half of the slots. */
+  bool Alloc(size_t blockSize, size_t cacheSize, unsigned numSlotsMin = 1) throw();
+  void Free() throw();
+  void Clear() throw();
+  bool IsAllocated() const { return _data != NULL; }
+  size_t GetBlockSize() const { return _blockSize; }
+  UInt32 GetNumSlots() const { return _numSlots; }
+
+  // returns the data of the block and marks it as most recently used, or NULL
+  const Byte *Find(UInt64 key, size_t &size) throw();
+  bool Contains(UInt64 key) const throw();
+
+  // the least recently used slot is cleared and marked as most recently used
+  UInt32 Reserve() throw();
+  Byte *GetSlotData(UInt32 slot) const { return _data + (size_t)slot * _blockSize; }
+  void Commit(UInt32 slot, UInt64 key, size_t size) throw();
+  void Remove(UInt64 key) throw();
+
+  /* sequential access detection:
+     (key) is the block that is accessed now, (nextKey) is the block after it.
+     It returns the number of blocks after (key) that should be unpacked
+     in advance: 0 for random access, and it grows up to the limit
+     after each block that continued the sequence. */
+  void SetReadAheadMax(unsigned num) { _readAheadMax = num; }
+  unsigned GetReadAhead(UInt64 key, UInt64 nextKey) throw();
+};
+
+
 class CCachedInStream:
   public IInStream,
   public CMyUnknownImp
 {
-  UInt64 *_tags;
-  Byte *_data;
-  size_t _dataSize;
+  CBlockCache _cache;
   unsigned _blockSizeLog;
-  unsigned _numBlocksLog;
   UInt64 _size;
   UInt64 _pos;
 protected:
   virtual HRESULT ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize) = 0;
 public:
-  CCachedInStream(): _tags(NULL), _data(NULL) {}
+  CCachedInStream() {}
   virtual ~CCachedInStream() { Free(); } // the destructor must be virtual (release calls it) !!!
-  void Free() throw();
+  void Free() throw() { _cache.Free(); }
   bool Alloc(unsigned blockSizeLog, unsigned numBlocksLog) throw();
   void Init(UInt64 size) throw();
 
@@ -54,3 +54,32 @@ HRESULT WriteStream(ISequentialOutStream *stream, const void *data, size_t size)
   }
   return S_OK;
 }
+
+const Byte *GetStreamView(ISequentialInStream *stream, UInt64 &size) throw()
+{
+  size = 0;
+  if (!stream)
+    return NULL;
+  IStreamGetView *getView = NULL;
+  stream->QueryInterface(IID_IStreamGetView, (void **)&getView);
+  if (!getView)
+    return NULL;
+  const Byte *data = NULL;
+  if (getView->GetView(&data, &size) != S_OK)
+    data = NULL;
+  getView->Release();
+  if (!data)
+    size = 0;
+  return data;
+}
+
+HRESULT SkipStreamView(ISequentialInStream *stream, UInt64 size) throw()
+{
+  IInStream *inStream = NULL;
+  stream->QueryInterface(IID_IInStream, (void **)&inStream);
+  if (!inStream)
+    return E_NOTIMPL;
+  const HRESULT res = inStream->Seek((Int64)size, STREAM_SEEK_CUR, NULL);
+  inStream->Release();
+  return res;
+}
@@ -10,4 +10,12 @@ HRESULT ReadStream_FALSE(ISequentialInStream *stream, void *data, size_t size) t
 HRESULT ReadStream_FAIL(ISequentialInStream *stream, void *data, size_t size) throw();
 HRESULT WriteStream(ISequentialOutStream *stream, const void *data, size_t size) throw();
 
+/* GetStreamView() returns the data from current position to the end of (stream),
+   if (stream) supports IStreamGetView and its data is in memory.
+   Otherwise it returns NULL.
+   SkipStreamView() moves the position of (stream) after (size) bytes of view. */
+
+const Byte *GetStreamView(ISequentialInStream *stream, UInt64 &size) throw();
+HRESULT SkipStreamView(ISequentialInStream *stream, UInt64 size) throw();
+
 #endif
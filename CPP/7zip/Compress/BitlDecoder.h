@@ -52,6 +52,9 @@ public:
   // the size of virtual data that was read from this object.
   UInt64 GetProcessedSize() const { return _stream.GetProcessedSize() - ((kNumBigValueBits - _bitPos) >> 3); }
 
+  // the number of virtual bits that were read from this object.
+  UInt64 GetProcessedBits() const { return (_stream.GetProcessedSize() << 3) - (kNumBigValueBits - _bitPos); }
+
   bool ThereAreDataInBitsBuffer() const { return this->_bitPos != kNumBigValueBits; }
   
   MY_FORCE_INLINE
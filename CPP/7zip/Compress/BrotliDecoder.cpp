@@ -1,8 +1,20 @@
 // (C) 2017 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
 #include "BrotliDecoder.h"
 
+/* brotli allocates its states and tables via the Alloc layer */
+static void *BrotliLayerAlloc(void *, size_t size) { return AllocLayer_Alloc(k_AllocKind_Brotli, size); }
+static void BrotliLayerFree(void *, void *address) { AllocLayer_Free(address); }
+
+static struct CBrotliAllocInit
+{
+  CBrotliAllocInit() { BrotliSetDefaultAllocators(BrotliLayerAlloc, BrotliLayerFree, NULL); }
+} g_BrotliAllocInit;
+
 int BrotliRead(void *arg, BROTLIMT_Buffer * in)
 {
   struct BrotliStream *x = (struct BrotliStream*)arg;
@@ -67,20 +79,57 @@ int BrotliWrite(void *arg, BROTLIMT_Buffer * out)
   return 0;
 }
 
+/* the first bytes of the stream were read already to check the format */
+struct BrotliPrefixStream {
+  struct BrotliStream s;
+  const Byte *prefix;
+  size_t prefixSize;
+};
+
+static int BrotliReadPrefix(void *arg, BROTLIMT_Buffer * in)
+{
+  struct BrotliPrefixStream *x = (struct BrotliPrefixStream*)arg;
+  size_t size = in->size;
+  if (size > x->prefixSize)
+    size = x->prefixSize;
+  memcpy(in->buf, x->prefix, size);
+  x->prefix += size;
+  x->prefixSize -= size;
+  if (size == in->size)
+    return 0;
+
+  BROTLIMT_Buffer rest;
+  rest.buf = (Byte *)in->buf + size;
+  rest.size = in->size - size;
+  rest.allocated = rest.size;
+  const int rv = BrotliRead(&x->s, &rest);
+  if (rv != 0)
+    return rv;
+  in->size = size + rest.size;
+  return 0;
+}
+
 namespace NCompress {
 namespace NBROTLI {
 
+static const size_t kSrcBufSize = (size_t)1 << 17;
+static const size_t kDstBufSize = (size_t)1 << 20;
+
 CDecoder::CDecoder():
   _processedIn(0),
   _processedOut(0),
   _inputSize(0),
-  _numThreads(NWindows::NSystem::GetNumberOfProcessors())
+  _numThreads(NWindows::NSystem::GetNumberOfProcessors()),
+  _srcBuf(NULL),
+  _dstBuf(NULL)
 {
   _props.clear();
 }
 
 CDecoder::~CDecoder()
 {
+  MyFree(_srcBuf);
+  MyFree(_dstBuf);
 }
 
 STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte * prop, UInt32 size)
@@ -117,6 +166,80 @@ STDMETHODIMP CDecoder::SetOutStreamSize(const UInt64 * outSize)
   return S_OK;
 }
 
+/*
+  single threaded decoder for a standard brotli stream (without the
+  skippable frames of brotli-mt), as written by the encoder with (std)
+*/
+HRESULT CDecoder::DecodeStd(ISequentialInStream * inStream,
+  ISequentialOutStream * outStream, ICompressProgressInfo * progress,
+  const Byte * prefix, size_t prefixSize)
+{
+  if (!_srcBuf) {
+    _srcBuf = MyAlloc(kSrcBufSize);
+    if (!_srcBuf)
+      return E_OUTOFMEMORY;
+  }
+  if (!_dstBuf) {
+    _dstBuf = MyAlloc(kDstBufSize);
+    if (!_dstBuf)
+      return E_OUTOFMEMORY;
+  }
+
+  BrotliDecoderState *state = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  if (!state)
+    return E_OUTOFMEMORY;
+
+  HRESULT res = S_OK;
+  const uint8_t *nextIn = prefix;
+  size_t availIn = prefixSize;
+
+  for (;;) {
+    uint8_t *nextOut = (uint8_t *)_dstBuf;
+    size_t availOut = kDstBufSize;
+    const BrotliDecoderResult result = BrotliDecoderDecompressStream(state,
+        &availIn, &nextIn, &availOut, &nextOut, NULL);
+
+    /* write decompressed result */
+    const size_t size = kDstBufSize - availOut;
+    if (size) {
+      res = WriteStream(outStream, _dstBuf, size);
+      if (res != S_OK)
+        break;
+      _processedOut += size;
+      if (progress) {
+        res = progress->SetRatioInfo(&_processedIn, &_processedOut);
+        if (res != S_OK)
+          break;
+      }
+    }
+
+    if (result == BROTLI_DECODER_RESULT_SUCCESS)
+      break;
+    if (result == BROTLI_DECODER_RESULT_ERROR) {
+      res = S_FALSE;
+      break;
+    }
+
+    /* read next input, the stream must not end before its last metablock */
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+      size_t processed = kSrcBufSize;
+      res = ReadStream(inStream, _srcBuf, &processed);
+      if (res != S_OK)
+        break;
+      if (processed == 0) {
+        res = S_FALSE;
+        break;
+      }
+      _processedIn += processed;
+      nextIn = (const uint8_t *)_srcBuf;
+      availIn = processed;
+    }
+  }
+
+  BrotliDecoderDestroyInstance(state);
+  return res;
+}
+
 HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
   ISequentialOutStream * outStream, ICompressProgressInfo * progress)
 {
@@ -124,9 +247,19 @@ HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
   size_t result;
   HRESULT res = S_OK;
 
-  struct BrotliStream Rd;
-  Rd.inStream = inStream;
-  Rd.processedIn = &_processedIn;
+  /* 0) brotli-mt frames start with the skippable magic, a standard stream can't */
+  Byte prefix[4];
+  size_t prefixSize = sizeof(prefix);
+  RINOK(ReadStream(inStream, prefix, &prefixSize));
+  _processedIn += prefixSize;
+  if (prefixSize < 4 || GetUi32(prefix) != BROTLIMT_MAGIC_SKIPPABLE)
+    return DecodeStd(inStream, outStream, progress, prefix, prefixSize);
+
+  struct BrotliPrefixStream Rd;
+  Rd.s.inStream = inStream;
+  Rd.s.processedIn = &_processedIn;
+  Rd.prefix = prefix;
+  Rd.prefixSize = prefixSize;
 
   struct BrotliStream Wr;
   Wr.progress = progress;
@@ -135,7 +268,7 @@ HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
   Wr.processedOut = &_processedOut;
 
   /* 1) setup read/write functions */
-  rdwr.fn_read = ::BrotliRead;
+  rdwr.fn_read = ::BrotliReadPrefix;
   rdwr.fn_write = ::BrotliWrite;
   rdwr.arg_read = (void *)&Rd;
   rdwr.arg_write = (void *)&Wr;
@@ -165,6 +298,68 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream * inStream, ISequentialOutStream
   return CodeSpec(inStream, outStream, progress);
 }
 
+/*
+  BROTLIMT_decompressDCtx() format: each brotli stream is preceded by
+  a skippable frame with its size, the frames are decoded in parallel by Code().
+  A standard brotli stream has no such frame.
+*/
+STDMETHODIMP CDecoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  const size_t destLim = *destSize;
+  *destSize = 0;
+  if (srcSize < 4 || GetUi32(src) != BROTLIMT_MAGIC_SKIPPABLE)
+  {
+    size_t outSize = destLim;
+    _processedIn = 0;
+    _processedOut = 0;
+    if (BrotliDecoderDecompress(srcSize, src, &outSize, dest) != BROTLI_DECODER_RESULT_SUCCESS)
+      return S_FALSE;
+    _processedIn = srcSize;
+    _processedOut = outSize;
+    *destSize = outSize;
+    return S_OK;
+  }
+  if (srcSize < 16)
+    return S_FALSE;
+  if (_numThreads > 1 && srcSize - 16 > GetUi32(src + 8))
+    return E_NOTIMPL;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  HRESULT res = S_OK;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+
+  while (srcPos != srcSize)
+  {
+    const Byte *p = src + srcPos;
+    const size_t rem = srcSize - srcPos;
+    if (rem < 16
+        || GetUi32(p) != BROTLIMT_MAGIC_SKIPPABLE
+        || GetUi32(p + 4) != 8
+        || GetUi16(p + 12) != BROTLIMT_MAGICNUMBER
+        || GetUi32(p + 8) > rem - 16) {
+      res = S_FALSE;
+      break;
+    }
+    const size_t frameSize = GetUi32(p + 8);
+    size_t outSize = destLim - destPos;
+    if (BrotliDecoderDecompress(frameSize, p + 16, &outSize, dest + destPos)
+        != BROTLI_DECODER_RESULT_SUCCESS) {
+      res = S_FALSE;
+      break;
+    }
+    srcPos += 16 + frameSize;
+    destPos += outSize;
+  }
+
+  _processedIn = srcPos;
+  _processedOut = destPos;
+  *destSize = destPos;
+  return res;
+}
+
 #ifndef NO_READ_FROM_CODER
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream * inStream)
 {
@@ -47,6 +47,7 @@ struct DProps
 class CDecoder:public ICompressCoder,
   public ICompressSetDecoderProperties2,
   public ICompressSetCoderMt,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CMyComPtr < ISequentialInStream > _inStream;
@@ -58,7 +59,13 @@ class CDecoder:public ICompressCoder,
   UInt32 _inputSize;
   UInt32 _numThreads;
 
+  /* buffers of the streaming decoder */
+  void *_srcBuf;
+  void *_dstBuf;
+
   HRESULT CodeSpec(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+  HRESULT DecodeStd(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress,
+      const Byte *prefix, size_t prefixSize);
   HRESULT SetOutStreamSizeResume(const UInt64 *outSize);
 
 public:
@@ -69,10 +76,12 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
 #endif
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
 
   MY_ADDREF_RELEASE
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetDecoderProperties2)(const Byte *data, UInt32 size);
   STDMETHOD (SetOutStreamSize)(const UInt64 *outSize);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
@@ -1,6 +1,10 @@
 // (C) 2017 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
+#include "CoderCtxCache.h"
 #include "BrotliEncoder.h"
 #include "BrotliDecoder.h"
 
@@ -8,25 +12,50 @@
 namespace NCompress {
 namespace NBROTLI {
 
+static void FreeCCtx(BROTLIMT_CCtx *ctx) { BROTLIMT_freeCCtx(ctx); }
+
+/* level, thread count and input size are fixed, when the context is created */
+static CCtxCache<BROTLIMT_CCtx> g_CCtxCache(FreeCCtx, 4);
+
+static UInt64 GetCtxKey(UInt32 numThreads, unsigned level, UInt32 inputSize)
+{
+  return ((UInt64)inputSize << 32) | ((UInt64)numThreads << 8) | level;
+}
+
+/* each thread keeps the input and output buffers of one frame, the
+   encoder state is about the same size. It's an estimate for the cache */
+static size_t GetCtxSize(UInt64 key)
+{
+  const unsigned level = (unsigned)key & 0xFF;
+  UInt32 inputSize = (UInt32)(key >> 32);
+  if (inputSize == 0)
+    inputSize = ((UInt32)1 << 20) * (level ? level : 1);
+  const UInt64 size = (UInt64)((UInt32)key >> 8) * inputSize * 3;
+  return size > kCtxCacheSizeMax ? kCtxCacheSizeMax + 1 : (size_t)size;
+}
+
 CEncoder::CEncoder():
   _processedIn(0),
   _processedOut(0),
   _inputSize(0),
   _ctx(NULL),
-  _numThreads(NWindows::NSystem::GetNumberOfProcessors())
+  _numThreads(NWindows::NSystem::GetNumberOfProcessors()),
+  _stdStream(false),
+  _ctxKey(0)
 {
   _props.clear();
 }
 
 CEncoder::~CEncoder()
 {
-  if (_ctx)
-    BROTLIMT_freeCCtx(_ctx);
+  g_CCtxCache.Put(_ctxKey, _ctx, GetCtxSize(_ctxKey));
 }
 
 STDMETHODIMP CEncoder::SetCoderProperties(const PROPID * propIDs, const PROPVARIANT * coderProps, UInt32 numProps)
 {
   _props.clear();
+  _inputSize = 0;
+  _stdStream = false;
 
   for (UInt32 i = 0; i < numProps; i++)
   {
@@ -52,6 +81,23 @@ STDMETHODIMP CEncoder::SetCoderProperties(const PROPID * propIDs, const PROPVARI
         SetNumberOfThreads(v);
         break;
       }
+    case NCoderPropID::kBlockSize:
+      {
+        /* size of the chunks, which are compressed in parallel */
+        if (prop.vt != VT_UI4)
+          return E_INVALIDARG;
+        const UInt32 kChunkSizeMin = (UInt32)1 << 16;
+        const UInt32 kChunkSizeMax = (UInt32)1 << 30;
+        _inputSize = v < kChunkSizeMin ? kChunkSizeMin : (v > kChunkSizeMax ? kChunkSizeMax : v);
+        break;
+      }
+    case NCoderPropID::kStdStream:
+      {
+        if (prop.vt != VT_BOOL)
+          return E_INVALIDARG;
+        _stdStream = (prop.boolVal != VARIANT_FALSE);
+        break;
+      }
     default:
       {
         break;
@@ -101,14 +147,27 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
   rdwr.arg_write = (void *)&Wr;
 
   /* 2) create compression context, if needed */
-  if (!_ctx)
-    _ctx = BROTLIMT_createCCtx(_numThreads, _props._level, _inputSize);
-  if (!_ctx)
-    return S_FALSE;
+  const UInt64 key = GetCtxKey(_numThreads, _props._level, _inputSize);
+  if (_ctx && _ctxKey != key) {
+    g_CCtxCache.Put(_ctxKey, _ctx, GetCtxSize(_ctxKey));
+    _ctx = NULL;
+  }
+  if (!_ctx) {
+    _ctx = g_CCtxCache.Get(key);
+    if (!_ctx)
+      _ctx = BROTLIMT_createCCtx(_numThreads, _props._level, _inputSize);
+    if (!_ctx)
+      return S_FALSE;
+    _ctxKey = key;
+  }
+  BROTLIMT_setStreamModeCCtx(_ctx, _stdStream ? 1 : 0);
 
   /* 3) compress */
   result = BROTLIMT_compressCCtx(_ctx, &rdwr);
   if (BROTLIMT_isError(result)) {
+    /* the context may be left in some unfinished state */
+    BROTLIMT_freeCCtx(_ctx);
+    _ctx = NULL;
     if (result == (size_t)-BROTLIMT_error_canceled)
       return E_ABORT;
     return E_FAIL;
@@ -117,6 +176,74 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
   return res;
 }
 
+/*
+  same frames as BROTLIMT_compressCCtx(): one brotli stream per (_inputSize)
+  bytes, each one with the 16 bytes skippable header.
+  With (_stdStream) the whole buffer is one standard brotli stream.
+  Several frames are compressed in parallel by Code() only.
+*/
+STDMETHODIMP CEncoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  /* BROTLIMT_createCCtx() default */
+  const size_t frameSize = _inputSize ? _inputSize : ((size_t)1 << 20) * (_props._level ? _props._level : 1);
+  if (_numThreads > 1 && srcSize > frameSize)
+    return E_NOTIMPL;
+
+  if (_stdStream)
+  {
+    size_t outSize = *destSize;
+    *destSize = 0;
+    _processedIn = 0;
+    _processedOut = 0;
+    if (BrotliEncoderCompress(_props._level, BROTLI_MAX_WINDOW_BITS, BROTLI_MODE_GENERIC,
+        srcSize, src, &outSize, dest) == BROTLI_FALSE)
+      return S_FALSE;
+    _processedIn = srcSize;
+    _processedOut = outSize;
+    *destSize = outSize;
+    return S_OK;
+  }
+
+  const size_t destLim = *destSize;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+  *destSize = 0;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  do {
+    size_t size = srcSize - srcPos;
+    if (size > frameSize)
+      size = frameSize;
+    if (destLim - destPos < 16)
+      return S_FALSE;
+    size_t outSize = destLim - destPos - 16;
+    if (BrotliEncoderCompress(_props._level, BROTLI_MAX_WINDOW_BITS, BROTLI_MODE_GENERIC,
+        size, src + srcPos, &outSize, dest + destPos + 16) == BROTLI_FALSE)
+      return S_FALSE;
+
+    /* number of 64 KiB blocks needed for decompression */
+    UInt32 hintSize = (UInt32)(frameSize >> 16);
+    if (frameSize > size)
+      hintSize = (UInt32)(size >> 16) + 1;
+
+    Byte *p = dest + destPos;
+    SetUi32(p, BROTLIMT_MAGIC_SKIPPABLE);
+    SetUi32(p + 4, 8);
+    SetUi32(p + 8, (UInt32)outSize);
+    SetUi16(p + 12, BROTLIMT_MAGICNUMBER);
+    SetUi16(p + 14, (UInt16)hintSize);
+    srcPos += size;
+    destPos += 16 + outSize;
+  } while (srcPos != srcSize);
+
+  _processedIn = srcSize;
+  _processedOut = destPos;
+  *destSize = destPos;
+  return S_OK;
+}
+
 STDMETHODIMP CEncoder::SetNumberOfThreads(UInt32 numThreads)
 {
   const UInt32 kNumThreadsMax = BROTLIMT_THREAD_MAX;
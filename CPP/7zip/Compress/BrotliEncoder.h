@@ -36,6 +36,7 @@ class CEncoder:
   public ICompressSetCoderMt,
   public ICompressSetCoderProperties,
   public ICompressWriteCoderProperties,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CProps _props;
@@ -44,18 +45,22 @@ class CEncoder:
   UInt64 _processedOut;
   UInt32 _inputSize;
   UInt32 _numThreads;
+  bool _stdStream;
 
   BROTLIMT_CCtx *_ctx;
+  UInt64 _ctxKey;
 
 public:
   MY_QUERYINTERFACE_BEGIN2(ICompressCoder)
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderProperties)
   MY_QUERYINTERFACE_ENTRY(ICompressWriteCoderProperties)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
   MY_ADDREF_RELEASE
 
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
   STDMETHOD (WriteCoderProperties)(ISequentialOutStream *outStream);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
@@ -0,0 +1,175 @@
+// Compress/CoderCtxCache.h
+
+#ifndef __COMPRESS_CODER_CTX_CACHE_H
+#define __COMPRESS_CODER_CTX_CACHE_H
+
+#include "../../Common/MyTypes.h"
+#include "../../Common/MyVector.h"
+
+#ifndef _7ZIP_ST
+#include "../../Windows/Synchronization.h"
+#endif
+
+namespace NCompress {
+
+/*
+CCtxCache keeps the contexts of released coder objects.
+Archive handlers and the zip / hash code create a new coder object for
+each item, so without the cache each item allocates and clears all tables
+of the codec library again.
+Each codec defines one static cache in its .cpp file.
+  Key : the parameters that can't be changed in allocated context
+        (for example, the number of threads).
+        The coder must reset all other parameters after Get().
+  Size : the memory that is held by the context (it can be estimated).
+        The cached contexts are limited by kCtxCacheSizeMax bytes,
+        the oldest contexts are freed first.
+
+The contexts can hold threads (FL2 / zstd / lz4 / brotli thread pools),
+so they must not be freed from static destructors at module unload:
+  the module (7z.dll / 7z.so / codec dll) calls FreeAllCtxCaches()
+  from FreeCtxCaches() export, and the host calls that export
+  before it unloads the module.
+  The executable that contains the codecs calls FreeAllCtxCaches()
+  when CCodecs object is destroyed.
+*/
+
+const size_t kCtxCacheSizeMax = (size_t)sizeof(size_t) << 25;
+
+class CCtxCacheBase;
+
+// the list of all caches of the module.
+// the static member of template is defined in header, so we don't need .cpp file
+template <int dummy> struct CCtxCacheList { static CCtxCacheBase *Head; };
+template <int dummy> CCtxCacheBase *CCtxCacheList<dummy>::Head = NULL;
+
+class CCtxCacheBase
+{
+  CCtxCacheBase *_next;
+
+  CLASS_NO_COPY(CCtxCacheBase)
+protected:
+  // the caches are static objects, so they are created in single thread
+  CCtxCacheBase(): _next(CCtxCacheList<0>::Head) { CCtxCacheList<0>::Head = this; }
+  virtual ~CCtxCacheBase()
+  {
+    for (CCtxCacheBase **p = &CCtxCacheList<0>::Head; *p; p = &(*p)->_next)
+      if (*p == this)
+      {
+        *p = _next;
+        break;
+      }
+  }
+public:
+  CCtxCacheBase *Next() const { return _next; }
+  virtual void FreeAll() = 0;
+};
+
+inline void FreeAllCtxCaches()
+{
+  for (CCtxCacheBase *p = CCtxCacheList<0>::Head; p; p = p->Next())
+    p->FreeAll();
+}
+
+template <class T>
+class CCtxCache: public CCtxCacheBase
+{
+public:
+  typedef void (*CFreeFunc)(T *ctx);
+
+private:
+  struct CItem
+  {
+    UInt64 Key;
+    T *Ctx;
+    size_t Size;
+  };
+
+  CRecordVector<CItem> _items;
+  CFreeFunc _free;
+  unsigned _numMax;
+  size_t _size;
+  #ifndef _7ZIP_ST
+  NWindows::NSynchronization::CCriticalSection _cs;
+  #endif
+
+  CLASS_NO_COPY(CCtxCache)
+public:
+  CCtxCache(CFreeFunc freeFunc, unsigned numMax): _free(freeFunc), _numMax(numMax), _size(0) {}
+
+  // the cache is empty here, if FreeAll() was called before unload
+  ~CCtxCache() { FreeAll(); }
+
+  void FreeAll()
+  {
+    CRecordVector<T *> freed;
+    {
+      #ifndef _7ZIP_ST
+      NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+      #endif
+      FOR_VECTOR (i, _items)
+        freed.Add(_items[i].Ctx);
+      _items.Clear();
+      _size = 0;
+    }
+    FOR_VECTOR (i, freed)
+      _free(freed[i]);
+  }
+
+  // returns NULL, if there is no context with such key
+  T *Get(UInt64 key)
+  {
+    #ifndef _7ZIP_ST
+    NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+    #endif
+    for (unsigned i = _items.Size(); i != 0;)
+    {
+      i--;
+      if (_items[i].Key == key)
+      {
+        T *ctx = _items[i].Ctx;
+        _size -= _items[i].Size;
+        _items.Delete(i);
+        return ctx;
+      }
+    }
+    return NULL;
+  }
+
+  // the oldest contexts are freed, if the cache is full
+  void Put(UInt64 key, T *ctx, size_t size)
+  {
+    if (!ctx)
+      return;
+    if (_numMax == 0 || size > kCtxCacheSizeMax)
+    {
+      _free(ctx);
+      return;
+    }
+    CRecordVector<T *> freed;
+    {
+      #ifndef _7ZIP_ST
+      NWindows::NSynchronization::CCriticalSectionLock lock(_cs);
+      #endif
+      while (!_items.IsEmpty()
+          && (_items.Size() >= _numMax || kCtxCacheSizeMax - _size < size))
+      {
+        freed.Add(_items[0].Ctx);
+        _size -= _items[0].Size;
+        _items.Delete(0);
+      }
+      CItem item;
+      item.Key = key;
+      item.Ctx = ctx;
+      item.Size = size;
+      _items.Add(item);
+      _size += size;
+    }
+    FOR_VECTOR (i, freed)
+      _free(freed[i]);
+  }
+};
+
+}
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "StdAfx.h"
 
+#include "../Common/StreamObjects.h"
+
 #include "DeflateDecoder.h"
 
 namespace NCompress {
@@ -16,6 +18,12 @@ CCoder::CCoder(bool deflate64Mode):
     _needInitInStream(true),
     _outSizeDefined(false),
     _outStartPos(0),
+    _apCallback(NULL),
+    _apSpan(0),
+    _apLastPos(0),
+    _apWindow(NULL),
+    _apWindowSize(0),
+    _apBitOffset(0),
     ZlibMode(false) {}
 
 UInt32 CCoder::ReadBits(unsigned numBits)
@@ -164,6 +172,22 @@ HRESULT CCoder::InitInStream(bool needInit)
 }
 
 
+HRESULT CCoder::AddAccessPoint()
+{
+  const UInt64 outPos = GetOutProcessedCur();
+  if (outPos == 0 || outPos - _apLastPos < _apSpan)
+    return S_OK;
+  _apLastPos = outPos;
+  const UInt32 histSize = _deflate64Mode ? kHistorySize64: kHistorySize32;
+  UInt32 size = histSize;
+  if (size > outPos)
+    size = (UInt32)outPos;
+  _apBuf.AllocAtLeast(histSize);
+  m_OutWindowStream.GetHistory(_apBuf, size);
+  return _apCallback->AddAccessPoint(m_InBitStream.GetProcessedBits(), outPos, _apBuf, size);
+}
+
+
 HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream, UInt32 inputProgressLimit)
 {
   if (_remainLen == kLenIdFinished)
@@ -176,6 +200,14 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream, UInt32 inputPro
         return E_OUTOFMEMORY;
     RINOK(InitInStream(_needInitInStream));
     m_OutWindowStream.Init(_keepHistory);
+    _apLastPos = 0;
+
+    if (_apWindow)
+    {
+      m_OutWindowStream.SetDictionary(_apWindow, _apWindowSize);
+      ReadBits(_apBitOffset);
+      _apWindow = NULL;
+    }
   
     m_FinalBlock = false;
     _remainLen = 0;
@@ -210,6 +242,11 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream, UInt32 inputPro
       if (inputProgressLimit != 0)
         if (m_InBitStream.GetProcessedSize() - inputStart >= inputProgressLimit)
           return S_OK;
+
+      if (_apCallback && _remainLen == 0)
+      {
+        RINOK(AddAccessPoint());
+      }
       
       if (!ReadTables())
         return S_FALSE;
@@ -408,6 +445,32 @@ HRESULT CCoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStr
 }
 
 
+/*
+  The stream must be finished in (src).
+  The output is copied from the history window directly to (dest).
+*/
+
+STDMETHODIMP CCoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  CBufInStream *inStreamSpec = new CBufInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(src, srcSize);
+
+  const UInt64 outSize = *destSize;
+  SetInStream(inStream);
+  SetOutStreamSize(&outSize);
+  m_OutWindowStream.SetMemStream(dest);
+  HRESULT res = CodeReal(NULL, NULL);
+  m_OutWindowStream.SetMemStream(NULL);
+  ReleaseInStream();
+
+  *destSize = (size_t)GetOutProcessedCur();
+  if (res == S_OK && !IsFinished())
+    res = S_FALSE;
+  return res;
+}
+
+
 STDMETHODIMP CCoder::SetFinishMode(UInt32 finishMode)
 {
   Set_NeedFinishInput(finishMode != 0);
@@ -3,6 +3,7 @@
 #ifndef __DEFLATE_DECODER_H
 #define __DEFLATE_DECODER_H
 
+#include "../../Common/MyBuffer.h"
 #include "../../Common/MyCom.h"
 
 #include "../ICoder.h"
@@ -21,11 +22,27 @@ namespace NDecoder {
 const int kLenIdFinished = -1;
 const int kLenIdNeedInit = -2;
 
+/*
+Access point is the start of block with the window that precedes it.
+The decoder can resume from access point without decoding of previous data.
+If callback is set, the decoder calls AddAccessPoint() before the header of
+block, if at least (span) bytes were decoded after the previous access point.
+  inBitPos : the position of block header in input stream (in bits)
+  outPos   : the number of bytes decoded after SetOutStreamSize() / CodeResume()
+  window   : the last (windowSize) decoded bytes
+*/
+
+struct IAccessPointCallback
+{
+  virtual HRESULT AddAccessPoint(UInt64 inBitPos, UInt64 outPos, const Byte *window, UInt32 windowSize) = 0;
+};
+
 class CCoder:
   public ICompressCoder,
   public ICompressSetFinishMode,
   public ICompressGetInStreamProcessedSize,
   public ICompressReadUnusedFromInBuf,
+  public ICompressCodeBuf,
   #ifndef NO_READ_FROM_CODER
   public ICompressSetInStream,
   public ICompressSetOutStreamSize,
@@ -60,6 +77,17 @@ class CCoder:
   UInt64 _outSize;
   UInt64 _outStartPos;
 
+  IAccessPointCallback *_apCallback;
+  UInt32 _apSpan;
+  UInt64 _apLastPos;
+  CByteBuffer _apBuf;
+
+  const Byte *_apWindow;
+  UInt32 _apWindowSize;
+  unsigned _apBitOffset;
+
+  HRESULT AddAccessPoint();
+
   void SetOutStreamSizeResume(const UInt64 *outSize);
   UInt64 GetOutProcessedCur() const { return m_OutWindowStream.GetProcessedSize() - _outStartPos; }
 
@@ -96,6 +124,22 @@ public:
   void Set_KeepHistory(bool keepHistory) { _keepHistory = keepHistory; }
   void Set_NeedFinishInput(bool needFinishInput) { _needFinishInput = needFinishInput; }
 
+  void SetAccessPointCallback(IAccessPointCallback *callback, UInt32 span)
+  {
+    _apCallback = callback;
+    _apSpan = span;
+  }
+  
+  /* the next decoding after SetOutStreamSize() starts from access point:
+     (bitOffset) is the position of block header in first byte of input stream.
+     (window) data must be available until the decoding is started. */
+  void SetAccessPoint(unsigned bitOffset, const Byte *window, UInt32 windowSize)
+  {
+    _apBitOffset = bitOffset;
+    _apWindow = window;
+    _apWindowSize = windowSize;
+  }
+
   bool IsFinished() const { return _remainLen == kLenIdFinished;; }
   bool IsFinalBlock() const { return m_FinalBlock; }
 
@@ -105,6 +149,7 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetFinishMode)
   MY_QUERYINTERFACE_ENTRY(ICompressGetInStreamProcessedSize)
   MY_QUERYINTERFACE_ENTRY(ICompressReadUnusedFromInBuf)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
 
   #ifndef NO_READ_FROM_CODER
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
@@ -122,6 +167,7 @@ public:
   STDMETHOD(SetFinishMode)(UInt32 finishMode);
   STDMETHOD(GetInStreamProcessedSize)(UInt64 *value);
   STDMETHOD(ReadUnusedFromInBuf)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
 
   STDMETHOD(SetInStream)(ISequentialInStream *inStream);
   STDMETHOD(ReleaseInStream)();
@@ -149,6 +195,7 @@ public:
 
   // size of virtual input stream processed
   UInt64 GetInputProcessedSize() const { return m_InBitStream.GetProcessedSize(); }
+  UInt64 GetInputProcessedBits() const { return m_InBitStream.GetProcessedBits(); }
 };
 
 class CCOMCoder     : public CCoder { public: CCOMCoder(): CCoder(false) {} };
@@ -8,6 +8,7 @@
 #include "../../Common/ComTry.h"
 
 #include "../Common/CWrappers.h"
+#include "../Common/StreamUtils.h"
 
 #include "DeflateEncoder.h"
 
@@ -36,6 +37,14 @@ static const UInt32 kMatchArrayLimit = kMatchArraySize - kMatchMaxLen * 4 * size
 static const UInt32 kBlockUncompressedSizeThreshold = kMaxUncompressedBlockSize -
     kMatchMaxLen - kNumOpts;
 
+#ifndef _7ZIP_ST
+static const UInt32 kMtNumThreadsMax = 64;
+static const unsigned kMtNumChunksPerThread = 2;
+// [kHistorySize64, (1 << 31)); bigger chunks give better compression ratio and need more memory.
+static const UInt32 kMtChunkSize = (1 << 18);
+static const UInt32 kMtPrimeSize = (1 << 14);
+#endif
+
 // static const unsigned kMaxCodeBitLength = 11;
 static const unsigned kMaxLevelBitLength = 7;
 
@@ -152,6 +161,9 @@ CCoder::CCoder(bool deflate64Mode):
     CEncProps props;
     SetProps(&props);
   }
+  #ifndef _7ZIP_ST
+  _numThreads = 1;
+  #endif
   MatchFinder_Construct(&_lzInWindow);
 }
 
@@ -213,6 +225,9 @@ HRESULT CCoder::Create()
 HRESULT CCoder::BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
 {
   CEncProps props;
+  #ifndef _7ZIP_ST
+  UInt32 numThreads = 1;
+  #endif
   for (UInt32 i = 0; i < numProps; i++)
   {
     const PROPVARIANT &prop = coderProps[i];
@@ -229,11 +244,23 @@ HRESULT CCoder::BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIA
       case NCoderPropID::kMatchFinderCycles: props.mc = v; break;
       case NCoderPropID::kAlgorithm: props.algo = (int)v; break;
       case NCoderPropID::kLevel: props.Level = (int)v; break;
-      case NCoderPropID::kNumThreads: break;
+      case NCoderPropID::kNumThreads:
+        #ifndef _7ZIP_ST
+        numThreads = v;
+        #endif
+        break;
       default: return E_INVALIDARG;
     }
   }
   SetProps(&props);
+  #ifndef _7ZIP_ST
+  if (numThreads < 1) numThreads = 1;
+  if (numThreads > kMtNumThreadsMax) numThreads = kMtNumThreadsMax;
+  _numThreads = numThreads;
+  _mtProps = props;
+  // the match finders of the workers were created with old properties
+  _mtWorkers.Clear();
+  #endif
   return S_OK;
 }
   
@@ -939,8 +966,7 @@ void CCoder::CodeBlock(unsigned tableIndex, bool finalBlock)
 }
 
 
-HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
-    const UInt64 * /* inSize */ , const UInt64 * /* outSize */ , ICompressProgressInfo *progress)
+HRESULT CCoder::Prepare()
 {
   m_CheckStatic = (m_NumPasses != 1 || m_NumDivPasses != 1);
   m_IsMultiPass = (m_CheckStatic || (m_NumPasses != 1 || m_NumDivPasses != 1));
@@ -948,24 +974,17 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
   RINOK(Create());
 
   m_ValueBlockSize = (7 << 10) + (1 << 12) * m_NumDivPasses;
+  return S_OK;
+}
 
+HRESULT CCoder::CodeBlocks(bool finalStream, ICompressProgressInfo *progress)
+{
   UInt64 nowPos = 0;
 
-  CSeqInStreamWrap _seqInStream;
-  
-  _seqInStream.Init(inStream);
-
-  _lzInWindow.stream = &_seqInStream.vt;
-
-  MatchFinder_Init(&_lzInWindow);
-  m_OutStream.SetStream(outStream);
-  m_OutStream.Init();
-
   m_OptimumEndIndex = m_OptimumCurrentIndex = 0;
 
   CTables &t = m_Tables[1];
   t.m_Pos = 0;
-  t.InitStructures();
 
   m_AdditionalOffset = 0;
   do
@@ -973,7 +992,7 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
     t.BlockSizeRes = kBlockUncompressedSizeThreshold;
     m_SecondPass = false;
     GetBlockPrice(1, m_NumDivPasses);
-    CodeBlock(1, Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0);
+    CodeBlock(1, finalStream && Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0);
     nowPos += m_Tables[1].BlockSizeRes;
     if (progress != NULL)
     {
@@ -982,6 +1001,32 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
     }
   }
   while (Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) != 0);
+  return S_OK;
+}
+
+
+HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */ , const UInt64 * /* outSize */ , ICompressProgressInfo *progress)
+{
+  RINOK(Prepare());
+
+  #ifndef _7ZIP_ST
+  if (_numThreads > 1)
+    return CodeMt(inStream, outStream, progress);
+  #endif
+
+  CSeqInStreamWrap _seqInStream;
+  
+  _seqInStream.Init(inStream);
+
+  _lzInWindow.stream = &_seqInStream.vt;
+
+  MatchFinder_Init(&_lzInWindow);
+  m_OutStream.SetStream(outStream);
+  m_OutStream.Init();
+
+  m_Tables[1].InitStructures();
+  RINOK(CodeBlocks(true, progress));
   
   if (_seqInStream.Res != S_OK)
     return _seqInStream.Res;
@@ -999,10 +1044,341 @@ HRESULT CCoder::BaseCode(ISequentialInStream *inStream, ISequentialOutStream *ou
   catch(...) { return E_FAIL; }
 }
 
+struct CMemInStream
+{
+  ISeqInStream vt;
+  const Byte *Data;
+  size_t Rem;
+};
+
+static SRes MemInStream_Read(const ISeqInStream *pp, void *data, size_t *size)
+{
+  CMemInStream *p = CONTAINER_FROM_VTBL(pp, CMemInStream, vt);
+  size_t cur = *size;
+  if (cur > p->Rem)
+    cur = p->Rem;
+  memcpy(data, p->Data, cur);
+  p->Data += cur;
+  p->Rem -= cur;
+  *size = cur;
+  return SZ_OK;
+}
+
+HRESULT CCoder::CodeBufReal(const Byte *src, size_t srcSize, ISequentialOutStream *outStream)
+{
+  #ifndef _7ZIP_ST
+  // several chunks are compressed in parallel by CodeMt() only
+  if (_numThreads > 1 && srcSize > kMtChunkSize)
+    return E_NOTIMPL;
+  #endif
+
+  RINOK(Prepare());
+
+  CMemInStream inStream;
+  inStream.vt.Read = MemInStream_Read;
+  inStream.Data = src;
+  inStream.Rem = srcSize;
+  _lzInWindow.stream = &inStream.vt;
+
+  MatchFinder_Init(&_lzInWindow);
+  m_OutStream.SetStream(outStream);
+  m_OutStream.Init();
+
+  m_Tables[1].InitStructures();
+  RINOK(CodeBlocks(true, NULL));
+
+  if (_lzInWindow.result != SZ_OK)
+    return SResToHRESULT(_lzInWindow.result);
+  return m_OutStream.Flush();
+}
+
+HRESULT CCoder::BaseCodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  CBufPtrSeqOutStream *outStreamSpec = new CBufPtrSeqOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  outStreamSpec->Init(dest, *destSize);
+  HRESULT res;
+  try { res = CodeBufReal(src, srcSize, outStream); }
+  catch(const COutBufferException &e) { res = e.ErrorCode; }
+  catch(...) { res = E_FAIL; }
+  // CBufPtrSeqOutStream::Write() returns E_FAIL, if (dest) is full
+  if (res == E_FAIL && outStreamSpec->GetPos() == *destSize)
+    res = S_FALSE;
+  *destSize = outStreamSpec->GetPos();
+  return res;
+}
+
+#ifndef _7ZIP_ST
+
+CMtChunk::CMtChunk():
+    Buf(NULL),
+    DictSize(0),
+    Size(0),
+    Final(false),
+    Res(S_OK)
+{
+  OutSpec = new CDynBufSeqOutStream;
+  Out = OutSpec;
+}
+
+CMtChunk::~CMtChunk()
+{
+  ::MidFree(Buf);
+}
+
+CMtWorker::~CMtWorker()
+{
+  delete Coder;
+}
+
+void CCoder::MtSkip(UInt32 num)
+{
+  if (num == 0)
+    return;
+  if (_btMode)
+    Bt3Zip_MatchFinder_Skip(&_lzInWindow, num);
+  else
+    Hc3Zip_MatchFinder_Skip(&_lzInWindow, num);
+}
+
+HRESULT CCoder::CodeChunk(CMtChunk &c)
+{
+  RINOK(Prepare());
+
+  CMemInStream inStream;
+  inStream.vt.Read = MemInStream_Read;
+  inStream.Data = c.Buf;
+  inStream.Rem = (size_t)c.DictSize + c.Size;
+  _lzInWindow.stream = &inStream.vt;
+
+  CTables &t = m_Tables[1];
+  t.InitStructures();
+
+  if (c.DictSize != 0 && !_fastMode)
+  {
+    /* The default prices make the matches to previous chunk too cheap.
+       So we get the prices for first block from the end of previous chunk. */
+    const UInt32 primeSize = MyMin(c.DictSize, kMtPrimeSize);
+    MatchFinder_Init(&_lzInWindow);
+    MtSkip(c.DictSize - primeSize);
+    m_OptimumEndIndex = m_OptimumCurrentIndex = 0;
+    m_AdditionalOffset = 0;
+    m_SecondPass = false;
+    t.m_Pos = 0;
+    t.BlockSizeRes = primeSize;
+    TryDynBlock(1, m_NumPasses);
+    inStream.Data = c.Buf;
+    inStream.Rem = (size_t)c.DictSize + c.Size;
+  }
+
+  MatchFinder_Init(&_lzInWindow);
+  // the end of previous chunk is inserted to match finder, but it's not encoded
+  MtSkip(c.DictSize);
+
+  c.OutSpec->Init();
+  m_OutStream.SetStream(c.Out);
+  m_OutStream.Init();
+
+  RINOK(CodeBlocks(c.Final, NULL));
+
+  if (!c.Final)
+  {
+    // empty stored block (sync flush): the next chunk starts from byte boundary
+    WriteBits(NFinalBlockField::kNotFinalBlock, kFinalBlockFieldSize);
+    WriteBits(NBlockType::kStored, kBlockTypeFieldSize);
+    m_OutStream.FlushByte();
+    WriteBits(0, kStoredBlockLengthFieldSize);
+    WriteBits(0xFFFF, kStoredBlockLengthFieldSize);
+  }
+
+  if (_lzInWindow.result != SZ_OK)
+    return SResToHRESULT(_lzInWindow.result);
+  return m_OutStream.Flush();
+}
+
+HRESULT CCoder::BaseCodeChunk(CMtChunk &c)
+{
+  try { return CodeChunk(c); }
+  catch(const COutBufferException &e) { return e.ErrorCode; }
+  catch(...) { return E_FAIL; }
+}
+
+void CCoder::WorkerThread(CMtWorker &w)
+{
+  const unsigned numChunks = _mtChunks.Size();
+  for (;;)
+  {
+    _mtWorkSem.Lock();
+    if (_mtExit)
+      return;
+    unsigned index;
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_mtCs);
+      index = (unsigned)(_mtNextChunk++ % numChunks);
+    }
+    CMtChunk &c = _mtChunks[index];
+    c.Res = w.Coder->BaseCodeChunk(c);
+    c.Done.Set();
+  }
+}
+
+static THREAD_FUNC_DECL MtWorkerThread(void *p)
+{
+  CMtWorker *w = (CMtWorker *)p;
+  w->Parent->WorkerThread(*w);
+  return 0;
+}
+
+HRESULT CCoder::WriteChunk(CMtChunk &c, ISequentialOutStream *outStream,
+    UInt64 &inSize, UInt64 &outSize, ICompressProgressInfo *progress)
+{
+  RINOK(c.Res);
+  const size_t size = c.OutSpec->GetSize();
+  RINOK(WriteStream(outStream, c.OutSpec->GetBuffer(), size));
+  inSize += c.Size;
+  outSize += size;
+  if (progress)
+    return progress->SetRatioInfo(&inSize, &outSize);
+  return S_OK;
+}
+
+HRESULT CCoder::CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  const UInt32 dictSizeMax = m_Deflate64Mode ? kHistorySize64 : kHistorySize32;
+  const unsigned numThreads = _numThreads;
+  const unsigned numChunks = numThreads * kMtNumChunksPerThread;
+
+  if (_mtChunks.Size() != numChunks)
+  {
+    _mtChunks.Clear();
+    for (unsigned i = 0; i < numChunks; i++)
+      _mtChunks.AddNew();
+  }
+  for (unsigned i = 0; i < numChunks; i++)
+  {
+    CMtChunk &c = _mtChunks[i];
+    if (!c.Buf)
+    {
+      c.Buf = (Byte *)::MidAlloc(dictSizeMax + kMtChunkSize);
+      if (!c.Buf)
+        return E_OUTOFMEMORY;
+    }
+    WRes wres = c.Done.CreateIfNotCreated_Reset();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+
+  UInt64 inSize = 0;
+  UInt64 outSize = 0;
+
+  {
+    // small stream is compressed in this thread
+    CMtChunk &c = _mtChunks[0];
+    size_t size = kMtChunkSize;
+    RINOK(ReadStream(inStream, c.Buf, &size));
+    c.DictSize = 0;
+    c.Size = (UInt32)size;
+    c.Final = (size != kMtChunkSize);
+    if (c.Final)
+    {
+      c.Res = CodeChunk(c);
+      return WriteChunk(c, outStream, inSize, outSize, progress);
+    }
+  }
+
+  while (_mtWorkers.Size() < numThreads)
+  {
+    CMtWorker &w = _mtWorkers.AddNew();
+    w.Parent = this;
+    w.Coder = new CCoder(m_Deflate64Mode);
+    w.Coder->SetProps(&_mtProps);
+  }
+
+  {
+    WRes wres = _mtWorkSem.OptCreateInit(0, numChunks + numThreads);
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  
+  _mtNextChunk = 0;
+  _mtExit = false;
+
+  HRESULT res = S_OK;
+  unsigned numCreated;
+  for (numCreated = 0; numCreated < numThreads; numCreated++)
+  {
+    WRes wres = _mtWorkers[numCreated].Thread.Create(MtWorkerThread, &_mtWorkers[numCreated]);
+    if (wres != 0)
+    {
+      res = HRESULT_FROM_WIN32(wres);
+      break;
+    }
+  }
+
+  UInt64 numRead = 0;
+  UInt64 numWritten = 0;
+
+  if (numCreated != 0)
+  {
+    // the first chunk was read already
+    numRead = 1;
+    _mtWorkSem.Release();
+  }
+
+  while (res == S_OK && numRead != 0 && !_mtChunks[(unsigned)((numRead - 1) % numChunks)].Final)
+  {
+    if (numRead - numWritten == numChunks)
+    {
+      CMtChunk &c = _mtChunks[(unsigned)(numWritten++ % numChunks)];
+      c.Done.Lock();
+      res = WriteChunk(c, outStream, inSize, outSize, progress);
+      if (res != S_OK)
+        break;
+    }
+
+    const CMtChunk &prev = _mtChunks[(unsigned)((numRead - 1) % numChunks)];
+    CMtChunk &c = _mtChunks[(unsigned)(numRead % numChunks)];
+    {
+      const UInt32 prevSize = prev.DictSize + prev.Size;
+      c.DictSize = MyMin(prevSize, dictSizeMax);
+      memcpy(c.Buf, prev.Buf + prevSize - c.DictSize, c.DictSize);
+    }
+    size_t size = kMtChunkSize;
+    res = ReadStream(inStream, c.Buf + c.DictSize, &size);
+    if (res != S_OK)
+      break;
+    c.Size = (UInt32)size;
+    c.Final = (size != kMtChunkSize);
+    numRead++;
+    _mtWorkSem.Release();
+  }
+
+  while (numWritten < numRead)
+  {
+    CMtChunk &c = _mtChunks[(unsigned)(numWritten++ % numChunks)];
+    c.Done.Lock();
+    if (res == S_OK)
+      res = WriteChunk(c, outStream, inSize, outSize, progress);
+  }
+
+  _mtExit = true;
+  if (numCreated != 0)
+    _mtWorkSem.Release(numCreated);
+  for (unsigned i = 0; i < numCreated; i++)
+    _mtWorkers[i].Thread.Wait_Close();
+
+  return res;
+}
+
+#endif
+
 STDMETHODIMP CCOMCoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
     const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress)
   { return BaseCode(inStream, outStream, inSize, outSize, progress); }
 
+STDMETHODIMP CCOMCoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+  { return BaseCodeBuf(src, srcSize, dest, destSize); }
+
 STDMETHODIMP CCOMCoder::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps)
   { return BaseSetEncoderProperties2(propIDs, props, numProps); }
 
@@ -1010,6 +1386,9 @@ STDMETHODIMP CCOMCoder64::Code(ISequentialInStream *inStream, ISequentialOutStre
     const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress)
   { return BaseCode(inStream, outStream, inSize, outSize, progress); }
 
+STDMETHODIMP CCOMCoder64::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+  { return BaseCodeBuf(src, srcSize, dest, destSize); }
+
 STDMETHODIMP CCOMCoder64::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps)
   { return BaseSetEncoderProperties2(propIDs, props, numProps); }
 
@@ -7,8 +7,16 @@
 
 #include "../../Common/MyCom.h"
 
+#ifndef _7ZIP_ST
+#include "../../Common/MyVector.h"
+#include "../../Windows/Synchronization.h"
+#include "../../Windows/Thread.h"
+#endif
+
 #include "../ICoder.h"
 
+#include "../Common/StreamObjects.h"
+
 #include "BitlEncoder.h"
 #include "DeflateConst.h"
 
@@ -66,6 +74,42 @@ struct CEncProps
   void Normalize();
 };
 
+#ifndef _7ZIP_ST
+
+/*
+In multithreaded mode the input is split to chunks that are compressed
+independently. Each chunk is primed with the end of the previous chunk,
+and each chunk (except the last) ends with an empty stored block,
+so the chunk streams can be concatenated to one deflate stream.
+*/
+
+struct CMtChunk
+{
+  Byte *Buf; // (DictSize) bytes from the previous chunk, then (Size) bytes of the chunk
+  UInt32 DictSize;
+  UInt32 Size;
+  bool Final;
+  HRESULT Res;
+  CDynBufSeqOutStream *OutSpec;
+  CMyComPtr<ISequentialOutStream> Out;
+  NWindows::NSynchronization::CAutoResetEvent Done;
+
+  CMtChunk();
+  ~CMtChunk();
+};
+
+struct CMtWorker
+{
+  CCoder *Parent;
+  CCoder *Coder;
+  NWindows::CThread Thread;
+
+  CMtWorker(): Parent(NULL), Coder(NULL) {}
+  ~CMtWorker();
+};
+
+#endif
+
 class CCoder
 {
   CMatchFinder _lzInWindow;
@@ -162,6 +206,29 @@ public:
   void CodeBlock(unsigned tableIndex, bool finalBlock);
 
   void SetProps(const CEncProps *props2);
+
+  HRESULT Prepare();
+  HRESULT CodeBlocks(bool finalStream, ICompressProgressInfo *progress);
+
+  #ifndef _7ZIP_ST
+  UInt32 _numThreads;
+  CEncProps _mtProps;
+  CObjectVector<CMtWorker> _mtWorkers;
+  CObjectVector<CMtChunk> _mtChunks;
+  NWindows::NSynchronization::CSemaphore _mtWorkSem;
+  NWindows::NSynchronization::CCriticalSection _mtCs;
+  UInt64 _mtNextChunk;
+  bool _mtExit;
+
+  void MtSkip(UInt32 num);
+  HRESULT CodeChunk(CMtChunk &c);
+  HRESULT WriteChunk(CMtChunk &c, ISequentialOutStream *outStream,
+      UInt64 &inSize, UInt64 &outSize, ICompressProgressInfo *progress);
+  HRESULT CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+public:
+  HRESULT BaseCodeChunk(CMtChunk &c);
+  void WorkerThread(CMtWorker &w);
+  #endif
 public:
   CCoder(bool deflate64Mode = false);
   ~CCoder();
@@ -172,6 +239,9 @@ public:
   HRESULT BaseCode(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
 
+  HRESULT CodeBufReal(const Byte *src, size_t srcSize, ISequentialOutStream *outStream);
+  HRESULT BaseCodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
+
   HRESULT BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
@@ -179,28 +249,32 @@ public:
 class CCOMCoder :
   public ICompressCoder,
   public ICompressSetCoderProperties,
+  public ICompressCodeBuf,
   public CMyUnknownImp,
   public CCoder
 {
 public:
-  MY_UNKNOWN_IMP2(ICompressCoder, ICompressSetCoderProperties)
+  MY_UNKNOWN_IMP3(ICompressCoder, ICompressSetCoderProperties, ICompressCodeBuf)
   CCOMCoder(): CCoder(false) {};
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
 class CCOMCoder64 :
   public ICompressCoder,
   public ICompressSetCoderProperties,
+  public ICompressCodeBuf,
   public CMyUnknownImp,
   public CCoder
 {
 public:
-  MY_UNKNOWN_IMP2(ICompressCoder, ICompressSetCoderProperties)
+  MY_UNKNOWN_IMP3(ICompressCoder, ICompressSetCoderProperties, ICompressCodeBuf)
   CCOMCoder64(): CCoder(true) {};
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
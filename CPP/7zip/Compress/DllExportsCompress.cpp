@@ -8,6 +8,8 @@
 
 #include "../Common/RegisterCodec.h"
 
+#include "CoderCtxCache.h"
+
 static const unsigned kNumCodecsMax = 48;
 unsigned g_NumCodecs = 0;
 const CCodecInfo *g_Codecs[kNumCodecsMax];
@@ -57,3 +59,11 @@ STDAPI CreateObject(const GUID *clsid, const GUID *iid, void **outObject)
 {
   return CreateCoder(clsid, iid, outObject);
 }
+
+// the host calls it before it unloads the module
+STDAPI FreeCtxCaches();
+STDAPI FreeCtxCaches()
+{
+  NCompress::FreeAllCtxCaches();
+  return S_OK;
+}
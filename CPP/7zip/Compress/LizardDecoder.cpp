@@ -1,6 +1,9 @@
 // (C) 2017 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
 #include "LizardDecoder.h"
 
 int LizardRead(void *arg, LIZARDMT_Buffer * in)
@@ -165,6 +168,78 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream * inStream, ISequentialOutStream
   return CodeSpec(inStream, outStream, progress);
 }
 
+/*
+  LIZARDMT_decompressDCtx() formats:
+    - Lizard frames without sizes, decoded one after another
+    - each frame is preceded by a skippable frame with its size,
+      the frames are decoded in parallel by Code()
+*/
+STDMETHODIMP CDecoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  const size_t destLim = *destSize;
+  *destSize = 0;
+  if (srcSize < 4)
+    return S_FALSE;
+
+  const bool sizes = (GetUi32(src) == LIZARDFMT_MAGIC_SKIPPABLE);
+  if (!sizes && GetUi32(src) != LIZARDFMT_MAGICNUMBER)
+    return S_FALSE;
+  if (sizes && _numThreads > 1 && srcSize >= 12 && srcSize - 12 > GetUi32(src + 8))
+    return E_NOTIMPL;
+
+  LizardF_decompressionContext_t dctx;
+  if (LizardF_isError(LizardF_createDecompressionContext(&dctx, LIZARDF_VERSION)))
+    return E_OUTOFMEMORY;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  HRESULT res = S_OK;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+
+  while (srcPos != srcSize)
+  {
+    size_t frameSize = srcSize - srcPos;
+    if (sizes) {
+      if (frameSize < 12
+          || GetUi32(src + srcPos) != LIZARDFMT_MAGIC_SKIPPABLE
+          || GetUi32(src + srcPos + 4) != 4
+          || GetUi32(src + srcPos + 8) > frameSize - 12) {
+        res = S_FALSE;
+        break;
+      }
+      frameSize = GetUi32(src + srcPos + 8);
+      srcPos += 12;
+    }
+
+    size_t result = 1;
+    while (frameSize != 0)
+    {
+      size_t inSize = frameSize;
+      size_t outSize = destLim - destPos;
+      result = LizardF_decompress(dctx, dest + destPos, &outSize, src + srcPos, &inSize, NULL);
+      if (LizardF_isError(result) || (inSize == 0 && outSize == 0))
+        break;
+      srcPos += inSize;
+      frameSize -= inSize;
+      destPos += outSize;
+    }
+
+    /* the frame must end with the input */
+    if (result != 0 || frameSize != 0) {
+      res = S_FALSE;
+      break;
+    }
+  }
+
+  LizardF_freeDecompressionContext(dctx);
+  _processedIn = srcPos;
+  _processedOut = destPos;
+  *destSize = destPos;
+  return res;
+}
+
 #ifndef NO_READ_FROM_CODER
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream * inStream)
 {
@@ -1,6 +1,9 @@
 // (C) 2017 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
 #include "LizardEncoder.h"
 #include "LizardDecoder.h"
 
@@ -8,6 +11,9 @@
 namespace NCompress {
 namespace NLIZARD {
 
+/* frame size of LIZARDMT_createCCtx(), if (inputsize == 0) */
+static const UInt32 kInputSizeDefault = (UInt32)1 << 22;
+
 CEncoder::CEncoder():
   _processedIn(0),
   _processedOut(0),
@@ -115,6 +121,57 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
   return res;
 }
 
+/*
+  same frames as LIZARDMT_compressCCtx(): one frame per (_inputSize) bytes,
+  each one with the skippable size header.
+  Several frames are compressed in parallel by Code() only.
+*/
+STDMETHODIMP CEncoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  const size_t frameSize = _inputSize ? _inputSize : kInputSizeDefault;
+  if (_numThreads > 1 && srcSize > frameSize)
+    return E_NOTIMPL;
+
+  LizardF_preferences_t prefs;
+  memset(&prefs, 0, sizeof(prefs));
+  prefs.compressionLevel = _props._level;
+  prefs.frameInfo.blockMode = LizardF_blockLinked;
+  prefs.frameInfo.contentSize = 1;
+  prefs.frameInfo.contentChecksumFlag = LizardF_contentChecksumEnabled;
+
+  const size_t headerSize = 12;
+  const size_t destLim = *destSize;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+  *destSize = 0;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  do {
+    size_t size = srcSize - srcPos;
+    if (size > frameSize)
+      size = frameSize;
+    if (destLim - destPos < headerSize)
+      return S_FALSE;
+    const size_t result = LizardF_compressFrame(dest + destPos + headerSize,
+        destLim - destPos - headerSize, src + srcPos, size, &prefs);
+    /* LizardF_compressFrame() requires LizardF_compressFrameBound() bytes */
+    if (LizardF_isError(result))
+      return S_FALSE;
+    SetUi32(dest + destPos, LIZARDFMT_MAGIC_SKIPPABLE);
+    SetUi32(dest + destPos + 4, 4);
+    SetUi32(dest + destPos + 8, (UInt32)result);
+    srcPos += size;
+    destPos += headerSize + result;
+  } while (srcPos != srcSize);
+
+  _processedIn = srcSize;
+  _processedOut = destPos;
+  *destSize = destPos;
+  return S_OK;
+}
+
 STDMETHODIMP CEncoder::SetNumberOfThreads(UInt32 numThreads)
 {
   const UInt32 kNumThreadsMax = LIZARDMT_THREAD_MAX;
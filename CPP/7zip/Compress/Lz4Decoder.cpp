@@ -1,6 +1,11 @@
 // (C) 2016 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
+#include "../../Common/MyBuffer2.h"
+
 #include "Lz4Decoder.h"
 
 int Lz4Read(void *arg, LZ4MT_Buffer * in)
@@ -70,6 +75,8 @@ int Lz4Write(void *arg, LZ4MT_Buffer * out)
 namespace NCompress {
 namespace NLZ4 {
 
+static const size_t kOutBufSize = (size_t)1 << 22;
+
 CDecoder::CDecoder():
   _processedIn(0),
   _processedOut(0),
@@ -124,6 +131,24 @@ STDMETHODIMP CDecoder::SetOutStreamSize(const UInt64 * outSize)
 HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
   ISequentialOutStream * outStream, ICompressProgressInfo * progress)
 {
+  {
+    /* the frames from mapped file or memory buffer are decoded without copying,
+       if they are not decoded in parallel */
+    UInt64 viewSize;
+    const Byte *view = GetStreamView(inStream, viewSize);
+    if (view && viewSize >= 4 && viewSize == (size_t)viewSize
+        && (_numThreads <= 1 || GetUi32(view) != LZ4FMT_MAGIC_SKIPPABLE))
+    {
+      CMidBuffer outBuf;
+      outBuf.Alloc(kOutBufSize);
+      if (!outBuf.IsAllocated())
+        return E_OUTOFMEMORY;
+      const UInt64 inStart = _processedIn;
+      RINOK(DecodeMem(view, (size_t)viewSize, outBuf, kOutBufSize, outStream, progress));
+      return SkipStreamView(inStream, _processedIn - inStart);
+    }
+  }
+
   LZ4MT_RdWr_t rdwr;
   size_t result;
   HRESULT res = S_OK;
@@ -169,6 +194,108 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream * inStream, ISequentialOutStream
   return CodeSpec(inStream, outStream, progress);
 }
 
+/*
+  DecodeMem() decodes the frames from memory:
+    (outStream == NULL) : to (dest) buffer,
+    (outStream != NULL) : via (dest) buffer to (outStream).
+*/
+HRESULT CDecoder::DecodeMem(const Byte *src, size_t srcSize, Byte *dest, size_t destLim,
+    ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  if (srcSize < 4)
+    return S_FALSE;
+
+  const bool sizes = (GetUi32(src) == LZ4FMT_MAGIC_SKIPPABLE);
+  if (!sizes && GetUi32(src) != LZ4FMT_MAGICNUMBER)
+    return S_FALSE;
+
+  LZ4F_decompressionContext_t dctx;
+  if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)))
+    return E_OUTOFMEMORY;
+
+  HRESULT res = S_OK;
+  const UInt64 inStart = _processedIn;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+
+  while (srcPos != srcSize && res == S_OK)
+  {
+    size_t frameSize = srcSize - srcPos;
+    if (sizes) {
+      if (frameSize < 12
+          || GetUi32(src + srcPos) != LZ4FMT_MAGIC_SKIPPABLE
+          || GetUi32(src + srcPos + 4) != 4
+          || GetUi32(src + srcPos + 8) > frameSize - 12) {
+        res = S_FALSE;
+        break;
+      }
+      frameSize = GetUi32(src + srcPos + 8);
+      srcPos += 12;
+    }
+
+    size_t result = 1;
+    while (frameSize != 0)
+    {
+      if (outStream && destPos == destLim)
+      {
+        _processedIn = inStart + srcPos;
+        _processedOut += destPos;
+        res = WriteStream(outStream, dest, destPos);
+        destPos = 0;
+        if (res == S_OK && progress)
+          res = progress->SetRatioInfo(&_processedIn, &_processedOut);
+        if (res != S_OK)
+          break;
+      }
+      size_t inSize = frameSize;
+      size_t outSize = destLim - destPos;
+      result = LZ4F_decompress(dctx, dest + destPos, &outSize, src + srcPos, &inSize, NULL);
+      if (LZ4F_isError(result) || (inSize == 0 && outSize == 0))
+        break;
+      srcPos += inSize;
+      frameSize -= inSize;
+      destPos += outSize;
+    }
+
+    /* the frame must end with the input */
+    if (res == S_OK && (result != 0 || frameSize != 0))
+      res = S_FALSE;
+  }
+
+  LZ4F_freeDecompressionContext(dctx);
+  _processedIn = inStart + srcPos;
+  _processedOut += destPos;
+  if (outStream && destPos != 0)
+  {
+    HRESULT res2 = WriteStream(outStream, dest, destPos);
+    if (res == S_OK)
+      res = res2;
+  }
+  return res;
+}
+
+/*
+  LZ4MT_decompressDCtx() formats:
+    - LZ4 frames without sizes, decoded one after another
+    - each frame is preceded by a skippable frame with its size,
+      the frames are decoded in parallel by Code()
+*/
+STDMETHODIMP CDecoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  const size_t destLim = *destSize;
+  *destSize = 0;
+  if (srcSize >= 12 && _numThreads > 1
+      && GetUi32(src) == LZ4FMT_MAGIC_SKIPPABLE
+      && srcSize - 12 > GetUi32(src + 8))
+    return E_NOTIMPL;
+
+  _processedIn = 0;
+  _processedOut = 0;
+  HRESULT res = DecodeMem(src, srcSize, dest, destLim, NULL, NULL);
+  *destSize = (size_t)_processedOut;
+  return res;
+}
+
 #ifndef NO_READ_FROM_CODER
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream * inStream)
 {
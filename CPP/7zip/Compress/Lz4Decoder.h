@@ -4,6 +4,7 @@
 #include "../../../C/Alloc.h"
 #include "../../../C/Threads.h"
 #include "../../../C/lz4/lz4.h"
+#include "../../../C/lz4/lz4frame.h"
 #include "../../../C/zstdmt/lz4-mt.h"
 
 #include "../../Windows/System.h"
@@ -48,6 +49,7 @@ struct DProps
 class CDecoder:public ICompressCoder,
   public ICompressSetDecoderProperties2,
   public ICompressSetCoderMt,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CMyComPtr < ISequentialInStream > _inStream;
@@ -60,6 +62,8 @@ class CDecoder:public ICompressCoder,
   UInt32 _numThreads;
 
   HRESULT CodeSpec(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+  HRESULT DecodeMem(const Byte *src, size_t srcSize, Byte *dest, size_t destLim,
+      ISequentialOutStream *outStream, ICompressProgressInfo *progress);
   HRESULT SetOutStreamSizeResume(const UInt64 *outSize);
 
 public:
@@ -70,10 +74,12 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
 #endif
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
 
   MY_ADDREF_RELEASE
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetDecoderProperties2)(const Byte *data, UInt32 size);
   STDMETHOD (SetOutStreamSize)(const UInt64 *outSize);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
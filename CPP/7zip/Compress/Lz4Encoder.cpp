@@ -1,6 +1,10 @@
 // (C) 2016 - 2020 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
+#include "CoderCtxCache.h"
 #include "Lz4Encoder.h"
 #include "Lz4Decoder.h"
 
@@ -8,20 +12,43 @@
 namespace NCompress {
 namespace NLZ4 {
 
+static void FreeCCtx(LZ4MT_CCtx *ctx) { LZ4MT_freeCCtx(ctx); }
+
+/* level, thread count and input size are fixed, when the context is created */
+static CCtxCache<LZ4MT_CCtx> g_CCtxCache(FreeCCtx, 4);
+
+/* frame size of LZ4MT_createCCtx(), if (inputsize == 0) */
+static const UInt32 kInputSizeDefault = (UInt32)1 << 22;
+
+static UInt64 GetCtxKey(UInt32 numThreads, unsigned level, UInt32 inputSize)
+{
+  return ((UInt64)inputSize << 32) | ((UInt64)numThreads << 8) | level;
+}
+
+/* each thread keeps the input buffer and the output buffer of one frame */
+static size_t GetCtxSize(UInt64 key)
+{
+  UInt32 inputSize = (UInt32)(key >> 32);
+  if (inputSize == 0)
+    inputSize = kInputSizeDefault;
+  const UInt64 size = (UInt64)((UInt32)key >> 8) * inputSize * 2;
+  return size > kCtxCacheSizeMax ? kCtxCacheSizeMax + 1 : (size_t)size;
+}
+
 CEncoder::CEncoder():
   _processedIn(0),
   _processedOut(0),
   _inputSize(0),
   _ctx(NULL),
-  _numThreads(1)
+  _numThreads(1),
+  _ctxKey(0)
 {
   _props.clear();
 }
 
 CEncoder::~CEncoder()
 {
-  if (_ctx)
-    LZ4MT_freeCCtx(_ctx);
+  g_CCtxCache.Put(_ctxKey, _ctx, GetCtxSize(_ctxKey));
 }
 
 STDMETHODIMP CEncoder::SetCoderProperties(const PROPID * propIDs, const PROPVARIANT * coderProps, UInt32 numProps)
@@ -98,14 +125,26 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
   rdwr.arg_write = (void *)&Wr;
 
   /* 2) create compression context, if needed */
-  if (!_ctx)
-    _ctx = LZ4MT_createCCtx(_numThreads, _props._level, _inputSize);
-  if (!_ctx)
-    return S_FALSE;
+  const UInt64 key = GetCtxKey(_numThreads, _props._level, _inputSize);
+  if (_ctx && _ctxKey != key) {
+    g_CCtxCache.Put(_ctxKey, _ctx, GetCtxSize(_ctxKey));
+    _ctx = NULL;
+  }
+  if (!_ctx) {
+    _ctx = g_CCtxCache.Get(key);
+    if (!_ctx)
+      _ctx = LZ4MT_createCCtx(_numThreads, _props._level, _inputSize);
+    if (!_ctx)
+      return S_FALSE;
+    _ctxKey = key;
+  }
 
   /* 3) compress */
   result = LZ4MT_compressCCtx(_ctx, &rdwr);
   if (LZ4MT_isError(result)) {
+    /* the context may be left in some unfinished state */
+    LZ4MT_freeCCtx(_ctx);
+    _ctx = NULL;
     if (result == (size_t)-LZ4MT_error_canceled)
       return E_ABORT;
     return E_FAIL;
@@ -114,6 +153,59 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
   return res;
 }
 
+/*
+  same frames as LZ4MT_compressCCtx(): one frame per (_inputSize) bytes,
+  with the skippable size headers in multithreaded mode.
+  Several frames are compressed in parallel by Code() only.
+*/
+STDMETHODIMP CEncoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  const size_t frameSize = _inputSize ? _inputSize : kInputSizeDefault;
+  if (_numThreads > 1 && srcSize > frameSize)
+    return E_NOTIMPL;
+
+  LZ4F_preferences_t prefs;
+  memset(&prefs, 0, sizeof(prefs));
+  prefs.compressionLevel = _props._level;
+  prefs.frameInfo.blockMode = LZ4F_blockLinked;
+  prefs.frameInfo.contentSize = 1;
+  prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+
+  const size_t headerSize = (_numThreads > 1) ? 12 : 0;
+  const size_t destLim = *destSize;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+  *destSize = 0;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  do {
+    size_t size = srcSize - srcPos;
+    if (size > frameSize)
+      size = frameSize;
+    if (destLim - destPos < headerSize)
+      return S_FALSE;
+    const size_t result = LZ4F_compressFrame(dest + destPos + headerSize,
+        destLim - destPos - headerSize, src + srcPos, size, &prefs);
+    /* LZ4F_compressFrame() requires LZ4F_compressFrameBound() bytes */
+    if (LZ4F_isError(result))
+      return S_FALSE;
+    if (headerSize) {
+      SetUi32(dest + destPos, LZ4FMT_MAGIC_SKIPPABLE);
+      SetUi32(dest + destPos + 4, 4);
+      SetUi32(dest + destPos + 8, (UInt32)result);
+    }
+    srcPos += size;
+    destPos += headerSize + result;
+  } while (srcPos != srcSize);
+
+  _processedIn = srcSize;
+  _processedOut = destPos;
+  *destSize = destPos;
+  return S_OK;
+}
+
 STDMETHODIMP CEncoder::SetNumberOfThreads(UInt32 numThreads)
 {
   const UInt32 kNumThreadsMax = LZ4MT_THREAD_MAX;
@@ -4,6 +4,7 @@
 #include "../../../C/Alloc.h"
 #include "../../../C/Threads.h"
 #include "../../../C/lz4/lz4.h"
+#include "../../../C/lz4/lz4frame.h"
 #include "../../../C/zstdmt/lz4-mt.h"
 
 #include "../../Common/Common.h"
@@ -37,6 +38,7 @@ class CEncoder:
   public ICompressSetCoderMt,
   public ICompressSetCoderProperties,
   public ICompressWriteCoderProperties,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CProps _props;
@@ -47,16 +49,19 @@ class CEncoder:
   UInt32 _numThreads;
 
   LZ4MT_CCtx *_ctx;
+  UInt64 _ctxKey;
 
 public:
   MY_QUERYINTERFACE_BEGIN2(ICompressCoder)
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderProperties)
   MY_QUERYINTERFACE_ENTRY(ICompressWriteCoderProperties)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
   MY_ADDREF_RELEASE
 
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
   STDMETHOD (WriteCoderProperties)(ISequentialOutStream *outStream);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
@@ -1,6 +1,9 @@
 // (C) 2016 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
 #include "Lz5Decoder.h"
 
 int Lz5Read(void *arg, LZ5MT_Buffer * in)
@@ -169,6 +172,78 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream * inStream, ISequentialOutStream
   return CodeSpec(inStream, outStream, progress);
 }
 
+/*
+  LZ5MT_decompressDCtx() formats:
+    - LZ5 frames without sizes, decoded one after another
+    - each frame is preceded by a skippable frame with its size,
+      the frames are decoded in parallel by Code()
+*/
+STDMETHODIMP CDecoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  const size_t destLim = *destSize;
+  *destSize = 0;
+  if (srcSize < 4)
+    return S_FALSE;
+
+  const bool sizes = (GetUi32(src) == LZ5FMT_MAGIC_SKIPPABLE);
+  if (!sizes && GetUi32(src) != LZ5FMT_MAGICNUMBER)
+    return S_FALSE;
+  if (sizes && _numThreads > 1 && srcSize >= 12 && srcSize - 12 > GetUi32(src + 8))
+    return E_NOTIMPL;
+
+  LZ5F_decompressionContext_t dctx;
+  if (LZ5F_isError(LZ5F_createDecompressionContext(&dctx, LZ5F_VERSION)))
+    return E_OUTOFMEMORY;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  HRESULT res = S_OK;
+  size_t srcPos = 0;
+  size_t destPos = 0;
+
+  while (srcPos != srcSize)
+  {
+    size_t frameSize = srcSize - srcPos;
+    if (sizes) {
+      if (frameSize < 12
+          || GetUi32(src + srcPos) != LZ5FMT_MAGIC_SKIPPABLE
+          || GetUi32(src + srcPos + 4) != 4
+          || GetUi32(src + srcPos + 8) > frameSize - 12) {
+        res = S_FALSE;
+        break;
+      }
+      frameSize = GetUi32(src + srcPos + 8);
+      srcPos += 12;
+    }
+
+    size_t result = 1;
+    while (frameSize != 0)
+    {
+      size_t inSize = frameSize;
+      size_t outSize = destLim - destPos;
+      result = LZ5F_decompress(dctx, dest + destPos, &outSize, src + srcPos, &inSize, NULL);
+      if (LZ5F_isError(result) || (inSize == 0 && outSize == 0))
+        break;
+      srcPos += inSize;
+      frameSize -= inSize;
+      destPos += outSize;
+    }
+
+    /* the frame must end with the input */
+    if (result != 0 || frameSize != 0) {
+      res = S_FALSE;
+      break;
+    }
+  }
+
+  LZ5F_freeDecompressionContext(dctx);
+  _processedIn = srcPos;
+  _processedOut = destPos;
+  *destSize = destPos;
+  return res;
+}
+
 #ifndef NO_READ_FROM_CODER
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream * inStream)
 {
@@ -4,6 +4,7 @@
 #include "../../../C/Alloc.h"
 #include "../../../C/Threads.h"
 #include "../../../C/lz5/lz5.h"
+#include "../../../C/lz5/lz5frame.h"
 #include "../../../C/zstdmt/lz5-mt.h"
 
 #include "../../Windows/System.h"
@@ -48,6 +49,7 @@ struct DProps
 class CDecoder:public ICompressCoder,
   public ICompressSetDecoderProperties2,
   public ICompressSetCoderMt,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CMyComPtr < ISequentialInStream > _inStream;
@@ -70,10 +72,12 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
 #endif
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
 
   MY_ADDREF_RELEASE
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetDecoderProperties2)(const Byte *data, UInt32 size);
   STDMETHOD (SetOutStreamSize)(const UInt64 *outSize);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
@@ -12,3 +12,28 @@ void CLzOutWindow::Init(bool solid) throw()
   ErrorCode = S_OK;
   #endif
 }
+
+void CLzOutWindow::SetDictionary(const Byte *data, UInt32 size) throw()
+{
+  memcpy(_buf, data, size);
+  if (size == _bufSize)
+  {
+    size = 0;
+    _overDict = true;
+  }
+  _pos = size;
+  _streamPos = size;
+}
+
+void CLzOutWindow::GetHistory(Byte *dest, UInt32 size) const throw()
+{
+  const UInt32 pos = _pos;
+  if (size > pos)
+  {
+    const UInt32 rem = size - pos;
+    memcpy(dest, _buf + _bufSize - rem, rem);
+    dest += rem;
+    size = pos;
+  }
+  memcpy(dest, _buf + pos - size, size);
+}
@@ -13,6 +13,11 @@ class CLzOutWindow: public COutBuffer
 {
 public:
   void Init(bool solid = false) throw();
+
+  // call it after Init(). These (size <= _bufSize) bytes are not written to stream
+  void SetDictionary(const Byte *data, UInt32 size) throw();
+  // it copies the last (size) bytes of history. (size) must not exceed the size of history
+  void GetHistory(Byte *dest, UInt32 size) const throw();
   
   // distance >= 0, len > 0,
   bool CopyBlock(UInt32 distance, UInt32 len)
@@ -9,6 +9,7 @@
 #include "../Common/CWrappers.h"
 #include "../Common/StreamUtils.h"
 
+#include "CoderCtxCache.h"
 #include "Lzma2Encoder.h"
 #pragma warning(disable : 4127)
 
@@ -52,6 +53,11 @@ HRESULT SetLzma2Prop(PROPID propID, const PROPVARIANT &prop, CLzma2EncProps &lzm
         return E_INVALIDARG;
       break;
     }
+    case NCoderPropID::kBlockPrimeSize:
+      if (prop.vt != VT_UI4)
+        return E_INVALIDARG;
+      lzma2Props.blockPrimeSize = prop.ulVal;
+      break;
     case NCoderPropID::kNumThreads:
       if (prop.vt != VT_UI4)
         return E_INVALIDARG;
@@ -154,15 +160,22 @@ static HRESULT TranslateError(size_t res)
 #define MIN_BLOCK_SIZE (1U << 20)
 #define MAX_BLOCK_SIZE (1U << 28)
 
+static void FreeCStream(FL2_CStream *fcs) { FL2_freeCStream(fcs); }
+
+/* the key is the number of threads. One stream only: the dictionary buffer stays allocated */
+static CCtxCache<FL2_CStream> g_CStreamCache(FreeCStream, 1);
+
 CFastEncoder::FastLzma2::FastLzma2()
   : fcs(NULL),
+  fcsThreads(0),
   dict_pos(0)
 {
 }
 
 CFastEncoder::FastLzma2::~FastLzma2()
 {
-  FL2_freeCCtx(fcs);
+  if (fcs)
+    g_CStreamCache.Put(fcsThreads, fcs, FL2_estimateCCtxSize_usingCCtx(fcs));
 }
 
 HRESULT CFastEncoder::FastLzma2::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
@@ -174,10 +187,20 @@ HRESULT CFastEncoder::FastLzma2::SetCoderProperties(const PROPID *propIDs, const
   {
     RINOK(SetLzma2Prop(propIDs[i], coderProps[i], lzma2Props));
   }
+  const unsigned numThreads = (unsigned)lzma2Props.numTotalThreads;
+  if (fcs != NULL && fcsThreads != numThreads) {
+    g_CStreamCache.Put(fcsThreads, fcs, FL2_estimateCCtxSize_usingCCtx(fcs));
+    fcs = NULL;
+  }
   if (fcs == NULL) {
-    fcs = FL2_createCStreamMt(lzma2Props.numTotalThreads, 1);
+    /* a cached stream keeps the parameters of the previous coder,
+       all of them are set again by the compression level below */
+    fcs = g_CStreamCache.Get(numThreads);
+    if (fcs == NULL)
+      fcs = FL2_createCStreamMt(numThreads, 1);
     if (fcs == NULL)
       return E_OUTOFMEMORY;
+    fcsThreads = numThreads;
   }
   if (lzma2Props.lzmaProps.algo > 2) {
     if (lzma2Props.lzmaProps.algo > 3)
@@ -187,6 +210,7 @@ HRESULT CFastEncoder::FastLzma2::SetCoderProperties(const PROPID *propIDs, const
     FL2_CCtx_setParameter(fcs, FL2_p_compressionLevel, lzma2Props.lzmaProps.level);
   }
   else {
+    FL2_CCtx_setParameter(fcs, FL2_p_highCompression, 0);
     FL2_CCtx_setParameter(fcs, FL2_p_compressionLevel, lzma2Props.lzmaProps.level);
   }
   size_t dictSize = lzma2Props.lzmaProps.dictSize;
@@ -64,6 +64,7 @@ class CFastEncoder :
     HRESULT WriteBuffers(ISequentialOutStream *outStream);
 
     FL2_CStream* fcs;
+    unsigned fcsThreads;
     FL2_dictBuffer dict;
     size_t dict_pos;
 
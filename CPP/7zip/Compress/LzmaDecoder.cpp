@@ -227,6 +227,51 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream
 }
 
 
+/*
+  (*destSize) works as (outSize) in Code(),
+  so it must be the exact size for the stream without end marker.
+  The probabilities of (_state) are used with (dest) as dictionary.
+*/
+
+STDMETHODIMP CDecoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  if (!_propsWereSet)
+    return S_FALSE;
+
+  Byte *dic = _state.dic;
+  const SizeT dicBufSize = _state.dicBufSize;
+  _state.dic = dest;
+  _state.dicBufSize = *destSize;
+  LzmaDec_Init(&_state);
+
+  SizeT inProcessed = srcSize;
+  ELzmaStatus status;
+  SRes res = LzmaDec_DecodeToDic(&_state, *destSize, src, &inProcessed,
+      FinishStream ? LZMA_FINISH_END : LZMA_FINISH_ANY, &status);
+
+  const bool outFinished = (_state.dicPos == *destSize);
+  *destSize = _state.dicPos;
+  _state.dic = dic;
+  _state.dicBufSize = dicBufSize;
+  LzmaDec_Init(&_state);
+
+  _lzmaStatus = status;
+  _inProcessed = inProcessed;
+  _outProcessed = *destSize;
+
+  if (res != SZ_OK)
+    return S_FALSE;
+  if (FinishStream && inProcessed != srcSize)
+    return S_FALSE;
+  if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+    return S_OK;
+  if (outFinished && status != LZMA_STATUS_NEEDS_MORE_INPUT)
+    if (!FinishStream || status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+      return S_OK;
+  return S_FALSE;
+}
+
+
 #ifndef NO_READ_FROM_CODER
 
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream *inStream) { _inStream = inStream; return S_OK; }
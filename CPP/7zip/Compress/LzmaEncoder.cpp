@@ -33,12 +33,16 @@ CEncoder::CEncoder()
   _encoder = LzmaEnc_Create(&g_AlignedAlloc);
   if (!_encoder)
     throw 1;
+  _bufEncoder = NULL;
+  LzmaEncProps_Init(&_props);
 }
 
 CEncoder::~CEncoder()
 {
   if (_encoder)
     LzmaEnc_Destroy(_encoder, &g_AlignedAlloc, &g_BigAlloc);
+  if (_bufEncoder)
+    LzmaEnc_Destroy(_bufEncoder, &g_AlignedAlloc, &g_BigAlloc);
 }
 
 static inline wchar_t GetLowCharFast(wchar_t c)
@@ -176,7 +180,11 @@ STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs,
         RINOK(SetLzmaProp(propID, prop, props));
     }
   }
-  return SResToHRESULT(LzmaEnc_SetProps(_encoder, &props));
+  RINOK(SResToHRESULT(LzmaEnc_SetProps(_encoder, &props)));
+  _props = props;
+  if (_bufEncoder)
+    return SResToHRESULT(LzmaEnc_SetProps(_bufEncoder, &props));
+  return S_OK;
 }
 
 
@@ -293,8 +301,21 @@ static void PrintStat(HANDLE thread, UInt64 totalTime, const CBaseStat *prevStat
 
 
 
+HRESULT CEncoder::CreateBufEncoder()
+{
+  if (!_bufEncoder)
+  {
+    _bufEncoder = LzmaEnc_Create(&g_AlignedAlloc);
+    if (!_bufEncoder)
+      return E_OUTOFMEMORY;
+    RINOK(SResToHRESULT(LzmaEnc_SetProps(_bufEncoder, &_props)));
+  }
+  return S_OK;
+}
+
+
 STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
-    const UInt64 * /* inSize */, const UInt64 * /* outSize */, ICompressProgressInfo *progress)
+    const UInt64 *inSize, const UInt64 * /* outSize */, ICompressProgressInfo *progress)
 {
   CSeqInStreamWrap inWrap;
   CSeqOutStreamWrap outWrap;
@@ -304,6 +325,25 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream
   outWrap.Init(outStream);
   progressWrap.Init(progress);
 
+  {
+    // the match finder reads mapped file or memory buffer without copying to its window
+    UInt64 viewSize;
+    const Byte *view = GetStreamView(inStream, viewSize);
+    if (inSize && viewSize > *inSize)
+      viewSize = *inSize;
+    if (view && viewSize == (SizeT)viewSize)
+    {
+      RINOK(CreateBufEncoder());
+      SRes res = LzmaEnc_MemEncodeToStream(_bufEncoder, &outWrap.vt, view, (SizeT)viewSize,
+          progress ? &progressWrap.vt : NULL, &g_AlignedAlloc, &g_BigAlloc);
+      _inputProcessed = viewSize;
+      RET_IF_WRAP_ERROR(outWrap.Res, res, SZ_ERROR_WRITE)
+      RET_IF_WRAP_ERROR(progressWrap.Res, res, SZ_ERROR_PROGRESS)
+      RINOK(SResToHRESULT(res));
+      return SkipStreamView(inStream, viewSize);
+    }
+  }
+
   #ifdef LOG_LZMA_THREADS
 
   FILETIME startTimeFT;
@@ -344,4 +384,18 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream
   return SResToHRESULT(res);
 }
 
+
+STDMETHODIMP CEncoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  RINOK(CreateBufEncoder());
+  SizeT destLen = *destSize;
+  SRes res = LzmaEnc_MemEncode(_bufEncoder, dest, &destLen, src, srcSize,
+      _props.writeEndMark, NULL, &g_AlignedAlloc, &g_BigAlloc);
+  *destSize = destLen;
+  _inputProcessed = srcSize;
+  if (res == SZ_ERROR_OUTPUT_EOF)
+    return S_FALSE;
+  return SResToHRESULT(res);
+}
+
 }}
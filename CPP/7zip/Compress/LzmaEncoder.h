@@ -17,22 +17,33 @@ class CEncoder:
   public ICompressSetCoderProperties,
   public ICompressWriteCoderProperties,
   public ICompressSetCoderPropertiesOpt,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CLzmaEncHandle _encoder;
   UInt64 _inputProcessed;
+
+  /* LzmaEnc_MemEncode() switches the match finder to direct input,
+     so CodeBuf() and Code() for input stream with memory view
+     use another encoder object with the same properties */
+  CLzmaEncHandle _bufEncoder;
+  CLzmaEncProps _props;
+
+  HRESULT CreateBufEncoder();
 public:
-  MY_UNKNOWN_IMP4(
+  MY_UNKNOWN_IMP5(
       ICompressCoder,
       ICompressSetCoderProperties,
       ICompressWriteCoderProperties,
-      ICompressSetCoderPropertiesOpt)
+      ICompressSetCoderPropertiesOpt,
+      ICompressCodeBuf)
     
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
   STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
   STDMETHOD(WriteCoderProperties)(ISequentialOutStream *outStream);
   STDMETHOD(SetCoderPropertiesOpt)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
+  STDMETHOD(CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
 
   CEncoder();
   virtual ~CEncoder();
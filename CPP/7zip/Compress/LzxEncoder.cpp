@@ -0,0 +1,404 @@
+// LzxEncoder.cpp
+
+#include "StdAfx.h"
+
+#include <string.h>
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+#include "../../../C/HuffEnc.h"
+
+#include "LzxEncoder.h"
+
+namespace NCompress {
+namespace NLzx {
+
+static const unsigned kNumPosSlots_Enc = kEncNumDictBits * 2;
+static const unsigned kMainTableSize_Enc = 256 + kNumPosSlots_Enc * kNumLenSlots;
+
+static const unsigned kMatchMinLen_Enc = 3;
+static const unsigned kNumFastBytes = 32;
+
+// (formatted offset = dist + 2) must be smaller than window size
+static const UInt32 kDistMax = kEncBlockSizeMax - 3;
+
+static const UInt32 kTranslationSize = 12000000;
+
+static const UInt16 kNoLenSym = 0xFFFF;
+
+
+static void x86_Filter_Enc(Byte *data, UInt32 size)
+{
+  const UInt32 kResidue = 10;
+  if (size <= kResidue)
+    return;
+  size -= kResidue;
+
+  for (UInt32 i = 0;;)
+  {
+    while (i < size && data[i] != 0xE8)
+      i++;
+    if (i >= size)
+      break;
+    Byte *p = data + (size_t)i + 1;
+    Int32 v = (Int32)GetUi32(p);
+    const Int32 pos = (Int32)i;
+    if (v >= -pos && v < (Int32)kTranslationSize)
+    {
+      v = (v < (Int32)kTranslationSize - pos) ? v + pos : v - (Int32)kTranslationSize;
+      SetUi32(p, (UInt32)v);
+    }
+    i += 5;
+  }
+}
+
+
+class CBitStream
+{
+  Byte *_buf;
+  Byte *_lim;
+  UInt32 _value;
+  unsigned _numBits;
+  bool _overflow;
+public:
+  void Init(Byte *data, size_t size)
+  {
+    _buf = data;
+    _lim = data + (size & ~(size_t)1);
+    _value = 0;
+    _numBits = 0;
+    _overflow = false;
+  }
+
+  // (numBits <= 16)
+  void WriteBits(UInt32 value, unsigned numBits)
+  {
+    _value = (_value << numBits) | value;
+    _numBits += numBits;
+    if (_numBits >= 16)
+    {
+      _numBits -= 16;
+      if (_buf == _lim)
+        _overflow = true;
+      else
+      {
+        SetUi16(_buf, (UInt16)(_value >> _numBits));
+        _buf += 2;
+      }
+    }
+  }
+
+  void Flush()
+  {
+    if (_numBits != 0)
+      WriteBits(0, 16 - _numBits);
+  }
+
+  bool WasOverflow() const { return _overflow; }
+  const Byte *GetPtr() const { return _buf; }
+};
+
+
+static void WriteTable(CBitStream &bs, const Byte *levels, unsigned numSymbols)
+{
+  // the levels of previous table are zeros in each chunk
+
+  Byte syms[kMaxTableSize];
+  Byte extras[kMaxTableSize];
+  UInt32 freqs[kLevelTableSize];
+  UInt32 codes[kLevelTableSize];
+  Byte lens[kLevelTableSize];
+
+  unsigned i;
+  for (i = 0; i < kLevelTableSize; i++)
+    freqs[i] = 0;
+
+  unsigned num = 0;
+
+  for (i = 0; i < numSymbols;)
+  {
+    const unsigned level = levels[i];
+    if (level == 0)
+    {
+      const unsigned kRunMax = kLevelSym_Zero2_Start + (1 << kLevelSym_Zero2_NumBits) - 1;
+      unsigned run = 1;
+      while (run < kRunMax && i + run < numSymbols && levels[i + run] == 0)
+        run++;
+      if (run >= kLevelSym_Zero2_Start)
+      {
+        syms[num] = kLevelSym_Zero2;
+        extras[num] = (Byte)(run - kLevelSym_Zero2_Start);
+      }
+      else if (run >= kLevelSym_Zero1_Start)
+      {
+        syms[num] = kLevelSym_Zero1;
+        extras[num] = (Byte)(run - kLevelSym_Zero1_Start);
+      }
+      else
+      {
+        syms[num] = 0;
+        run = 1;
+      }
+      i += run;
+    }
+    else
+    {
+      syms[num] = (Byte)(kNumHuffmanBits + 1 - level);
+      i++;
+    }
+    freqs[syms[num]]++;
+    num++;
+  }
+
+  Huffman_Generate(freqs, codes, lens, kLevelTableSize, (1 << kNumLevelBits) - 1);
+
+  for (i = 0; i < kLevelTableSize; i++)
+    bs.WriteBits(lens[i], kNumLevelBits);
+
+  for (i = 0; i < num; i++)
+  {
+    const unsigned sym = syms[i];
+    bs.WriteBits(codes[sym], lens[sym]);
+    if (sym == kLevelSym_Zero1)
+      bs.WriteBits(extras[i], kLevelSym_Zero1_NumBits);
+    else if (sym == kLevelSym_Zero2)
+      bs.WriteBits(extras[i], kLevelSym_Zero2_NumBits);
+  }
+}
+
+
+static unsigned GetPosSlot(UInt32 formattedPos)
+{
+  unsigned i = 1;
+  while ((formattedPos >> (i + 1)) != 0)
+    i++;
+  return (i << 1) + (unsigned)((formattedPos >> (i - 1)) & 1);
+}
+
+static unsigned GetNumDirectBits(unsigned posSlot)
+{
+  return posSlot < 4 ? 0 : (posSlot >> 1) - 1;
+}
+
+static UInt32 GetLongestMatch(const UInt32 *distances, UInt32 num, UInt32 &dist)
+{
+  for (; num != 0; num -= 2)
+  {
+    const UInt32 d = distances[num - 1] + 1;
+    if (d <= kDistMax)
+    {
+      dist = d;
+      return distances[num - 2];
+    }
+  }
+  return 0;
+}
+
+
+CEncoder::CEncoder():
+    _buf(NULL),
+    _items(NULL),
+    _created(false)
+{
+  MatchFinder_Construct(&_lzInWindow);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_lzInWindow, &g_Alloc);
+  MyFree(_items);
+  MyFree(_buf);
+}
+
+HRESULT CEncoder::Create()
+{
+  if (_created)
+    return S_OK;
+  if (!_buf)
+  {
+    _buf = (Byte *)MyAlloc(kEncBlockSizeMax);
+    if (!_buf)
+      return E_OUTOFMEMORY;
+  }
+  if (!_items)
+  {
+    _items = (CEncItem *)MyAlloc(kEncBlockSizeMax * sizeof(CEncItem));
+    if (!_items)
+      return E_OUTOFMEMORY;
+  }
+  _lzInWindow.btMode = 0;
+  _lzInWindow.numHashBytes = 3;
+  _lzInWindow.directInput = 1;
+  if (!MatchFinder_Create(&_lzInWindow, kEncBlockSizeMax, 0, kMatchMaxLen, 0, &g_Alloc))
+    return E_OUTOFMEMORY;
+  _created = true;
+  return S_OK;
+}
+
+
+HRESULT CEncoder::Encode(const Byte *in, size_t inSize, Byte *out, size_t &outSize)
+{
+  const size_t outSizeMax = outSize;
+  outSize = 0;
+  if (inSize == 0 || inSize > kEncBlockSizeMax)
+    return E_INVALIDARG;
+
+  RINOK(Create());
+
+  const UInt32 size = (UInt32)inSize;
+  memcpy(_buf, in, size);
+  x86_Filter_Enc(_buf, size);
+
+  _lzInWindow.bufferBase = _buf;
+  _lzInWindow.directInputRem = size;
+  MatchFinder_Init(&_lzInWindow);
+
+  UInt32 mainFreqs[kMainTableSize_Enc];
+  UInt32 lenFreqs[kNumLenSymbols];
+  {
+    unsigned i;
+    for (i = 0; i < kMainTableSize_Enc; i++)
+      mainFreqs[i] = 0;
+    for (i = 0; i < kNumLenSymbols; i++)
+      lenFreqs[i] = 0;
+  }
+
+  // ---------- LZ parsing (with lazy matching) ----------
+
+  UInt32 distances[kMatchMaxLen * 2 + 3];
+  UInt32 reps[kNumReps] = { 1, 1, 1 };
+  UInt32 numItems = 0;
+  UInt32 pos = 0;
+
+  UInt32 dist = 0;
+  UInt32 len = GetLongestMatch(distances,
+      (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distances) - distances), dist);
+
+  while (pos < size)
+  {
+    CEncItem &item = _items[numItems++];
+    item.LenSym = kNoLenSym;
+
+    if (len < kMatchMinLen_Enc)
+    {
+      item.Sym = _buf[pos++];
+      mainFreqs[item.Sym]++;
+    }
+    else
+    {
+      if (len < kNumFastBytes && pos + 1 < size)
+      {
+        UInt32 dist2 = 0;
+        const UInt32 len2 = GetLongestMatch(distances,
+            (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distances) - distances), dist2);
+        if (len2 > len)
+        {
+          item.Sym = _buf[pos++];
+          mainFreqs[item.Sym]++;
+          len = len2;
+          dist = dist2;
+          continue;
+        }
+        Hc3Zip_MatchFinder_Skip(&_lzInWindow, len - 2);
+      }
+      else
+        Hc3Zip_MatchFinder_Skip(&_lzInWindow, len - 1);
+
+      unsigned posSlot;
+      item.PosBits = 0;
+
+      if (dist == reps[0])
+        posSlot = 0;
+      else if (dist == reps[1])
+      {
+        posSlot = 1;
+        reps[1] = reps[0];
+        reps[0] = dist;
+      }
+      else if (dist == reps[2])
+      {
+        posSlot = 2;
+        reps[2] = reps[0];
+        reps[0] = dist;
+      }
+      else
+      {
+        const UInt32 formattedPos = dist + kNumReps - 1;
+        posSlot = GetPosSlot(formattedPos);
+        const unsigned numDirectBits = GetNumDirectBits(posSlot);
+        item.PosBits = formattedPos - ((2 | ((UInt32)posSlot & 1)) << numDirectBits);
+        reps[2] = reps[1];
+        reps[1] = reps[0];
+        reps[0] = dist;
+      }
+
+      unsigned lenSlot = len - kMatchMinLen;
+      if (lenSlot >= kNumLenSlots - 1)
+      {
+        lenSlot = kNumLenSlots - 1;
+        item.LenSym = (UInt16)(len - kMatchMinLen - (kNumLenSlots - 1));
+        lenFreqs[item.LenSym]++;
+      }
+      item.Sym = (UInt16)(256 + posSlot * kNumLenSlots + lenSlot);
+      mainFreqs[item.Sym]++;
+
+      pos += len;
+    }
+
+    len = 0;
+    if (pos < size)
+      len = GetLongestMatch(distances,
+          (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distances) - distances), dist);
+  }
+
+  // ---------- Verbatim block ----------
+
+  UInt32 mainCodes[kMainTableSize_Enc];
+  Byte mainLevels[kMainTableSize_Enc];
+  UInt32 lenCodes[kNumLenSymbols];
+  Byte lenLevels[kNumLenSymbols];
+
+  Huffman_Generate(mainFreqs, mainCodes, mainLevels, kMainTableSize_Enc, kNumHuffmanBits);
+  Huffman_Generate(lenFreqs, lenCodes, lenLevels, kNumLenSymbols, kNumHuffmanBits);
+
+  CBitStream bs;
+  bs.Init(out, outSizeMax);
+
+  bs.WriteBits(kBlockType_Verbatim, kBlockType_NumBits);
+  if (size == kEncBlockSizeMax)
+    bs.WriteBits(1, 1);
+  else
+  {
+    bs.WriteBits(0, 1);
+    bs.WriteBits(size, 16);
+  }
+
+  WriteTable(bs, mainLevels, 256);
+  WriteTable(bs, mainLevels + 256, kMainTableSize_Enc - 256);
+  WriteTable(bs, lenLevels, kNumLenSymbols);
+
+  for (UInt32 i = 0; i < numItems; i++)
+  {
+    if (bs.WasOverflow())
+      return S_FALSE;
+    const CEncItem &item = _items[i];
+    const unsigned sym = item.Sym;
+    bs.WriteBits(mainCodes[sym], mainLevels[sym]);
+    if (sym < 256)
+      continue;
+    if (item.LenSym != kNoLenSym)
+      bs.WriteBits(lenCodes[item.LenSym], lenLevels[item.LenSym]);
+    const unsigned posSlot = (sym - 256) / kNumLenSlots;
+    if (posSlot >= kNumReps)
+      bs.WriteBits(item.PosBits, GetNumDirectBits(posSlot));
+  }
+
+  bs.Flush();
+  if (bs.WasOverflow())
+    return S_FALSE;
+
+  outSize = (size_t)(bs.GetPtr() - out);
+  return S_OK;
+}
+
+}}
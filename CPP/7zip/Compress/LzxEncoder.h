@@ -0,0 +1,51 @@
+// LzxEncoder.h
+
+#ifndef __LZX_ENCODER_H
+#define __LZX_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "../../Common/MyTypes.h"
+
+#include "Lzx.h"
+
+namespace NCompress {
+namespace NLzx {
+
+/*
+  CEncoder packs one independent block (WIM chunk) to LZX format of WIM:
+    - the window size is 32 KB,
+    - x86 (E8) translation is always used with translation size = 12000000.
+  Encode() returns S_FALSE, if packed data doesn't fit to (outSize) bytes.
+  In that case the caller stores the block without compression.
+*/
+
+const unsigned kEncNumDictBits = kNumDictBits_Min;
+const UInt32 kEncBlockSizeMax = (UInt32)1 << kEncNumDictBits;
+
+struct CEncItem
+{
+  UInt16 Sym;
+  UInt16 LenSym;
+  UInt32 PosBits;
+};
+
+class CEncoder
+{
+  CMatchFinder _lzInWindow;
+  Byte *_buf;
+  CEncItem *_items;
+  bool _created;
+
+  HRESULT Create();
+public:
+  CEncoder();
+  ~CEncoder();
+
+  // (inSize <= kEncBlockSizeMax)
+  HRESULT Encode(const Byte *in, size_t inSize, Byte *out, size_t &outSize);
+};
+
+}}
+
+#endif
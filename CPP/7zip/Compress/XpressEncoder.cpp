@@ -0,0 +1,261 @@
+// XpressEncoder.cpp
+
+#include "StdAfx.h"
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+#include "../../../C/HuffEnc.h"
+
+#include "XpressEncoder.h"
+
+namespace NCompress {
+namespace NXpress {
+
+static const unsigned kNumHuffBits = 15;
+static const unsigned kNumLenBits = 4;
+static const unsigned kLenMask = (1 << kNumLenBits) - 1;
+static const unsigned kNumPosSlots = 16;
+static const unsigned kNumSyms = 256 + (kNumPosSlots << kNumLenBits);
+static const unsigned kSym_End = 256;
+
+static const unsigned kMatchMinLen = 3;
+static const unsigned kMatchMaxLen = 273;
+static const unsigned kNumFastBytes = 32;
+
+/*
+  The bits are written by 16-bit little-endian words.
+  Additional length bytes are stored between words. Decoder reads
+  two words ahead of current bit position, so the encoder reserves
+  the places for two next words before writing the byte.
+*/
+
+struct CBitStream
+{
+  Byte *NextBits;
+  Byte *NextBits2;
+  Byte *NextByte;
+  UInt32 Value;
+  unsigned NumBits;
+
+  void Init(Byte *p)
+  {
+    NextBits = p;
+    NextBits2 = p + 2;
+    NextByte = p + 4;
+    Value = 0;
+    NumBits = 0;
+  }
+
+  void WriteBits(UInt32 value, unsigned numBits)
+  {
+    Value = (Value << numBits) | value;
+    NumBits += numBits;
+    if (NumBits > 16)
+    {
+      NumBits -= 16;
+      SetUi16(NextBits, (UInt16)(Value >> NumBits));
+      NextBits = NextBits2;
+      NextBits2 = NextByte;
+      NextByte += 2;
+    }
+  }
+
+  void WriteByte(Byte b) { *NextByte++ = b; }
+
+  void Flush()
+  {
+    SetUi16(NextBits, (UInt16)(Value << (16 - NumBits)));
+    SetUi16(NextBits2, 0);
+  }
+};
+
+
+CEncoder::CEncoder():
+    _items(NULL),
+    _created(false)
+{
+  MatchFinder_Construct(&_lzInWindow);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_lzInWindow, &g_Alloc);
+  MyFree(_items);
+}
+
+HRESULT CEncoder::Create()
+{
+  if (_created)
+    return S_OK;
+  if (!_items)
+  {
+    _items = (UInt32 *)MyAlloc(kBlockSizeMax * sizeof(UInt32));
+    if (!_items)
+      return E_OUTOFMEMORY;
+  }
+  _lzInWindow.btMode = 0;
+  _lzInWindow.numHashBytes = 3;
+  _lzInWindow.directInput = 1;
+  if (!MatchFinder_Create(&_lzInWindow, kBlockSizeMax, 0, kMatchMaxLen, 0, &g_Alloc))
+    return E_OUTOFMEMORY;
+  _created = true;
+  return S_OK;
+}
+
+
+static unsigned GetPosSlot(UInt32 dist)
+{
+  unsigned i = 0;
+  while ((dist >> i) > 1)
+    i++;
+  return i;
+}
+
+HRESULT CEncoder::Encode(const Byte *in, size_t inSize, Byte *out, size_t &outSize)
+{
+  const size_t outSizeMax = outSize;
+  outSize = 0;
+  if (inSize == 0 || inSize > kBlockSizeMax)
+    return E_INVALIDARG;
+  if (outSizeMax < kNumSyms / 2 + 8)
+    return S_FALSE;
+
+  RINOK(Create());
+
+  _lzInWindow.bufferBase = (Byte *)in;
+  _lzInWindow.directInputRem = inSize;
+  MatchFinder_Init(&_lzInWindow);
+
+  // ---------- LZ parsing (with lazy matching) ----------
+
+  UInt32 distances[kMatchMaxLen * 2 + 3];
+  UInt32 numItems = 0;
+  UInt32 pos = 0;
+  const UInt32 size = (UInt32)inSize;
+
+  UInt32 len = 0;
+  UInt32 dist = 0;
+  {
+    const UInt32 num = (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distances) - distances);
+    if (num != 0)
+    {
+      len = distances[num - 2];
+      dist = distances[num - 1] + 1;
+    }
+  }
+
+  while (pos < size)
+  {
+    if (len < kMatchMinLen)
+    {
+      _items[numItems++] = in[pos++];
+      len = 0;
+    }
+    else
+    {
+      if (len < kNumFastBytes && pos + 1 < size)
+      {
+        const UInt32 num = (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distances) - distances);
+        if (num != 0 && distances[num - 2] > len)
+        {
+          _items[numItems++] = in[pos++];
+          len = distances[num - 2];
+          dist = distances[num - 1] + 1;
+          continue;
+        }
+        Hc3Zip_MatchFinder_Skip(&_lzInWindow, len - 2);
+      }
+      else
+        Hc3Zip_MatchFinder_Skip(&_lzInWindow, len - 1);
+      _items[numItems++] = (len << 16) | dist;
+      pos += len;
+      len = 0;
+    }
+
+    if (pos < size)
+    {
+      const UInt32 num = (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distances) - distances);
+      if (num != 0)
+      {
+        len = distances[num - 2];
+        dist = distances[num - 1] + 1;
+      }
+    }
+  }
+
+  // ---------- Huffman codes ----------
+
+  UInt32 freqs[kNumSyms];
+  UInt32 codes[kNumSyms];
+  Byte lens[kNumSyms];
+  {
+    unsigned i;
+    for (i = 0; i < kNumSyms; i++)
+      freqs[i] = 0;
+    for (i = 0; i < numItems; i++)
+    {
+      const UInt32 item = _items[i];
+      if (item < 256)
+        freqs[item]++;
+      else
+      {
+        const UInt32 lenTemp = (item >> 16) - kMatchMinLen;
+        freqs[256 + (GetPosSlot(item & 0xFFFF) << kNumLenBits) + (lenTemp < kLenMask ? lenTemp : kLenMask)]++;
+      }
+    }
+    freqs[kSym_End]++;
+    Huffman_Generate(freqs, codes, lens, kNumSyms, kNumHuffBits);
+    for (i = 0; i < kNumSyms / 2; i++)
+      out[i] = (Byte)(lens[(size_t)i * 2] | (lens[(size_t)i * 2 + 1] << 4));
+  }
+
+  // ---------- Symbols ----------
+
+  CBitStream bs;
+  bs.Init(out + kNumSyms / 2);
+
+  // each item requires 8 bytes at most
+  const Byte *lim = out + outSizeMax - 8;
+
+  for (UInt32 i = 0; i < numItems; i++)
+  {
+    if (bs.NextByte > lim)
+      return S_FALSE;
+    const UInt32 item = _items[i];
+    if (item < 256)
+    {
+      bs.WriteBits(codes[item], lens[item]);
+      continue;
+    }
+
+    const UInt32 lenTemp = (item >> 16) - kMatchMinLen;
+    const UInt32 matchDist = item & 0xFFFF;
+    const unsigned posSlot = GetPosSlot(matchDist);
+    const unsigned sym = 256 + (posSlot << kNumLenBits) + (lenTemp < kLenMask ? lenTemp : kLenMask);
+    bs.WriteBits(codes[sym], lens[sym]);
+
+    if (lenTemp >= kLenMask)
+    {
+      if (lenTemp - kLenMask < 0xFF)
+        bs.WriteByte((Byte)(lenTemp - kLenMask));
+      else
+      {
+        bs.WriteByte(0xFF);
+        bs.WriteByte((Byte)lenTemp);
+        bs.WriteByte((Byte)(lenTemp >> 8));
+      }
+    }
+
+    bs.WriteBits(matchDist - ((UInt32)1 << posSlot), posSlot);
+  }
+
+  if (bs.NextByte > lim)
+    return S_FALSE;
+  bs.WriteBits(codes[kSym_End], lens[kSym_End]);
+  bs.Flush();
+
+  outSize = (size_t)(bs.NextByte - out);
+  return S_OK;
+}
+
+}}
@@ -0,0 +1,39 @@
+// XpressEncoder.h
+
+#ifndef __XPRESS_ENCODER_H
+#define __XPRESS_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "../../Common/MyTypes.h"
+
+namespace NCompress {
+namespace NXpress {
+
+const UInt32 kBlockSizeMax = (UInt32)1 << 16;
+
+/*
+  CEncoder packs one independent block (WIM chunk) to XPRESS (LZ77+Huffman) format,
+  that can be unpacked by NXpress::Decode().
+  Encode() returns S_FALSE, if packed data doesn't fit to (outSize) bytes.
+  In that case the caller stores the block without compression.
+*/
+
+class CEncoder
+{
+  CMatchFinder _lzInWindow;
+  UInt32 *_items;
+  bool _created;
+
+  HRESULT Create();
+public:
+  CEncoder();
+  ~CEncoder();
+
+  // (inSize <= kBlockSizeMax)
+  HRESULT Encode(const Byte *in, size_t inSize, Byte *out, size_t &outSize);
+};
+
+}}
+
+#endif
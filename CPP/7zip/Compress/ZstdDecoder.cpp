@@ -1,27 +1,84 @@
 // (C) 2016 - 2020 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
+#include "CoderCtxCache.h"
 #include "ZstdDecoder.h"
 
 namespace NCompress {
 namespace NZSTD {
 
+static void *ZstdLayerAlloc(void *, size_t size) { return AllocLayer_Alloc(k_AllocKind_Zstd, size); }
+static void ZstdLayerFree(void *, void *address) { AllocLayer_Free(address); }
+
+ZSTD_customMem GetCustomMem()
+{
+  /* the big blocks of the layer are allocated via BigAlloc(),
+     so the windows and the match finder tables can use large pages */
+  const ZSTD_customMem mem = { ZstdLayerAlloc, ZstdLayerFree, NULL };
+  return mem;
+}
+
+static void FreeDCtx(ZSTD_DCtx *ctx) { ZSTD_freeDCtx(ctx); }
+
+/* the contexts of the main thread and of the mt workers */
+static CCtxCache<ZSTD_DCtx> g_DCtxCache(FreeDCtx, 16);
+
+ZSTD_DCtx *AllocDCtx()
+{
+  ZSTD_DCtx *ctx = g_DCtxCache.Get(0);
+  if (!ctx)
+    ctx = ZSTD_createDCtx_advanced(GetCustomMem());
+  if (!ctx)
+    return NULL;
+  if (ZSTD_isError(ZSTD_DCtx_setParameter(ctx, ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX))) {
+    ZSTD_freeDCtx(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+void ReleaseDCtx(ZSTD_DCtx *ctx)
+{
+  /* drops the reference to our DDict, the window buffer stays allocated */
+  if (ZSTD_isError(ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters)))
+    ZSTD_freeDCtx(ctx);
+  else
+    g_DCtxCache.Put(0, ctx, ZSTD_sizeof_DCtx(ctx));
+}
+
+#ifndef _7ZIP_ST
+CMtWorker::~CMtWorker()
+{
+  if (Ctx)
+    ReleaseDCtx(Ctx);
+}
+#endif
+
 CDecoder::CDecoder():
   _ctx(NULL),
+  _ddict(NULL),
+  _ddictChanged(false),
   _srcBuf(NULL),
   _dstBuf(NULL),
   _srcBufSize(ZSTD_DStreamInSize()),
   _dstBufSize(ZSTD_DStreamOutSize()),
   _processedIn(0),
-  _processedOut(0)
+  _processedOut(0),
+  _numThreads(1),
+  _memUsage((UInt64)(sizeof(size_t)) << 28)
 {
   _props.clear();
 }
 
 CDecoder::~CDecoder()
 {
+  if (_ddict)
+    ZSTD_freeDDict(_ddict);
   if (_ctx) {
-    ZSTD_freeDCtx(_ctx);
+    ReleaseDCtx(_ctx);
     MyFree(_srcBuf);
     MyFree(_dstBuf);
   }
@@ -34,13 +91,38 @@ STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte * prop, UInt32 size)
   switch (size) {
   case 3:
     memcpy(&_props, pProps, 3);
-    return S_OK;
+    break;
   case 5:
     memcpy(&_props, pProps, 5);
-    return S_OK;
+    break;
   default:
-    return E_NOTIMPL;
+    if (size < 5)
+      return E_NOTIMPL;
+    memcpy(&_props, pProps, 5);
+    break;
+  }
+
+  /**
+   * a trained dictionary follows the props, 7z calls this for every
+   * folder, so the digested dictionary is kept while it's the same
+   */
+  const size_t dictSize = size > 5 ? size - 5 : 0;
+  if (dictSize == _dict.Size()
+      && (dictSize == 0 || memcmp(_dict, prop + 5, dictSize) == 0))
+    return S_OK;
+
+  if (_ddict) {
+    ZSTD_freeDDict(_ddict);
+    _ddict = NULL;
   }
+  _dict.CopyFrom(prop + 5, dictSize);
+  if (dictSize) {
+    _ddict = ZSTD_createDDict(_dict, dictSize);
+    if (!_ddict)
+      return E_OUTOFMEMORY;
+  }
+  _ddictChanged = true;
+  return S_OK;
 }
 
 HRESULT CDecoder::SetOutStreamSizeResume(const UInt64 * /*outSize*/)
@@ -56,44 +138,154 @@ STDMETHODIMP CDecoder::SetOutStreamSize(const UInt64 * outSize)
   return S_OK;
 }
 
-HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
-  ISequentialOutStream * outStream, ICompressProgressInfo * progress)
+static HRESULT ErrorOut(size_t code)
 {
-  size_t srcBufLen, result;
-  ZSTD_inBuffer zIn;
-  ZSTD_outBuffer zOut;
+  switch (ZSTD_getErrorCode(code)) {
+    /* @Igor: would be nice, if we have an API to store the errmsg */
+    case ZSTD_error_memory_allocation:
+      return E_OUTOFMEMORY;
+    case ZSTD_error_frameParameter_unsupported:
+    case ZSTD_error_parameter_unsupported:
+    case ZSTD_error_version_unsupported:
+      return E_NOTIMPL;
+    case ZSTD_error_frameParameter_windowTooLarge:
+    case ZSTD_error_parameter_outOfBound:
+      return E_INVALIDARG;
+    default:
+      return E_FAIL;
+  }
+}
 
-  /* 1) create context */
+HRESULT CDecoder::CreateContext()
+{
   if (!_ctx) {
-    _ctx = ZSTD_createDCtx();
+    _ctx = AllocDCtx();
     if (!_ctx)
       return E_OUTOFMEMORY;
+  }
 
+  if (!_srcBuf) {
     _srcBuf = MyAlloc(_srcBufSize);
     if (!_srcBuf)
       return E_OUTOFMEMORY;
+  }
 
+  if (!_dstBuf) {
     _dstBuf = MyAlloc(_dstBufSize);
     if (!_dstBuf)
       return E_OUTOFMEMORY;
+  }
+
+  return S_OK;
+}
+
+/**
+ * in-memory decoder, all frames (and skippable frames) of src are decoded
+ * directly to dest, without the stream buffers
+ */
+STDMETHODIMP CDecoder::CodeBuf(const Byte * src, size_t srcSize, Byte * dest, size_t * destSize)
+{
+  size_t result;
+
+  if (!_ctx) {
+    _ctx = AllocDCtx();
+    if (!_ctx)
+      return E_OUTOFMEMORY;
+  }
+  if (_ddictChanged) {
+    result = ZSTD_DCtx_refDDict(_ctx, _ddict);
+    if (ZSTD_isError(result))
+      return E_OUTOFMEMORY;
+    _ddictChanged = false;
+  }
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  result = ZSTD_decompressDCtx(_ctx, dest, *destSize, src, srcSize);
+  if (ZSTD_isError(result)) {
+    *destSize = 0;
+    const HRESULT res = ErrorOut(result);
+    return res == E_FAIL ? S_FALSE : res;
+  }
+
+  _processedIn = srcSize;
+  _processedOut = result;
+  *destSize = result;
+  return S_OK;
+}
+
+/**
+ * streaming decoder, used for single threaded mode and as fallback
+ * - prefix: already read input, which is decoded first
+ * - inStream: may be NULL, when there is no more input
+ */
+/* reads next input block to (buf), or takes it from the memory view of stream.
+   If the read fails, (zIn) still contains the data that was read before the error */
+static HRESULT ReadInput(ISequentialInStream *inStream, void *buf, size_t bufSize,
+    const Byte *&view, UInt64 &viewRem, ZSTD_inBuffer &zIn)
+{
+  HRESULT res = S_OK;
+  size_t size = bufSize;
+  if (view)
+  {
+    if (size > viewRem)
+      size = (size_t)viewRem;
+    zIn.src = view;
+    view += size;
+    viewRem -= size;
+  }
+  else
+  {
+    if (inStream)
+      res = ReadStream(inStream, buf, &size);
+    else
+      size = 0;
+    zIn.src = buf;
+  }
+  zIn.size = size;
+  zIn.pos = 0;
+  return res;
+}
+
+HRESULT CDecoder::DecodeSerial(ISequentialInStream * inStream,
+  ISequentialOutStream * outStream, ICompressProgressInfo * progress,
+  const Byte * prefix, size_t prefixSize)
+{
+  size_t result;
+  ZSTD_inBuffer zIn;
+  ZSTD_outBuffer zOut;
 
-    result = ZSTD_DCtx_setParameter(_ctx, ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX);
+  /* 1) create context */
+  RINOK(CreateContext());
+  ZSTD_resetDStream(_ctx);
+  if (_ddictChanged) {
+    result = ZSTD_DCtx_refDDict(_ctx, _ddict);
     if (ZSTD_isError(result))
       return E_OUTOFMEMORY;
-  } else {
-    ZSTD_resetDStream(_ctx);
+    _ddictChanged = false;
   }
 
   zOut.dst = _dstBuf;
-  srcBufLen = _srcBufSize;
 
-  /* read first input block */
-  RINOK(ReadStream(inStream, _srcBuf, &srcBufLen));
-  _processedIn += srcBufLen;
+  /* the data of mapped file or memory buffer is decoded without copying */
+  UInt64 viewRem = 0;
+  const Byte *view = GetStreamView(inStream, viewRem);
+  const UInt64 viewSize = viewRem;
 
-  zIn.src = _srcBuf;
-  zIn.size = srcBufLen;
-  zIn.pos = 0;
+  /* the data before the read error is decoded and written,
+     and then the error is returned */
+  HRESULT readRes = S_OK;
+
+  if (prefixSize) {
+    zIn.src = prefix;
+    zIn.size = prefixSize;
+    zIn.pos = 0;
+  } else {
+    /* read first input block */
+    readRes = ReadInput(inStream, _srcBuf, _srcBufSize, view, viewRem, zIn);
+    _processedIn += zIn.size;
+  }
 
   /* Main decompression Loop */
   for (;;) {
@@ -103,22 +295,8 @@ HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
       zOut.pos = 0;
 
       result = ZSTD_decompressStream(_ctx, &zOut, &zIn);
-      if (ZSTD_isError(result)) {
-        switch (ZSTD_getErrorCode(result)) {
-          /* @Igor: would be nice, if we have an API to store the errmsg */
-          case ZSTD_error_memory_allocation:
-            return E_OUTOFMEMORY;
-          case ZSTD_error_frameParameter_unsupported:
-          case ZSTD_error_parameter_unsupported:
-          case ZSTD_error_version_unsupported:
-            return E_NOTIMPL;
-          case ZSTD_error_frameParameter_windowTooLarge:
-          case ZSTD_error_parameter_outOfBound:
-            return E_INVALIDARG;
-          default:
-            return E_FAIL;
-        }
-      }
+      if (ZSTD_isError(result))
+        return ErrorOut(result);
 
       /* write decompressed result */
       if (zOut.pos) {
@@ -150,17 +328,430 @@ HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
     } /* for() decompress */
 
     /* read next input */
-    srcBufLen = _srcBufSize;
-    RINOK(ReadStream(inStream, _srcBuf, &srcBufLen));
-    _processedIn += srcBufLen;
+    RINOK(readRes);
+    readRes = ReadInput(inStream, _srcBuf, _srcBufSize, view, viewRem, zIn);
+    _processedIn += zIn.size;
 
     /* finished */
-    if (srcBufLen == 0)
+    if (zIn.size == 0) {
+      RINOK(readRes);
+      return view ? SkipStreamView(inStream, viewSize) : S_OK;
+    }
+  }
+}
+
+#ifndef _7ZIP_ST
+
+/**
+ * multi threaded decoding of multi-frame streams
+ *
+ * - the calling thread scans the input for frame boundaries (frame header
+ *   and block headers), without decompressing anything
+ * - each complete frame is handed to one of the workers, which have their
+ *   own ZSTD_DCtx
+ * - the calling thread writes the results in order, at most kMtSlotsPerThread
+ *   frames per worker are in flight
+ * - the slots and the size of frame for a slot are reduced to fit the memory
+ *   limit (SetMemLimit), the buffers are freed at the end of the stream
+ * - frames, which are too big for buffering or look corrupted, are decoded
+ *   on the calling thread by DecodeSerial(), so the result is always the
+ *   same as in single threaded mode
+ *
+ * A stream with only one frame (like the output of ZSTD_c_nbWorkers) has
+ * no independent parts and is decoded by DecodeSerial().
+ */
+
+static const unsigned kMtSlotsPerThread = 2;
+static const size_t kMtInSizeMax = (size_t)1 << 26;
+static const size_t kMtOutSizeMax = (size_t)1 << 27;
+static const size_t kMtOutSizeMin = (size_t)1 << 20;
+
+enum
+{
+  kFrame_Ok,
+  kFrame_End,
+  kFrame_Serial
+};
+
+static bool Frame_Grow(Byte *&buf, size_t &alloc, size_t keep, size_t need)
+{
+  if (alloc >= need)
+    return true;
+  size_t newAlloc = alloc ? alloc : ((size_t)1 << 16);
+  while (newAlloc < need)
+    newAlloc <<= 1;
+  Byte *newBuf = (Byte *)MyAlloc(newAlloc);
+  if (!newBuf)
+    return false;
+  if (keep)
+    memcpy(newBuf, buf, keep);
+  MyFree(buf);
+  buf = newBuf;
+  alloc = newAlloc;
+  return true;
+}
+
+/* appends up to (size) bytes to f.In, returns false on eof */
+static HRESULT Frame_Read(ISequentialInStream *inStream, CMtFrame &f, size_t size, bool &full)
+{
+  full = false;
+  if (!Frame_Grow(f.In, f.InAlloc, f.InSize, f.InSize + size))
+    return E_OUTOFMEMORY;
+  size_t processed = size;
+  HRESULT res = ReadStream(inStream, f.In + f.InSize, &processed);
+  f.InSize += processed;
+  full = (processed == size);
+  return res;
+}
+
+/**
+ * reads the next zstd frame into f.In
+ * - skippable frames (as written by zstdmt or pzstd) are skipped
+ * - status is kFrame_Serial, if the stream must be continued with
+ *   DecodeSerial() from f.In
+ */
+HRESULT CDecoder::ReadFrame(ISequentialInStream *inStream, CMtFrame &f, int &status)
+{
+  bool full;
+  for (;;) {
+    f.InSize = 0;
+    RINOK(Frame_Read(inStream, f, 4, full));
+    _processedIn += f.InSize;
+    if (f.InSize == 0) {
+      status = kFrame_End;
+      return S_OK;
+    }
+    if (!full) {
+      status = kFrame_Serial;
       return S_OK;
+    }
 
-    zIn.size = srcBufLen;
-    zIn.pos = 0;
+    const UInt32 magic = GetUi32(f.In);
+    if ((magic & ZSTD_MAGIC_SKIPPABLE_MASK) != ZSTD_MAGIC_SKIPPABLE_START)
+      break;
+
+    RINOK(Frame_Read(inStream, f, 4, full));
+    _processedIn += f.InSize - 4;
+    if (!full) {
+      status = kFrame_End;
+      return S_OK;
+    }
+
+    UInt32 rem = GetUi32(f.In + 4);
+    while (rem) {
+      size_t cur = _srcBufSize;
+      if (cur > rem)
+        cur = rem;
+      size_t processed = cur;
+      RINOK(ReadStream(inStream, _srcBuf, &processed));
+      _processedIn += processed;
+      if (processed != cur) {
+        status = kFrame_End;
+        return S_OK;
+      }
+      rem -= (UInt32)cur;
+    }
+  }
+
+  status = kFrame_Serial;
+  if (GetUi32(f.In) != ZSTD_MAGICNUMBER)
+    return S_OK;
+
+  /* frame header */
+  size_t pos = f.InSize;
+  RINOK(Frame_Read(inStream, f, ZSTD_FRAMEHEADERSIZE_PREFIX(ZSTD_f_zstd1) - pos, full));
+  _processedIn += f.InSize - pos;
+  if (!full)
+    return S_OK;
+
+  size_t headerSize = ZSTD_frameHeaderSize(f.In, f.InSize);
+  if (ZSTD_isError(headerSize))
+    return S_OK;
+  pos = f.InSize;
+  RINOK(Frame_Read(inStream, f, headerSize - pos, full));
+  _processedIn += f.InSize - pos;
+  if (!full)
+    return S_OK;
+
+  ZSTD_frameHeader zfh;
+  if (ZSTD_getFrameHeader(&zfh, f.In, f.InSize) != 0)
+    return S_OK;
+  if (zfh.frameContentSize != ZSTD_CONTENTSIZE_UNKNOWN
+      && zfh.frameContentSize > _mtOutSizeMax)
+    return S_OK;
+  f.ContentSize = zfh.frameContentSize;
+
+  /* blocks */
+  for (;;) {
+    pos = f.InSize;
+    RINOK(Frame_Read(inStream, f, 3, full));
+    _processedIn += f.InSize - pos;
+    if (!full)
+      return S_OK;
+
+    const UInt32 bh = GetUi16(f.In + pos) | ((UInt32)f.In[pos + 2] << 16);
+    const unsigned blockType = (bh >> 1) & 3;
+    size_t blockSize = bh >> 3;
+    if (blockType == 1)
+      blockSize = 1;
+    else if (blockType == 3 || blockSize > ZSTD_BLOCKSIZE_MAX)
+      return S_OK;
+    if (f.InSize + blockSize > _mtInSizeMax)
+      return S_OK;
+
+    pos = f.InSize;
+    RINOK(Frame_Read(inStream, f, blockSize, full));
+    _processedIn += f.InSize - pos;
+    if (!full)
+      return S_OK;
+
+    if (bh & 1)
+      break;
+  }
+
+  /* checksum */
+  if (zfh.checksumFlag) {
+    pos = f.InSize;
+    RINOK(Frame_Read(inStream, f, 4, full));
+    _processedIn += f.InSize - pos;
+    if (!full)
+      return S_OK;
+  }
+
+  status = kFrame_Ok;
+  return S_OK;
+}
+
+static HRESULT DecodeFrame(ZSTD_DCtx *ctx, const ZSTD_DDict *ddict, CMtFrame &f, size_t outSizeMax)
+{
+  ZSTD_inBuffer zIn;
+  ZSTD_outBuffer zOut;
+
+  size_t outSize;
+  if (f.ContentSize != ZSTD_CONTENTSIZE_UNKNOWN)
+    outSize = (size_t)f.ContentSize;
+  else
+    outSize = f.InSize * 4;
+  if (outSize == 0)
+    outSize = 1;
+  if (outSize > outSizeMax)
+    outSize = outSizeMax;
+  if (!Frame_Grow(f.Out, f.OutAlloc, 0, outSize))
+    return S_FALSE;
+
+  ZSTD_DCtx_reset(ctx, ZSTD_reset_session_only);
+  if (ZSTD_isError(ZSTD_DCtx_refDDict(ctx, ddict)))
+    return S_FALSE;
+  zIn.src = f.In;
+  zIn.size = f.InSize;
+  zIn.pos = 0;
+  zOut.dst = f.Out;
+  zOut.size = f.OutAlloc;
+  zOut.pos = 0;
+
+  for (;;) {
+    size_t result = ZSTD_decompressStream(ctx, &zOut, &zIn);
+    if (ZSTD_isError(result))
+      return S_FALSE;
+    if (result == 0)
+      break;
+    if (zOut.pos != zOut.size) {
+      /* incomplete frame */
+      if (zIn.pos == zIn.size)
+        return S_FALSE;
+      continue;
+    }
+    if (f.OutAlloc >= outSizeMax)
+      return S_FALSE;
+    if (!Frame_Grow(f.Out, f.OutAlloc, zOut.pos, f.OutAlloc + 1))
+      return S_FALSE;
+    zOut.dst = f.Out;
+    zOut.size = f.OutAlloc;
+  }
+
+  /* the serial decoder would continue with the next frame */
+  if (zIn.pos != zIn.size)
+    return S_FALSE;
+
+  f.OutSize = zOut.pos;
+  return S_OK;
+}
+
+void CDecoder::WorkerThread(CMtWorker &w)
+{
+  const unsigned numSlots = _mtFrames.Size();
+  for (;;) {
+    _mtWorkSem.Lock();
+    if (_mtExit)
+      return;
+    unsigned index;
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_mtCs);
+      index = (unsigned)(_mtNextDecode++ % numSlots);
+    }
+    CMtFrame &f = _mtFrames[index];
+    f.Res = DecodeFrame(w.Ctx, _ddict, f, _mtOutSizeMax);
+    f.Done.Set();
+  }
+}
+
+static THREAD_FUNC_DECL MtWorkerThread(void *p)
+{
+  CMtWorker *w = (CMtWorker *)p;
+  w->Decoder->WorkerThread(*w);
+  return 0;
+}
+
+HRESULT CDecoder::WriteFrame(CMtFrame &f, ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  if (f.Res != S_OK)
+    return DecodeSerial(NULL, outStream, progress, f.In, f.InSize);
+
+  if (f.OutSize) {
+    RINOK(WriteStream(outStream, f.Out, f.OutSize));
+    _processedOut += f.OutSize;
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&_processedIn, &_processedOut));
+    }
+  }
+  return S_OK;
+}
+
+HRESULT CDecoder::CodeMt(ISequentialInStream * inStream,
+  ISequentialOutStream * outStream, ICompressProgressInfo * progress)
+{
+  /* the frames that don't fit to the slot are decoded by DecodeSerial(),
+     so we reduce the size of slot first, and then the number of slots */
+  unsigned numThreads = _numThreads;
+  unsigned numSlots = numThreads * kMtSlotsPerThread;
+  size_t inSizeMax = kMtInSizeMax;
+  size_t outSizeMax = kMtOutSizeMax;
+  while ((UInt64)numSlots * (inSizeMax + outSizeMax) > _memUsage) {
+    if (outSizeMax > kMtOutSizeMin) {
+      inSizeMax >>= 1;
+      outSizeMax >>= 1;
+    }
+    else if (numSlots > 2)
+      numSlots--;
+    else
+      break;
+  }
+  if ((UInt64)numSlots * (inSizeMax + outSizeMax) > _memUsage)
+    return DecodeSerial(inStream, outStream, progress, NULL, 0);
+  if (numThreads > numSlots)
+    numThreads = numSlots;
+  _mtInSizeMax = inSizeMax;
+  _mtOutSizeMax = outSizeMax;
+
+  RINOK(CreateContext());
+
+  while (_mtWorkers.Size() < numThreads) {
+    CMtWorker &w = _mtWorkers.AddNew();
+    w.Decoder = this;
+    w.Ctx = AllocDCtx();
+    if (!w.Ctx)
+      return E_OUTOFMEMORY;
+  }
+  if (_mtFrames.Size() != numSlots) {
+    _mtFrames.Clear();
+    for (unsigned i = 0; i < numSlots; i++)
+      _mtFrames.AddNew();
+  }
+  for (unsigned i = 0; i < numSlots; i++) {
+    WRes wres = _mtFrames[i].Done.CreateIfNotCreated_Reset();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
   }
+  {
+    WRes wres = _mtWorkSem.OptCreateInit(0, numSlots + numThreads);
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+
+  _mtNextDecode = 0;
+  _mtExit = false;
+
+  HRESULT res = S_OK;
+  unsigned numCreated;
+  for (numCreated = 0; numCreated < numThreads; numCreated++) {
+    WRes wres = _mtWorkers[numCreated].Thread.Create_Numa(MtWorkerThread, &_mtWorkers[numCreated], numCreated);
+    if (wres != 0) {
+      res = HRESULT_FROM_WIN32(wres);
+      break;
+    }
+  }
+
+  UInt64 numRead = 0;
+  UInt64 numWritten = 0;
+  CMtFrame *tail = NULL;
+  HRESULT readRes = S_OK;
+
+  while (res == S_OK && numCreated != 0) {
+    /* bounded queue: write the oldest frame, before its slot is reused */
+    if (numRead - numWritten == numSlots) {
+      CMtFrame &f = _mtFrames[(unsigned)(numWritten++ % numSlots)];
+      f.Done.Lock();
+      res = WriteFrame(f, outStream, progress);
+      if (res != S_OK)
+        break;
+    }
+
+    CMtFrame &f = _mtFrames[(unsigned)(numRead % numSlots)];
+    int status;
+    res = ReadFrame(inStream, f, status);
+    if (res != S_OK) {
+      /* the data before the read error is written, as in DecodeSerial() */
+      readRes = res;
+      res = S_OK;
+      tail = &f;
+      break;
+    }
+    if (status == kFrame_End)
+      break;
+    if (status == kFrame_Serial) {
+      tail = &f;
+      break;
+    }
+
+    numRead++;
+    _mtWorkSem.Release();
+  }
+
+  /* drain */
+  while (numWritten < numRead) {
+    CMtFrame &f = _mtFrames[(unsigned)(numWritten++ % numSlots)];
+    f.Done.Lock();
+    if (res == S_OK)
+      res = WriteFrame(f, outStream, progress);
+  }
+
+  _mtExit = true;
+  if (numCreated != 0)
+    _mtWorkSem.Release(numCreated);
+  for (unsigned i = 0; i < numCreated; i++)
+    _mtWorkers[i].Thread.Wait_Close();
+
+  if (res == S_OK && tail)
+    res = DecodeSerial(readRes == S_OK ? inStream : NULL, outStream, progress, tail->In, tail->InSize);
+  if (res == S_OK)
+    res = readRes;
+
+  for (unsigned i = 0; i < numSlots; i++)
+    _mtFrames[i].Free();
+  return res;
+}
+
+#endif
+
+HRESULT CDecoder::CodeSpec(ISequentialInStream * inStream,
+  ISequentialOutStream * outStream, ICompressProgressInfo * progress)
+{
+#ifndef _7ZIP_ST
+  if (_numThreads > 1)
+    return CodeMt(inStream, outStream, progress);
+#endif
+  return DecodeSerial(inStream, outStream, progress, NULL, 0);
 }
 
 STDMETHODIMP CDecoder::Code(ISequentialInStream * inStream, ISequentialOutStream * outStream,
@@ -184,8 +775,18 @@ STDMETHODIMP CDecoder::ReleaseInStream()
 }
 #endif
 
-STDMETHODIMP CDecoder::SetNumberOfThreads(UInt32 /* numThreads */)
+STDMETHODIMP CDecoder::SetNumberOfThreads(UInt32 numThreads)
+{
+  const UInt32 kNumThreadsMax = ZSTD_THREAD_MAX;
+  if (numThreads < 1) numThreads = 1;
+  if (numThreads > kNumThreadsMax) numThreads = kNumThreadsMax;
+  _numThreads = numThreads;
+  return S_OK;
+}
+
+STDMETHODIMP CDecoder::SetMemLimit(UInt64 memUsage)
 {
+  _memUsage = memUsage;
   return S_OK;
 }
 
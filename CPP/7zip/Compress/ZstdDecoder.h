@@ -6,8 +6,14 @@
 #include "../../../C/zstd/zstd_errors.h"
 
 #include "../../Windows/System.h"
+#ifndef _7ZIP_ST
+#include "../../Windows/Synchronization.h"
+#include "../../Windows/Thread.h"
+#endif
 #include "../../Common/Common.h"
+#include "../../Common/MyBuffer.h"
 #include "../../Common/MyCom.h"
+#include "../../Common/MyVector.h"
 #include "../ICoder.h"
 #include "../Common/StreamUtils.h"
 #include "../Common/RegisterCodec.h"
@@ -28,9 +34,29 @@
 #define ZSTD_LEVEL_MAX     22
 #define ZSTD_THREAD_MAX   256
 
+/**
+ * seekable zstd format, see zstd/contrib/seekable_format:
+ * independent frames, followed by a skippable frame with the seek table
+ * - entry: compressed size (4), decompressed size (4), [checksum (4)]
+ * - footer: number of frames (4), descriptor (1), magic (4)
+ */
+#define ZSTD_SEEKABLE_SKIPPABLE        0x184D2A5E
+#define ZSTD_SEEKABLE_MAGICNUMBER      0x8F92EAB1
+#define ZSTD_SEEKABLE_FOOTERSIZE       9
+#define ZSTD_SEEKABLE_CHECKSUMFLAG     0x80
+#define ZSTD_SEEKABLE_MAXFRAMES        0x8000000U
+#define ZSTD_SEEKABLE_MAXFRAMESIZE     0x40000000U
+
 namespace NCompress {
 namespace NZSTD {
 
+/* the allocator for zstd contexts: the Alloc layer (statistics, pool, large pages) */
+ZSTD_customMem GetCustomMem();
+
+/* the decoding contexts from the cache of released contexts */
+ZSTD_DCtx *AllocDCtx();
+void ReleaseDCtx(ZSTD_DCtx *ctx);
+
 struct DProps
 {
   DProps() { clear (); }
@@ -48,15 +74,60 @@ struct DProps
   Byte _reserved[2];
 };
 
+#ifndef _7ZIP_ST
+
+/* one independent zstd frame, decoded by a worker thread */
+struct CMtFrame
+{
+  Byte  *In;
+  size_t InSize;
+  size_t InAlloc;
+  Byte  *Out;
+  size_t OutSize;
+  size_t OutAlloc;
+  UInt64 ContentSize;
+
+  /* S_OK: Out is valid, S_FALSE: must be decoded on the main thread */
+  HRESULT Res;
+  NWindows::NSynchronization::CAutoResetEvent Done;
+
+  CMtFrame(): In(NULL), InSize(0), InAlloc(0), Out(NULL), OutSize(0), OutAlloc(0) {}
+  ~CMtFrame() { Free(); }
+  void Free()
+  {
+    MyFree(In); In = NULL; InSize = 0; InAlloc = 0;
+    MyFree(Out); Out = NULL; OutSize = 0; OutAlloc = 0;
+  }
+};
+
+class CDecoder;
+
+struct CMtWorker
+{
+  CDecoder *Decoder;
+  ZSTD_DCtx *Ctx;
+  NWindows::CThread Thread;
+
+  CMtWorker(): Decoder(NULL), Ctx(NULL) {}
+  ~CMtWorker();
+};
+
+#endif
+
 class CDecoder:public ICompressCoder,
   public ICompressSetDecoderProperties2,
   public ICompressSetCoderMt,
+  public ICompressSetMemLimit,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CMyComPtr < ISequentialInStream > _inStream;
   DProps _props;
 
   ZSTD_DCtx* _ctx;
+  ZSTD_DDict* _ddict;
+  CByteBuffer _dict;
+  bool _ddictChanged;
   void*  _srcBuf;
   void*  _dstBuf;
   size_t _srcBufSize;
@@ -64,6 +135,30 @@ class CDecoder:public ICompressCoder,
 
   UInt64 _processedIn;
   UInt64 _processedOut;
+  UInt32 _numThreads;
+  UInt64 _memUsage;
+
+  HRESULT CreateContext();
+  HRESULT DecodeSerial(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      ICompressProgressInfo *progress, const Byte *prefix, size_t prefixSize);
+
+#ifndef _7ZIP_ST
+  CObjectVector<CMtWorker> _mtWorkers;
+  CObjectVector<CMtFrame> _mtFrames;
+  NWindows::NSynchronization::CSemaphore _mtWorkSem;
+  NWindows::NSynchronization::CCriticalSection _mtCs;
+  UInt64 _mtNextDecode;
+  size_t _mtInSizeMax;
+  size_t _mtOutSizeMax;
+  bool _mtExit;
+
+  HRESULT ReadFrame(ISequentialInStream *inStream, CMtFrame &f, int &status);
+  HRESULT WriteFrame(CMtFrame &f, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+  HRESULT CodeMt(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+public:
+  void WorkerThread(CMtWorker &w);
+private:
+#endif
 
   HRESULT CodeSpec(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
   HRESULT SetOutStreamSizeResume(const UInt64 *outSize);
@@ -75,13 +170,17 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
 #endif
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
+  MY_QUERYINTERFACE_ENTRY(ICompressSetMemLimit)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
 
   MY_ADDREF_RELEASE
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetDecoderProperties2)(const Byte *data, UInt32 size);
   STDMETHOD (SetOutStreamSize)(const UInt64 *outSize);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
+  STDMETHOD (SetMemLimit)(UInt64 memUsage);
 
 #ifndef NO_READ_FROM_CODER
   STDMETHOD (SetInStream)(ISequentialInStream *inStream);
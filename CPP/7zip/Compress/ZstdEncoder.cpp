@@ -1,6 +1,13 @@
 // (C) 2016 - 2020 Tino Reichardt
 
 #include "StdAfx.h"
+
+#include "../../../C/CpuArch.h"
+
+#include "../../Common/StringConvert.h"
+#include "../../Windows/FileIO.h"
+
+#include "CoderCtxCache.h"
 #include "ZstdEncoder.h"
 #include "ZstdDecoder.h"
 
@@ -8,6 +15,27 @@
 namespace NCompress {
 namespace NZSTD {
 
+static void FreeCCtx(ZSTD_CCtx *ctx) { ZSTD_freeCCtx(ctx); }
+
+/* the key is the number of workers, all other parameters are set again */
+static CCtxCache<ZSTD_CCtx> g_CCtxCache(FreeCCtx, 2);
+
+static HRESULT ReadDictFile(const wchar_t *path, CByteBuffer &dict)
+{
+  NWindows::NFile::NIO::CInFile file;
+  UInt64 size;
+  if (!file.Open(us2fs(path)) || !file.GetLength(size))
+    return E_INVALIDARG;
+  /* zstd dictionaries are small, 110 KiB by default */
+  if (size == 0 || size > ((UInt32)1 << 26))
+    return E_INVALIDARG;
+  dict.Alloc((size_t)size);
+  size_t processed;
+  if (!file.ReadFull(dict, (size_t)size, processed) || processed != size)
+    return E_INVALIDARG;
+  return S_OK;
+}
+
 CEncoder::CEncoder():
   _ctx(NULL),
   _srcBuf(NULL),
@@ -30,7 +58,8 @@ CEncoder::CEncoder():
   _LdmHashLog(-1),
   _LdmMinMatch(-1),
   _LdmBucketSizeLog(-1),
-  _LdmHashRateLog(-1)
+  _LdmHashRateLog(-1),
+  _FrameSize(0)
 {
   _props.clear();
 }
@@ -38,7 +67,13 @@ CEncoder::CEncoder():
 CEncoder::~CEncoder()
 {
   if (_ctx) {
-    ZSTD_freeCCtx(_ctx);
+    /* the dictionary and the parameters are dropped, the tables stay allocated */
+    int numWorkers = 0;
+    ZSTD_CCtx_getParameter(_ctx, ZSTD_c_nbWorkers, &numWorkers);
+    if (ZSTD_isError(ZSTD_CCtx_reset(_ctx, ZSTD_reset_session_and_parameters)))
+      ZSTD_freeCCtx(_ctx);
+    else
+      g_CCtxCache.Put((UInt32)numWorkers, _ctx, ZSTD_sizeof_CCtx(_ctx));
     MyFree(_srcBuf);
     MyFree(_dstBuf);
   }
@@ -47,6 +82,7 @@ CEncoder::~CEncoder()
 STDMETHODIMP CEncoder::SetCoderProperties(const PROPID * propIDs, const PROPVARIANT * coderProps, UInt32 numProps)
 {
   _props.clear();
+  _dict.Free();
 
   for (UInt32 i = 0; i < numProps; i++)
   {
@@ -192,6 +228,24 @@ STDMETHODIMP CEncoder::SetCoderProperties(const PROPID * propIDs, const PROPVARI
         _LdmBucketSizeLog = v;
         break;
       }
+    case NCoderPropID::kDictFile:
+      {
+        if (prop.vt != VT_BSTR)
+          return E_INVALIDARG;
+        RINOK(ReadDictFile(prop.bstrVal, _dict));
+        break;
+      }
+    case NCoderPropID::kBlockSize:
+      {
+        /* m0=zstd:c=1m -> seekable format with 1 MiB frames */
+        UInt64 v64 = v;
+        if (prop.vt == VT_UI8)
+          v64 = prop.uhVal.QuadPart;
+        if (v64 != 0 && v64 < (1 << 10)) v64 = (1 << 10);
+        if (v64 > ZSTD_SEEKABLE_MAXFRAMESIZE) v64 = ZSTD_SEEKABLE_MAXFRAMESIZE;
+        _FrameSize = (UInt32)v64;
+        break;
+      }
     case NCoderPropID::kLdmHashRateLog:
       {
         if (v < 0) v = 0; /* 0 => automatic mode */
@@ -211,32 +265,21 @@ STDMETHODIMP CEncoder::SetCoderProperties(const PROPID * propIDs, const PROPVARI
 
 STDMETHODIMP CEncoder::WriteCoderProperties(ISequentialOutStream * outStream)
 {
-  return WriteStream(outStream, &_props, sizeof (_props));
+  RINOK(WriteStream(outStream, &_props, sizeof (_props)));
+  if (_dict.Size() != 0)
+    return WriteStream(outStream, _dict, _dict.Size());
+  return S_OK;
 }
 
-STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
-  ISequentialOutStream *outStream, const UInt64 * /*inSize*/ ,
-  const UInt64 * /*outSize */, ICompressProgressInfo *progress)
+HRESULT CEncoder::CreateContext()
 {
-  ZSTD_EndDirective ZSTD_todo = ZSTD_e_continue;
-  ZSTD_outBuffer outBuff;
-  ZSTD_inBuffer inBuff;
-  size_t err, srcSize;
-
-  _processedIn = 0;
-  _processedOut = 0;
+  size_t err;
 
   if (!_ctx) {
-    _ctx = ZSTD_createCCtx();
+    _ctx = g_CCtxCache.Get(_numThreads);
+    if (!_ctx)
+      _ctx = ZSTD_createCCtx_advanced(GetCustomMem());
     if (!_ctx)
-      return E_OUTOFMEMORY;
-
-    _srcBuf = MyAlloc(_srcBufSize);
-    if (!_srcBuf)
-      return E_OUTOFMEMORY;
-
-    _dstBuf = MyAlloc(_dstBufSize);
-    if (!_dstBuf)
       return E_OUTOFMEMORY;
 
     /* setup level */
@@ -320,36 +363,81 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
       err = ZSTD_CCtx_setParameter(_ctx, ZSTD_c_ldmHashRateLog, _LdmHashRateLog);
       if (ZSTD_isError(err)) return E_INVALIDARG;
     }
+
+    /* digested once, then used for all frames of this context */
+    if (_dict.Size() != 0) {
+      err = ZSTD_CCtx_loadDictionary(_ctx, _dict, _dict.Size());
+      if (ZSTD_isError(err)) return E_INVALIDARG;
+    }
+  }
+
+  return S_OK;
+}
+
+STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
+  ISequentialOutStream *outStream, const UInt64 * /*inSize*/ ,
+  const UInt64 * /*outSize */, ICompressProgressInfo *progress)
+{
+  ZSTD_EndDirective ZSTD_todo = ZSTD_e_continue;
+  ZSTD_outBuffer outBuff;
+  ZSTD_inBuffer inBuff;
+  size_t err, srcSize;
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  RINOK(CreateContext());
+
+  if (!_srcBuf) {
+    _srcBuf = MyAlloc(_srcBufSize);
+    if (!_srcBuf)
+      return E_OUTOFMEMORY;
   }
 
+  if (!_dstBuf) {
+    _dstBuf = MyAlloc(_dstBufSize);
+    if (!_dstBuf)
+      return E_OUTOFMEMORY;
+  }
+
+  UInt32 frameIn = 0;
+  UInt32 frameOut = 0;
+  _seekTable.Clear();
+
   for (;;) {
 
     /* read input */
     srcSize = _srcBufSize;
+    if (_FrameSize && srcSize > _FrameSize - frameIn)
+      srcSize = _FrameSize - frameIn;
     RINOK(ReadStream(inStream, _srcBuf, &srcSize));
 
     /* eof */
-    if (srcSize == 0)
+    if (srcSize == 0) {
+      ZSTD_todo = ZSTD_e_end;
+      /* seekable: the last frame is already finished */
+      if (frameIn == 0 && _seekTable.Size() != 0)
+        return WriteSeekTable(outStream);
+    } else if (_FrameSize && frameIn + srcSize == _FrameSize) {
+      /* seekable: end of the current frame */
       ZSTD_todo = ZSTD_e_end;
+    } else {
+      ZSTD_todo = ZSTD_e_continue;
+    }
 
     /* compress data */
     _processedIn += srcSize;
+    frameIn += (UInt32)srcSize;
+
+    inBuff.src = _srcBuf;
+    inBuff.size = srcSize;
+    inBuff.pos = 0;
 
     for (;;) {
       outBuff.dst = _dstBuf;
       outBuff.size = _dstBufSize;
       outBuff.pos = 0;
 
-      if (ZSTD_todo == ZSTD_e_continue) {
-        inBuff.src = _srcBuf;
-        inBuff.size = srcSize;
-        inBuff.pos = 0;
-      } else {
-        inBuff.src = 0;
-        inBuff.size = srcSize;
-        inBuff.pos = 0;
-      }
-
       err = ZSTD_compressStream2(_ctx, &outBuff, &inBuff, ZSTD_todo);
       if (ZSTD_isError(err)) {
         switch (ZSTD_getErrorCode(err)) {
@@ -372,22 +460,94 @@ STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream,
       if (outBuff.pos) {
         RINOK(WriteStream(outStream, _dstBuf, outBuff.pos));
         _processedOut += outBuff.pos;
+        frameOut += (UInt32)outBuff.pos;
       }
 
       if (progress)
         RINOK(progress->SetRatioInfo(&_processedIn, &_processedOut));
 
-      /* done */
-      if (ZSTD_todo == ZSTD_e_end && err == 0)
-        return S_OK;
+      /* frame done */
+      if (ZSTD_todo == ZSTD_e_end && err == 0) {
+        if (!_FrameSize)
+          return S_OK;
+        if (_seekTable.Size() / 2 == ZSTD_SEEKABLE_MAXFRAMES)
+          return E_INVALIDARG;
+        _seekTable.Add(frameOut);
+        _seekTable.Add(frameIn);
+        frameIn = 0;
+        frameOut = 0;
+        if (srcSize == 0)
+          return WriteSeekTable(outStream);
+        break;
+      }
 
       /* need more input */
-      if (inBuff.pos == inBuff.size)
+      if (ZSTD_todo == ZSTD_e_continue && inBuff.pos == inBuff.size)
         break;
     }
   }
 }
 
+STDMETHODIMP CEncoder::CodeBuf(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  /* the seek table is written by Code() only */
+  if (_FrameSize)
+    return E_NOTIMPL;
+
+  RINOK(CreateContext());
+
+  _processedIn = 0;
+  _processedOut = 0;
+
+  const size_t err = ZSTD_compress2(_ctx, dest, *destSize, src, srcSize);
+  if (ZSTD_isError(err)) {
+    *destSize = 0;
+    switch (ZSTD_getErrorCode(err)) {
+      case ZSTD_error_memory_allocation:
+        return E_OUTOFMEMORY;
+      case ZSTD_error_dstSize_tooSmall:
+        return S_FALSE;
+      case ZSTD_error_parameter_unsupported:
+      case ZSTD_error_parameter_outOfBound:
+        return E_INVALIDARG;
+      default:
+        return E_FAIL;
+    }
+  }
+
+  _processedIn = srcSize;
+  _processedOut = err;
+  *destSize = err;
+  return S_OK;
+}
+
+HRESULT CEncoder::WriteSeekTable(ISequentialOutStream *outStream)
+{
+  const UInt32 numFrames = _seekTable.Size() / 2;
+  const size_t tableSize = (size_t)numFrames * 8 + ZSTD_SEEKABLE_FOOTERSIZE;
+  const size_t size = 8 + tableSize;
+  Byte *buf = (Byte *)MyAlloc(size);
+  if (!buf)
+    return E_OUTOFMEMORY;
+
+  SetUi32(buf, ZSTD_SEEKABLE_SKIPPABLE);
+  SetUi32(buf + 4, (UInt32)tableSize);
+  Byte *p = buf + 8;
+  for (UInt32 i = 0; i < numFrames; i++, p += 8) {
+    SetUi32(p, _seekTable[i * 2]);
+    SetUi32(p + 4, _seekTable[i * 2 + 1]);
+  }
+  SetUi32(p, numFrames);
+  p[4] = 0; /* no checksums */
+  SetUi32(p + 5, ZSTD_SEEKABLE_MAGICNUMBER);
+
+  HRESULT res = WriteStream(outStream, buf, size);
+  MyFree(buf);
+  if (res == S_OK)
+    _processedOut += size;
+  return res;
+}
+
 STDMETHODIMP CEncoder::SetNumberOfThreads(UInt32 numThreads)
 {
   const UInt32 kNumThreadsMax = ZSTD_THREAD_MAX;
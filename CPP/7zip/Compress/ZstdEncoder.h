@@ -7,6 +7,8 @@
 
 #include "../../Common/Common.h"
 #include "../../Common/MyCom.h"
+#include "../../Common/MyBuffer.h"
+#include "../../Common/MyVector.h"
 #include "../ICoder.h"
 #include "../Common/StreamUtils.h"
 
@@ -36,6 +38,7 @@ class CEncoder:
   public ICompressSetCoderMt,
   public ICompressSetCoderProperties,
   public ICompressWriteCoderProperties,
+  public ICompressCodeBuf,
   public CMyUnknownImp
 {
   CProps _props;
@@ -66,15 +69,27 @@ class CEncoder:
   Int32 _LdmBucketSizeLog;
   Int32 _LdmHashRateLog;
 
+  /* trained dictionary, it's appended to the coder properties */
+  CByteBuffer _dict;
+
+  /* seekable format: size of the independent frames, 0 = one frame */
+  UInt32 _FrameSize;
+  CRecordVector<UInt32> _seekTable;
+
+  HRESULT CreateContext();
+  HRESULT WriteSeekTable(ISequentialOutStream *outStream);
+
 public:
   MY_QUERYINTERFACE_BEGIN2(ICompressCoder)
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderProperties)
   MY_QUERYINTERFACE_ENTRY(ICompressWriteCoderProperties)
+  MY_QUERYINTERFACE_ENTRY(ICompressCodeBuf)
   MY_QUERYINTERFACE_END
   MY_ADDREF_RELEASE
 
   STDMETHOD (Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream, const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD (CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize);
   STDMETHOD (SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
   STDMETHOD (WriteCoderProperties)(ISequentialOutStream *outStream);
   STDMETHOD (SetNumberOfThreads)(UInt32 numThreads);
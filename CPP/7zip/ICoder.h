@@ -149,6 +149,9 @@ namespace NCoderPropID
     kLdmSearchLength,   // VT_UI4 The minimum ldmslen is 4 and the maximum is 4096 (default: 64).
     kLdmBucketSizeLog,  // VT_UI4 The minimum ldmblog is 0 and the maximum is 8 (default: 3).
     kLdmHashRateLog,    // VT_UI4 The default value is wlog - ldmhlog.
+    kDictFile,          // VT_BSTR path of a trained dictionary (zstd --train), it's stored in the coder properties
+    kBlockPrimeSize,    // VT_UI4 : LZMA2 : size of previous data that is used as preset dictionary for each block
+    kStdStream,         // VT_BOOL : Brotli : one standard stream instead of skippable frames, the chunks are still compressed in parallel
     kEndOfProp
   };
 }
@@ -315,6 +318,23 @@ CODER_INTERFACE(ICompressSetInStreamSize2, 0x39)
 };
 */
 
+CODER_INTERFACE(ICompressCodeBuf, 0x3A)
+{
+  STDMETHOD(CodeBuf)(const Byte *src, size_t srcSize, Byte *dest, size_t *destSize) PURE;
+
+  /* Buffer-to-buffer version of ICompressCoder::Code() for callers that
+     already have all input data in memory.
+     The output format is the same as the format of Code() stream.
+       (*destSize) : on input  : the size of (dest) buffer
+                     on output : the number of bytes written to (dest)
+     returns:
+       S_OK      : (src) was coded completely.
+                   Decoder: (srcSize) must contain the whole stream.
+       S_FALSE   : data error, or (dest) buffer is too small
+       E_NOTIMPL : the current coder properties are not supported in that mode.
+                   The caller must use Code() instead. */
+};
+
 
 /*
   ICompressFilter
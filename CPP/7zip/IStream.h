@@ -140,4 +140,21 @@ STREAM_INTERFACE(IStreamGetProp, 0x0a)
   STDMETHOD(ReloadProps)() PURE;
 };
 
+
+/*
+IStreamGetView::GetView()
+  If the data of stream is in memory (memory buffer or mapped file),
+  it returns S_OK and the pointer to the data at current position of stream,
+  and (*size) is the size of data from current position to the end of stream.
+  Otherwise it returns S_FALSE and (*data = NULL).
+  The data is valid while the stream object exists.
+  The caller reads the data from (*data) instead of Read() calls,
+  and then it must call Seek() to move the position after processed data.
+*/
+
+STREAM_INTERFACE(IStreamGetView, 0x0b)
+{
+  STDMETHOD(GetView)(const Byte **data, UInt64 *size) PURE;
+};
+
 #endif
@@ -15,9 +15,7 @@
 
 #include <stdio.h>
 
-#ifdef _7ZIP_LARGE_PAGES
 #include "../../../../C/Alloc.h"
-#endif
 
 #include "../../../Common/IntToString.h"
 #include "../../../Common/ListFileUtils.h"
@@ -34,6 +32,8 @@
 #include "../../../Windows/Synchronization.h"
 #endif
 
+#include "../../Common/FileStreams.h"
+
 #include "ArchiveCommandLine.h"
 #include "EnumDirItems.h"
 #include "Update.h"
@@ -101,6 +101,7 @@ enum Enum
   kDisableHeaders,
   kDisablePercents,
   kShowTime,
+  kShowMemStat,
   kLogLevel,
 
   kOutStream,
@@ -140,6 +141,8 @@ enum Enum
   kStdOut,
 
   kLargePages,
+  kMemPool,
+  kFileMap,
   kListfileCharSet,
   kConsoleCharSet,
   kTechMode,
@@ -249,6 +252,7 @@ static const CSwitchForm kSwitchForms[] =
   { "ba", SWFRM_SIMPLE },
   { "bd", SWFRM_SIMPLE },
   { "bt", SWFRM_SIMPLE },
+  { "bm", SWFRM_SIMPLE },
   { "bb", SWFRM_STRING_SINGL(0) },
 
   { "bso", NSwitchType::kChar, false, 1, k_Stream_PostCharSet },
@@ -288,6 +292,8 @@ static const CSwitchForm kSwitchForms[] =
   { "so", SWFRM_SIMPLE },
 
   { "slp", SWFRM_STRING },
+  { "smp", SWFRM_STRING },
+  { "smm", SWFRM_SIMPLE },
   { "scs", SWFRM_STRING },
   { "scc", SWFRM_STRING },
   { "slt", SWFRM_SIMPLE },
@@ -1011,6 +1017,7 @@ void CArcCmdLineParser::Parse1(const UStringVector &commandStrings,
   }
   options.TechMode = parser[NKey::kTechMode].ThereIs;
   options.ShowTime = parser[NKey::kShowTime].ThereIs;
+  options.ShowMemStat = parser[NKey::kShowMemStat].ThereIs;
 
   if (parser[NKey::kDisablePercents].ThereIs
       || options.StdOutMode
@@ -1073,9 +1080,7 @@ void CArcCmdLineParser::Parse1(const UStringVector &commandStrings,
           #endif
         )
     {
-      #ifdef _WIN32 // change it !
       SetLargePageSize();
-      #endif
       // note: this process also can inherit that Privilege from parent process
       g_LargePagesMode =
       #if defined(_WIN32) && !defined(UNDER_CE)
@@ -1088,6 +1093,25 @@ void CArcCmdLineParser::Parse1(const UStringVector &commandStrings,
   }
 
 
+  {
+    unsigned flags = 0;
+    UInt64 poolSize = (UInt64)1 << 30;
+    if (options.ShowMemStat)
+      flags |= k_AllocLayer_Stat;
+    if (parser[NKey::kMemPool].ThereIs)
+    {
+      const UString &s = parser[NKey::kMemPool].PostStrings[0];
+      if (!s.IsEmpty() && !ParseComplexSize(s, poolSize))
+        throw CArcCmdLineException("Unsupported switch postfix for -smp", s);
+      if (poolSize != (size_t)poolSize)
+        poolSize = (size_t)0 - 1;
+      if (poolSize != 0)
+        flags |= k_AllocLayer_Pool;
+    }
+    if (flags != 0 && !AllocLayer_Set(flags, (size_t)poolSize))
+      throw CArcCmdLineException("The allocations were started before -bm or -smp switch was applied");
+  }
+
   #ifndef UNDER_CE
 
   if (parser[NKey::kAffinity].ThereIs)
@@ -1330,6 +1354,14 @@ void CArcCmdLineParser::Parse2(CArcCmdLineOptions &options)
   if ((isExtractOrList || isRename) && options.StdInMode)
     thereIsArchiveName = false;
 
+  if (parser[NKey::kFileMap].ThereIs)
+  {
+    // the archive of update commands can be changed, so it's not mapped
+    if (!isExtractOrList)
+      throw CArcCmdLineException("-smm switch is supported only for e, x, t, l commands");
+    g_FileMapMode = true;
+  }
+
   if (parser[NKey::kArcNameMode].ThereIs)
     options.UpdateOptions.ArcNameMode = ParseArcNameMode(parser[NKey::kArcNameMode].PostCharIndex);
 
@@ -1647,6 +1679,25 @@ void CArcCmdLineParser::Parse2(CArcCmdLineOptions &options)
     hashOptions.StdInMode = options.StdInMode;
     hashOptions.AltStreamsMode = options.AltStreams.Val;
     hashOptions.SymLinks = options.SymLinks;
+    
+    #ifndef _7ZIP_ST
+    FOR_VECTOR (i, options.Properties)
+    {
+      const CProperty &prop = options.Properties[i];
+      // -mmt, -mmtN, -mmt=N. Another -m switches (-mtc, ...) are not used for hashing
+      if (!prop.Name.IsPrefixedBy_Ascii_NoCase("mt")
+          || (prop.Name.Len() > 2 && (prop.Name[2] < '0' || prop.Name[2] > '9')))
+        continue;
+      NCOM::CPropVariant propVariant;
+      if (!prop.Value.IsEmpty())
+        propVariant = prop.Value;
+      UInt32 numThreads = hashOptions.NumThreads;
+      bool forced;
+      if (ParseMtProp2(prop.Name.Ptr(2), propVariant, numThreads, forced) != S_OK)
+        throw CArcCmdLineException("Unsupported switch postfix -m", prop.Name);
+      hashOptions.NumThreads = numThreads;
+    }
+    #endif
   }
   else if (options.Command.CommandType == NCommandType::kInfo)
   {
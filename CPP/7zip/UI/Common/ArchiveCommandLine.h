@@ -65,6 +65,7 @@ struct CArcCmdLineOptions
   bool ShowDialog;
   bool TechMode;
   bool ShowTime;
+  bool ShowMemStat;
 
   AString ListFields;
 
@@ -136,6 +137,7 @@ struct CArcCmdLineOptions
       ShowDialog(false),
       TechMode(false),
       ShowTime(false),
+      ShowMemStat(false),
 
       ConsoleCodePage(-1),
 
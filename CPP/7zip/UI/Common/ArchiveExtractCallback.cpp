@@ -270,6 +270,9 @@ CArchiveExtractCallback::CArchiveExtractCallback():
     Write_CTime(true),
     Write_ATime(true),
     Write_MTime(true),
+    #ifndef _7ZIP_ST
+    _asyncOutFileStreamSpec(NULL),
+    #endif
     _multiArchives(false)
 {
   LocalProgressSpec = new CLocalProgress();
@@ -1411,7 +1414,17 @@ HRESULT CArchiveExtractCallback::GetExtractStream(CMyComPtr<ISequentialOutStream
 
   // ---------- CREATE WRITE FILE -----
 
-  _outFileStreamSpec = new COutFileStream;
+  #ifndef _7ZIP_ST
+  // large files are written in another thread, while the decoder works
+  _asyncOutFileStreamSpec = NULL;
+  if (!_isSplit && _curSizeDefined && _curSize >= k_AsyncFileStream_MinFileSize)
+  {
+    _asyncOutFileStreamSpec = new CAsyncOutFileStream;
+    _outFileStreamSpec = _asyncOutFileStreamSpec;
+  }
+  else
+  #endif
+    _outFileStreamSpec = new COutFileStream;
   CMyComPtr<ISequentialOutStream> outFileStream_Loc(_outFileStreamSpec);
   
   if (!_outFileStreamSpec->Open(fullProcessedPath, _isSplit ? OPEN_ALWAYS: CREATE_ALWAYS))
@@ -1873,6 +1886,13 @@ HRESULT CArchiveExtractCallback::CloseFile()
     return S_OK;
   
   HRESULT hres = S_OK;
+
+  #ifndef _7ZIP_ST
+  if (_asyncOutFileStreamSpec)
+  {
+    RINOK(_asyncOutFileStreamSpec->FlushBufs());
+  }
+  #endif
   
   const UInt64 processedSize = _outFileStreamSpec->ProcessedSize;
   if (_fileLengthWasSet && _fileLength_that_WasSet > processedSize)
@@ -10,6 +10,9 @@
 #include "../../IPassword.h"
 
 #include "../../Common/FileStreams.h"
+#ifndef _7ZIP_ST
+#include "../../Common/AsyncFileStreams.h"
+#endif
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamObjects.h"
 
@@ -354,6 +357,9 @@ class CArchiveExtractCallback:
 
   COutFileStream *_outFileStreamSpec;
   CMyComPtr<ISequentialOutStream> _outFileStream;
+  #ifndef _7ZIP_ST
+  CAsyncOutFileStream *_asyncOutFileStreamSpec; // it's (_outFileStreamSpec) for large files
+  #endif
 
   CByteBuffer _outMemBuf;
   CBufPtrSeqOutStream *_bufPtrSeqOutStream_Spec;
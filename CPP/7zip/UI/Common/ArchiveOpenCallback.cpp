@@ -136,6 +136,7 @@ STDMETHODIMP COpenCallbackImp::GetStream(const wchar_t *name, IInStream **inStre
   {
     return GetLastError_noZero_HRESULT();
   }
+  inFile->MapFile();
 
   FileSizes.Add(_fileInfo.Size);
   FileNames.Add(name2);
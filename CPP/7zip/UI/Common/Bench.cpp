@@ -43,12 +43,14 @@
 
 #include "../../../Windows/FileIO.h"
 #include "../../../Windows/FileFind.h"
+#include "../../../Windows/FileName.h"
 #include "../../../Windows/SystemInfo.h"
 
 #include "../../../Common/IntToString.h"
 #include "../../../Common/MyBuffer2.h"
 #include "../../../Common/StringConvert.h"
 #include "../../../Common/StringToInt.h"
+#include "../../../Common/UTFConvert.h"
 
 #include "../../Common/MethodProps.h"
 #include "../../Common/StreamObjects.h"
@@ -1062,6 +1064,7 @@ public:
   CBenchRandomGenerator rg;
 
   CMidAlignedBuffer rgCopy; // it must be 16-byte aligned !!!
+  CMidAlignedBuffer decodeBufs[2]; // output of ICompressCodeBuf decoders
   
   // CBenchmarkOutStream *propStreamSpec;
   Byte propsData[kMaxMethodPropSize];
@@ -1378,6 +1381,11 @@ HRESULT CEncoderInfo::Encode()
     RINOK(Set_Key_and_IV(cp));
   }
 
+  // the buffer coders are used without stream objects, if they support current properties
+  CMyComPtr<ICompressCodeBuf> codeBuf;
+  if (!_encoderFilter)
+    _encoder.QueryInterface(IID_ICompressCodeBuf, &codeBuf);
+
   compressedSize = 0;
   if (_encoderFilter)
     compressedSize = kBufferSize;
@@ -1424,10 +1432,29 @@ HRESULT CEncoderInfo::Encode()
     else
     {
       outStreamSpec->Init(true, calcCrc); // write real data for speed consistency at any number of iterations
-      inStreamSpec->Init(uncompressedDataPtr, kBufferSize);
-      RINOK(_encoder->Code(inStream, outStream, NULL, NULL, progressInfo[0]));
-      if (!inStreamSpec->WasFinished())
-        return E_FAIL;
+      HRESULT res = E_NOTIMPL;
+      if (codeBuf)
+      {
+        size_t size = outStreamSpec->Size();
+        res = codeBuf->CodeBuf(uncompressedDataPtr, kBufferSize, (Byte *)*outStreamSpec, &size);
+        if (res == S_OK)
+        {
+          outStreamSpec->Pos = size;
+          if (calcCrc)
+            outStreamSpec->Calc((const Byte *)*outStreamSpec, size);
+        }
+        else if (res == E_NOTIMPL)
+          codeBuf.Release();
+        else
+          return (res == S_FALSE ? E_FAIL : res);
+      }
+      if (res == E_NOTIMPL)
+      {
+        inStreamSpec->Init(uncompressedDataPtr, kBufferSize);
+        RINOK(_encoder->Code(inStream, outStream, NULL, NULL, progressInfo[0]));
+        if (!inStreamSpec->WasFinished())
+          return E_FAIL;
+      }
       if (compressedSize != outStreamSpec->Pos)
       {
         if (compressedSize != 0)
@@ -1559,6 +1586,16 @@ HRESULT CEncoderInfo::Decode(UInt32 decoderIndex)
     decoder->QueryInterface(IID_ICompressSetFinishMode, (void **)&setFinishMode);
   }
 
+  CMyComPtr<ICompressCodeBuf> codeBuf;
+  if (!_decoderFilter)
+  {
+    decoder.QueryInterface(IID_ICompressCodeBuf, &codeBuf);
+    if (codeBuf)
+    {
+      ALLOC_WITH_HRESULT(&decodeBufs[decoderIndex], kBufferSize);
+    }
+  }
+
   const UInt64 numIterations = this->NumIterations;
   const UInt32 mask = (CheckCrc_Dec ? 0 : 0xFFF);
 
@@ -1596,12 +1633,35 @@ HRESULT CEncoderInfo::Decode(UInt32 decoderIndex)
         RINOK(setFinishMode->SetFinishMode(BoolToUInt(true)));
       }
 
-      RINOK(decoder->Code(inStream, crcOutStream, 0, &outSize, progressInfo[decoderIndex]));
+      HRESULT res = E_NOTIMPL;
+      if (codeBuf)
+      {
+        Byte *dest = (Byte *)decodeBufs[decoderIndex];
+        size_t size = kBufferSize;
+        res = codeBuf->CodeBuf((const Byte *)*outStreamSpec, compressedSize, dest, &size);
+        if (res == S_OK)
+        {
+          crcOutStreamSpec->Pos = size;
+          if (calcCrc)
+            crcOutStreamSpec->Calc(dest, size);
+        }
+        else if (res == E_NOTIMPL)
+        {
+          codeBuf.Release();
+          decodeBufs[decoderIndex].Free();
+        }
+        else
+          return res;
+      }
+      if (res == E_NOTIMPL)
+      {
+        RINOK(decoder->Code(inStream, crcOutStream, 0, &outSize, progressInfo[decoderIndex]));
+        if (setFinishMode && !inStreamSpec->WasFinished())
+          return S_FALSE;
+      }
 
       if (setFinishMode)
       {
-        if (!inStreamSpec->WasFinished())
-          return S_FALSE;
 
         CMyComPtr<ICompressGetInStreamProcessedSize> getInStreamProcessedSize;
         decoder.QueryInterface(IID_ICompressGetInStreamProcessedSize, (void **)&getInStreamProcessedSize);
@@ -2548,6 +2608,10 @@ static const CBenchMethod g_Bench[] =
   { 80, 24, 1220,  145,   20, "LZMA:x5:mt1" },
   { 80, 24, 1220,  145,   20, "LZMA:x5:mt2" },
 
+  // the same blocks without and with preset dictionary from previous block
+  { 10, 24, 1220,  145,   20, "LZMA2:x5:mt4:c2m" },
+  { 10, 24, 1220,  145,   20, "LZMA2:x5:mt4:c2m:prime2m" },
+
   { 10, 16,  124,   40,   14, "Deflate:x1" },
   { 20, 16,  376,   40,   14, "Deflate:x5" },
   { 10, 16, 1082,   40,   14, "Deflate:x7" },
@@ -2572,6 +2636,15 @@ static const CBenchMethod g_Bench[] =
 
   {  2,  0,    4,    0,    4, "BCJ" },
 
+  /* the methods of this fork. (Weight == 0), so they don't change the total rating.
+     The complexity values are approximate */
+  {  0, 22,   50,    8,    4, "ZSTD:x3" },
+  {  0, 22,  600,   20,    6, "BROTLI:x5" },
+  {  0, 22,   20,    4,    2, "LZ4:x1" },
+  {  0, 22,   60,    6,    3, "LZ5:x3" },
+  {  0, 22,   60,    6,    3, "LIZARD:x17" },
+  {  0, 24, 1000,  145,   20, "FLZMA2:x5" },
+
   // { 10,  0,   18,    0,   18, "AES128CBC:1" },
   // { 10,  0,   21,    0,   21, "AES192CBC:1" },
   { 10,  0,   24,    0,   24, "AES256CBC:1" },
@@ -2622,7 +2695,8 @@ static const CBenchHash g_Hash[] =
   { 10, 2340,       0xff769021, "SHA1:1" },
   {  2, CMPLX((20 * 6 + 1) * 4 + 4), 0xff769021, "SHA1:2" },
   
-  {  2,  5500, 0x85189d02, "BLAKE2sp" }
+  {  2,  5500, 0x85189d02, "BLAKE2sp" },
+  {  2,  3000, 0xadff0092, "BLAKE3" }
 };
 
 static void PrintNumber(IBenchPrintCallback &f, UInt64 value, unsigned size)
@@ -2656,6 +2730,7 @@ static const unsigned kFieldSize_RU = 6;
 static const unsigned kFieldSize_Rating = 6;
 static const unsigned kFieldSize_EU = 5;
 static const unsigned kFieldSize_Effec = 5;
+static const unsigned kFieldSize_Ratio = 8;
 
 static const unsigned kFieldSize_TotalSize = 4 + kFieldSize_Speed + kFieldSize_Usage + kFieldSize_RU + kFieldSize_Rating;
 static const unsigned kFieldSize_EUAndEffec = 2 + kFieldSize_EU + kFieldSize_Effec;
@@ -2688,6 +2763,28 @@ static void PrintSpaces(IBenchPrintCallback &f, unsigned size)
   PrintChars(f, ' ', size);
 }
 
+// it prints the size of compressed data in percents of original size
+static void PrintRatio(IBenchPrintCallback &f, UInt64 packSize, UInt64 unpackSize, unsigned size)
+{
+  if (unpackSize == 0)
+  {
+    PrintSpaces(f, size);
+    return;
+  }
+  const UInt64 v = (packSize * 10000 + unpackSize / 2) / unpackSize;
+  char s[32];
+  ConvertUInt64ToString(v / 100, s);
+  unsigned pos = MyStringLen(s);
+  s[pos++] = '.';
+  s[pos++] = (char)('0' + (unsigned)(v / 10 % 10));
+  s[pos++] = (char)('0' + (unsigned)(v % 10));
+  s[pos++] = '%';
+  s[pos] = 0;
+  if (pos < size)
+    PrintSpaces(f, size - pos);
+  f.Print(s);
+}
+
 static void PrintUsage(IBenchPrintCallback &f, UInt64 usage, unsigned size)
 {
   PrintNumber(f, Benchmark_GetUsage_Percents(usage), size);
@@ -2785,6 +2882,264 @@ static void PrintTotals(IBenchPrintCallback &f,
 }
 
 
+// ---------- Report ----------
+
+/* the report contains one item for each measured row in JSON or CSV format.
+   The memory of row is the peak of allocated memory of that row
+   (the sum of all allocator kinds, while only that row is measured).
+   It's measured only if the statistics of allocations is enabled (-bm switch). */
+
+static const unsigned k_BenchReport_None = 0;
+static const unsigned k_BenchReport_Json = 1;
+static const unsigned k_BenchReport_Csv  = 2;
+
+static const UInt64 k_BenchMem_Undefined = (UInt64)(Int64)-1;
+
+struct CBenchPrintCallback_Null: public IBenchPrintCallback
+{
+  IBenchPrintCallback *Base;
+  
+  void Print(const char *) {}
+  void NewLine() {}
+  HRESULT CheckBreak() { return Base->CheckBreak(); }
+};
+
+static void BenchMem_Reset()
+{
+  if (AllocLayer_GetFlags() & k_AllocLayer_Stat)
+    AllocLayer_ResetMarkPeak();
+}
+
+static UInt64 BenchMem_Get()
+{
+  if (AllocLayer_GetFlags() & k_AllocLayer_Stat)
+    return AllocLayer_GetMarkPeak();
+  return k_BenchMem_Undefined;
+}
+
+struct CBenchReportItem
+{
+  AString Method;
+  AString Props;
+  AString File;         // the file in corpus mode (UTF-8)
+  const char *Mode;     // "encode", "decode", "hash"
+  UInt32 NumThreads;
+  UInt64 Dict;          // 0 : not defined
+  UInt64 Size;          // the size of data in one stream
+  UInt64 Ratio;         // the size of compressed data in 1/10000 of original size. 0 : not defined
+  UInt64 Speed;         // bytes per second of uncompressed data
+  UInt64 Rating;        // 0 : not defined
+  UInt64 Usage;         // CPU usage in percents
+  UInt64 Memory;
+
+  CBenchReportItem(): Mode(""), NumThreads(1), Dict(0), Size(0), Ratio(0),
+      Speed(0), Rating(0), Usage(0), Memory(k_BenchMem_Undefined) {}
+
+  void SetMethod(const AString &method, const UString &props)
+  {
+    Method = method;
+    Props = GetAnsiString(props);
+  }
+  
+  // "LZMA:x5:mt1" -> "LZMA" and "x5:mt1"
+  void SetMethod(const char *name)
+  {
+    Method = name;
+    Props.Empty();
+    const int pos = Method.Find(':');
+    if (pos >= 0)
+    {
+      Props = Method.Ptr((unsigned)(pos + 1));
+      Method.DeleteFrom((unsigned)pos);
+    }
+  }
+
+  void Set_From_BenchInfo(const CBenchInfo &info, UInt64 rating)
+  {
+    Speed = info.GetUnpackSizeSpeed();
+    Usage = Benchmark_GetUsage_Percents(info.GetUsage());
+    Rating = rating;
+    if (info.UnpackSize != 0)
+      Ratio = (info.PackSize * 10000 + info.UnpackSize / 2) / info.UnpackSize;
+  }
+};
+
+struct CBenchReport
+{
+  unsigned Format;
+  CObjectVector<CBenchReportItem> Items;
+  
+  CBenchReport(): Format(k_BenchReport_None) {}
+  void Print(IBenchPrintCallback &f) const;
+};
+
+static void Report_AddString(AString &s, const AString &v, unsigned format)
+{
+  if (format == k_BenchReport_Csv)
+  {
+    if (v.Find(',') < 0 && v.Find('\"') < 0 && v.Find('\n') < 0)
+    {
+      s += v;
+      return;
+    }
+  }
+  s += '\"';
+  for (unsigned i = 0; i < v.Len(); i++)
+  {
+    const char c = v[i];
+    if (format == k_BenchReport_Csv)
+    {
+      if (c == '\"')
+        s += '\"';
+      s += c;
+      continue;
+    }
+    if (c == '\"' || c == '\\')
+    {
+      s += '\\';
+      s += c;
+    }
+    else if (c == '\n')
+      s += "\\n";
+    else if ((Byte)c < 0x20)
+    {
+      char temp[16];
+      ConvertUInt32ToHex((Byte)c, temp);
+      s += "\\u00";
+      if ((Byte)c < 16)
+        s += '0';
+      s += temp;
+    }
+    else
+      s += c;
+  }
+  s += '\"';
+}
+
+static void Report_AddField(AString &s, const char *name, unsigned format)
+{
+  if (format == k_BenchReport_Json)
+  {
+    s += ", \"";
+    s += name;
+    s += "\": ";
+  }
+  else
+    s += ',';
+}
+
+static void Report_AddNumber(AString &s, const char *name, UInt64 v, bool defined, unsigned format)
+{
+  Report_AddField(s, name, format);
+  if (defined)
+    s.Add_UInt64(v);
+  else if (format == k_BenchReport_Json)
+    s += "null";
+}
+
+// it writes (v / 100) with 2 decimal digits
+static void Report_AddPercents(AString &s, const char *name, UInt64 v, bool defined, unsigned format)
+{
+  Report_AddField(s, name, format);
+  if (!defined)
+  {
+    if (format == k_BenchReport_Json)
+      s += "null";
+    return;
+  }
+  s.Add_UInt64(v / 100);
+  s += '.';
+  s += (char)('0' + (unsigned)(v / 10 % 10));
+  s += (char)('0' + (unsigned)(v % 10));
+}
+
+void CBenchReport::Print(IBenchPrintCallback &f) const
+{
+  AString s;
+  if (Format == k_BenchReport_Json)
+  {
+    f.Print("{");
+    f.NewLine();
+    {
+      AString v;
+      GetCpuName(v);
+      v.Trim();
+      s = "\"cpu\": ";
+      Report_AddString(s, v, Format);
+      s += ',';
+      f.Print(s);
+      f.NewLine();
+    }
+    {
+      AString v;
+      GetOsInfoText(v);
+      s = "\"os\": ";
+      Report_AddString(s, v, Format);
+      s += ',';
+      f.Print(s);
+      f.NewLine();
+    }
+    f.Print("\"results\": [");
+    f.NewLine();
+  }
+  else
+  {
+    f.Print("method,props,file,mode,threads,dict,size,ratio,speed,rating,usage,memory");
+    f.NewLine();
+  }
+
+  FOR_VECTOR (i, Items)
+  {
+    const CBenchReportItem &item = Items[i];
+    s.Empty();
+    if (Format == k_BenchReport_Json)
+      s += "{\"method\": ";
+    Report_AddString(s, item.Method, Format);
+    Report_AddField(s, "props", Format);
+    Report_AddString(s, item.Props, Format);
+    if (Format == k_BenchReport_Json)
+    {
+      if (!item.File.IsEmpty())
+      {
+        Report_AddField(s, "file", Format);
+        Report_AddString(s, item.File, Format);
+      }
+    }
+    else
+    {
+      s += ',';
+      if (!item.File.IsEmpty())
+        Report_AddString(s, item.File, Format);
+    }
+    Report_AddField(s, "mode", Format);
+    Report_AddString(s, AString(item.Mode), Format);
+    Report_AddNumber(s, "threads", item.NumThreads, true, Format);
+    Report_AddNumber(s, "dict", item.Dict, item.Dict != 0, Format);
+    Report_AddNumber(s, "size", item.Size, true, Format);
+    Report_AddPercents(s, "ratio", item.Ratio, item.Ratio != 0, Format);
+    Report_AddNumber(s, "speed", item.Speed, true, Format);
+    Report_AddNumber(s, "rating", item.Rating / 1000000, item.Rating != 0, Format);
+    Report_AddNumber(s, "usage", item.Usage, true, Format);
+    Report_AddNumber(s, "memory", item.Memory, item.Memory != k_BenchMem_Undefined, Format);
+    if (Format == k_BenchReport_Json)
+    {
+      s += '}';
+      if (i + 1 != Items.Size())
+        s += ',';
+    }
+    f.Print(s);
+    f.NewLine();
+  }
+
+  if (Format == k_BenchReport_Json)
+  {
+    f.Print("]");
+    f.NewLine();
+    f.Print("}");
+    f.NewLine();
+  }
+}
+
 static void PrintHex(AString &s, UInt64 v)
 {
   char temp[32];
@@ -2832,32 +3187,48 @@ AString GetProcessThreadsInfo(const NSystem::CProcessAffinity &ti)
 
 #ifdef _7ZIP_LARGE_PAGES
 
-#ifdef _WIN32
 extern bool g_LargePagesMode;
 extern "C"
 {
   extern SIZE_T g_LargePageSize;
 }
-#endif
 
 void Add_LargePages_String(AString &s)
 {
   #ifdef _WIN32
   if (g_LargePagesMode || g_LargePageSize != 0)
+  #else
+  if (g_LargePageSize != 0)
+  #endif
   {
     s.Add_OptSpaced("(LP-");
     PrintSize_KMGT_Or_Hex(s, g_LargePageSize);
+    #ifdef _WIN32
     #ifdef MY_CPU_X86_OR_AMD64
     if (CPU_IsSupported_PageGB())
       s += "-1G";
     #endif
     if (!g_LargePagesMode)
       s += "-NA";
+    #endif
+    s += ")";
+  }
+
+  /* the results of BigAlloc() calls that tried to use large pages */
+  CLargePagesStat stat;
+  LargePages_GetStat(&stat);
+  if (stat.NumLarge != 0 || stat.NumThp != 0 || stat.NumFallback != 0)
+  {
+    s.Add_OptSpaced("(large:");
+    s.Add_UInt32(stat.NumLarge);
+    #ifndef _WIN32
+    s += " thp:";
+    s.Add_UInt32(stat.NumThp);
+    #endif
+    s += " fallback:";
+    s.Add_UInt32(stat.NumFallback);
     s += ")";
   }
-  #else
-    s += "";
-  #endif
 }
 
 #endif
@@ -2904,19 +3275,27 @@ struct CBenchCallbackToPrint: public IBenchCallback
   bool ShowFreq;
   UInt64 CpuFreq;
 
+  bool ShowRatio;
+
   unsigned EncodeWeight;
   unsigned DecodeWeight;
 
+  CBenchReport *Report;
+  CBenchReportItem ReportItem; // the fields of current method for the items of Report
+
   CBenchCallbackToPrint():
       Use2Columns(false),
       NameFieldSize(0),
       ShowFreq(false),
       CpuFreq(0),
+      ShowRatio(false),
       EncodeWeight(1),
-      DecodeWeight(1)
+      DecodeWeight(1),
+      Report(NULL)
       {}
 
   void Init() { EncodeRes.Init(); DecodeRes.Init(); }
+  void AddReportItem(const char *mode, const CBenchInfo &info, UInt64 rating);
   void Print(const char *s);
   void NewLine();
   
@@ -2932,12 +3311,24 @@ HRESULT CBenchCallbackToPrint::SetFreq(bool showFreq, UInt64 cpuFreq)
   return S_OK;
 }
 
+void CBenchCallbackToPrint::AddReportItem(const char *mode, const CBenchInfo &info, UInt64 rating)
+{
+  CBenchReportItem item = ReportItem;
+  item.Mode = mode;
+  item.Set_From_BenchInfo(info, rating);
+  item.Memory = BenchMem_Get();
+  Report->Items.Add(item);
+  BenchMem_Reset();
+}
+
 HRESULT CBenchCallbackToPrint::SetEncodeResult(const CBenchInfo &info, bool final)
 {
   RINOK(_file->CheckBreak());
   if (final)
   {
     UInt64 rating = BenchProps.GetCompressRating(DictSize, info.GlobalTime, info.GlobalFreq, info.UnpackSize * info.NumIterations);
+    if (Report)
+      AddReportItem("encode", info, rating);
     PrintResults(_file, info,
         EncodeWeight, rating,
         ShowFreq, CpuFreq, &EncodeRes);
@@ -2955,6 +3346,8 @@ HRESULT CBenchCallbackToPrint::SetDecodeResult(const CBenchInfo &info, bool fina
   if (final)
   {
     UInt64 rating = BenchProps.GetDecompressRating(info.GlobalTime, info.GlobalFreq, info.UnpackSize, info.PackSize, info.NumIterations);
+    if (Report)
+      AddReportItem("decode", info, rating);
     if (Use2Columns)
       _file->Print(kSep);
     else
@@ -2966,6 +3359,8 @@ HRESULT CBenchCallbackToPrint::SetDecodeResult(const CBenchInfo &info, bool fina
     PrintResults(_file, info2,
         DecodeWeight, rating,
         ShowFreq, CpuFreq, &DecodeRes);
+    if (ShowRatio)
+      PrintRatio(*_file, info.PackSize, info.UnpackSize, kFieldSize_Ratio);
   }
   return S_OK;
 }
@@ -3018,6 +3413,7 @@ static HRESULT TotalBench(
       else if (IsString1PrefixedByString2(bench.Name, "AES192")) keySize = 24;
       callback->BenchProps.KeySize = keySize;
     }
+    callback->ShowRatio = IsString1PrefixedByString2(bench.Name, "LZMA2:");
     callback->BenchProps.DecComplexUnc = bench.DecComplexUnc;
     callback->BenchProps.DecComplexCompr = bench.DecComplexCompr;
     callback->BenchProps.EncComplex = bench.EncComplex;
@@ -3034,6 +3430,17 @@ static HRESULT TotalBench(
     callback->EncodeWeight = bench.Weight;
     callback->DecodeWeight = bench.Weight;
 
+    if (callback->Report)
+    {
+      CBenchReportItem &item = callback->ReportItem;
+      item.SetMethod(bench.Name);
+      #ifndef _7ZIP_ST
+      item.NumThreads = numThreads;
+      #endif
+      item.Size = unpackSize2;
+      BenchMem_Reset();
+    }
+
     HRESULT res = MethodBench(
         EXTERNAL_CODECS_LOC_VARS
         complexInCommands,
@@ -3421,6 +3828,8 @@ static HRESULT TotalBench_Hash(
 
     UInt64 speed, usage;
 
+    BenchMem_Reset();
+
     HRESULT res = CrcBench(
         EXTERNAL_CODECS_LOC_VARS
         complexInCommands,
@@ -3442,6 +3851,19 @@ static HRESULT TotalBench_Hash(
     else
     {
       RINOK(res);
+      if (callback->Report)
+      {
+        CBenchReportItem item;
+        item.SetMethod(bench.Name);
+        item.Mode = "hash";
+        item.NumThreads = numThreads;
+        item.Size = bufSize;
+        item.Speed = speed;
+        item.Usage = Benchmark_GetUsage_Percents(usage);
+        item.Rating = speed * bench.Complex / 256;
+        item.Memory = BenchMem_Get();
+        callback->Report->Items.Add(item);
+      }
     }
     callback->NewLine();
   }
@@ -3468,11 +3890,622 @@ static void ParseNumberString(const UString &s, NCOM::CPropVariant &prop)
 }
 
 
+// ---------- Corpus ----------
+
+/* corpus mode: the methods are used for each file of directory (with subdirectories).
+   The methods use their own threads (mt property), as in archiving. */
+
+static HRESULT Corpus_AddFiles(const FString &dirPrefix, const UString &relPrefix, UStringVector &files)
+{
+  NFile::NFind::CEnumerator enumerator;
+  enumerator.SetDirPrefix(dirPrefix);
+  NFile::NFind::CDirEntry fi;
+  for (;;)
+  {
+    bool found;
+    if (!enumerator.Next(fi, found))
+      return GetLastError_noZero_HRESULT();
+    if (!found)
+      break;
+    #ifdef _WIN32
+    const bool isDir = fi.IsDir();
+    #else
+    const bool isDir = enumerator.DirEntry_IsDir(fi, true); // followLink
+    #endif
+    UString name (relPrefix);
+    name += fs2us(fi.Name);
+    if (isDir)
+    {
+      FString dirPrefix2 (dirPrefix);
+      dirPrefix2 += fi.Name;
+      dirPrefix2.Add_PathSepar();
+      name.Add_PathSepar();
+      RINOK(Corpus_AddFiles(dirPrefix2, name, files));
+    }
+    else
+      files.Add(name);
+  }
+  return S_OK;
+}
+
+static void BenchInfo_Init(CBenchInfo &info)
+{
+  info.GlobalTime = 0;
+  info.GlobalFreq = 1;
+  info.UserTime = 0;
+  info.UserFreq = 1;
+  info.UnpackSize = 0;
+  info.PackSize = 0;
+  info.NumIterations = 1;
+}
+
+// (sum) contains the total sizes of all iterations and (sum.NumIterations == 1)
+static void BenchInfo_Add(CBenchInfo &sum, const CBenchInfo &info)
+{
+  sum.GlobalTime += info.GlobalTime;
+  sum.GlobalFreq = info.GlobalFreq;
+  sum.UserTime += info.UserTime;
+  sum.UserFreq = info.UserFreq;
+  sum.UnpackSize += info.UnpackSize * info.NumIterations;
+  sum.PackSize += info.PackSize * info.NumIterations;
+}
+
+struct CBenchResultsCallback: public IBenchCallback
+{
+  CBenchInfo EncInfo;
+  CBenchInfo DecInfo;
+  UInt64 EncMemory;
+  UInt64 DecMemory;
+
+  HRESULT SetEncodeResult(const CBenchInfo &info, bool final)
+  {
+    if (final)
+    {
+      EncInfo = info;
+      EncMemory = BenchMem_Get();
+      BenchMem_Reset();
+    }
+    return S_OK;
+  }
+
+  HRESULT SetDecodeResult(const CBenchInfo &info, bool final)
+  {
+    if (final)
+    {
+      DecInfo = info;
+      DecMemory = BenchMem_Get();
+    }
+    return S_OK;
+  }
+};
+
+struct CBenchCorpusMethod
+{
+  COneMethodInfo Method;
+  AString Name;
+  CBenchProps BenchProps;
+  unsigned DictBits;
+  UInt32 NumThreads;
+  bool Supported;
+  UInt64 Size;
+  UInt64 PackSize;
+  CBenchInfo Enc;
+  CBenchInfo Dec;
+};
+
+static const unsigned kFieldSize_CorpusName = 18;
+static const unsigned kFieldSize_CorpusSize = 12;
+static const unsigned kFieldSize_CorpusSpeed = 9;
+
+// it prints (speed) in MB/s with one decimal digit
+static void PrintSpeed_MBs(IBenchPrintCallback &f, UInt64 speed, unsigned size)
+{
+  const UInt64 v = (speed + 50000) / 100000;
+  char s[32];
+  ConvertUInt64ToString(v / 10, s);
+  unsigned pos = MyStringLen(s);
+  s[pos++] = '.';
+  s[pos++] = (char)('0' + (unsigned)(v % 10));
+  s[pos] = 0;
+  PrintRight(f, s, size + 1);
+}
+
+static void PrintCorpusRow(IBenchPrintCallback &f, const char *name,
+    UInt64 size, UInt64 packSize, const CBenchInfo &enc, const CBenchInfo &dec, const UString &file)
+{
+  PrintLeft(f, name, kFieldSize_CorpusName);
+  PrintNumber(f, size, kFieldSize_CorpusSize);
+  PrintNumber(f, packSize, kFieldSize_CorpusSize);
+  PrintRatio(f, packSize, size, kFieldSize_Ratio);
+  PrintSpeed_MBs(f, enc.GetUnpackSizeSpeed(), kFieldSize_CorpusSpeed);
+  PrintSpeed_MBs(f, dec.GetUnpackSizeSpeed(), kFieldSize_CorpusSpeed);
+  f.Print("  ");
+  f.Print(GetOemString(file));
+  f.NewLine();
+}
+
+static HRESULT CorpusBench(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    UInt64 complexInCommands,
+  #ifndef _7ZIP_ST
+    UInt32 numThreads,
+    const CAffinityMode *affinityMode,
+  #endif
+    const COneMethodInfo &method,
+    const FString &dirPath,
+    IBenchPrintCallback &f,
+    CBenchReport *report)
+{
+  FString dirPrefix (dirPath);
+  NFile::NName::NormalizeDirPathPrefix(dirPrefix);
+  UStringVector files;
+  RINOK(Corpus_AddFiles(dirPrefix, UString(), files));
+  files.Sort();
+
+  CObjectVector<CBenchCorpusMethod> methods;
+  {
+    const bool allMethods = method.MethodName.IsEqualTo_Ascii_NoCase("*");
+    const unsigned numMethods = allMethods ? ARRAY_SIZE(g_Bench) : 1;
+    for (unsigned i = 0; i < numMethods; i++)
+    {
+      // filters and encryption methods are not useful for real files
+      if (allMethods && g_Bench[i].DictBits == 0)
+        continue;
+      CBenchCorpusMethod &m = methods.AddNew();
+      m.BenchProps.SetLzmaCompexity();
+      m.DictBits = kOldLzmaDictBits;
+      if (allMethods)
+      {
+        const CBenchMethod &bench = g_Bench[i];
+        NCOM::CPropVariant propVariant;
+        propVariant = bench.Name;
+        RINOK(m.Method.ParseMethodFromPROPVARIANT(UString(), propVariant));
+        m.Name = bench.Name;
+        m.DictBits = bench.DictBits;
+        m.BenchProps.EncComplex = bench.EncComplex;
+        m.BenchProps.DecComplexCompr = bench.DecComplexCompr;
+        m.BenchProps.DecComplexUnc = bench.DecComplexUnc;
+      }
+      else
+      {
+        m.Method = method;
+        m.Name = method.MethodName;
+        if (!method.PropsString.IsEmpty())
+        {
+          m.Name += ':';
+          m.Name += GetAnsiString(method.PropsString);
+        }
+      }
+      m.NumThreads = 1;
+      #ifndef _7ZIP_ST
+      if (m.Method.Get_NumThreads() < 0)
+        m.Method.AddProp_NumThreads(numThreads);
+      m.NumThreads = (UInt32)m.Method.Get_NumThreads();
+      #endif
+      m.Supported = true;
+      m.Size = 0;
+      m.PackSize = 0;
+      BenchInfo_Init(m.Enc);
+      BenchInfo_Init(m.Dec);
+    }
+  }
+
+  f.Print("Corpus: ");
+  f.Print(GetOemString(fs2us(dirPath)));
+  f.Print("  files:");
+  PrintNumber(f, files.Size(), 0);
+  f.NewLine();
+  f.NewLine();
+  PrintLeft(f, "Method", kFieldSize_CorpusName);
+  PrintRight(f, "Size", kFieldSize_CorpusSize + 1);
+  PrintRight(f, "Packed", kFieldSize_CorpusSize + 1);
+  PrintRight(f, "Ratio", kFieldSize_Ratio);
+  PrintRight(f, "Compr", kFieldSize_CorpusSpeed + 1);
+  PrintRight(f, "Decompr", kFieldSize_CorpusSpeed + 1);
+  f.Print("  File");
+  f.NewLine();
+  PrintSpaces(f, kFieldSize_CorpusName + (kFieldSize_CorpusSize + 1) * 2 + kFieldSize_Ratio);
+  PrintRight(f, "MB/s", kFieldSize_CorpusSpeed + 1);
+  PrintRight(f, "MB/s", kFieldSize_CorpusSpeed + 1);
+  f.NewLine();
+  f.NewLine();
+
+  CMidAlignedBuffer fileData;
+
+  FOR_VECTOR (fileIndex, files)
+  {
+    const UString &name = files[fileIndex];
+    size_t size;
+    {
+      NFile::NIO::CInFile file;
+      if (!file.Open(dirPrefix + us2fs(name)))
+        return GetLastError_noZero_HRESULT();
+      UInt64 len64;
+      if (!file.GetLength(len64))
+        return GetLastError_noZero_HRESULT();
+      size = (size_t)len64;
+      if (size != len64)
+        return E_OUTOFMEMORY;
+      if (size == 0)
+        continue;
+      ALLOC_WITH_HRESULT(&fileData, size);
+      size_t processed;
+      if (!file.ReadFull((Byte *)fileData, size, processed))
+        return GetLastError_noZero_HRESULT();
+      if (processed != size)
+        return E_FAIL;
+    }
+
+    FOR_VECTOR (mi, methods)
+    {
+      CBenchCorpusMethod &m = methods[mi];
+      if (!m.Supported)
+        continue;
+      RINOK(f.CheckBreak());
+      
+      CBenchResultsCallback callback;
+      BenchMem_Reset();
+      const HRESULT res = MethodBench(
+          EXTERNAL_CODECS_LOC_VARS
+          complexInCommands,
+        #ifndef _7ZIP_ST
+          false, 1, affinityMode,
+        #endif
+          m.Method,
+          size, (const Byte *)fileData,
+          m.DictBits, &f, &callback, &m.BenchProps);
+      if (res == E_NOTIMPL)
+      {
+        m.Supported = false;
+        continue;
+      }
+      RINOK(res);
+
+      const CBenchInfo &enc = callback.EncInfo;
+      const CBenchInfo &dec = callback.DecInfo;
+      // MethodBench() uses one encoder here, so (enc.PackSize) is the size of one stream
+      const UInt64 packSize = enc.PackSize;
+
+      PrintCorpusRow(f, m.Name, size, packSize, enc, dec, name);
+
+      m.Size += size;
+      m.PackSize += packSize;
+      BenchInfo_Add(m.Enc, enc);
+      BenchInfo_Add(m.Dec, dec);
+
+      if (report)
+      {
+        CBenchReportItem item;
+        item.SetMethod(m.Name);
+        ConvertUnicodeToUTF8(name, item.File);
+        item.NumThreads = m.NumThreads;
+        item.Size = size;
+        item.Mode = "encode";
+        item.Set_From_BenchInfo(enc, 0);
+        item.Memory = callback.EncMemory;
+        report->Items.Add(item);
+        item.Mode = "decode";
+        item.Set_From_BenchInfo(dec, 0);
+        item.Memory = callback.DecMemory;
+        report->Items.Add(item);
+      }
+    }
+  }
+
+  PrintChars(f, '-', kFieldSize_CorpusName + (kFieldSize_CorpusSize + 1) * 2
+      + kFieldSize_Ratio + (kFieldSize_CorpusSpeed + 1) * 2);
+  f.NewLine();
+  
+  FOR_VECTOR (mi, methods)
+  {
+    const CBenchCorpusMethod &m = methods[mi];
+    if (!m.Supported)
+    {
+      PrintLeft(f, m.Name, kFieldSize_CorpusName);
+      f.Print("  ---");
+      f.NewLine();
+      continue;
+    }
+    if (m.Size == 0)
+      continue;
+    PrintCorpusRow(f, m.Name, m.Size, m.PackSize, m.Enc, m.Dec, UString("(total)"));
+  }
+  return S_OK;
+}
+
+
+
 static bool AreSameMethodNames(const char *fullName, const char *shortName)
 {
   return StringsAreEqualNoCase_Ascii(fullName, shortName);
 }
 
+// it returns the index of the first entry of the method in g_Bench, or -1
+static int FindBenchMethod(const AString &methodName)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE(g_Bench); i++)
+  {
+    AString benchMethod (g_Bench[i].Name);
+    const int propPos = benchMethod.Find(':');
+    if (propPos >= 0)
+      benchMethod.DeleteFrom((unsigned)propPos);
+    if (AreSameMethodNames(benchMethod, methodName))
+      return (int)i;
+  }
+  return -1;
+}
+
+
+// ---------- Sweep ----------
+
+/* sweep mode: the method is tested for each level (-mx=1-22) and each number
+   of threads (-mmt=1,4,16). The method uses its own threads, as in archiving.
+   The point is marked as Pareto optimal, if there is no other level
+   with the same number of threads that has better ratio and speed of compression. */
+
+// it parses the list of numbers and ranges: "1-3,5,16"
+static bool ParseNumberList(const UString &s, CUIntVector &v)
+{
+  const wchar_t *p = s;
+  for (;;)
+  {
+    const wchar_t *end;
+    const UInt32 a = ConvertStringToUInt32(p, &end);
+    if (end == p)
+      return false;
+    UInt32 b = a;
+    p = end;
+    if (*p == '-')
+    {
+      p++;
+      b = ConvertStringToUInt32(p, &end);
+      if (end == p || b < a || b - a > 1000)
+        return false;
+      p = end;
+    }
+    for (UInt32 i = a;; i++)
+    {
+      v.Add(i);
+      if (i == b)
+        break;
+    }
+    if (*p == 0)
+      return true;
+    if (*p != ',')
+      return false;
+    p++;
+  }
+}
+
+static bool IsNumberList(const UString &s)
+{
+  return s.Find(L',') >= 0 || s.Find(L'-') >= 0;
+}
+
+struct CBenchSweepPoint
+{
+  UInt32 Level;
+  UInt32 NumThreads;
+  UInt64 Ratio;
+  UInt64 EncSpeed;
+  UInt64 DecSpeed;
+  UInt64 EncMemory;
+  UInt64 DecMemory;
+  bool Supported;
+  bool Pareto;
+};
+
+static const unsigned kFieldSize_SweepLevel = 5;
+static const unsigned kFieldSize_SweepThreads = 7;
+static const unsigned kFieldSize_SweepMem = 8;
+
+static void PrintMemory_MB(IBenchPrintCallback &f, UInt64 v, unsigned size)
+{
+  if (v == k_BenchMem_Undefined)
+    PrintRight(f, "-", size + 1);
+  else
+    PrintNumber(f, (v + (1 << 20) - 1) >> 20, size);
+}
+
+static HRESULT SweepBench(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    UInt64 complexInCommands,
+  #ifndef _7ZIP_ST
+    const CAffinityMode *affinityMode,
+  #endif
+    const COneMethodInfo &method,
+    const CUIntVector &levels,
+    const CUIntVector &threads,
+    size_t uncompressedDataSize,
+    const Byte *fileData,
+    IBenchPrintCallback &f,
+    CBenchReport *report)
+{
+  CBenchProps benchProps;
+  benchProps.SetLzmaCompexity();
+  unsigned dictBits = kOldLzmaDictBits;
+  {
+    const int index = FindBenchMethod(method.MethodName);
+    if (index >= 0)
+    {
+      const CBenchMethod &h = g_Bench[(unsigned)index];
+      benchProps.EncComplex = h.EncComplex;
+      benchProps.DecComplexCompr = h.DecComplexCompr;
+      benchProps.DecComplexUnc = h.DecComplexUnc;
+      if (h.DictBits == 0)
+        dictBits = 0;
+    }
+  }
+
+  f.Print("Sweep: ");
+  f.Print(method.MethodName);
+  if (!method.PropsString.IsEmpty())
+  {
+    f.Print(":");
+    f.Print(GetAnsiString(method.PropsString));
+  }
+  f.Print("  size:");
+  PrintNumber(f, uncompressedDataSize, 0);
+  f.NewLine();
+  f.NewLine();
+
+  PrintRight(f, "Level", kFieldSize_SweepLevel);
+  PrintRight(f, "Threads", kFieldSize_SweepThreads + 1);
+  PrintRight(f, "Ratio", kFieldSize_Ratio);
+  PrintRight(f, "Compr", kFieldSize_CorpusSpeed + 1);
+  PrintRight(f, "Decompr", kFieldSize_CorpusSpeed + 1);
+  PrintRight(f, "EncMem", kFieldSize_SweepMem + 1);
+  PrintRight(f, "DecMem", kFieldSize_SweepMem + 1);
+  f.Print("  Pareto");
+  f.NewLine();
+  PrintSpaces(f, kFieldSize_SweepLevel + kFieldSize_SweepThreads + 1 + kFieldSize_Ratio);
+  PrintRight(f, "MB/s", kFieldSize_CorpusSpeed + 1);
+  PrintRight(f, "MB/s", kFieldSize_CorpusSpeed + 1);
+  PrintRight(f, "MB", kFieldSize_SweepMem + 1);
+  PrintRight(f, "MB", kFieldSize_SweepMem + 1);
+  f.NewLine();
+
+  CUIntVector levels2 (levels);
+  CUIntVector threads2 (threads);
+  const bool levelDefined = !levels2.IsEmpty();
+  if (!levelDefined)
+    levels2.Add((UInt32)method.GetLevel());
+  #ifdef _7ZIP_ST
+  threads2.Clear();
+  #endif
+  if (threads2.IsEmpty())
+    threads2.Add(1);
+
+  FOR_VECTOR (ti, threads2)
+  {
+    const UInt32 numThreads = threads2[ti];
+    CRecordVector<CBenchSweepPoint> points;
+    
+    f.NewLine();
+
+    FOR_VECTOR (li, levels2)
+    {
+      RINOK(f.CheckBreak());
+      const UInt32 level = levels2[li];
+      COneMethodInfo method2 = method;
+      AString props = GetAnsiString(method.PropsString);
+      if (levelDefined)
+      {
+        NCOM::CPropVariant propVariant = level;
+        RINOK(method2.ParseMethodFromPROPVARIANT(UString("x"), propVariant));
+        if (!props.IsEmpty())
+          props += ':';
+        props += 'x';
+        props.Add_UInt32(level);
+      }
+      #ifndef _7ZIP_ST
+      if (!threads.IsEmpty())
+      {
+        method2.AddProp_NumThreads(numThreads);
+        if (!props.IsEmpty())
+          props += ':';
+        props += "mt";
+        props.Add_UInt32(numThreads);
+      }
+      #endif
+
+      CBenchSweepPoint point;
+      point.Level = level;
+      point.NumThreads = numThreads;
+      point.Supported = false;
+      point.Pareto = false;
+
+      CBenchResultsCallback callback;
+      BenchMem_Reset();
+      const HRESULT res = MethodBench(
+          EXTERNAL_CODECS_LOC_VARS
+          complexInCommands,
+        #ifndef _7ZIP_ST
+          false, 1, affinityMode,
+        #endif
+          method2,
+          uncompressedDataSize, fileData,
+          dictBits, &f, &callback, &benchProps);
+      if (res != E_NOTIMPL && res != E_INVALIDARG)
+      {
+        RINOK(res);
+        const CBenchInfo &enc = callback.EncInfo;
+        const CBenchInfo &dec = callback.DecInfo;
+        point.Supported = true;
+        point.Ratio = enc.UnpackSize == 0 ? 0 : (enc.PackSize * 10000 + enc.UnpackSize / 2) / enc.UnpackSize;
+        point.EncSpeed = enc.GetUnpackSizeSpeed();
+        point.DecSpeed = dec.GetUnpackSizeSpeed();
+        point.EncMemory = callback.EncMemory;
+        point.DecMemory = callback.DecMemory;
+
+        if (report)
+        {
+          CBenchReportItem item;
+          item.Method = method.MethodName;
+          item.Props = props;
+          item.NumThreads = numThreads;
+          item.Size = uncompressedDataSize;
+          item.Mode = "encode";
+          item.Set_From_BenchInfo(enc, 0);
+          item.Memory = callback.EncMemory;
+          report->Items.Add(item);
+          item.Mode = "decode";
+          item.Set_From_BenchInfo(dec, 0);
+          item.Memory = callback.DecMemory;
+          report->Items.Add(item);
+        }
+      }
+      points.Add(point);
+    }
+
+    unsigned i;
+    for (i = 0; i < points.Size(); i++)
+    {
+      CBenchSweepPoint &p = points[i];
+      if (!p.Supported)
+        continue;
+      p.Pareto = true;
+      for (unsigned k = 0; k < points.Size(); k++)
+      {
+        const CBenchSweepPoint &p2 = points[k];
+        if (k == i || !p2.Supported)
+          continue;
+        if (p2.Ratio <= p.Ratio && p2.EncSpeed >= p.EncSpeed
+            && (p2.Ratio < p.Ratio || p2.EncSpeed > p.EncSpeed))
+        {
+          p.Pareto = false;
+          break;
+        }
+      }
+    }
+
+    for (i = 0; i < points.Size(); i++)
+    {
+      const CBenchSweepPoint &p = points[i];
+      if (levelDefined)
+        PrintNumber(f, p.Level, kFieldSize_SweepLevel - 1);
+      else
+        PrintSpaces(f, kFieldSize_SweepLevel);
+      PrintNumber(f, p.NumThreads, kFieldSize_SweepThreads);
+      if (!p.Supported)
+      {
+        f.Print("  ---");
+        f.NewLine();
+        continue;
+      }
+      PrintRatio(f, p.Ratio, 10000, kFieldSize_Ratio);
+      PrintSpeed_MBs(f, p.EncSpeed, kFieldSize_CorpusSpeed);
+      PrintSpeed_MBs(f, p.DecSpeed, kFieldSize_CorpusSpeed);
+      PrintMemory_MB(f, p.EncMemory, kFieldSize_SweepMem);
+      PrintMemory_MB(f, p.DecMemory, kFieldSize_SweepMem);
+      if (p.Pareto)
+        f.Print("  *");
+      f.NewLine();
+    }
+  }
+  return S_OK;
+}
+
 
 
 
@@ -3482,14 +4515,15 @@ static void Print_Usage_and_Threads(IBenchPrintCallback &f, UInt64 usage, UInt32
 }
 
 
-HRESULT Bench(
+static HRESULT Bench2(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IBenchPrintCallback *printCallback,
     IBenchCallback *benchCallback,
     const CObjectVector<CProperty> &props,
     UInt32 numIterations,
     bool multiDict,
-    IBenchFreqCallback *freqCallback)
+    IBenchFreqCallback *freqCallback,
+    CBenchReport *report)
 {
   if (!CrcInternalTest())
     return E_FAIL;
@@ -3543,6 +4577,9 @@ HRESULT Bench(
   CMidAlignedBuffer fileDataBuffer;
   bool use_fileData = false;
   bool isFixedDict = false;
+  FString corpusPath;
+  CUIntVector sweepLevels;
+  CUIntVector sweepThreads;
 
   {
   unsigned i;
@@ -3610,6 +4647,44 @@ HRESULT Bench(
       continue;
     }
 
+    if (name.IsEqualTo("corpus"))
+    {
+      if (property.Value.IsEmpty())
+        return E_INVALIDARG;
+      corpusPath = us2fs(property.Value);
+      continue;
+    }
+
+    // it was parsed by Bench()
+    if (name.IsEqualTo("report"))
+      continue;
+
+    // the lists for sweep mode: -mx=1-22 -mmt=1,4,16
+    if (name.IsPrefixedBy_Ascii_NoCase("x") || name.IsPrefixedBy_Ascii_NoCase("mt"))
+    {
+      const unsigned prefixLen = (name[0] == 'x' ? 1 : 2);
+      const UString s = (name.Len() == prefixLen ? property.Value : UString(name.Ptr(prefixLen)));
+      if (IsNumberList(s))
+      {
+        CUIntVector &list = (prefixLen == 1 ? sweepLevels : sweepThreads);
+        list.Clear();
+        if (!ParseNumberList(s, list))
+          return E_INVALIDARG;
+        if (prefixLen == 2)
+        {
+          numThreadsSpecified = 1;
+          FOR_VECTOR (k, list)
+          {
+            if (list[k] == 0)
+              return E_INVALIDARG;
+            if (numThreadsSpecified < list[k])
+              numThreadsSpecified = list[k];
+          }
+        }
+        continue;
+      }
+    }
+
     NCOM::CPropVariant propVariant;
     if (!property.Value.IsEmpty())
       ParseNumberString(property.Value, propVariant);
@@ -3928,6 +5003,21 @@ HRESULT Bench(
   if (method.MethodName.IsEmpty())
     method.MethodName = "LZMA";
 
+  if (!corpusPath.IsEmpty())
+  {
+    if (!printCallback)
+      return E_INVALIDARG;
+    printCallback->NewLine();
+    return CorpusBench(EXTERNAL_CODECS_LOC_VARS
+        complexInCommands,
+      #ifndef _7ZIP_ST
+        numThreadsSpecified,
+        &affinityMode,
+      #endif
+        method, corpusPath,
+        *printCallback, report);
+  }
+
   if (benchCallback)
   {
     CBenchProps benchProps;
@@ -4000,7 +5090,11 @@ HRESULT Bench(
 
         if (AreSameMethodNames(benchMethod, methodName))
         {
-          bool isMainMathed = method.PropsString.IsEmpty();
+          /* the number of threads of hasher (BLAKE3:mt4) doesn't change the digest.
+             So we can use the check sum of main method for such props. */
+          bool isMainMathed = method.PropsString.IsEmpty()
+              || (method.PropsString.IsPrefixedBy_Ascii_NoCase("mt")
+                && method.PropsString.Find(L':') < 0);
           if (isMainMathed)
             isMainMathed = !checkSum
                 || (benchMethod.IsEqualTo_Ascii_NoCase("crc32") && benchProps.IsEqualTo_Ascii_NoCase("8"));
@@ -4042,6 +5136,11 @@ HRESULT Bench(
     CUIntVector numThreadsVector;
     {
       unsigned nt = numThreads_Start;
+      if (!sweepThreads.IsEmpty())
+      {
+        numThreadsVector = sweepThreads;
+        nt = numThreadsSpecified + 1;
+      }
       for (;;)
       {
         if (nt > numThreadsSpecified)
@@ -4125,6 +5224,8 @@ HRESULT Bench(
           UInt64 speed = 0;
           UInt64 usage = 0;
 
+          BenchMem_Reset();
+
           HRESULT res = CrcBench(EXTERNAL_CODECS_LOC_VARS complexInCommands,
               t,
               dataSize, (const Byte *)fileDataBuffer,
@@ -4142,6 +5243,20 @@ HRESULT Bench(
           
           RINOK(res);
 
+          if (report)
+          {
+            CBenchReportItem item;
+            item.SetMethod(method.MethodName, method.PropsString);
+            item.Mode = "hash";
+            item.NumThreads = t;
+            item.Size = dataSize;
+            item.Speed = speed;
+            item.Usage = Benchmark_GetUsage_Percents(usage);
+            item.Rating = speed * complexity / 256;
+            item.Memory = BenchMem_Get();
+            report->Items.Add(item);
+          }
+
           PrintUsage(f, usage, kFieldSize_Usage);
           PrintNumber(f, speed / 1000000, kFieldSize_CrcSpeed);
           speedTotals.Values[ti] += speed;
@@ -4168,6 +5283,47 @@ HRESULT Bench(
     return S_OK;
   }
 
+  if (!sweepLevels.IsEmpty() || !sweepThreads.IsEmpty())
+  {
+    if (method.MethodName.IsEqualTo_Ascii_NoCase("*")
+        || method.MethodName.IsEqualTo_Ascii_NoCase("hash"))
+      return E_INVALIDARG;
+    if (!printCallback)
+      return E_INVALIDARG;
+    size_t dataSize;
+    if (use_fileData)
+      dataSize = fileDataBuffer.Size();
+    else
+    {
+      if (!dictIsDefined)
+      {
+        /* Get_DicSize() returns 0 without "d" property.
+           We use the dictionary of the method's entry in g_Bench (22 bits for most methods),
+           because the speed of small buffer is mostly the noise of timer. */
+        unsigned dictBits = startDicLog;
+        if (!startDicLog_Defined)
+        {
+          const int index = FindBenchMethod(method.MethodName);
+          if (index >= 0 && g_Bench[(unsigned)index].DictBits != 0)
+            dictBits = g_Bench[(unsigned)index].DictBits;
+        }
+        dict = (UInt64)1 << dictBits;
+      }
+      dataSize = (size_t)dict + kAdditionalSize;
+      if (dataSize < dict)
+        return E_OUTOFMEMORY;
+    }
+    printCallback->NewLine();
+    return SweepBench(EXTERNAL_CODECS_LOC_VARS
+        complexInCommands,
+      #ifndef _7ZIP_ST
+        &affinityMode,
+      #endif
+        method, sweepLevels, sweepThreads,
+        dataSize, (const Byte *)fileDataBuffer,
+        *printCallback, report);
+  }
+
   bool use2Columns = false;
 
   bool totalBenchMode = (method.MethodName.IsEqualTo_Ascii_NoCase("*"));
@@ -4210,6 +5366,7 @@ HRESULT Bench(
   CBenchCallbackToPrint callback;
   callback.Init();
   callback._file = printCallback;
+  callback.Report = report;
   
   IBenchPrintCallback &f = *printCallback;
 
@@ -4472,17 +5629,24 @@ HRESULT Bench(
           if (benchProps.IsEmpty()
               || (benchProps == "x5" && method.PropsString.IsEmpty())
               || method.PropsString.IsPrefixedBy_Ascii_NoCase(benchProps))
-          {
-            callback.BenchProps.EncComplex = h.EncComplex;
-            callback.BenchProps.DecComplexCompr = h.DecComplexCompr;
-            callback.BenchProps.DecComplexUnc = h.DecComplexUnc;;
-            needSetComplexity = false;
             break;
-          }
         }
       }
       if (i == ARRAY_SIZE(g_Bench))
-        return E_NOTIMPL;
+      {
+        /* the methods without "x5" entry (ZSTD:x3, LZ4:x1) use
+           the complexity of their first entry for the plain name */
+        const int index = FindBenchMethod(methodName);
+        if (index < 0 || !method.PropsString.IsEmpty())
+          return E_NOTIMPL;
+        i = (unsigned)index;
+      }
+      const CBenchMethod &h = g_Bench[i];
+      callback.BenchProps.EncComplex = h.EncComplex;
+      callback.BenchProps.DecComplexCompr = h.DecComplexCompr;
+      callback.BenchProps.DecComplexUnc = h.DecComplexUnc;;
+      callback.ShowRatio = IsString1PrefixedByString2(h.Name, "LZMA2:");
+      needSetComplexity = false;
     }
     if (needSetComplexity)
       callback.BenchProps.SetLzmaCompexity();
@@ -4532,6 +5696,16 @@ HRESULT Bench(
           uncompressedDataSize += kAdditionalSize;
       }
 
+      if (report)
+      {
+        CBenchReportItem &item = callback.ReportItem;
+        item.SetMethod(method.MethodName, method.PropsString);
+        item.NumThreads = numThreads;
+        item.Dict = callback.DictSize;
+        item.Size = uncompressedDataSize;
+        BenchMem_Reset();
+      }
+
       HRESULT res = MethodBench(
           EXTERNAL_CODECS_LOC_VARS
           complexInCommands,
@@ -4581,3 +5755,43 @@ HRESULT Bench(
   }
   return S_OK;
 }
+
+
+
+HRESULT Bench(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    IBenchPrintCallback *printCallback,
+    IBenchCallback *benchCallback,
+    const CObjectVector<CProperty> &props,
+    UInt32 numIterations,
+    bool multiDict,
+    IBenchFreqCallback *freqCallback)
+{
+  CBenchReport report;
+  
+  FOR_VECTOR (i, props)
+  {
+    const CProperty &property = props[i];
+    if (!property.Name.IsEqualTo_Ascii_NoCase("report"))
+      continue;
+    if (property.Value.IsEqualTo_Ascii_NoCase("json"))
+      report.Format = k_BenchReport_Json;
+    else if (property.Value.IsEqualTo_Ascii_NoCase("csv"))
+      report.Format = k_BenchReport_Csv;
+    else
+      return E_INVALIDARG;
+  }
+
+  if (report.Format == k_BenchReport_None || !printCallback || benchCallback)
+    return Bench2(EXTERNAL_CODECS_LOC_VARS
+        printCallback, benchCallback, props, numIterations, multiDict, freqCallback, NULL);
+
+  /* the report is printed instead of the tables,
+     so the output can be used by another programs */
+  CBenchPrintCallback_Null nullCallback;
+  nullCallback.Base = printCallback;
+  RINOK(Bench2(EXTERNAL_CODECS_LOC_VARS
+      &nullCallback, NULL, props, numIterations, multiDict, freqCallback, &report));
+  report.Print(*printCallback);
+  return S_OK;
+}
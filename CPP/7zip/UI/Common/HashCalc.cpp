@@ -9,6 +9,12 @@
 #include "../../../Common/IntToString.h"
 #include "../../../Common/StringToInt.h"
 
+#ifndef _7ZIP_ST
+#include "../../../Windows/Synchronization.h"
+#include "../../../Windows/System.h"
+#include "../../../Windows/Thread.h"
+#endif
+
 #include "../../Common/FileStreams.h"
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamObjects.h"
@@ -187,6 +193,22 @@ void CHasherState::AddDigest(unsigned groupIndex, const Byte *data)
 }
 
 void CHashBundle::Final(bool isDir, bool isAltStream, const UString &path)
+{
+  if (!isDir)
+    Final_CurrentDigests();
+  Final_Sums(isDir, isAltStream, path);
+}
+
+void CHashBundle::Final_CurrentDigests()
+{
+  FOR_VECTOR (i, Hashers)
+  {
+    CHasherState &h = Hashers[i];
+    h.Hasher->Final(h.Digests[k_HashCalc_Index_Current]);
+  }
+}
+
+void CHashBundle::Final_Sums(bool isDir, bool isAltStream, const UString &path)
 {
   if (isDir)
     NumDirs++;
@@ -209,12 +231,8 @@ void CHashBundle::Final(bool isDir, bool isAltStream, const UString &path)
   FOR_VECTOR (i, Hashers)
   {
     CHasherState &h = Hashers[i];
-    if (!isDir)
-    {
-      h.Hasher->Final(h.Digests[0]); // k_HashCalc_Index_Current
-      if (!isAltStream)
-        h.AddDigest(k_HashCalc_Index_DataSum, h.Digests[0]);
-    }
+    if (!isDir && !isAltStream)
+      h.AddDigest(k_HashCalc_Index_DataSum, h.Digests[0]); // k_HashCalc_Index_Current
 
     h.Hasher->Init();
     h.Hasher->Update(pre, sizeof(pre));
@@ -452,6 +470,331 @@ static void WriteLine(CDynLimBuf &hashFileString,
 }
 
 
+static const UInt32 kHashBufSize = 1 << 15;
+
+#ifndef _7ZIP_ST
+
+/*
+Multi-threaded hashing:
+The worker threads open, read and hash the files, and the main thread
+calls IHashCallbackUI methods for the files in original order.
+Up to (kHashMtSlotsPerThread * numThreads) files are processed at the same time,
+so the latency of file opening and reading is hidden for small files.
+*/
+
+static const unsigned kHashMtSlotsPerThread = 4;
+static const UInt32 kHashMtProgressStep = (UInt32)1 << 22;
+
+struct CHashMtSlot
+{
+  unsigned ItemIndex;
+  bool IsDir;
+  bool OpenError;
+  bool PhySizeDefined;
+  DWORD SystemError;
+  UInt64 PhySize;
+  UInt64 FileSize;
+  HRESULT Res;
+  bool Finished; // protected by CHashCalcMt::_cs
+  CByteBuffer Digests; // Hashers.Size() * k_HashCalc_DigestSize_Max
+};
+
+class CHashCalcMt;
+
+struct CHashMtWorker
+{
+  CHashCalcMt *Owner;
+  CHashBundle Bundle;
+  NWindows::CThread Thread;
+};
+
+class CHashCalcMt
+{
+  CObjectVector<CHashMtWorker> _workers;
+  NSynchronization::CSemaphore _workSem;
+  NSynchronization::CCriticalSection _cs;
+  unsigned _numCreated;
+  
+  // these variables are protected by (_cs)
+  unsigned _nextHash;
+  UInt64 _completeValue;
+  bool _stop;
+
+  HRESULT HashItem(CHashMtWorker &w, CHashMtSlot &s, void *buf);
+  HRESULT AddProgress(UInt64 size);
+public:
+  NSynchronization::CAutoResetEvent ProgressEvent;
+  CObjectVector<CHashMtSlot> Slots;
+  const CDirItems *DirItems;
+  bool PreserveATime;
+  bool OpenShareForWrite;
+
+  CHashCalcMt(): _numCreated(0), _nextHash(0), _completeValue(0), _stop(false) {}
+  ~CHashCalcMt();
+
+  HRESULT Create(DECL_EXTERNAL_CODECS_LOC_VARS const UStringVector &methods, unsigned numThreads);
+  void ThreadFunc(CHashMtWorker &w);
+  
+  void Submit(unsigned itemIndex);
+  bool GetState(const CHashMtSlot &s, UInt64 &completeValue);
+  UInt64 GetCompleteValue()
+  {
+    NSynchronization::CCriticalSectionLock lock(_cs);
+    return _completeValue;
+  }
+};
+
+static THREAD_FUNC_DECL HashMtThread(void *p)
+{
+  CHashMtWorker *w = (CHashMtWorker *)p;
+  w->Owner->ThreadFunc(*w);
+  return 0;
+}
+
+CHashCalcMt::~CHashCalcMt()
+{
+  {
+    NSynchronization::CCriticalSectionLock lock(_cs);
+    _stop = true;
+  }
+  if (_numCreated != 0)
+    _workSem.Release(_numCreated);
+  for (unsigned i = 0; i < _numCreated; i++)
+    _workers[i].Thread.Wait_Close();
+}
+
+HRESULT CHashCalcMt::Create(DECL_EXTERNAL_CODECS_LOC_VARS const UStringVector &methods, unsigned numThreads)
+{
+  unsigned i;
+  for (i = 0; i < numThreads; i++)
+  {
+    CHashMtWorker &w = _workers.AddNew();
+    w.Owner = this;
+    RINOK(w.Bundle.SetMethods(EXTERNAL_CODECS_LOC_VARS methods));
+  }
+  const unsigned numSlots = numThreads * kHashMtSlotsPerThread;
+  const size_t digestsSize = (size_t)_workers[0].Bundle.Hashers.Size() * k_HashCalc_DigestSize_Max;
+  for (i = 0; i < numSlots; i++)
+    Slots.AddNew().Digests.Alloc(digestsSize);
+  {
+    WRes wres = ProgressEvent.CreateIfNotCreated_Reset();
+    if (wres == 0)
+      wres = _workSem.OptCreateInit(0, numSlots + numThreads);
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  for (; _numCreated < numThreads; _numCreated++)
+  {
+    const WRes wres = _workers[_numCreated].Thread.Create(HashMtThread, &_workers[_numCreated]);
+    if (wres != 0)
+      return _numCreated == 0 ? HRESULT_FROM_WIN32(wres) : S_OK;
+  }
+  return S_OK;
+}
+
+void CHashCalcMt::Submit(unsigned itemIndex)
+{
+  CHashMtSlot &s = Slots[itemIndex % Slots.Size()];
+  s.ItemIndex = itemIndex;
+  s.Finished = false;
+  _workSem.Release();
+}
+
+bool CHashCalcMt::GetState(const CHashMtSlot &s, UInt64 &completeValue)
+{
+  NSynchronization::CCriticalSectionLock lock(_cs);
+  completeValue = _completeValue;
+  return s.Finished;
+}
+
+HRESULT CHashCalcMt::AddProgress(UInt64 size)
+{
+  bool stop;
+  {
+    NSynchronization::CCriticalSectionLock lock(_cs);
+    _completeValue += size;
+    stop = _stop;
+  }
+  ProgressEvent.Set();
+  return stop ? E_ABORT : S_OK;
+}
+
+HRESULT CHashCalcMt::HashItem(CHashMtWorker &w, CHashMtSlot &s, void *buf)
+{
+  const CDirItem &di = DirItems->Items[s.ItemIndex];
+  CMyComPtr<ISequentialInStream> inStream;
+  
+  s.IsDir = false;
+  s.OpenError = false;
+  s.PhySizeDefined = false;
+  s.FileSize = 0;
+  
+  #ifndef UNDER_CE
+  if (di.ReparseData.Size() != 0)
+  {
+    CBufInStream *inStreamSpec = new CBufInStream();
+    inStream = inStreamSpec;
+    inStreamSpec->Init(di.ReparseData, di.ReparseData.Size());
+  }
+  else
+  #endif
+  {
+    CInFileStream *inStreamSpec = new CInFileStream;
+    inStreamSpec->Set_PreserveATime(PreserveATime);
+    inStream = inStreamSpec;
+    s.IsDir = di.IsDir();
+    if (!s.IsDir)
+    {
+      if (!inStreamSpec->OpenShared(DirItems->GetPhyPath(s.ItemIndex), OpenShareForWrite))
+      {
+        s.OpenError = true;
+        s.SystemError = ::GetLastError();
+        return S_OK;
+      }
+      if (inStreamSpec->GetSize(&s.PhySize) == S_OK)
+        s.PhySizeDefined = true;
+    }
+  }
+  
+  CHashBundle &hb = w.Bundle;
+  hb.InitForNewFile();
+  
+  if (!s.IsDir)
+  {
+    UInt32 progressSize = 0;
+    for (;;)
+    {
+      UInt32 size;
+      RINOK(inStream->Read(buf, kHashBufSize, &size));
+      if (size == 0)
+        break;
+      hb.Update(buf, size);
+      s.FileSize += size;
+      progressSize += size;
+      if (progressSize >= kHashMtProgressStep)
+      {
+        RINOK(AddProgress(progressSize));
+        progressSize = 0;
+      }
+    }
+    RINOK(AddProgress(progressSize));
+    hb.Final_CurrentDigests();
+  }
+  
+  FOR_VECTOR (i, hb.Hashers)
+    memcpy(s.Digests + i * k_HashCalc_DigestSize_Max,
+        hb.Hashers[i].Digests[k_HashCalc_Index_Current], k_HashCalc_DigestSize_Max);
+  return S_OK;
+}
+
+void CHashCalcMt::ThreadFunc(CHashMtWorker &w)
+{
+  CHashMidBuf buf;
+  const bool bufIsAllocated = buf.Alloc(kHashBufSize);
+  
+  for (;;)
+  {
+    _workSem.Lock();
+    unsigned slotIndex;
+    bool stop;
+    {
+      NSynchronization::CCriticalSectionLock lock(_cs);
+      stop = _stop;
+      slotIndex = _nextHash++ % Slots.Size();
+    }
+    if (stop)
+      return;
+    CHashMtSlot &s = Slots[slotIndex];
+    if (!bufIsAllocated)
+      s.Res = E_OUTOFMEMORY;
+    else
+    {
+      try
+      {
+        s.Res = HashItem(w, s, buf);
+      }
+      catch(...) { s.Res = E_FAIL; }
+    }
+    {
+      NSynchronization::CCriticalSectionLock lock(_cs);
+      s.Finished = true;
+    }
+    ProgressEvent.Set();
+  }
+}
+
+
+static HRESULT HashItems_Mt(CHashCalcMt &mt, const CDirItems &dirItems,
+    CHashBundle &hb, UInt64 totalSize, IHashCallbackUI *callback)
+{
+  const unsigned numItems = dirItems.Items.Size();
+  const unsigned numSlots = mt.Slots.Size();
+  unsigned numSubmitted = 0;
+  UInt64 completeValue = 0;
+  
+  for (unsigned i = 0; i < numItems; i++)
+  {
+    for (; numSubmitted < numItems && numSubmitted - i < numSlots; numSubmitted++)
+      mt.Submit(numSubmitted);
+    
+    const CHashMtSlot &s = mt.Slots[i % numSlots];
+    for (;;)
+    {
+      const bool finished = mt.GetState(s, completeValue);
+      RINOK(callback->SetCompleted(&completeValue));
+      if (finished)
+        break;
+      mt.ProgressEvent.Lock();
+    }
+    
+    const CDirItem &di = dirItems.Items[i];
+    
+    if (s.OpenError)
+    {
+      HRESULT res = callback->OpenFileError(dirItems.GetPhyPath(i), s.SystemError);
+      hb.NumErrors++;
+      if (res != S_FALSE)
+        return res;
+      continue;
+    }
+    
+    if (s.PhySizeDefined && s.PhySize > di.Size)
+    {
+      totalSize += s.PhySize - di.Size;
+      RINOK(callback->SetTotal(totalSize));
+    }
+    
+    const UString path = dirItems.GetLogPath(i);
+    bool isAltStream = false;
+    #ifdef _WIN32
+    isAltStream = di.IsAltStream;
+    #endif
+    
+    RINOK(callback->GetStream(path, s.IsDir));
+    RINOK(s.Res);
+    
+    hb.InitForNewFile();
+    if (!s.IsDir)
+    {
+      FOR_VECTOR (k, hb.Hashers)
+      {
+        CHasherState &h = hb.Hashers[k];
+        memcpy(h.Digests[k_HashCalc_Index_Current], s.Digests + k * k_HashCalc_DigestSize_Max, h.DigestSize);
+      }
+    }
+    hb.SetSize(s.FileSize);
+    hb.Final_Sums(s.IsDir, isAltStream, path);
+    
+    RINOK(callback->SetOperationResult(s.FileSize, hb, !s.IsDir));
+  }
+  
+  completeValue = mt.GetCompleteValue();
+  return callback->SetCompleted(&completeValue);
+}
+
+#endif
+
+
 HRESULT HashCalc(
     DECL_EXTERNAL_CODECS_LOC_VARS
     const NWildcard::CCensor &censor,
@@ -512,9 +855,32 @@ HRESULT HashCalc(
     RINOK(callback->SetTotal(totalSize));
   }
 
-  const UInt32 kBufSize = 1 << 15;
+  #ifndef _7ZIP_ST
+  {
+    UInt32 numThreads = options.NumThreads;
+    if (numThreads == 0)
+      numThreads = NSystem::GetNumberOfProcessors();
+    if (!options.StdInMode && numThreads > 1 && dirItems.Items.Size() > 1)
+    {
+      if (numThreads > dirItems.Items.Size())
+        numThreads = dirItems.Items.Size();
+      CHashCalcMt mt;
+      mt.DirItems = &dirItems;
+      mt.PreserveATime = options.PreserveATime;
+      mt.OpenShareForWrite = options.OpenShareForWrite;
+      // if threads can't be created, we use single-thread mode
+      if (mt.Create(EXTERNAL_CODECS_LOC_VARS options.Methods, numThreads) == S_OK)
+      {
+        RINOK(callback->BeforeFirstFile(hb));
+        RINOK(HashItems_Mt(mt, dirItems, hb, totalSize, callback));
+        return callback->AfterLastFile(hb);
+      }
+    }
+  }
+  #endif
+
   CHashMidBuf buf;
-  if (!buf.Alloc(kBufSize))
+  if (!buf.Alloc(kHashBufSize))
     return E_OUTOFMEMORY;
 
   UInt64 completeValue = 0;
@@ -604,7 +970,7 @@ HRESULT HashCalc(
           RINOK(callback->SetCompleted(&completeValue));
         }
         UInt32 size;
-        RINOK(inStream->Read(buf, kBufSize, &size));
+        RINOK(inStream->Read(buf, kHashBufSize, &size));
         if (size == 0)
           break;
         hb.Update(buf, size);
@@ -104,6 +104,12 @@ struct CHashBundle: public IHashCalc
   void Update(const void *data, UInt32 size);
   void SetSize(UInt64 size);
   void Final(bool isDir, bool isAltStream, const UString &path);
+
+  // Final() == Final_CurrentDigests() + Final_Sums()
+  void Final_CurrentDigests();
+  /* Final_Sums() uses (Digests[k_HashCalc_Index_Current]) and (CurSize),
+     that can be set by caller, if the file was hashed by another CHashBundle */
+  void Final_Sums(bool isDir, bool isAltStream, const UString &path);
 };
 
 #define INTERFACE_IHashCallbackUI(x) \
@@ -195,12 +201,20 @@ struct CHashOptions
 
   NWildcard::ECensorPathMode PathMode;
 
+  #ifndef _7ZIP_ST
+  UInt32 NumThreads; // (0) means the number of processors
+  #endif
+
   CHashOptions():
       PreserveATime(false),
       OpenShareForWrite(false),
       StdInMode(false),
       AltStreamsMode(false),
-      PathMode(NWildcard::k_RelatPath) {};
+      PathMode(NWildcard::k_RelatPath)
+      #ifndef _7ZIP_ST
+      , NumThreads(0)
+      #endif
+      {};
 };
 
 
@@ -33,6 +33,8 @@ EXPORT_CODECS
 
 #include "StdAfx.h"
 
+#include "../../../../C/Alloc.h"
+
 #include "../../../Common/MyCom.h"
 #include "../../../Common/StringToInt.h"
 #include "../../../Common/StringConvert.h"
@@ -53,6 +55,8 @@ using namespace NWindows;
 #include "../../Common/RegisterArc.h"
 #include "../../Common/RegisterCodec.h"
 
+#include "../../Compress/CoderCtxCache.h"
+
 #ifdef EXTERNAL_CODECS
 
 // #define EXPORT_CODECS
@@ -510,6 +514,9 @@ extern "C"
 }
 #endif
 
+typedef HRESULT (WINAPI *Func_SetAllocLayer)(const CAllocLayerHost *host);
+typedef HRESULT (WINAPI *Func_FreeCtxCaches)();
+
 
 void CCodecs::AddLastError(const FString &path)
 {
@@ -591,6 +598,24 @@ HRESULT CCodecs::LoadDll(const FString &dllPath, bool needCheckDll, bool *loaded
     }
     #endif
 
+    if (AllocLayer_GetFlags() != 0)
+    {
+      MY_GET_FUNC_LOC (setAllocLayer, Func_SetAllocLayer, lib.Lib.GetProc("SetAllocLayer"));
+      if (setAllocLayer)
+      {
+        CAllocLayerHost host;
+        AllocLayer_GetHost(&host);
+        const HRESULT res = setAllocLayer(&host);
+        if (res != S_OK)
+        {
+          CCodecError &error = Errors.AddNew();
+          error.Path = dllPath;
+          error.Message = "cannot set the allocation layer (-bm, -smp)";
+          error.ErrorCode = res;
+        }
+      }
+    }
+
     if (CaseSensitive_Change)
     {
       MY_GET_FUNC_LOC (setCaseSensitive, Func_SetCaseSensitive, lib.Lib.GetProc("SetCaseSensitive"));
@@ -700,6 +725,9 @@ void CCodecs::CloseLibs()
   So we need to call FreeLibrary() before global destructors.
   
   Also we free global links from DLLs to object of this module before CLibrary::Free() call.
+
+  The cached coder contexts in DLL can hold threads,
+  so DLL must free them before DLL unloading.
   */
   
   FOR_VECTOR(i, Libs)
@@ -707,6 +735,9 @@ void CCodecs::CloseLibs()
     const CCodecLib &lib = Libs[i];
     if (lib.SetCodecs)
       lib.SetCodecs(NULL);
+    MY_GET_FUNC_LOC (freeCtxCaches, Func_FreeCtxCaches, lib.Lib.GetProc("FreeCtxCaches"));
+    if (freeCtxCaches)
+      freeCtxCaches();
   }
   
   // OutputDebugStringA("~CloseLibs after SetCodecs");
@@ -717,6 +748,13 @@ void CCodecs::CloseLibs()
 #endif // EXTERNAL_CODECS
 
 
+CCodecs::~CCodecs()
+{
+  // OutputDebugStringA("~CCodecs");
+  // the codecs that are linked to this module can hold threads in the cached contexts
+  NCompress::FreeAllCtxCaches();
+}
+
 HRESULT CCodecs::Load()
 {
   #ifdef NEW_FOLDER_INTERFACE
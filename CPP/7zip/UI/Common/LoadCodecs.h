@@ -374,10 +374,7 @@ public:
       CaseSensitive(false)
       {}
 
-  ~CCodecs()
-  {
-    // OutputDebugStringA("~CCodecs");
-  }
+  ~CCodecs();
  
   const wchar_t *GetFormatNamePtr(int formatIndex) const
   {
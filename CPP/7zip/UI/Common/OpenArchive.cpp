@@ -1334,6 +1334,35 @@ static void PrintNumber(const char *s, int n)
 }
 */
 
+#ifndef _SFX
+
+// it checks the property with new handler objects of parent formats
+
+static HRESULT ParentFormats_AcceptProp(const COpenOptions &op, const CObjectVector<CProperty> &props, bool &accepted)
+{
+  accepted = false;
+  FOR_VECTOR (i, op.parentFormats)
+  {
+    const int formatIndex = op.parentFormats[i];
+    if (formatIndex < 0)
+      continue;
+    CMyComPtr<IInArchive> archive;
+    RINOK(op.codecs->CreateInArchive((unsigned)formatIndex, archive));
+    if (!archive)
+      continue;
+    CMyComPtr<ISetProperties> setProperties;
+    archive.QueryInterface(IID_ISetProperties, (void **)&setProperties);
+    if (setProperties && SetProperties(archive, props) == S_OK)
+    {
+      accepted = true;
+      return S_OK;
+    }
+  }
+  return S_OK;
+}
+
+#endif
+
 HRESULT CArc::PrepareToOpen(const COpenOptions &op, unsigned formatIndex, CMyComPtr<IInArchive> &archive)
 {
   // OutputDebugStringA("a1");
@@ -1393,7 +1422,32 @@ HRESULT CArc::PrepareToOpen(const COpenOptions &op, unsigned formatIndex, CMyCom
       }
     }
     */
-    RINOK(SetProperties(archive, *op.props));
+    HRESULT res = SetProperties(archive, *op.props);
+    /* the properties are set to all levels of nested archives.
+       The handler of sub-archive can reject the property of parent handler
+       (tar in gz with -midx), so it doesn't get the properties that
+       it rejects, if the handler of some parent archive accepts them.
+       Other rejected properties (for example, a typo in -m switch) are errors. */
+    if (res == E_INVALIDARG && op.subArcMode)
+    {
+      CObjectVector<CProperty> props;
+      FOR_VECTOR (i, *op.props)
+      {
+        CObjectVector<CProperty> props1;
+        props1.Add((*op.props)[i]);
+        if (SetProperties(archive, props1) == S_OK)
+          props.Add((*op.props)[i]);
+        else
+        {
+          bool accepted = false;
+          RINOK(ParentFormats_AcceptProp(op, props1, accepted));
+          if (!accepted)
+            return res;
+        }
+      }
+      res = SetProperties(archive, props);
+    }
+    RINOK(res);
   }
   
   #endif
@@ -3105,6 +3159,7 @@ HRESULT CArc::OpenStreamOrFile(COpenOptions &op)
     Path = filePath;
     if (!fileStreamSpec->Open(us2fs(Path)))
       return GetLastError_noZero_HRESULT();
+    fileStreamSpec->MapFile();
     op.stream = fileStream;
     #ifdef _SFX
     IgnoreSplit = true;
@@ -3375,6 +3430,9 @@ HRESULT CArchiveLink::Open(COpenOptions &op)
     op2.openType.ZerosTailIsAllowed = zerosTailIsAllowed;
     op2.excludedFormats = &excl;
     op2.stdInMode = false;
+    op2.subArcMode = true;
+    FOR_VECTOR (k, Arcs)
+      op2.parentFormats.Add(Arcs[k].FormatIndex);
     op2.stream = subStream;
     op2.filePath = arc2.Path;
     op2.callback = op.callback;
@@ -3525,6 +3583,7 @@ HRESULT CArchiveLink::ReOpen(COpenOptions &op)
   CMyComPtr<IInStream> stream(fileStreamSpec);
   if (!fileStreamSpec->Open(us2fs(op.filePath)))
     return GetLastError_noZero_HRESULT();
+  fileStreamSpec->MapFile();
   op.stream = stream;
 
   CArc &arc = Arcs[0];
@@ -129,6 +129,8 @@ struct COpenOptions
   // bool openOnlySpecifiedByExtension,
 
   bool stdInMode;
+  bool subArcMode; // the stream is item of parent archive
+  CIntVector parentFormats; // (subArcMode) : the formats of parent archives
   UString filePath;
 
   COpenOptions():
@@ -139,7 +141,8 @@ struct COpenOptions
       seqStream(NULL),
       callback(NULL),
       callbackSpec(NULL),
-      stdInMode(false)
+      stdInMode(false),
+      subArcMode(false)
     {}
 
 };
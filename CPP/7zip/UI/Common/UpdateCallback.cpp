@@ -33,6 +33,10 @@
 
 #include "../../Common/StreamObjects.h"
 
+#ifndef _7ZIP_ST
+#include "../../Common/AsyncFileStreams.h"
+#endif
+
 #include "UpdateCallback.h"
 
 #if defined(_WIN32) && !defined(UNDER_CE)
@@ -609,7 +613,16 @@ STDMETHODIMP CArchiveUpdateCallback::GetStream2(UInt32 index, ISequentialInStrea
     }
     #endif // !defined(UNDER_CE)
 
+   #ifndef _7ZIP_ST
+    // large files are read in another thread ahead of the coders
+    CInFileStream *inStreamSpec;
+    if (DirItems->Items[(unsigned)up.DirIndex].Size >= k_AsyncFileStream_MinFileSize)
+      inStreamSpec = new CAsyncInFileStream;
+    else
+      inStreamSpec = new CInFileStream;
+   #else
     CInFileStream *inStreamSpec = new CInFileStream;
+   #endif
     CMyComPtr<ISequentialInStream> inStreamLoc(inStreamSpec);
 
    /*
@@ -39,5 +39,8 @@ UI_COMMON_OBJS = \
   $O\UpdatePair.obj \
   $O\UpdateProduce.obj \
 
+7ZIP_COMMON_OBJS = $(7ZIP_COMMON_OBJS) \
+  $O\AsyncFileStreams.obj \
+
 C_OBJS = $(C_OBJS) \
   $O\DllSecur.obj \
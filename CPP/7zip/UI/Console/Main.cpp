@@ -13,6 +13,7 @@
 #include <sys/times.h>
 #endif
 
+#include "../../../../C/Alloc.h"
 #include "../../../../C/CpuArch.h"
 
 #include "../../../Common/MyInitGuid.h"
@@ -125,6 +126,7 @@ static const char * const kHelpString =
     "  -bd : disable progress indicator\n"
     "  -bs{o|e|p}{0|1|2} : set output stream for output/error/progress line\n"
     "  -bt : show execution time statistics\n"
+    "  -bm : show allocation statistics per allocator kind\n"
     "  -i[r[-|0]]{@listfile|!wildcard} : Include filenames\n"
     "  -m{Parameters} : set compression Method\n"
     "    -mmt[N] : set number of CPU threads\n"
@@ -144,6 +146,7 @@ static const char * const kHelpString =
     "  -si[{name}] : read data from stdin\n"
     "  -slp : set Large Pages mode\n"
     "  -slt : show technical information for l (List) command\n"
+    "  -smm : map archive files to memory for e, x, t, l commands\n"
     "  -snh : store hard links as links\n"
     "  -snl : store symbolic links as links\n"
     "  -sni : store NT security information\n"
@@ -677,12 +680,60 @@ static void PrintStat(UInt64 startTime)
   PrintTime("Process", (UInt64)t.tms_utime + (UInt64)t.tms_stime, totalTime, kFreq);
   PrintTime("Global ", totalTime, totalTime, 0);
   *g_StdStream << endl;
+
+  #ifdef _7ZIP_LARGE_PAGES
+  AString lp;
+  Add_LargePages_String(lp);
+  if (!lp.IsEmpty())
+    *g_StdStream << "Large pages: " << lp << endl;
+  #endif
 }
 
 #endif // ! _WIN32
 
 
+static const char * const k_AllocHist_Names[k_AllocStat_HistSize] =
+  { "<16", "<256", "<4K", "<64K", "<1M", "<16M", "<256M", "more" };
+
+/* (Total) line: the allocations from the base allocators, including the blocks in the pool */
+
+static void PrintUInt64(CStdOutStream &so, UInt64 val, unsigned size)
+{
+  char s[32];
+  ConvertUInt64ToString(val, s);
+  PrintStringRight(so, s, size);
+}
 
+static void PrintAllocStat(CStdOutStream &so)
+{
+  unsigned i;
+  // the codecs share the allocators, so there are no statistics per method
+  so << endl << "Allocation statistics per allocator kind (all methods together):" << endl;
+  so << "AllocKind    Allocs     Frees PoolHits  Total KiB   Peak KiB";
+  for (i = 0; i < k_AllocStat_HistSize; i++)
+    PrintStringRight(so, k_AllocHist_Names[i], 7);
+  so << endl;
+
+  for (unsigned kind = 0; kind <= k_AllocKind_Total; kind++)
+  {
+    CAllocStat st;
+    AllocLayer_GetStat(kind, &st);
+    if (st.NumAllocs == 0 && st.NumPoolHits == 0)
+      continue;
+    const char *name = AllocLayer_GetKindName(kind);
+    so << name;
+    for (i = MyStringLen(name); i < 9; i++)
+      so << ' ';
+    PrintUInt64(so, st.NumAllocs, 10);
+    PrintUInt64(so, st.NumFrees, 10);
+    PrintUInt64(so, st.NumPoolHits, 9);
+    PrintUInt64(so, (st.TotalBytes + 1023) >> 10, 11);
+    PrintUInt64(so, (st.PeakBytes + 1023) >> 10, 11);
+    for (i = 0; i < k_AllocStat_HistSize; i++)
+      PrintUInt64(so, st.Hist[i], 7);
+    so << endl;
+  }
+}
 
 
 static void PrintHexId(CStdOutStream &so, UInt64 id)
@@ -1490,6 +1541,19 @@ int Main2(
       #endif
     );
 
+  if (options.ShowMemStat)
+  {
+    CStdOutStream *so = g_StdStream;
+    /* the benchmark report (-mreport) must be the only data in stdout,
+       so the statistics go to stderr in that case */
+    if (options.Command.CommandType == NCommandType::kBenchmark)
+      FOR_VECTOR (i, options.Properties)
+        if (options.Properties[i].Name.IsEqualTo_Ascii_NoCase("report"))
+          so = g_ErrStream;
+    if (so)
+      PrintAllocStat(*so);
+  }
+
   ThrowException_if_Error(hresultMain);
 
   return retCode;
@@ -238,6 +238,8 @@ static const CHashCommand g_HashCommands[] =
   { CZipContextMenu::kHash_CRC64,    "CRC-64",   "CRC64" },
   { CZipContextMenu::kHash_XXH32,    "XXH-32",   "XXH32" },
   { CZipContextMenu::kHash_XXH64,    "XXH-64",   "XXH64" },
+  { CZipContextMenu::kHash_XXH3,     "XXH3-64",  "XXH3" },
+  { CZipContextMenu::kHash_XXH128,   "XXH3-128", "XXH128" },
   { CZipContextMenu::kHash_MD2,      "MD2",      "MD2" },
   { CZipContextMenu::kHash_MD4,      "MD4",      "MD4" },
   { CZipContextMenu::kHash_MD5,      "MD5",      "MD5" },
@@ -1221,6 +1223,8 @@ HRESULT CZipContextMenu::InvokeCommandCommon(const CCommandMapItem &cmi)
       case kHash_CRC64:
       case kHash_XXH32:
       case kHash_XXH64:
+      case kHash_XXH3:
+      case kHash_XXH128:
       case kHash_MD2:
       case kHash_MD4:
       case kHash_MD5:
@@ -50,6 +50,8 @@ public:
     kHash_CRC64,
     kHash_XXH32,
     kHash_XXH64,
+    kHash_XXH3,
+    kHash_XXH128,
     kHash_MD2,
     kHash_MD4,
     kHash_MD5,
@@ -658,6 +658,8 @@ bool ExecuteFileCommand(unsigned id)
     case IDM_CRC64: g_App.CalculateCrc("CRC64"); break;
     case IDM_XXH32: g_App.CalculateCrc("XXH32"); break;
     case IDM_XXH64: g_App.CalculateCrc("XXH64"); break;
+    case IDM_XXH3:  g_App.CalculateCrc("XXH3"); break;
+    case IDM_XXH128: g_App.CalculateCrc("XXH128"); break;
     case IDM_MD2:   g_App.CalculateCrc("MD2"); break;
     case IDM_MD4:   g_App.CalculateCrc("MD4"); break;
     case IDM_MD5:   g_App.CalculateCrc("MD5"); break;
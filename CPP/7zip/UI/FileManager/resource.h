@@ -34,6 +34,8 @@
 #define IDM_SHA512               112
 #define IDM_BLAKE2sp             113
 #define IDM_BLAKE3               114
+#define IDM_XXH3                 115
+#define IDM_XXH128               116
 
 #define IDM_OPEN                 540
 #define IDM_OPEN_INSIDE          541
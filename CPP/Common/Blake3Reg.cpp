@@ -8,36 +8,264 @@ EXTERN_C_BEGIN
 #include "../../C/hashes/blake3.h"
 EXTERN_C_END
 
+#include "../Common/MyBuffer2.h"
 #include "../Common/MyCom.h"
+
+#ifndef _7ZIP_ST
+#include "../Windows/Synchronization.h"
+#include "../Windows/Thread.h"
+#endif
+
 #include "../7zip/Common/RegisterCodec.h"
 
+#ifndef _7ZIP_ST
+
+/*
+In multithreaded mode the input is collected to blocks of (numThreads) parts.
+Each part is a complete subtree of kBlake3PartSize bytes.
+The parts of block are compressed to CV pairs in different threads,
+and then the CV pairs are pushed to hasher in the order of parts.
+So the digest is the same as in single-threaded mode.
+The tail of the stream that doesn't fill the block is hashed in main thread.
+*/
+
+static const size_t kBlake3PartSize = (size_t)1 << 20;
+static const UInt32 kBlake3NumThreadsMax = 64;
+
+struct CBlake3MtWorker
+{
+  NWindows::CThread Thread;
+  NWindows::NSynchronization::CAutoResetEvent StartEvent;
+  NWindows::NSynchronization::CAutoResetEvent DoneEvent;
+
+  const blake3_hasher *Ctx;
+  const Byte *Data;
+  UInt64 ChunkCounter;
+  bool Exit;
+  Byte CvPair[2 * BLAKE3_OUT_LEN];
+
+  CBlake3MtWorker(): Exit(false) {}
+  ~CBlake3MtWorker();
+  WRes Create();
+  void ThreadFunc();
+};
+
+static THREAD_FUNC_DECL Blake3MtWorker_Thread(void *p)
+{
+  ((CBlake3MtWorker *)p)->ThreadFunc();
+  return 0;
+}
+
+WRes CBlake3MtWorker::Create()
+{
+  WRes wres = StartEvent.CreateIfNotCreated_Reset();
+  if (wres == 0) wres = DoneEvent.CreateIfNotCreated_Reset();
+  if (wres == 0) wres = Thread.Create(Blake3MtWorker_Thread, this);
+  return wres;
+}
+
+CBlake3MtWorker::~CBlake3MtWorker()
+{
+  if (Thread.IsCreated())
+  {
+    Exit = true;
+    StartEvent.Set();
+    Thread.Wait_Close();
+  }
+}
+
+void CBlake3MtWorker::ThreadFunc()
+{
+  for (;;)
+  {
+    StartEvent.Lock();
+    if (Exit)
+      return;
+    blake3_compress_subtree_pair(Ctx, Data, kBlake3PartSize, ChunkCounter, CvPair);
+    DoneEvent.Set();
+  }
+}
+
+#endif
+
 // BLAKE3
 class CBLAKE3Hasher:
   public IHasher,
+  public ICompressSetCoderProperties,
   public CMyUnknownImp
 {
   blake3_hasher _ctx;
   Byte mtDummy[1 << 7];
 
+  #ifndef _7ZIP_ST
+  UInt32 _numThreads;
+  unsigned _numWorkers;
+  CBlake3MtWorker *_workers; // (_numThreads - 1) workers, the first part is hashed in main thread
+  CMidBuffer _buf;
+  size_t _bufPos;
+
+  size_t GetBlockSize() const { return kBlake3PartSize * _numThreads; }
+  void FreeMt();
+  bool CreateMt();
+  void UpdateBlock(const Byte *data);
+  #endif
+
 public:
-  CBLAKE3Hasher() { blake3_hasher_init(&_ctx); }
+  CBLAKE3Hasher()
+    #ifndef _7ZIP_ST
+      : _numThreads(1)
+      , _numWorkers(0)
+      , _workers(NULL)
+      , _bufPos(0)
+    #endif
+    { blake3_hasher_init(&_ctx); }
+
+  #ifndef _7ZIP_ST
+  ~CBLAKE3Hasher() { FreeMt(); }
+  #endif
 
-  MY_UNKNOWN_IMP1(IHasher)
+  MY_UNKNOWN_IMP2(IHasher, ICompressSetCoderProperties)
   INTERFACE_IHasher(;)
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
+#ifndef _7ZIP_ST
+
+void CBLAKE3Hasher::FreeMt()
+{
+  delete []_workers;
+  _workers = NULL;
+  _numWorkers = 0;
+  _buf.Free();
+  _bufPos = 0;
+}
+
+bool CBLAKE3Hasher::CreateMt()
+{
+  if (_workers)
+    return true;
+  _buf.AllocAtLeast(GetBlockSize());
+  if (_buf.IsAllocated())
+  {
+    _workers = new CBlake3MtWorker[_numThreads - 1];
+    for (; _numWorkers < _numThreads - 1; _numWorkers++)
+      if (_workers[_numWorkers].Create() != 0)
+        break;
+    if (_numWorkers == _numThreads - 1)
+      return true;
+  }
+  // we switch to single-threaded mode, if we can't create threads
+  FreeMt();
+  _numThreads = 1;
+  return false;
+}
+
+void CBLAKE3Hasher::UpdateBlock(const Byte *data)
+{
+  const UInt64 chunkCounter = _ctx.chunk.chunk_counter;
+  const UInt64 partChunks = kBlake3PartSize / BLAKE3_CHUNK_LEN;
+  unsigned i;
+  for (i = 0; i < _numWorkers; i++)
+  {
+    CBlake3MtWorker &w = _workers[i];
+    w.Ctx = &_ctx;
+    w.Data = data + kBlake3PartSize * (i + 1);
+    w.ChunkCounter = chunkCounter + partChunks * (i + 1);
+    w.StartEvent.Set();
+  }
+  Byte cvPair[2 * BLAKE3_OUT_LEN];
+  blake3_compress_subtree_pair(&_ctx, data, kBlake3PartSize, chunkCounter, cvPair);
+  blake3_hasher_push_subtree_pair(&_ctx, cvPair, kBlake3PartSize);
+  for (i = 0; i < _numWorkers; i++)
+  {
+    CBlake3MtWorker &w = _workers[i];
+    w.DoneEvent.Lock();
+    blake3_hasher_push_subtree_pair(&_ctx, w.CvPair, kBlake3PartSize);
+  }
+}
+
+#endif
+
 STDMETHODIMP_(void) CBLAKE3Hasher::Init() throw()
 {
   blake3_hasher_init(&_ctx);
+  #ifndef _7ZIP_ST
+  _bufPos = 0;
+  #endif
 }
 
 STDMETHODIMP_(void) CBLAKE3Hasher::Update(const void *data, UInt32 size) throw()
 {
+  #ifndef _7ZIP_ST
+  if (_numThreads > 1 && CreateMt())
+  {
+    const Byte *p = (const Byte *)data;
+    const size_t blockSize = GetBlockSize();
+    while (size != 0)
+    {
+      if (_bufPos == 0 && size >= blockSize)
+      {
+        // we don't copy full blocks of input data
+        UpdateBlock(p);
+        p += blockSize;
+        size -= (UInt32)blockSize;
+        continue;
+      }
+      size_t cur = blockSize - _bufPos;
+      if (cur > size)
+        cur = size;
+      memcpy(_buf + _bufPos, p, cur);
+      _bufPos += cur;
+      p += cur;
+      size -= (UInt32)cur;
+      if (_bufPos == blockSize)
+      {
+        UpdateBlock(_buf);
+        _bufPos = 0;
+      }
+    }
+    return;
+  }
+  #endif
   blake3_hasher_update(&_ctx, data, size);
 }
 
 STDMETHODIMP_(void) CBLAKE3Hasher::Final(Byte *digest) throw()
 {
+  #ifndef _7ZIP_ST
+  if (_bufPos != 0)
+  {
+    blake3_hasher_update(&_ctx, _buf, _bufPos);
+    _bufPos = 0;
+  }
+  #endif
   blake3_hasher_finalize(&_ctx, digest, BLAKE3_OUT_LEN);
 }
+
+STDMETHODIMP CBLAKE3Hasher::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    const PROPVARIANT &prop = coderProps[i];
+    if (propIDs[i] == NCoderPropID::kNumThreads)
+    {
+      if (prop.vt != VT_UI4)
+        return E_INVALIDARG;
+      #ifndef _7ZIP_ST
+      UInt32 numThreads = prop.ulVal;
+      if (numThreads < 1)
+        numThreads = 1;
+      if (numThreads > kBlake3NumThreadsMax)
+        numThreads = kBlake3NumThreadsMax;
+      if (numThreads != _numThreads)
+      {
+        FreeMt();
+        _numThreads = numThreads;
+      }
+      #endif
+    }
+  }
+  return S_OK;
+}
+
 REGISTER_HASHER(CBLAKE3Hasher, 0x20a, "BLAKE3", BLAKE3_OUT_LEN)
@@ -0,0 +1,40 @@
+// XXH128Reg.cpp
+
+#include "StdAfx.h"
+
+#include "../../C/hashes/xxh3.h"
+
+#include "../Common/MyCom.h"
+#include "../7zip/Common/RegisterCodec.h"
+
+// XXH128 (XXH3 128-bit)
+class CXXH128Hasher:
+  public IHasher,
+  public CMyUnknownImp
+{
+  xxh3_ctx *_ctx;
+  Byte mtDummy[1 << 7];
+
+public:
+  CXXH128Hasher() { _ctx = xxh3_create(); }
+  ~CXXH128Hasher() { xxh3_free(_ctx); }
+
+  MY_UNKNOWN_IMP1(IHasher)
+  INTERFACE_IHasher(;)
+};
+
+STDMETHODIMP_(void) CXXH128Hasher::Init() throw()
+{
+  xxh3_reset(_ctx);
+}
+
+STDMETHODIMP_(void) CXXH128Hasher::Update(const void *data, UInt32 size) throw()
+{
+  xxh3_update(_ctx, data, size);
+}
+
+STDMETHODIMP_(void) CXXH128Hasher::Final(Byte *digest) throw()
+{
+  xxh3_digest128(_ctx, digest);
+}
+REGISTER_HASHER(CXXH128Hasher, 0x20c, "XXH128", XXH3_128_DIGEST_LENGTH)
@@ -0,0 +1,42 @@
+// XXH3Reg.cpp
+
+#include "StdAfx.h"
+
+#include "../../C/CpuArch.h"
+#include "../../C/hashes/xxh3.h"
+
+#include "../Common/MyCom.h"
+#include "../7zip/Common/RegisterCodec.h"
+
+// XXH3 (64-bit)
+class CXXH3Hasher:
+  public IHasher,
+  public CMyUnknownImp
+{
+  xxh3_ctx *_ctx;
+  Byte mtDummy[1 << 7];
+
+public:
+  CXXH3Hasher() { _ctx = xxh3_create(); }
+  ~CXXH3Hasher() { xxh3_free(_ctx); }
+
+  MY_UNKNOWN_IMP1(IHasher)
+  INTERFACE_IHasher(;)
+};
+
+STDMETHODIMP_(void) CXXH3Hasher::Init() throw()
+{
+  xxh3_reset(_ctx);
+}
+
+STDMETHODIMP_(void) CXXH3Hasher::Update(const void *data, UInt32 size) throw()
+{
+  xxh3_update(_ctx, data, size);
+}
+
+STDMETHODIMP_(void) CXXH3Hasher::Final(Byte *digest) throw()
+{
+  UInt64 val = xxh3_digest64(_ctx);
+  SetUi64(digest, val);
+}
+REGISTER_HASHER(CXXH3Hasher, 0x20b, "XXH3", XXH3_64_DIGEST_LENGTH)
@@ -303,6 +303,31 @@ static const char * const k_PF[] =
 #endif
 
 
+#if defined(_7ZIP_LARGE_PAGES) || defined(_WIN32)
+
+void PrintSize_KMGT_Or_Hex(AString &s, UInt64 v)
+{
+  char c = 0;
+  if ((v & 0x3FF) == 0) { v >>= 10; c = 'K';
+  if ((v & 0x3FF) == 0) { v >>= 10; c = 'M';
+  if ((v & 0x3FF) == 0) { v >>= 10; c = 'G';
+  if ((v & 0x3FF) == 0) { v >>= 10; c = 'T';
+  }}}}
+  else
+  {
+    PrintHex(s, v);
+    return;
+  }
+  char temp[32];
+  ConvertUInt64ToString(v, temp);
+  s += temp;
+  if (c)
+    s += c;
+}
+
+#endif
+
+
 #ifdef _WIN32
 
 static void PrintPage(AString &s, UInt32 v)
@@ -330,30 +355,6 @@ static AString TypeToString2(const char * const table[], unsigned num, UInt32 va
   return (AString)p;
 }
 
-// #if defined(_7ZIP_LARGE_PAGES) || defined(_WIN32)
-// #ifdef _WIN32
-void PrintSize_KMGT_Or_Hex(AString &s, UInt64 v)
-{
-  char c = 0;
-  if ((v & 0x3FF) == 0) { v >>= 10; c = 'K';
-  if ((v & 0x3FF) == 0) { v >>= 10; c = 'M';
-  if ((v & 0x3FF) == 0) { v >>= 10; c = 'G';
-  if ((v & 0x3FF) == 0) { v >>= 10; c = 'T';
-  }}}}
-  else
-  {
-    PrintHex(s, v);
-    return;
-  }
-  char temp[32];
-  ConvertUInt64ToString(v, temp);
-  s += temp;
-  if (c)
-    s += c;
-}
-// #endif
-// #endif
-
 static void SysInfo_To_String(AString &s, const SYSTEM_INFO &si)
 {
   s += TypeToString2(k_PROCESSOR_ARCHITECTURE, ARRAY_SIZE(k_PROCESSOR_ARCHITECTURE), si.wProcessorArchitecture);
@@ -26,6 +26,8 @@ public:
     { return Thread_Create_With_Affinity(&thread, startAddress, param, affinity); }
   WRes Create_With_CpuSet(THREAD_FUNC_TYPE startAddress, LPVOID param, const CCpuSet *cpuSet)
     { return Thread_Create_With_CpuSet(&thread, startAddress, param, cpuSet); }
+  WRes Create_Numa(THREAD_FUNC_TYPE startAddress, LPVOID param, unsigned index)
+    { return Thread_Create_Numa(&thread, startAddress, param, index); }
   
   #ifdef _WIN32
   operator HANDLE() { return thread; }